@@ -0,0 +1,347 @@
+/**
+    file: anim.cpp
+
+    Delta-frame animation player for the PICASO SGC driver.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "anim.h"
+
+using namespace disp;
+
+#define ERRMSG(fmt, args...) snprintf(errmsg, PGDERRLEN, "%s:%d: %s(): " fmt,\
+    __FILE__, __LINE__, __FUNCTION__,##args)
+
+
+PGDANIM::PGDANIM()
+{
+    x = 0;
+    y = 0;
+    width = 0;
+    height = 0;
+    colormode = 0x10;
+    tile = PGDANIMTILE;
+    ntx = 0;
+    nty = 0;
+    frames = NULL;
+    nframes = 0;
+    dirty = NULL;
+    mask = NULL;
+    pack = NULL;
+    delta = NULL;
+    cur = -1;
+    errmsg[0] = 0;
+    return;
+}
+
+
+
+PGDANIM::~PGDANIM()
+{
+    clear();
+    return;
+}
+
+
+
+void
+PGDANIM::clear(void)
+{
+    delete [] frames;
+    delete [] dirty;
+    delete [] mask;
+    delete [] pack;
+    delete [] delta;
+    frames = NULL;
+    dirty = NULL;
+    mask = NULL;
+    pack = NULL;
+    delta = NULL;
+    nframes = 0;
+    key.Clear();
+    merged.Clear();
+    cur = -1;
+    return;
+}
+
+
+
+int
+PGDANIM::SetFrames(ushort x, ushort y, ushort width, ushort height, uchar colormode,
+                   const uchar **frames, int nframes, int tile)
+{
+    clear();
+
+    if ((colormode != 0x08)&&(colormode != 0x10))
+    {
+        ERRMSG("invalid color mode (%ud); valid values are 0x08 and 0x10 only", colormode);
+        return -1;
+    }
+    if ((!frames) || (nframes < 1) || (!width) || (!height) || (tile < 1))
+    {
+        ERRMSG("invalid arguments (%d frames of %d x %d, tile %d)",
+               nframes, width, height, tile);
+        return -1;
+    }
+    int i;
+    for (i = 0; i < nframes; ++i)
+    {
+        if (!frames[i])
+        {
+            ERRMSG("invalid data for frame %d (NULL)", i);
+            return -1;
+        }
+    }
+
+    PGDANIM::x = x;
+    PGDANIM::y = y;
+    PGDANIM::width = width;
+    PGDANIM::height = height;
+    PGDANIM::colormode = colormode;
+    PGDANIM::tile = tile;
+    ntx = (width + tile - 1) / tile;
+    nty = (height + tile - 1) / tile;
+    int nt = ntx * nty;
+
+    PGDANIM::frames = new const uchar *[nframes];
+    dirty = new uchar[nframes * nt];
+    mask = new uchar[nt];
+    pack = new uchar[width * tile * 2];
+    delta = new PGDCMDBUF[nframes];
+    if ((!PGDANIM::frames) || (!dirty) || (!mask) || (!pack) || (!delta))
+    {
+        clear();
+        ERRMSG("could not allocate memory (%d frames of %d tiles)", nframes, nt);
+        return -1;
+    }
+    PGDANIM::nframes = nframes;
+    for (i = 0; i < nframes; ++i) PGDANIM::frames[i] = frames[i];
+
+    // compare each frame with the previous one, tile by tile
+    int bpp = (colormode == 0x10) ? 2 : 1;
+    int stride = width * bpp;
+    int f, tx, ty, row, r1, c0, clen;
+    const uchar *a, *b;
+    uchar *dp;
+    for (f = 0; f < nframes; ++f)
+    {
+        a = frames[(f + nframes - 1) % nframes];
+        b = frames[f];
+        dp = &dirty[f * nt];
+        memset(dp, 0, nt);
+        for (ty = 0; ty < nty; ++ty)
+        {
+            r1 = (ty + 1) * tile;
+            if (r1 > height) r1 = height;
+            for (tx = 0; tx < ntx; ++tx)
+            {
+                c0 = tx * tile * bpp;
+                clen = ((tx + 1) * tile > width) ? stride - c0 : tile * bpp;
+                for (row = ty * tile; row < r1; ++row)
+                {
+                    if (memcmp(&a[row * stride + c0], &b[row * stride + c0], clen))
+                    {
+                        dp[ty * ntx + tx] = 1;
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (encode(&delta[f], f, dp))
+        {
+            char msg[PGDERRLEN];
+            snprintf(msg, PGDERRLEN, "%s", errmsg);
+            clear();
+            ERRMSG("could not encode frame %d\n%s", f, msg);
+            return -1;
+        }
+    }
+
+    // the whole first frame; the buffer for dropped frames never needs
+    // more than one command per tile
+    memset(mask, 1, nt);
+    if ((encode(&key, 0, mask))
+        || (merged.Reserve(key.GetLength() + nt * 10, nt)))
+    {
+        clear();
+        ERRMSG("could not allocate memory for the key frame");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+
+int
+PGDANIM::encode(PGDCMDBUF *buf, int idx, const uchar *tmask)
+{
+    int bpp = (colormode == 0x10) ? 2 : 1;
+    int stride = width * bpp;
+    const uchar *fp = frames[idx];
+    int tx, ty, t0, c0, c1, r0, r1, row, rlen;
+
+    buf->Clear();
+    for (ty = 0; ty < nty; ++ty)
+    {
+        r0 = ty * tile;
+        r1 = (r0 + tile > height) ? height : r0 + tile;
+        tx = 0;
+        while (tx < ntx)
+        {
+            if (!tmask[ty * ntx + tx])
+            {
+                ++tx;
+                continue;
+            }
+
+            // run of changed tiles
+            t0 = tx;
+            while ((tx < ntx) && (tmask[ty * ntx + tx])) ++tx;
+            c0 = t0 * tile;
+            c1 = (tx * tile > width) ? width : tx * tile;
+            rlen = (c1 - c0) * bpp;
+            for (row = r0; row < r1; ++row)
+                memcpy(&pack[(row - r0) * rlen], &fp[row * stride + c0 * bpp], rlen);
+            if (buf->DrawIcon(x + c0, y + r0, c1 - c0, r1 - r0, colormode,
+                              pack, rlen * (r1 - r0)))
+            {
+                ERRMSG("failed; see message below\n%s", buf->GetError());
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+
+int
+PGDANIM::GetDeltaBytes(int idx)
+{
+    if ((idx < 0) || (idx >= nframes)) return -1;
+    return delta[idx].GetLength();
+}
+
+
+
+int
+PGDANIM::Play(PGD *pgd, int fps, int count)
+{
+    stats = PGDANIMSTATS();
+    if (!pgd)
+    {
+        ERRMSG("invalid display (NULL pointer)");
+        return -1;
+    }
+    if (!nframes)
+    {
+        ERRMSG("no frames");
+        return -1;
+    }
+    if ((fps < 1) || (count < 0))
+    {
+        ERRMSG("invalid arguments (%d frames at %d fps)", count, fps);
+        return -1;
+    }
+
+    double period = 1e6 / fps;
+    struct timeval ts, now;
+    double el;
+    int nt = ntx * nty;
+    int slot = 0;                       // frame period being shown
+    int adv = 1;                        // frames to advance
+    int next, due, target, f, i, j, res;
+    const PGDCMDBUF *buf;
+
+    gettimeofday(&ts, NULL);
+    while (slot < count)
+    {
+        if (cur < 0)
+        {
+            // nothing shown yet; send the whole frame
+            target = 0;
+            buf = &key;
+        }
+        else if (adv == 1)
+        {
+            target = (cur + 1) % nframes;
+            buf = &delta[target];
+        }
+        else
+        {
+            // tiles changed in any of the skipped frames
+            target = (cur + adv) % nframes;
+            memset(mask, 0, nt);
+            f = cur;
+            for (i = 0; i < adv; ++i)
+            {
+                f = (f + 1) % nframes;
+                for (j = 0; j < nt; ++j) mask[j] |= dirty[f * nt + j];
+            }
+            if (encode(&merged, target, mask)) return -1;
+            buf = &merged;
+        }
+
+        if ((res = pgd->Transmit(buf)))
+        {
+            gettimeofday(&now, NULL);
+            stats.seconds = (now.tv_sec - ts.tv_sec) + (now.tv_usec - ts.tv_usec) / 1e6;
+            ERRMSG("failed at frame %d; see message below\n%s", target, pgd->GetError());
+            // the display state is unknown
+            cur = -1;
+            return res;
+        }
+        cur = target;
+        ++stats.shown;
+        stats.bytes += buf->GetLength();
+
+        // wait for the next period or skip the periods already missed
+        gettimeofday(&now, NULL);
+        el = (now.tv_sec - ts.tv_sec) * 1e6 + (now.tv_usec - ts.tv_usec);
+        next = slot + 1;
+        if (el < next * period)
+        {
+            usleep((useconds_t)(next * period - el));
+        }
+        else
+        {
+            due = (int)(el / period);
+            if (due > count) due = count;
+            if (due > next)
+            {
+                stats.dropped += due - next;
+                next = due;
+            }
+        }
+        adv = next - slot;
+        slot = next;
+    }
+
+    gettimeofday(&now, NULL);
+    stats.seconds = (now.tv_sec - ts.tv_sec) + (now.tv_usec - ts.tv_usec) / 1e6;
+    return 0;
+}
@@ -0,0 +1,128 @@
+/**
+    file: anim.h
+
+    Delta-frame animation player for the PICASO SGC driver.  The tiles
+    which change between consecutive frames are found and encoded in
+    advance; during playback only those tiles are sent with DrawIcon,
+    paced to a target frame rate.  Frames are dropped when the serial
+    link cannot keep up.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+/*
+    Notes:
+        + Frame data is not copied; it must remain valid while the
+          animation is in use.
+        + The sequence loops; the delta of the first frame is taken
+          against the last frame.  The first frame played after
+          SetFrames() or Reset() is sent whole.
+        + Adjacent changed tiles in a row of tiles are sent as a single
+          DrawIcon command.
+        + When frames are dropped, the tiles changed in all of the
+          skipped frames are sent from the next frame shown.
+        + The commands are sent with PGD::Transmit() and are not clipped
+          or rotated; the animation is drawn in the native orientation.
+ */
+
+#ifndef ANIM_H
+#define ANIM_H
+
+#include "oled.h"
+#include "cmdbuf.h"
+
+namespace disp {
+
+// default edge of the tiles compared between frames
+#define PGDANIMTILE (16)
+
+    /* playback statistics */
+    struct PGDANIMSTATS {
+        int shown;                      // frames sent
+        int dropped;                    // frames skipped to keep the frame rate
+        unsigned long bytes;            // command bytes sent
+        double seconds;                 // duration of playback
+
+        PGDANIMSTATS()
+        {
+            shown = 0;
+            dropped = 0;
+            bytes = 0;
+            seconds = 0.0;
+        }
+    };
+
+    /** Animation sent as changed tiles */
+    class PGDANIM {
+        private:
+            ushort x;
+            ushort y;
+            ushort width;
+            ushort height;
+            uchar colormode;
+            int tile;                   // tile edge in pixels
+            int ntx;                    // tiles per row
+            int nty;                    // rows of tiles
+            const uchar **frames;
+            int nframes;
+            uchar *dirty;               // changed tiles of each frame (nframes x ntx*nty)
+            uchar *mask;                // union of masks when frames are dropped
+            uchar *pack;                // pixel data of one run of tiles
+            PGDCMDBUF *delta;           // commands for each frame
+            PGDCMDBUF key;              // commands for the whole first frame
+            PGDCMDBUF merged;           // commands after dropped frames
+            int cur;                    // last frame shown, -1 for none
+            PGDANIMSTATS stats;
+            char errmsg[PGDERRLEN];
+            // release the frame data
+            void clear(void);
+            // record the changed tiles of frame <idx> given by <tmask>
+            int  encode(PGDCMDBUF *buf, int idx, const uchar *tmask);
+            PGDANIM(const PGDANIM &);
+            PGDANIM &operator=(const PGDANIM &);
+
+        public:
+            PGDANIM();
+            ~PGDANIM();
+
+            const char *GetError(void) { return errmsg; }
+
+            /// Set the frame sequence drawn at <x>, <y> and precompute the changed
+            /// tiles; <colormode> is 0x08 or 0x10 as for DrawIcon and <tile> is the
+            /// edge of the compared tiles in pixels.
+            /// @return 0 for success, -1 for failure
+            int  SetFrames(ushort x, ushort y, ushort width, ushort height, uchar colormode,
+                           const uchar **frames, int nframes, int tile = PGDANIMTILE);
+            int  GetFrameCount(void) { return nframes; }
+            /// @return number of command bytes sent to show frame <idx> after
+            /// the previous frame, or -1 for an invalid index
+            int  GetDeltaBytes(int idx);
+            /// @return number of command bytes sent for a whole frame
+            int  GetKeyBytes(void) { return key.GetLength(); }
+
+            /// Play <count> frame periods at <fps> frames per second, continuing
+            /// from the last frame shown. Return values are as for PGD::Transmit().
+            int  Play(PGD *pgd, int fps, int count);
+            /// Send the whole frame again on the next Play()
+            void Reset(void) { cur = -1; }
+            /// @return the statistics of the last Play()
+            const PGDANIMSTATS &GetStats(void) { return stats; }
+    };
+
+};  //namespace disp
+#endif // ANIM_H
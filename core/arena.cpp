@@ -0,0 +1,87 @@
+/**
+    file: arena.cpp
+
+    Fixed-size memory arena for the PICASO SGC driver.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "arena.h"
+
+using namespace disp;
+
+// alignment of allocations; must be 2^n
+#define ARENA_ALIGN (8)
+
+
+PGDARENA::PGDARENA()
+{
+    base = NULL;
+    size = 0;
+    used = 0;
+}
+
+PGDARENA::~PGDARENA()
+{
+    free(base);
+    return;
+}
+
+
+
+int
+PGDARENA::Init(unsigned int size)
+{
+    free(base);
+    base = NULL;
+    this->size = 0;
+    used = 0;
+    stats = PGDMEMSTATS();
+
+    if (!size) return 0;
+
+    base = (char *)malloc(size);
+    if (!base) return -1;
+
+    this->size = size;
+    stats.capacity = size;
+    return 0;
+}
+
+
+
+void *
+PGDARENA::Alloc(unsigned int len)
+{
+    unsigned int start = (used + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if ((!base) || (start > size) || (len > size - start))
+    {
+        ++stats.failures;
+        return NULL;
+    }
+
+    used = start + len;
+    ++stats.allocs;
+    stats.inuse = used;
+    if (used > stats.peak) stats.peak = used;
+    if (used > stats.steady) stats.steady = used;
+    return &base[start];
+}
@@ -0,0 +1,89 @@
+/**
+    file: arena.h
+
+    Fixed-size memory arena for the PICASO SGC driver.  The arena is
+    allocated once and handed out in stack order, so the memory used
+    by the driver is bounded and no heap allocation happens per call.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+/*
+    Usage:
+        unsigned int mark = arena.GetMark();
+        char *p = (char *)arena.Alloc(n);
+        ...
+        arena.Release(mark);    // frees p and everything allocated after it
+
+    The arena is not thread safe; a PGD's arena must only be used by
+    the thread which issues the PGD's commands.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+namespace disp {
+
+    /* arena usage statistics (bytes) */
+    struct PGDMEMSTATS {
+        unsigned int capacity;      // size of the arena
+        unsigned int inuse;         // currently allocated
+        unsigned int peak;          // max. allocated since the arena was created
+        unsigned int steady;        // max. allocated since the last ResetPeak()
+        unsigned int allocs;        // number of successful allocations
+        unsigned int failures;      // number of requests which did not fit
+        PGDMEMSTATS() {
+            capacity = inuse = peak = steady = allocs = failures = 0;
+        }
+    };
+
+    /** Stack-ordered memory arena */
+    class PGDARENA {
+        private:
+            char *base;
+            unsigned int size;
+            unsigned int used;
+            PGDMEMSTATS stats;
+            PGDARENA(const PGDARENA &);
+            PGDARENA &operator=(const PGDARENA &);
+
+        public:
+            PGDARENA();
+            ~PGDARENA();
+
+            /// Allocate the arena; any previous arena is released. A size of 0
+            /// disables the arena.
+            /// @return 0 for success, -1 if the memory could not be allocated
+            int  Init(unsigned int size);
+            /// @return pointer to <len> bytes aligned to 8 bytes, NULL if they do not fit
+            void *Alloc(unsigned int len);
+            /// @return a mark to be passed to Release()
+            unsigned int GetMark(void) { return used; }
+            /// Free everything allocated since <mark> was obtained
+            void Release(unsigned int mark) { if (mark < used) used = mark; stats.inuse = used; }
+            /// Free everything
+            void Reset(void) { Release(0); }
+            /// Start a new measurement of the steady-state peak
+            void ResetPeak(void) { stats.steady = used; }
+            /// @return the number of bytes which can still be allocated
+            unsigned int GetFree(void) { return size - used; }
+            const PGDMEMSTATS &GetStats(void) { return stats; }
+    };
+
+};  //namespace disp
+#endif // ARENA_H
@@ -0,0 +1,246 @@
+/**
+    file: btncache.cpp
+
+    Cached button faces for the PICASO SGC driver.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "btncache.h"
+
+using namespace disp;
+
+#define ERRMSG(fmt, args...) snprintf(errmsg, PGDERRLEN, "%s:%d: %s(): " fmt,\
+    __FILE__, __LINE__, __FUNCTION__,##args)
+
+// estimated margin around the text of a button
+#define BTNMARGIN (4)
+
+
+PGDBTNCACHE::PGDBTNCACHE()
+{
+    nbtn = 0;
+    card = false;
+    send = snext = 0;
+    errmsg[0] = 0;
+    return;
+}
+
+
+
+void
+PGDBTNCACHE::SetStage(const PGDRECT &area)
+{
+    stage.SetArea(area);
+    card = false;
+    nbtn = 0;
+    return;
+}
+
+
+
+int
+PGDBTNCACHE::SetCard(unsigned int sectaddr, unsigned int nsect)
+{
+    if ((!nsect) || (sectaddr + nsect - 1 > 0x00ffffff))
+    {
+        ERRMSG("invalid sectors (%u at %.8X)", nsect, sectaddr);
+        return -1;
+    }
+    card = true;
+    snext = sectaddr;
+    send = sectaddr + nsect;
+    nbtn = 0;
+    return 0;
+}
+
+
+
+int
+PGDBTNCACHE::Add(ushort x, ushort y, ushort bcolor, uchar font, ushort tcolor,
+                 uchar xmul, uchar ymul, const char *text, ushort bgcolor)
+{
+    if (nbtn >= PGDMAXBUTTONS)
+    {
+        ERRMSG("too many buttons (max. %d)", PGDMAXBUTTONS);
+        return -1;
+    }
+    if ((!text) || (!text[0]))
+    {
+        ERRMSG("invalid button text (NULL or empty)");
+        return -1;
+    }
+
+    BUTTON *bp = &btn[nbtn];
+    snprintf(bp->text, PGDBTNTEXTLEN, "%s", text);
+    bp->rect = PGDTextExtent(x, y, font, xmul, ymul, bp->text);
+    bp->rect.x2 += 2 * BTNMARGIN;
+    bp->rect.y2 += 2 * BTNMARGIN;
+
+    int w = bp->rect.x2 - bp->rect.x1 + 1;
+    int h = bp->rect.y2 - bp->rect.y1 + 1;
+    if (card)
+    {
+        unsigned int ns = (w * h * 2 + 511) / 512;
+        if (snext + 2 * ns > send)
+        {
+            ERRMSG("no room for a %d x %d button on the card", w, h);
+            return -1;
+        }
+        bp->sect[0] = snext;
+        bp->sect[1] = snext + ns;
+        snext += 2 * ns;
+    }
+    else if ((stage.Alloc(w, h, &bp->slot[0])) || (stage.Alloc(w, h, &bp->slot[1])))
+    {
+        ERRMSG("no room for a %d x %d button in the staging area", w, h);
+        return -1;
+    }
+
+    bp->bcolor = bcolor;
+    bp->font = font;
+    bp->tcolor = tcolor;
+    bp->xmul = xmul;
+    bp->ymul = ymul;
+    bp->bgcolor = bgcolor;
+    bp->loaded = false;
+    bp->pressed = false;
+    return nbtn++;
+}
+
+
+
+int
+PGDBTNCACHE::Find(ushort x, ushort y)
+{
+    int i;
+    for (i = nbtn - 1; i >= 0; --i)
+    {
+        const PGDRECT &r = btn[i].rect;
+        if ((x >= r.x1) && (x <= r.x2) && (y >= r.y1) && (y <= r.y2)) return i;
+    }
+    return -1;
+}
+
+
+
+int
+PGDBTNCACHE::store(PGD *pgd, int id)
+{
+    BUTTON *bp = &btn[id];
+    int w = bp->rect.x2 - bp->rect.x1 + 1;
+    int h = bp->rect.y2 - bp->rect.y1 + 1;
+    int res = 0;
+    int i;
+
+    // the pressed face is drawn first so that the button is left released
+    for (i = 1; (i >= 0) && (!res); --i)
+    {
+        int x = card ? bp->rect.x1 : bp->slot[i].x1;
+        int y = card ? bp->rect.y1 : bp->slot[i].y1;
+        res = pgd->Rectangle(x, y, x + w - 1, y + h - 1, bp->bgcolor);
+        if (!res) res = pgd->Button(i == 1, x, y, bp->bcolor, bp->font, bp->tcolor,
+                                    bp->xmul, bp->ymul, bp->text);
+        if ((!res) && (card)) res = pgd->SDScreenCopyRaw(x, y, w, h, bp->sect[i]);
+    }
+    if (!res) bp->loaded = true;
+    return res;
+}
+
+
+
+int
+PGDBTNCACHE::show(PGD *pgd, int id)
+{
+    BUTTON *bp = &btn[id];
+    int f = bp->pressed ? 1 : 0;
+    int w = bp->rect.x2 - bp->rect.x1 + 1;
+    int h = bp->rect.y2 - bp->rect.y1 + 1;
+
+    if (card)
+        return pgd->SDShowImageRaw(bp->rect.x1, bp->rect.y1, w, h, 0x10, bp->sect[f]);
+    return pgd->CopyPaste(bp->slot[f].x1, bp->slot[f].y1, bp->rect.x1, bp->rect.y1, w, h);
+}
+
+
+
+int
+PGDBTNCACHE::Load(PGD *pgd)
+{
+    if (!pgd)
+    {
+        ERRMSG("invalid display (NULL pointer)");
+        return -1;
+    }
+
+    int i;
+    int res = 0;
+    uchar pen = pgd->GetPenSize();
+    if (pen != SOLID) res = pgd->PenSize(SOLID);
+
+    for (i = 0; (i < nbtn) && (!res); ++i)
+    {
+        if (!btn[i].loaded) res = store(pgd, i);
+        if (!res) res = show(pgd, i);
+    }
+    if ((!res) && (pen != SOLID)) res = pgd->PenSize(pen);
+
+    if (res) ERRMSG("failed; see message below\n%s", pgd->GetError());
+    return res;
+}
+
+
+
+int
+PGDBTNCACHE::Press(PGD *pgd, int id, bool pressed)
+{
+    if (!pgd)
+    {
+        ERRMSG("invalid display (NULL pointer)");
+        return -1;
+    }
+    if ((id < 0) || (id >= nbtn) || (!btn[id].loaded))
+    {
+        ERRMSG("invalid or unloaded button (%d)", id);
+        return -1;
+    }
+    if (pressed == btn[id].pressed) return 0;
+
+    btn[id].pressed = pressed;
+    int res = show(pgd, id);
+    if (res)
+    {
+        btn[id].pressed = !pressed;
+        ERRMSG("failed; see message below\n%s", pgd->GetError());
+    }
+    return res;
+}
+
+
+
+void
+PGDBTNCACHE::Invalidate(void)
+{
+    int i;
+    if (card) return;
+    for (i = 0; i < nbtn; ++i) btn[i].loaded = false;
+    return;
+}
@@ -0,0 +1,136 @@
+/**
+    file: btncache.h
+
+    Cached button faces for the PICASO SGC driver.  The device draws
+    both faces of each button once; the faces are kept in an off-screen
+    staging area or on the memory card and a press or release is shown
+    with a single CopyPaste or SDShowImageRaw instead of a Button
+    command which the device must render again.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+/*
+    Notes:
+        + The size of a button is estimated from the font cell size
+          (see PGDTextExtent()) plus a margin; the part of the estimated
+          area which the button does not cover is filled with the
+          background color given to Add().
+        + In the staging area each button takes two slots of its own
+          size.  On the card each face takes (width * height * 2 + 511) / 512
+          sectors; the faces are drawn at the button's own position and
+          saved with SDScreenCopyRaw, so no hidden screen area is needed.
+        + Faces in the staging area are lost when anything draws over
+          it; call Invalidate() and Load() again.  Faces on the card
+          survive a PGD::Clear(); Load() only has to show them again.
+        + Commands are sent with the PGD drawing commands, so positions
+          are those of the current orientation and the staging area must
+          lie within the clipping area.
+        + Faces on the card are shown with the old-format SDShowImageRaw.
+          R11 devices only accept it while the image format is IMG_OLD;
+          select it with Ctl(DM_IMGFORMAT, IMG_OLD) before SetCard() is
+          used on such a device.
+ */
+
+#ifndef BTNCACHE_H
+#define BTNCACHE_H
+
+#include "oled.h"
+#include "stage.h"
+
+namespace disp {
+
+// max. number of cached buttons
+#define PGDMAXBUTTONS (16)
+// max. length of the button text including the terminator
+#define PGDBTNTEXTLEN (64)
+
+    /** Buttons whose faces are drawn once and copied into view */
+    class PGDBTNCACHE {
+        private:
+            struct BUTTON {
+                PGDRECT rect;           // area covered on the screen
+                ushort bcolor;
+                uchar font;
+                ushort tcolor;
+                uchar xmul;
+                uchar ymul;
+                ushort bgcolor;         // fills the estimated area around the button
+                char text[PGDBTNTEXTLEN];
+                PGDRECT slot[2];        // released and pressed faces in the staging area
+                unsigned int sect[2];   // released and pressed faces on the card
+                bool loaded;            // faces have been stored
+                bool pressed;
+            };
+            BUTTON btn[PGDMAXBUTTONS];
+            int nbtn;
+            PGDRECT none;               // returned for an invalid button
+            bool card;                  // faces are stored on the card
+            PGDSTAGE stage;
+            unsigned int snext;         // next free sector on the card
+            unsigned int send;          // end of the sectors reserved for the faces
+            char errmsg[PGDERRLEN];
+            // draw and store both faces of button <id>
+            int  store(PGD *pgd, int id);
+            // show the current face of button <id>
+            int  show(PGD *pgd, int id);
+            PGDBTNCACHE(const PGDBTNCACHE &);
+            PGDBTNCACHE &operator=(const PGDBTNCACHE &);
+
+        public:
+            PGDBTNCACHE();
+
+            const char *GetError(void) { return errmsg; }
+
+            /// Keep the faces in <area> (which the user cannot see); all buttons
+            /// are discarded
+            void SetStage(const PGDRECT &area);
+            /// Keep the faces on the card in the <nsect> sectors starting at
+            /// <sectaddr>; all buttons are discarded
+            int  SetCard(unsigned int sectaddr, unsigned int nsect);
+            /// Add a button; the arguments are as for PGD::Button() and <bgcolor>
+            /// is the color of the screen around the button.
+            /// @return the button ID or -1 for failure
+            int  Add(ushort x, ushort y, ushort bcolor, uchar font, ushort tcolor,
+                     uchar xmul, uchar ymul, const char *text, ushort bgcolor);
+            int  GetCount(void) { return nbtn; }
+            /// @return the button at (x, y) or -1 if there is none
+            int  Find(ushort x, ushort y);
+            /// @return the area of button <id>; an empty rectangle if there is none
+            const PGDRECT &GetRect(int id)
+            {
+                return ((id < 0) || (id >= nbtn)) ? none : btn[id].rect;
+            }
+
+            /// Draw and store the faces which are not stored yet, then show
+            /// every button.  Return values are as for PGD commands.
+            int  Load(PGD *pgd);
+            /// Show a button pressed or released; this sends a single command.
+            /// Return values are as for PGD commands.
+            int  Press(PGD *pgd, int id, bool pressed);
+            /// @return true if button <id> is shown pressed; false if there is none
+            bool IsPressed(int id)
+            {
+                return ((id < 0) || (id >= nbtn)) ? false : btn[id].pressed;
+            }
+            /// The faces must be drawn again (the staging area was cleared)
+            void Invalidate(void);
+    };
+
+};  //namespace disp
+#endif // BTNCACHE_H
@@ -0,0 +1,213 @@
+/**
+    file: capcache.cpp
+
+    Persistent cache of display capabilities for the PICASO SGC driver.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "capcache.h"
+
+using namespace disp;
+
+#define ERRMSG(fmt, args...) snprintf(errmsg, PGDERRLEN, "%s:%d: %s(): " fmt,\
+    __FILE__, __LINE__, __FUNCTION__,##args)
+
+
+// true if two version responses describe the same display
+static bool sameVersion(const PGDVER &a, const PGDVER &b)
+{
+    return (a.display_type == b.display_type) && (a.hardware_rev == b.hardware_rev)
+            && (a.firmware_rev == b.firmware_rev) && (a.hres == b.hres)
+            && (a.vres == b.vres);
+}
+
+
+PGDCAPCACHE::PGDCAPCACHE()
+{
+    errmsg[0] = 0;
+}
+
+
+
+int
+PGDCAPCACHE::Load(const char *filename)
+{
+    if (!filename)
+    {
+        ERRMSG("invalid filename (NULL pointer)");
+        return -1;
+    }
+
+    entries.clear();
+    FILE *fp = fopen(filename, "r");
+    if (!fp)
+    {
+        if (errno == ENOENT) return 0;
+        ERRMSG("could not open '%s': %s", filename, strerror(errno));
+        return -1;
+    }
+
+    char line[PATH_MAX + 64];
+    char port[PATH_MAX];
+    unsigned int type, hw, fw, hres, vres, rev, baud;
+    int lineno = 0;
+    ENTRY ent;
+    while (fgets(line, sizeof(line), fp))
+    {
+        ++lineno;
+        char *cp = strchr(line, '#');
+        if (cp) *cp = 0;
+        cp = line;
+        while ((*cp == ' ') || (*cp == '\t')) ++cp;
+        if ((*cp == 0) || (*cp == '\n') || (*cp == '\r')) continue;
+
+        if (sscanf(cp, "%4095s %u %u %u %u %u %u %u", port, &type, &hw, &fw,
+                   &hres, &vres, &rev, &baud) != 8)
+        {
+            ERRMSG("%s: line %d: malformed entry", filename, lineno);
+            fclose(fp);
+            entries.clear();
+            return -1;
+        }
+
+        // a value this version does not know cannot be trusted; the
+        // display is probed again instead
+        if ((rev > SGC_R11) || ((baud != DB_9600)
+            && ((baud < DB_57600) || (baud > DB_256000))))
+            continue;
+
+        ent.port = port;
+        ent.caps.ver.display_type = type;
+        ent.caps.ver.hardware_rev = hw;
+        ent.caps.ver.firmware_rev = fw;
+        ent.caps.ver.hres = hres;
+        ent.caps.ver.vres = vres;
+        ent.caps.rev = (DSGCREV)rev;
+        ent.caps.baud = (DBAUD)baud;
+        entries.push_back(ent);
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+
+
+int
+PGDCAPCACHE::Save(const char *filename)
+{
+    if (!filename)
+    {
+        ERRMSG("invalid filename (NULL pointer)");
+        return -1;
+    }
+
+    char tmpname[PATH_MAX];
+    if (snprintf(tmpname, PATH_MAX, "%s.tmp", filename) >= PATH_MAX)
+    {
+        ERRMSG("filename too long");
+        return -1;
+    }
+
+    FILE *fp = fopen(tmpname, "w");
+    if (!fp)
+    {
+        ERRMSG("could not create '%s': %s", tmpname, strerror(errno));
+        return -1;
+    }
+
+    fprintf(fp, "# port type hwrev fwrev hres vres rev baud\n");
+    std::list<ENTRY>::iterator it = entries.begin();
+    while (it != entries.end())
+    {
+        fprintf(fp, "%s %u %u %u %u %u %u %u\n", it->port.c_str(),
+                it->caps.ver.display_type, it->caps.ver.hardware_rev,
+                it->caps.ver.firmware_rev, it->caps.ver.hres, it->caps.ver.vres,
+                it->caps.rev, it->caps.baud);
+        ++it;
+    }
+
+    if ((fflush(fp)) || (ferror(fp)))
+    {
+        ERRMSG("could not write '%s': %s", tmpname, strerror(errno));
+        fclose(fp);
+        remove(tmpname);
+        return -1;
+    }
+    fclose(fp);
+
+    if (rename(tmpname, filename))
+    {
+        ERRMSG("could not replace '%s': %s", filename, strerror(errno));
+        remove(tmpname);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+
+int
+PGDCAPCACHE::Find(const char *port, const PGDVER &ver, PGDCAPS *caps)
+{
+    if ((!port) || (!caps)) return -1;
+
+    std::list<ENTRY>::iterator it = entries.begin();
+    while (it != entries.end())
+    {
+        if ((it->port == port) && (sameVersion(it->caps.ver, ver)))
+        {
+            *caps = it->caps;
+            return 0;
+        }
+        ++it;
+    }
+
+    return -1;
+}
+
+
+
+void
+PGDCAPCACHE::Store(const char *port, const PGDCAPS &caps)
+{
+    if (!port) return;
+
+    // a port has one display at a time; drop whatever was recorded for it
+    std::list<ENTRY>::iterator it = entries.begin();
+    while (it != entries.end())
+    {
+        if (it->port == port)
+            it = entries.erase(it);
+        else
+            ++it;
+    }
+
+    ENTRY ent;
+    ent.port = port;
+    ent.caps = caps;
+    entries.push_back(ent);
+    return;
+}
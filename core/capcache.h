@@ -0,0 +1,76 @@
+/**
+    file: capcache.h
+
+    Persistent cache of display capabilities for the PICASO SGC driver;
+    entries are keyed by the serial port and the display's version
+    response so that a replaced or reflashed display is probed again.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+/*
+    Cache file format; one entry per line, '#' starts a comment:
+
+        port type hwrev fwrev hres vres rev baud
+
+    type, rev and baud are the numeric values of DTYPE, DSGCREV and
+    DBAUD; lines with a rev or baud which is not one of those values
+    are skipped.  The file is rewritten through a temporary file so that an
+    interrupted Save() leaves the previous contents intact.
+ */
+
+#ifndef CAPCACHE_H
+#define CAPCACHE_H
+
+#include <list>
+#include <string>
+
+#include "oled.h"
+
+namespace disp {
+
+    class PGDCAPCACHE {
+        private:
+            struct ENTRY {
+                std::string port;
+                PGDCAPS caps;
+            };
+            std::list<ENTRY> entries;
+            char errmsg[PGDERRLEN];
+
+        public:
+            PGDCAPCACHE();
+
+            const char *GetError(void) { return errmsg; }
+
+            /// Read a cache file; a missing file is an empty cache
+            /// @return 0 for success, -1 for failure
+            int  Load(const char *filename);
+            /// @return 0 for success, -1 for failure
+            int  Save(const char *filename);
+
+            /// Look up the capabilities of the display with version <ver> on <port>
+            /// @return 0 if found, -1 otherwise
+            int  Find(const char *port, const PGDVER &ver, PGDCAPS *caps);
+            /// Add or replace the entry for the display on <port>
+            void Store(const char *port, const PGDCAPS &caps);
+            void Clear(void) { entries.clear(); }
+    };
+
+};  //namespace disp
+#endif // CAPCACHE_H
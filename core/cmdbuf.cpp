@@ -0,0 +1,649 @@
+/**
+    file: cmdbuf.cpp
+
+    Pre-encoded command sequences for the PICASO SGC driver.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cmdbuf.h"
+
+using namespace disp;
+
+#define ERRMSG(fmt, args...) snprintf(errmsg, PGDERRLEN, "%s:%d: %s(): " fmt,\
+    __FILE__, __LINE__, __FUNCTION__,##args)
+
+// store a 16-bit value MSB first
+#define PUTW(p, val) do {\
+    (p)[0] = ((val) >> 8) & 0xff;\
+    (p)[1] = (val) & 0xff;\
+    } while (0)
+
+
+PGDCMDBUF::PGDCMDBUF()
+{
+    data = NULL;
+    dlen = 0;
+    dsize = 0;
+    cmdofs = NULL;
+    cmdtmo = NULL;
+    ncmd = 0;
+    csize = 0;
+    errmsg[0] = 0;
+}
+
+PGDCMDBUF::~PGDCMDBUF()
+{
+    delete [] data;
+    delete [] cmdofs;
+    delete [] cmdtmo;
+    return;
+}
+
+
+
+int
+PGDCMDBUF::Reserve(int nbytes, int ncmds)
+{
+    if (nbytes > dsize)
+    {
+        char *tp = new char[nbytes];
+        if (!tp)
+        {
+            ERRMSG("could not allocate memory (%d bytes)", nbytes);
+            return -1;
+        }
+        if (dlen) memcpy(tp, data, dlen);
+        delete [] data;
+        data = tp;
+        dsize = nbytes;
+    }
+
+    if (ncmds > csize)
+    {
+        // cmdofs holds one more entry than there are commands
+        int *op = new int[ncmds + 1];
+        int *tp = new int[ncmds];
+        if ((!op) || (!tp))
+        {
+            delete [] op;
+            delete [] tp;
+            ERRMSG("could not allocate memory (%d commands)", ncmds);
+            return -1;
+        }
+        if (ncmd)
+        {
+            memcpy(op, cmdofs, (ncmd + 1) * sizeof(int));
+            memcpy(tp, cmdtmo, ncmd * sizeof(int));
+        }
+        delete [] cmdofs;
+        delete [] cmdtmo;
+        cmdofs = op;
+        cmdtmo = tp;
+        csize = ncmds;
+    }
+
+    return 0;
+}
+
+
+
+char *
+PGDCMDBUF::addCmd(int len, int timeout)
+{
+    int nb = dsize;
+    int nc = csize;
+    if ((dlen + len) > nb)
+    {
+        if (nb < 256) nb = 256;
+        while ((dlen + len) > nb) nb *= 2;
+    }
+    if (ncmd >= nc)
+    {
+        if (nc < 16) nc = 16;
+        else nc *= 2;
+    }
+    if (Reserve(nb, nc)) return NULL;
+
+    char *cp = &data[dlen];
+    cmdofs[ncmd] = dlen;
+    cmdtmo[ncmd] = timeout;
+    dlen += len;
+    ++ncmd;
+    cmdofs[ncmd] = dlen;
+    return cp;
+}
+
+
+
+int
+PGDCMDBUF::Append(const PGDCMDBUF &buf)
+{
+    if (&buf == this)
+    {
+        ERRMSG("cannot append a buffer to itself");
+        return -1;
+    }
+    if (!buf.ncmd) return 0;
+    if (Reserve(dlen + buf.dlen, ncmd + buf.ncmd)) return -1;
+
+    int i;
+    memcpy(&data[dlen], buf.data, buf.dlen);
+    for (i = 0; i < buf.ncmd; ++i)
+    {
+        cmdofs[ncmd + i] = dlen + buf.cmdofs[i];
+        cmdtmo[ncmd + i] = buf.cmdtmo[i];
+    }
+    dlen += buf.dlen;
+    ncmd += buf.ncmd;
+    cmdofs[ncmd] = dlen;
+    return 0;
+}
+
+
+
+int
+PGDCMDBUF::AddEncoded(const char *cmd, int len, int timeout)
+{
+    if ((!cmd) || (len < 1) || (timeout < 1))
+    {
+        ERRMSG("invalid command (%s, %d bytes, timeout %d)", cmd ? "data" : "NULL",
+               len, timeout);
+        return -1;
+    }
+
+    char *cp = addCmd(len, timeout);
+    if (!cp) return -1;
+    memcpy(cp, cmd, len);
+    return 0;
+}
+
+
+
+int
+PGDCMDBUF::GetOffset(int idx) const
+{
+    if ((idx < 0) || (idx > ncmd)) return -1;
+    if (!ncmd) return 0;
+    return cmdofs[idx];
+}
+
+
+
+int
+PGDCMDBUF::GetTimeout(int idx) const
+{
+    if ((idx < 0) || (idx >= ncmd)) return 0;
+    return cmdtmo[idx];
+}
+
+
+
+char *
+PGDCMDBUF::GetCommand(int idx)
+{
+    if ((idx < 0) || (idx >= ncmd)) return NULL;
+    return &data[cmdofs[idx]];
+}
+
+
+
+/*****************************************************
+               GRAPHICS COMMANDS
+*****************************************************/
+
+int
+PGDCMDBUF::AddBitmap(uchar group, uchar index, const uchar *data, int datalen)
+{
+    static const int blen[3] = { 8, 32, 128 };
+    static const int bidx[3] = { 63, 15, 7 };
+
+    if (group > 2)
+    {
+        ERRMSG("invalid group (%d); valid values are 0..2", group);
+        return -1;
+    }
+    if ((datalen != blen[group]) || (index > bidx[group]) || (!data))
+    {
+        ERRMSG("invalid data or index for group %d", group);
+        return -1;
+    }
+
+    char *cp = addCmd(datalen + 3, 200);
+    if (!cp) return -1;
+    cp[0] = 'A';
+    cp[1] = group;
+    cp[2] = index;
+    memcpy(&cp[3], data, datalen);
+    return 0;
+}
+
+
+
+int
+PGDCMDBUF::DrawBitmap(uchar group, uchar index, ushort x, ushort y, ushort color)
+{
+    static const int bidx[3] = { 63, 15, 7 };
+
+    if ((group > 2) || (index > bidx[group]))
+    {
+        ERRMSG("invalid group (%d) or index (%d)", group, index);
+        return -1;
+    }
+
+    char *cp = addCmd(9, 100);
+    if (!cp) return -1;
+    cp[0] = 'D';
+    cp[1] = group;
+    cp[2] = index;
+    PUTW(&cp[3], x);
+    PUTW(&cp[5], y);
+    PUTW(&cp[7], color);
+    return 0;
+}
+
+
+
+int
+PGDCMDBUF::Circle(ushort x, ushort y, ushort radius, ushort color)
+{
+    char *cp = addCmd(9, 100);
+    if (!cp) return -1;
+    cp[0] = 'C';
+    PUTW(&cp[1], x);
+    PUTW(&cp[3], y);
+    PUTW(&cp[5], radius);
+    PUTW(&cp[7], color);
+    return 0;
+}
+
+
+
+int
+PGDCMDBUF::Triangle(ushort x1, ushort y1, ushort x2, ushort y2,
+                    ushort x3, ushort y3, ushort color)
+{
+    char *cp = addCmd(15, 200);
+    if (!cp) return -1;
+    cp[0] = 'G';
+    PUTW(&cp[1], x1);
+    PUTW(&cp[3], y1);
+    PUTW(&cp[5], x2);
+    PUTW(&cp[7], y2);
+    PUTW(&cp[9], x3);
+    PUTW(&cp[11], y3);
+    PUTW(&cp[13], color);
+    return 0;
+}
+
+
+
+int
+PGDCMDBUF::DrawIcon(ushort x, ushort y, ushort width, ushort height,
+                    uchar colormode, const uchar *data, int datalen)
+{
+    if ((colormode != 0x08)&&(colormode != 0x10))
+    {
+        ERRMSG("invalid color mode (%ud); valid values are 0x08 and 0x10 only", colormode);
+        return -1;
+    }
+
+    int dsize = width*height;
+    if (colormode == 0x10) dsize *= 2;
+
+    if ((dsize != datalen) || (!data))
+    {
+        ERRMSG("invalid data length for color mode 0x%.2d (size = %d, expected %d)",
+               colormode, datalen, dsize);
+        return -1;
+    }
+
+    char *cp = addCmd(dsize + 10, 400);
+    if (!cp) return -1;
+    cp[0] = 'I';
+    PUTW(&cp[1], x);
+    PUTW(&cp[3], y);
+    PUTW(&cp[5], width);
+    PUTW(&cp[7], height);
+    cp[9] = colormode;
+    memcpy(&cp[10], data, datalen);
+    return 0;
+}
+
+
+
+int
+PGDCMDBUF::SetBackground(ushort color)
+{
+    char *cp = addCmd(3, 100);
+    if (!cp) return -1;
+    cp[0] = 'K';
+    PUTW(&cp[1], color);
+    return 0;
+}
+
+
+
+int
+PGDCMDBUF::Line(ushort x1, ushort y1, ushort x2, ushort y2, ushort color)
+{
+    char *cp = addCmd(11, 100);
+    if (!cp) return -1;
+    cp[0] = 'L';
+    PUTW(&cp[1], x1);
+    PUTW(&cp[3], y1);
+    PUTW(&cp[5], x2);
+    PUTW(&cp[7], y2);
+    PUTW(&cp[9], color);
+    return 0;
+}
+
+
+
+int
+PGDCMDBUF::Polygon(uchar vertices, ushort *xp, ushort *yp, ushort color)
+{
+    if ((vertices < 3) || (vertices > 7))
+    {
+        ERRMSG("invalid number of vertices (%d); valid range is 3..7", vertices);
+        return -1;
+    }
+    if ((!xp)||(!yp))
+    {
+        ERRMSG("invalid vertex list (NULL pointer)");
+        return -1;
+    }
+
+    char *cp = addCmd(4 + 4 * vertices, 100);
+    if (!cp) return -1;
+    cp[0] = 'g';
+    cp[1] = vertices;
+
+    int i;
+    for (i = 0; i < vertices; ++i)
+    {
+        PUTW(&cp[2 + 4 * i], xp[i]);
+        PUTW(&cp[4 + 4 * i], yp[i]);
+    }
+    PUTW(&cp[2 + 4 * vertices], color);
+    return 0;
+}
+
+
+
+int
+PGDCMDBUF::Rectangle(ushort x1, ushort y1, ushort x2, ushort y2, ushort color)
+{
+    char *cp = addCmd(11, 100);
+    if (!cp) return -1;
+    cp[0] = 'r';
+    PUTW(&cp[1], x1);
+    PUTW(&cp[3], y1);
+    PUTW(&cp[5], x2);
+    PUTW(&cp[7], y2);
+    PUTW(&cp[9], color);
+    return 0;
+}
+
+
+
+int
+PGDCMDBUF::Ellipse(ushort x, ushort y, ushort rx, ushort ry, ushort color)
+{
+    char *cp = addCmd(11, 200);
+    if (!cp) return -1;
+    cp[0] = 'e';
+    PUTW(&cp[1], x);
+    PUTW(&cp[3], y);
+    PUTW(&cp[5], rx);
+    PUTW(&cp[7], ry);
+    PUTW(&cp[9], color);
+    return 0;
+}
+
+
+
+int
+PGDCMDBUF::WritePixel(ushort x, ushort y, ushort color)
+{
+    char *cp = addCmd(7, 200);
+    if (!cp) return -1;
+    cp[0] = 'P';
+    PUTW(&cp[1], x);
+    PUTW(&cp[3], y);
+    PUTW(&cp[5], color);
+    return 0;
+}
+
+
+
+int
+PGDCMDBUF::CopyPaste(ushort xsrc, ushort ysrc, ushort xdst, ushort ydst,
+                     ushort width, ushort height)
+{
+    char *cp = addCmd(13, 2000);
+    if (!cp) return -1;
+    cp[0] = 'c';
+    PUTW(&cp[1], xsrc);
+    PUTW(&cp[3], ysrc);
+    PUTW(&cp[5], xdst);
+    PUTW(&cp[7], ydst);
+    PUTW(&cp[9], width);
+    PUTW(&cp[11], height);
+    return 0;
+}
+
+
+
+int
+PGDCMDBUF::ReplaceColor(ushort x1, ushort y1, ushort x2, ushort y2,
+                        ushort oldcolor, ushort newcolor)
+{
+    char *cp = addCmd(13, 5000);
+    if (!cp) return -1;
+    cp[0] = 'k';
+    PUTW(&cp[1], x1);
+    PUTW(&cp[3], y1);
+    PUTW(&cp[5], x2);
+    PUTW(&cp[7], y2);
+    PUTW(&cp[9], oldcolor);
+    PUTW(&cp[11], newcolor);
+    return 0;
+}
+
+
+
+int
+PGDCMDBUF::PenSize(uchar size)
+{
+    if ((size != 0) && (size != 1))
+    {
+        ERRMSG("invalid pen size (%d); valid values are 0,1", size);
+        return -1;
+    }
+
+    char *cp = addCmd(2, 100);
+    if (!cp) return -1;
+    cp[0] = 'p';
+    cp[1] = size;
+    return 0;
+}
+
+
+
+/*****************************************************
+                    TEXT COMMANDS
+*****************************************************/
+
+int
+PGDCMDBUF::SetFont(uchar size)
+{
+    if (size > 3)
+    {
+        ERRMSG("invalid font size (%d); valid values are 0..3", size);
+        return -1;
+    }
+
+    char *cp = addCmd(2, 100);
+    if (!cp) return -1;
+    cp[0] = 'F';
+    cp[1] = size;
+    return 0;
+}
+
+
+
+int
+PGDCMDBUF::SetOpacity(uchar mode)
+{
+    if ((mode != 0) && (mode != 1))
+    {
+        ERRMSG("invalid text opacity mode (%d); valid values are 0,1", mode);
+        return -1;
+    }
+
+    char *cp = addCmd(2, 100);
+    if (!cp) return -1;
+    cp[0] = 'O';
+    cp[1] = mode;
+    return 0;
+}
+
+
+
+int
+PGDCMDBUF::ShowChar(uchar glyph, uchar col, uchar row, ushort color)
+{
+    char *cp = addCmd(6, 100);
+    if (!cp) return -1;
+    cp[0] = 'T';
+    cp[1] = glyph;
+    cp[2] = col;
+    cp[3] = row;
+    PUTW(&cp[4], color);
+    return 0;
+}
+
+
+
+int
+PGDCMDBUF::ScaleChar(uchar glyph, ushort x, ushort y, ushort color, uchar xmul, uchar ymul)
+{
+    char *cp = addCmd(10, 5000);
+    if (!cp) return -1;
+    cp[0] = 't';
+    cp[1] = glyph;
+    PUTW(&cp[2], x);
+    PUTW(&cp[4], y);
+    PUTW(&cp[6], color);
+    cp[8] = xmul;
+    cp[9] = ymul;
+    return 0;
+}
+
+
+
+int
+PGDCMDBUF::ShowString(uchar col, uchar row, uchar font, ushort color, const char *data)
+{
+    int dlen;
+    if (!data)
+    {
+        ERRMSG("invalid string pointer (NULL)");
+        return -1;
+    }
+
+    if ((dlen = strlen(data)) == 0) return 0; // nothing to do
+    if (dlen > 256) dlen = 256;
+
+    char *cp = addCmd(dlen + 7, 400);
+    if (!cp) return -1;
+    cp[0] = 's';
+    cp[1] = col;
+    cp[2] = row;
+    cp[3] = font;
+    PUTW(&cp[4], color);
+    memcpy(&cp[6], data, dlen);
+    cp[dlen + 6] = 0;
+    return 0;
+}
+
+
+
+int
+PGDCMDBUF::ScaleString(ushort x, ushort y, uchar font, ushort color, uchar width,
+                       uchar height, const char *data)
+{
+    int dlen;
+    if (!data)
+    {
+        ERRMSG("invalid string pointer (NULL)");
+        return -1;
+    }
+
+    if ((dlen = strlen(data)) == 0) return 0; // nothing to do
+    if (dlen > 256) dlen = 256;
+
+    char *cp = addCmd(dlen + 11, 5000);
+    if (!cp) return -1;
+    cp[0] = 'S';
+    PUTW(&cp[1], x);
+    PUTW(&cp[3], y);
+    cp[5] = font;
+    PUTW(&cp[6], color);
+    cp[8] = width;
+    cp[9] = height;
+    memcpy(&cp[10], data, dlen);
+    cp[dlen + 10] = 0;
+    return 0;
+}
+
+
+
+int
+PGDCMDBUF::Button(bool pressed, ushort x, ushort y, ushort bcolor, uchar font,
+                  ushort tcolor, uchar xmul, uchar ymul, const char *text)
+{
+    int dlen;
+    if (!text)
+    {
+        ERRMSG("invalid string pointer (NULL)");
+        return -1;
+    }
+
+    if ((dlen = strlen(text)) == 0) return 0; // nothing to do
+    if (dlen > 256) dlen = 256;
+
+    char *cp = addCmd(dlen + 14, 2000);
+    if (!cp) return -1;
+    cp[0] = 'b';
+    cp[1] = pressed ? 1 : 0;
+    PUTW(&cp[2], x);
+    PUTW(&cp[4], y);
+    PUTW(&cp[6], bcolor);
+    cp[8] = font;
+    PUTW(&cp[9], tcolor);
+    cp[11] = xmul;
+    cp[12] = ymul;
+    memcpy(&cp[13], text, dlen);
+    cp[dlen + 13] = 0;
+    return 0;
+}
@@ -0,0 +1,125 @@
+/**
+    file: cmdbuf.h
+
+    Pre-encoded command sequences for the PICASO SGC driver. Commands
+    are encoded exactly as PGD would send them, but are stored so that
+    a whole sequence can be sent with PGD::Transmit() in one go.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+/*
+    Notes:
+        + The encoding routines have the same names and arguments as
+          their PGD counterparts so that drawing code can be written
+          once (for example as a template) and either executed directly
+          or recorded into a buffer.
+        + Only commands which respond with a single ACK/NACK may be
+          recorded; commands which return data (ReadPixel, Version,
+          GetTouch...) cannot be pipelined.
+ */
+
+#ifndef CMDBUF_H
+#define CMDBUF_H
+
+#include "oled.h"
+
+namespace disp {
+
+    /** Sequence of encoded SGC commands */
+    class PGDCMDBUF {
+        private:
+            char *data;                 // encoded command bytes
+            int  dlen;                  // bytes in use
+            int  dsize;                 // bytes allocated
+            int  *cmdofs;               // offset of each command; cmdofs[ncmd] == dlen
+            int  *cmdtmo;               // ACK timeout (msec) of each command
+            int  ncmd;                  // number of commands
+            int  csize;                 // number of command slots allocated
+            char errmsg[PGDERRLEN];
+            // reserve space for a command of <len> bytes; returns NULL on failure
+            char *addCmd(int len, int timeout);
+            // disallow copying
+            PGDCMDBUF(const PGDCMDBUF &);
+            PGDCMDBUF &operator=(const PGDCMDBUF &);
+
+        public:
+            PGDCMDBUF();
+            ~PGDCMDBUF();
+
+            const char *GetError(void) { return errmsg; }
+
+            /// Preallocate space so that recording does not allocate memory
+            /// @return 0 for success, -1 for failure
+            int  Reserve(int nbytes, int ncmds);
+            /// Discard all commands but keep the allocated memory
+            void Clear(void) { dlen = 0; ncmd = 0; }
+            /// Append all commands of another buffer
+            int  Append(const PGDCMDBUF &buf);
+            /// Append a command which is already encoded; it must respond with a
+            /// single ACK/NACK within <timeout> msec
+            int  AddEncoded(const char *cmd, int len, int timeout);
+
+            const char *GetData(void) const { return data; }
+            int  GetLength(void) const { return dlen; }
+            int  GetCount(void) const { return ncmd; }
+            /// @return byte offset of command <idx>; idx == GetCount() yields the length
+            int  GetOffset(int idx) const;
+            /// @return ACK timeout for command <idx> in msec
+            int  GetTimeout(int idx) const;
+            /// @return writable pointer to command <idx> (for patching), NULL if invalid
+            char *GetCommand(int idx);
+
+            /*
+                ENCODING ROUTINES
+
+                Arguments are validated as in PGD; each routine returns
+                0 for success and -1 for invalid arguments or if memory
+                could not be allocated.
+            */
+            int  AddBitmap(uchar group, uchar index, const uchar *data, int datalen);
+            int  DrawBitmap(uchar group, uchar index, ushort x, ushort y, ushort color);
+            int  Circle(ushort x, ushort y, ushort radius, ushort color);
+            int  Triangle(ushort x1, ushort y1, ushort x2, ushort y2,
+                          ushort x3, ushort y3, ushort color);
+            int  DrawIcon(ushort x, ushort y, ushort width, ushort height,
+                          uchar colormode, const uchar *data, int datalen);
+            int  SetBackground(ushort color);
+            int  Line(ushort x1, ushort y1, ushort x2, ushort y2, ushort color);
+            int  Polygon(uchar vertices, ushort *xp, ushort *yp, ushort color);
+            int  Rectangle(ushort x1, ushort y1, ushort x2, ushort y2, ushort color);
+            int  Ellipse(ushort x, ushort y, ushort rx, ushort ry, ushort color);
+            int  WritePixel(ushort x, ushort y, ushort color);
+            int  CopyPaste(ushort xsrc, ushort ysrc, ushort xdst, ushort ydst,
+                           ushort width, ushort height);
+            int  ReplaceColor(ushort x1, ushort y1, ushort x2, ushort y2,
+                              ushort oldcolor, ushort newcolor);
+            int  PenSize(uchar size);
+            int  SetFont(uchar size);
+            int  SetOpacity(uchar mode);
+            int  ShowChar(uchar glyph, uchar col, uchar row, ushort color);
+            int  ScaleChar(uchar glyph, ushort x, ushort y, ushort color, uchar xmul, uchar ymul);
+            int  ShowString(uchar col, uchar row, uchar font, ushort color, const char *data);
+            int  ScaleString(ushort x, ushort y, uchar font, ushort color, uchar width, uchar height,
+                             const char *data);
+            int  Button(bool pressed, ushort x, ushort y, ushort bcolor, uchar font,
+                        ushort tcolor, uchar xmul, uchar ymul, const char *text);
+    };
+
+};  //namespace disp
+#endif // CMDBUF_H
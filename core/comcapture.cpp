@@ -0,0 +1,694 @@
+/**
+    file: comcapture.cpp
+
+    Capture of the serial traffic to a file and replay of the captured
+    device responses.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+
+*/
+
+#include <time.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include "comcapture.h"
+
+using namespace com;
+
+#define ERRMSG(fmt, args...) snprintf(errmsg, ERRLEN, "%s:%d: %s(): " fmt,\
+    __FILE__, __LINE__, __FUNCTION__,##args)
+
+static const char CAPMAGIC[8] = { 'O', 'L', 'E', 'D', 'C', 'A', 'P', '1' };
+
+// a record as held in the ring; CAPGAP records carry no data
+struct CAPHDR
+{
+    unsigned long long t;   // usec, CLOCK_MONOTONIC
+    unsigned int len;
+    unsigned int tag;
+};
+
+
+static unsigned long long monoUsec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+
+static void sleepUsec(unsigned long long usec)
+{
+    struct timespec ts;
+    ts.tv_sec = usec / 1000000ULL;
+    ts.tv_nsec = (usec % 1000000ULL) * 1000;
+    while (nanosleep(&ts, &ts) && (errno == EINTR));
+}
+
+
+// a sleep may overrun by a few hundred usec; the replay sleeps until
+// shortly before a response is due and yields for the rest
+static void waitUsec(long long usec)
+{
+    if (usec > REPLAYSPIN)
+        sleepUsec(usec - REPLAYSPIN);
+    else
+        sched_yield();
+}
+
+
+
+CAPTURE::CAPTURE()
+{
+    ring = NULL;
+    ringlen = 0;
+    head = 0;
+    tail = 0;
+    lost = 0;
+    stop = false;
+    running = false;
+    fp = NULL;
+    last = 0;
+    errmsg[0] = 0;
+}
+
+
+
+CAPTURE::~CAPTURE()
+{
+    Stop();
+}
+
+
+
+int
+CAPTURE::Start(const char *filename, unsigned long ringlen)
+{
+    if (running)
+    {
+        ERRMSG("capture already running");
+        return -1;
+    }
+    if (filename == NULL)
+    {
+        ERRMSG("invalid file name (NULL)");
+        return -1;
+    }
+
+    // the ring must hold at least two records of the largest size
+    if (ringlen < 2 * (sizeof(CAPHDR) + CAPMAXREC)) ringlen = 2 * (sizeof(CAPHDR) + CAPMAXREC);
+    unsigned long len = 1;
+    while (len < ringlen) len <<= 1;
+
+    fp = fopen(filename, "wb");
+    if (fp == NULL)
+    {
+        ERRMSG("could not create '%s': %s", filename, strerror(errno));
+        return -1;
+    }
+    if (fwrite(CAPMAGIC, 1, sizeof(CAPMAGIC), fp) != sizeof(CAPMAGIC))
+    {
+        ERRMSG("could not write '%s': %s", filename, strerror(errno));
+        fclose(fp);
+        fp = NULL;
+        return -1;
+    }
+
+    ring = new char[len];
+    this->ringlen = len;
+    head = 0;
+    tail = 0;
+    lost = 0;
+    last = 0;
+    stop = false;
+    stats = CAPSTATS();
+
+    if (pthread_create(&writer, NULL, writeThread, this))
+    {
+        ERRMSG("could not start the writer thread");
+        fclose(fp);
+        fp = NULL;
+        delete [] ring;
+        ring = NULL;
+        return -1;
+    }
+
+    // the port may now see the capture as active
+    __atomic_store_n(&running, true, __ATOMIC_RELEASE);
+    return 0;
+}
+
+
+
+int
+CAPTURE::Stop(void)
+{
+    if (!running) return 0;
+
+    running = false;
+    __atomic_store_n(&stop, true, __ATOMIC_RELEASE);
+    pthread_join(writer, NULL);
+
+    // data lost after the last record put into the ring
+    if (lost) encode(CAPGAP, monoUsec(), NULL, lost);
+    lost = 0;
+
+    int res = 0;
+    if (ferror(fp) || fclose(fp))
+    {
+        ERRMSG("could not write the capture file: %s", strerror(errno));
+        res = -1;
+    }
+    fp = NULL;
+    delete [] ring;
+    ring = NULL;
+    return res;
+}
+
+
+
+void
+CAPTURE::ringCopyIn(unsigned long pos, const void *data, unsigned long len)
+{
+    unsigned long off = pos & (ringlen - 1);
+    unsigned long nb = ringlen - off;
+    if (nb > len) nb = len;
+    memcpy(&ring[off], data, nb);
+    if (nb < len) memcpy(ring, (const char *)data + nb, len - nb);
+}
+
+
+
+void
+CAPTURE::ringCopyOut(unsigned long pos, void *data, unsigned long len)
+{
+    unsigned long off = pos & (ringlen - 1);
+    unsigned long nb = ringlen - off;
+    if (nb > len) nb = len;
+    memcpy(data, &ring[off], nb);
+    if (nb < len) memcpy((char *)data + nb, ring, len - nb);
+}
+
+
+
+void
+CAPTURE::Put(int tag, const char *data, int len)
+{
+    if ((!running) || (data == NULL) || (len <= 0)) return;
+
+    CAPHDR hdr;
+    hdr.t = monoUsec();
+    unsigned long h = head;
+    unsigned long space = ringlen - (h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE));
+
+    // a gap goes in ahead of the first block which fits after it
+    if (lost && (space >= 2 * sizeof(CAPHDR) + (len < CAPMAXREC ? len : CAPMAXREC)))
+    {
+        hdr.len = lost;
+        hdr.tag = CAPGAP;
+        ringCopyIn(h, &hdr, sizeof(hdr));
+        h += sizeof(hdr);
+        space -= sizeof(hdr);
+        lost = 0;
+    }
+
+    hdr.tag = tag;
+    while (len > 0)
+    {
+        hdr.len = (len > CAPMAXREC) ? CAPMAXREC : len;
+        if (lost || (space < sizeof(hdr) + hdr.len))
+        {
+            // never wait for the writer thread
+            lost += len;
+            stats.dropped += len;
+            break;
+        }
+        ringCopyIn(h, &hdr, sizeof(hdr));
+        ringCopyIn(h + sizeof(hdr), data, hdr.len);
+        h += sizeof(hdr) + hdr.len;
+        space -= sizeof(hdr) + hdr.len;
+        data += hdr.len;
+        len -= hdr.len;
+    }
+
+    __atomic_store_n(&head, h, __ATOMIC_RELEASE);
+    return;
+}
+
+
+
+void *
+CAPTURE::writeThread(void *arg)
+{
+    CAPTURE *cap = (CAPTURE *)arg;
+    bool dirty = false;
+
+    while (true)
+    {
+        bool fin = __atomic_load_n(&cap->stop, __ATOMIC_ACQUIRE);
+        if (cap->drain())
+        {
+            dirty = true;
+            continue;
+        }
+        if (fin) break;
+        // keep the file current while the port is idle
+        if (dirty) fflush(cap->fp);
+        dirty = false;
+        sleepUsec(1000);
+    }
+
+    return NULL;
+}
+
+
+
+int
+CAPTURE::drain(void)
+{
+    unsigned long t = tail;
+    unsigned long h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    if (t == h) return 0;
+
+    CAPHDR hdr;
+    char buf[CAPMAXREC];
+    while (t != h)
+    {
+        ringCopyOut(t, &hdr, sizeof(hdr));
+        t += sizeof(hdr);
+        if (hdr.tag != CAPGAP)
+        {
+            ringCopyOut(t, buf, hdr.len);
+            t += hdr.len;
+        }
+        encode(hdr.tag, hdr.t, buf, hdr.len);
+        // release the space as soon as the record is copied
+        __atomic_store_n(&tail, t, __ATOMIC_RELEASE);
+    }
+    return 1;
+}
+
+
+
+void
+CAPTURE::encode(int tag, unsigned long long t, const char *data, unsigned int len)
+{
+    unsigned char buf[24];
+    int n = 0;
+    unsigned long long dt = (stats.records && (t > last)) ? t - last : 0;
+    unsigned long nb = len;
+
+    if (stats.records == 0 || t > last) last = t;
+    buf[n++] = (unsigned char)tag;
+    do
+    {
+        buf[n] = dt & 0x7f;
+        dt >>= 7;
+        if (dt) buf[n] |= 0x80;
+        ++n;
+    } while (dt);
+    do
+    {
+        buf[n] = nb & 0x7f;
+        nb >>= 7;
+        if (nb) buf[n] |= 0x80;
+        ++n;
+    } while (nb);
+
+    fwrite(buf, 1, n, fp);
+    if (tag != CAPGAP)
+    {
+        fwrite(data, 1, len, fp);
+        stats.bytes += len;
+    }
+    ++stats.records;
+    return;
+}
+
+
+
+COMREPLAY::COMREPLAY()
+{
+    recs = NULL;
+    nrecs = 0;
+    data = NULL;
+    scale = 1.0;
+    open = false;
+    portname[0] = 0;
+    errmsg[0] = 0;
+    rewind();
+}
+
+
+
+COMREPLAY::~COMREPLAY()
+{
+    Close();
+}
+
+
+
+// read an LEB128 value; false if the file ends first
+static bool getVarint(const unsigned char *buf, long len, long &pos, unsigned long long &val)
+{
+    int shift = 0;
+    val = 0;
+    while ((pos < len) && (shift < 64))
+    {
+        val |= (unsigned long long)(buf[pos] & 0x7f) << shift;
+        if (!(buf[pos++] & 0x80)) return true;
+        shift += 7;
+    }
+    return false;
+}
+
+
+
+int
+COMREPLAY::Open(const char *portname, const COMPARAMS *params, const char * /*lockid*/)
+{
+    if (portname == NULL)
+    {
+        ERRMSG("invalid file name (NULL)");
+        return -1;
+    }
+    if (open) Close();
+
+    FILE *fp = fopen(portname, "rb");
+    if (fp == NULL)
+    {
+        ERRMSG("could not open '%s': %s", portname, strerror(errno));
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    long flen = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (flen < (long)sizeof(CAPMAGIC))
+    {
+        ERRMSG("'%s' is not a capture file", portname);
+        fclose(fp);
+        return -1;
+    }
+    data = new char[flen];
+    if (fread(data, 1, flen, fp) != (size_t)flen)
+    {
+        ERRMSG("could not read '%s': %s", portname, strerror(errno));
+        fclose(fp);
+        Close();
+        return -1;
+    }
+    fclose(fp);
+    if (memcmp(data, CAPMAGIC, sizeof(CAPMAGIC)))
+    {
+        ERRMSG("'%s' is not a capture file", portname);
+        Close();
+        return -1;
+    }
+
+    // each record takes at least 3 bytes
+    recs = new REPREC[(flen - sizeof(CAPMAGIC)) / 3 + 1];
+    nrecs = 0;
+    const unsigned char *buf = (const unsigned char *)data;
+    long pos = sizeof(CAPMAGIC);
+    unsigned long long t = 0;
+    unsigned long long dt, len;
+    int prevtx = -1;
+    while (pos < flen)
+    {
+        REPREC &rec = recs[nrecs];
+        rec.tag = buf[pos++];
+        if (((rec.tag != CAPTX) && (rec.tag != CAPRX) && (rec.tag != CAPGAP))
+            || (!getVarint(buf, flen, pos, dt)) || (!getVarint(buf, flen, pos, len))
+            || ((rec.tag != CAPGAP) && (len > (unsigned long long)(flen - pos))))
+        {
+            ERRMSG("'%s': bad record at offset %ld", portname, pos);
+            Close();
+            return -1;
+        }
+        t += dt;
+        rec.t = t;
+        rec.len = (unsigned int)len;
+        rec.off = pos;
+        rec.prevtx = prevtx;
+        rec.wall = 0;
+        if (rec.tag != CAPGAP) pos += len;
+        if (rec.tag == CAPTX) prevtx = nrecs;
+        ++nrecs;
+    }
+
+    if (params) this->params = *params;
+    snprintf(this->portname, MAX_PATH, "%s", portname);
+    open = true;
+    rewind();
+    return 0;
+}
+
+
+
+int
+COMREPLAY::Reopen(const char * /*lockid*/)
+{
+    if (!open)
+    {
+        ERRMSG("port not open");
+        return -1;
+    }
+    rewind();
+    return 0;
+}
+
+
+
+int
+COMREPLAY::Close(const char * /*lockid*/)
+{
+    delete [] recs;
+    recs = NULL;
+    delete [] data;
+    data = NULL;
+    nrecs = 0;
+    bool wasopen = open;
+    open = false;
+    rewind();
+    return wasopen ? 0 : -1;
+}
+
+
+
+void
+COMREPLAY::rewind(void)
+{
+    txrec = 0;
+    txoff = 0;
+    rxrec = 0;
+    rxoff = 0;
+    stats = REPLAYSTATS();
+    while ((txrec < nrecs) && (recs[txrec].tag != CAPTX)) ++txrec;
+    // records ahead of the first write are timed from now
+    start = monoUsec();
+    return;
+}
+
+
+
+void
+COMREPLAY::skipRx(void)
+{
+    while ((rxrec < nrecs) && (recs[rxrec].tag != CAPRX))
+    {
+        if (recs[rxrec].tag == CAPGAP) ++stats.gaps;
+        ++rxrec;
+    }
+    return;
+}
+
+
+
+long long
+COMREPLAY::nextDue(void)
+{
+    skipRx();
+    // everything written ahead of the response must have been written
+    if ((rxrec >= nrecs) || (txrec < rxrec)) return -1;
+
+    const REPREC &rec = recs[rxrec];
+    unsigned long long base = start;
+    unsigned long long tbase = recs[0].t;
+    if (rec.prevtx >= 0)
+    {
+        base = recs[rec.prevtx].wall;
+        tbase = recs[rec.prevtx].t;
+    }
+    return (long long)(base + (unsigned long long)((rec.t - tbase) * scale));
+}
+
+
+
+int
+COMREPLAY::Flush(const char * /*lockid*/)
+{
+    if (!open)
+    {
+        ERRMSG("port not open");
+        return -1;
+    }
+
+    long long due;
+    long long now = (long long)monoUsec();
+    while (((due = nextDue()) >= 0) && (due <= now))
+    {
+        rxoff = 0;
+        ++rxrec;
+    }
+    return 0;
+}
+
+
+
+int
+COMREPLAY::Select(unsigned int duration)
+{
+    if (!open)
+    {
+        ERRMSG("port not open");
+        return -1;
+    }
+
+    long long deadline = (long long)monoUsec() + duration * 1000LL;
+    while (true)
+    {
+        long long due = nextDue();
+        long long now = (long long)monoUsec();
+        if ((due >= 0) && (due <= now)) return 1;
+        // without delays nothing more arrives before the next write
+        if ((now >= deadline) || ((due < 0) && (scale == 0.0))) return 0;
+        waitUsec((((due < 0) || (due > deadline)) ? deadline : due) - now);
+    }
+}
+
+
+
+int
+COMREPLAY::SetBaud(speed_t speed, int /*timeout*/, const char * /*lockid*/)
+{
+    if (!open)
+    {
+        ERRMSG("port not open");
+        return -1;
+    }
+    params.speed = speed;
+    return 0;
+}
+
+
+
+int
+COMREPLAY::Read(char *data, int len, int timeout, char delim, const char * /*lockid*/)
+{
+    if (!open)
+    {
+        ERRMSG("port not open");
+        return -1;
+    }
+    if ((data == NULL) || (len <= 0))
+    {
+        ERRMSG("invalid buffer (%p, %d)", data, len);
+        return -1;
+    }
+
+    int idx = 0;
+    long long deadline = (long long)monoUsec() + timeout * 1000LL;
+    while (idx < len)
+    {
+        long long due = nextDue();
+        long long now = (long long)monoUsec();
+        if ((due >= 0) && (due <= now))
+        {
+            REPREC &rec = recs[rxrec];
+            while ((idx < len) && (rxoff < rec.len))
+            {
+                char c = this->data[rec.off + rxoff++];
+                data[idx++] = c;
+                ++stats.rxbytes;
+                if (delim && (c == delim)) break;
+            }
+            if (rxoff == rec.len)
+            {
+                rxoff = 0;
+                ++rxrec;
+            }
+            if (delim && (data[idx - 1] == delim)) return idx;
+            continue;
+        }
+        if ((timeout <= 0) || (now >= deadline) || ((due < 0) && (scale == 0.0)))
+            break;
+        waitUsec((((due < 0) || (due > deadline)) ? deadline : due) - now);
+    }
+
+    return idx;
+}
+
+
+
+int
+COMREPLAY::Write(const char* data, int len, int /*timeout*/, const char * /*lockid*/)
+{
+    if (!open)
+    {
+        ERRMSG("port not open");
+        return -1;
+    }
+    if ((data == NULL) || (len <= 0))
+    {
+        ERRMSG("invalid data (%p, %d)", data, len);
+        return -1;
+    }
+
+    unsigned long long now = monoUsec();
+    int i;
+    for (i = 0; (i < len) && (txrec < nrecs); ++i)
+    {
+        REPREC &rec = recs[txrec];
+        if (data[i] != this->data[rec.off + txoff]) ++stats.mismatched;
+        if (++txoff == rec.len)
+        {
+            // the responses to this block are timed from now
+            rec.wall = now;
+            txoff = 0;
+            ++txrec;
+            while ((txrec < nrecs) && (recs[txrec].tag != CAPTX)) ++txrec;
+        }
+    }
+    stats.extra += len - i;
+    stats.txbytes += len;
+    return len;
+}
+
+
+
+int
+COMREPLAY::WriteRead(const char* dataout, int lenout, char* datain,
+                     int lenin, int timeout, char delim, const char* lockid)
+{
+    if (Write(dataout, lenout, timeout, lockid) != lenout) return -1;
+    return Read(datain, lenin, timeout, delim, lockid);
+}
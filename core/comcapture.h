@@ -0,0 +1,223 @@
+/**
+    file: comcapture.h
+
+    Capture of the serial traffic to a file and replay of the captured
+    device responses.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+
+*/
+
+/*
+    Notes:
+        + A CAPTURE is attached to a COMPORT (or COMURING) with
+          COMPORT::SetCapture().  The port copies each block it writes
+          or reads, with a CLOCK_MONOTONIC time, into a ring buffer and
+          a background thread encodes the ring into the file.  The port
+          never waits for the file: when the ring is full the block is
+          dropped and a gap record stating the number of bytes lost is
+          written in its place.
+        + The ring has a single producer; the port calls which feed one
+          CAPTURE must not overlap.  PGD serializes its port calls.
+        + File format: the 8 byte magic "OLEDCAP1" followed by records
+              tag (1 byte): CAPTX, CAPRX or CAPGAP
+              usec since the previous record (LEB128)
+              length in bytes (LEB128)
+              <length> bytes of data (none for CAPGAP)
+        + COMREPLAY opens a capture file as a port.  Write() consumes the
+          captured transmitted bytes (and counts the bytes which differ)
+          and each received block is made available to Read() at the
+          same interval after the write preceding it as in the capture,
+          scaled by SetTimeScale().  Received blocks are never delivered
+          before the host has written everything which preceded them.
+ */
+
+#ifndef __COMCAPTURE_H__
+#define __COMCAPTURE_H__
+
+#include <pthread.h>
+#include <cstdio>
+
+#include "comport.h"
+
+namespace com {
+
+// default size of the capture ring; must be 2^n
+#define CAPRINGLEN (1 << 20)
+// largest block stored as one record; longer blocks are split
+#define CAPMAXREC (4096)
+
+// usec before a response is due at which COMREPLAY stops sleeping
+#define REPLAYSPIN (500)
+
+// record tags
+#define CAPTX  (0x54)
+#define CAPRX  (0x52)
+#define CAPGAP (0x47)
+
+    /// Counters of a CAPTURE
+    struct CAPSTATS
+    {
+        unsigned long records;      // records written to the file
+        unsigned long bytes;        // data bytes written to the file
+        unsigned long dropped;      // data bytes lost to a full ring
+        CAPSTATS() { records = 0; bytes = 0; dropped = 0; }
+    };
+
+    class CAPTURE
+    {
+    private:
+        char    *ring;
+        unsigned long ringlen;
+        unsigned long head;         // written by the port (producer)
+        unsigned long tail;         // written by the writer thread
+        unsigned long lost;         // bytes dropped since the last gap record
+        bool    stop;               // tells the writer thread to finish
+        bool    running;
+        pthread_t writer;
+        FILE    *fp;
+        unsigned long long last;    // time of the previous record in the file
+        CAPSTATS stats;
+        char    errmsg[ERRLEN];
+
+        static void *writeThread(void *arg);
+        // encode the records in the ring; 0 if the ring was empty
+        int drain(void);
+        void encode(int tag, unsigned long long t, const char *data, unsigned int len);
+        void ringCopyIn(unsigned long pos, const void *data, unsigned long len);
+        void ringCopyOut(unsigned long pos, void *data, unsigned long len);
+        CAPTURE(const CAPTURE &);
+        CAPTURE &operator=(const CAPTURE &);
+
+    public:
+        CAPTURE();
+        ~CAPTURE();
+
+        /// Create <filename> and start the writer thread
+        /// @param ringlen bytes in the ring; rounded up to 2^n
+        /// @return 0 for success, otherwise -1
+        int Start(const char *filename, unsigned long ringlen = CAPRINGLEN);
+        /// Write out what remains in the ring and close the file
+        int Stop(void);
+        bool IsActive(void) { return running; }
+
+        /// Copy a block into the ring; never blocks
+        /// @param tag CAPTX or CAPRX
+        void Put(int tag, const char *data, int len);
+
+        /// Counters; stable after Stop()
+        const CAPSTATS &GetStats(void) { return stats; }
+        const char *GetError(void) { return errmsg; }
+    };  // class CAPTURE
+
+
+    /// Counters of a COMREPLAY
+    struct REPLAYSTATS
+    {
+        unsigned long txbytes;      // bytes written by the host
+        unsigned long mismatched;   // bytes which differ from the capture
+        unsigned long extra;        // bytes written beyond the capture
+        unsigned long rxbytes;      // bytes delivered to the host
+        unsigned long gaps;         // gap records passed
+        REPLAYSTATS() { txbytes = 0; mismatched = 0; extra = 0; rxbytes = 0; gaps = 0; }
+    };
+
+    class COMREPLAY : public COMMIF
+    {
+    private:
+        struct REPREC
+        {
+            int tag;
+            unsigned long long t;   // capture time in usec
+            unsigned long off;      // data offset in 'data'
+            unsigned int len;
+            int prevtx;             // index of the previous CAPTX record; -1 if none
+            unsigned long long wall;    // CAPTX: time the host completed it
+        };
+
+        REPREC  *recs;
+        int     nrecs;
+        char    *data;
+        int     txrec;              // next CAPTX record and offset within it
+        unsigned int txoff;
+        int     rxrec;              // next CAPRX record and offset within it
+        unsigned int rxoff;
+        double  scale;
+        unsigned long long start;   // time of Open() or Reopen()
+        bool    open;
+        struct  COMPARAMS params;
+        char    portname[MAX_PATH];
+        char    errmsg[ERRLEN];
+        REPLAYSTATS stats;
+
+        void rewind(void);
+        // find the next CAPRX record; -1 if it may not be delivered yet,
+        // otherwise the usec (monotonic) at which it is due
+        long long nextDue(void);
+        // move <rxrec> past the records which are not CAPRX
+        void skipRx(void);
+        COMREPLAY(const COMREPLAY &);
+        COMREPLAY &operator=(const COMREPLAY &);
+
+    public:
+        COMREPLAY();
+        ~COMREPLAY();
+
+        /// Load a capture file
+        int Open(const char *portname, const COMPARAMS *params = NULL,
+                const char *lockid = NULL);
+        /// Start the replay again from the beginning
+        int Reopen(const char *lockid = NULL);
+        int Close(const char *lockid = NULL);
+        /// Discard the received data which is due
+        int Flush(const char *lockid = NULL);
+        int Drain(const char * /*lockid*/ = NULL) { return open ? 0 : -1; }
+        /// Wait up to <duration> msec for received data to be due
+        /// @return 1 if there is data, 0 on timeout, -1 for fault
+        int Select(unsigned int duration);
+        /// Only records the rate; the capture determines the timing
+        int SetBaud(speed_t speed, int timeout = 0, const char* lockid = NULL);
+        int Read(char *data, int len, int timeout = 0,
+                char delim = 0, const char *lockid = NULL);
+        /// Compare the data with the capture and release the responses
+        /// @return <len> or -1 for fault
+        int Write(const char* data, int len, int timeout = 0,
+                const char* lockid = NULL);
+        int WriteRead(const char* dataout, int lenout, char* datain,
+                    int lenin, int timeout, char delim = 0,
+                    const char* lockid = NULL);
+
+        inline int Lock(const char* /*lockid*/ = NULL, int /*timeout*/ = 0) { return 0; }
+        inline int Unlock(const char* /*lockid*/ = NULL) { return 0; }
+
+        const char *GetError(void) { return errmsg; }
+        void ClearError(void) { errmsg[0] = 0; }
+        const char *GetPortName(void) { return portname; }
+        bool IsOpen(void) { return open; }
+
+        /// Multiply the captured intervals by <factor>; 0 replays
+        /// without delays
+        void SetTimeScale(double factor) { scale = (factor < 0.0) ? 0.0 : factor; }
+        const REPLAYSTATS &GetStats(void) { return stats; }
+        /// @return true when every captured record has been consumed
+        bool AtEnd(void) { return (txrec >= nrecs) && (rxrec >= nrecs); }
+    };  // class COMREPLAY
+
+}; // namespace com
+
+#endif
@@ -65,6 +65,8 @@ namespace com {
     {
 
     public:
+        virtual ~COMMIF() { }
+
         virtual int Open(const char *portname, const COMPARAMS *params = NULL,
                         const char *lockid = NULL) = 0;
         virtual int Reopen(const char *lockid = NULL) = 0;
@@ -93,7 +95,7 @@ namespace com {
         /// method if a single response is expected. To lock out other users
         /// for a period, use \p Lock to obtain a lock, use \p Read and \p Write
         /// as required, and call Unlock() when done.
-        virtual int Write(const char* data, int len, int timeout,
+        virtual int Write(const char* data, int len, int timeout = 0,
                         const char* lockid = NULL) = 0;
 
         /// Write data and wait for a response to be read; other users are prevented
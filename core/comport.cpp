@@ -31,7 +31,7 @@
 
  */
 
-#include <sys/select.h>
+#include <poll.h>
 #include <sys/time.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -41,6 +41,7 @@
 #include <string.h>
 
 #include "comport.h"
+#include "comcapture.h"
 
 using namespace com;
 
@@ -50,6 +51,7 @@ COMPORT::COMPORT()
     portname[0] = 0;
     errmsg[0] = 0;
     hasterm = false;
+    capture = NULL;
     bufclr();
 }
 
@@ -154,6 +156,7 @@ COMPORT::Write(const char* data, int len, int /*timeout*/,
         rtx -= bsent;
         tcdrain(fd);
     }
+    mirror(CAPTX, data, (int) ntx);
     if (bsent == -1)
     {
         snprintf(errmsg, ERRLEN, "%s:%d: %s(): write incomplete (req: %d, sent %d): %s",
@@ -268,6 +271,7 @@ COMPORT::Read(char *data, int len, int timeout,
                 {
                     // read until the end of the buffer
                     if ((ilen = read(fd, &tbuf[cbiwr], PBUF_SIZE - cbiwr)) < 0) break;
+                    mirror(CAPRX, &tbuf[cbiwr], ilen);
                     cbiwr = (cbiwr + ilen) & PBUF_MASK;
                     if (cbiwr != 0)
                     {
@@ -279,6 +283,7 @@ COMPORT::Read(char *data, int len, int timeout,
                 // read in what remains
                 if ((ilen = read(fd, &tbuf[cbiwr], dlen)) > 0)
                 {
+                    mirror(CAPRX, &tbuf[cbiwr], ilen);
                     cbiwr = (cbiwr + ilen) & PBUF_MASK;
                 }
                 // transfer from the circular buffer to the user data space
@@ -295,7 +300,11 @@ COMPORT::Read(char *data, int len, int timeout,
         else
         {
             val = read(fd, &data[idx], nb);
-            if (val > 0) idx += val;
+            if (val > 0)
+            {
+                mirror(CAPRX, &data[idx], val);
+                idx += val;
+            }
         }
 
         if (idx == len) return idx;
@@ -390,23 +399,15 @@ COMPORT::Select(unsigned int duration)
 {
     // if there is no open port just pretend there is nothing to do
     if (fd == -1) return 0;
-    struct timeval ts;
-    if (duration >= 1000)
-    {
-        ts.tv_sec = duration / 1000;
-        ts.tv_usec = (duration % 1000) * 1000;
-    }
-    else
-    {
-        ts.tv_sec = 0;
-        ts.tv_usec = duration * 1000;
-    }
 
-    fd_set rdfd;
-    FD_ZERO(&rdfd);
-    FD_SET(fd, &rdfd);
+    // poll() rather than select(): descriptors beyond FD_SETSIZE are
+    // common when many ports are open
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
 
-    return select(fd+1, &rdfd, NULL, NULL, &ts);
+    return poll(&pfd, 1, (int)duration);
 }
 
 int
@@ -500,3 +501,11 @@ void COMPORT::ClearError(void)
 {
     errmsg[0] = 0;
 }
+
+
+
+void
+COMPORT::mirror(int tag, const char *data, int len)
+{
+    if (capture && (len > 0)) capture->Put(tag, data, len);
+}
@@ -37,6 +37,7 @@
 #define __COMPORT_H__
 
 #include <sys/termios.h>
+#include <climits>
 #include <cstdio>
 
 #include "commif.h"
@@ -59,9 +60,11 @@ namespace com {
     /// Error message buffer length
     const int ERRLEN = 512;
 
+    class CAPTURE;
+
     class COMPORT : public COMMIF
     {
-    private:
+    protected:
         int     fd;                 // Serial port file descriptor number
         struct  termios oldterm;    // Remember the previous settings
         bool    hasterm;            // true when 'oldterm' is set
@@ -76,6 +79,9 @@ namespace com {
         inline int bufrdlen(void) { return (cbiwr - cbird) & PBUF_MASK; }
         inline int bufwrlen(void) { return PBUF_MASK - ((cbiwr - cbird) & PBUF_MASK); }
         inline void bufclr(void) { cbird = cbiwr = 0; }
+        CAPTURE *capture;   // receives a copy of the traffic; may be NULL
+        // copy a block which was written or read to the capture
+        void mirror(int tag, const char *data, int len);
 
     public:
         COMPORT();
@@ -144,6 +150,10 @@ namespace com {
         inline int Lock(const char* /*lockid*/ = NULL, int /*timeout*/ = 0) { return 0; }
         /// Relinquish exclusive access to the port
         inline int Unlock(const char* /*lockid*/ = NULL) { return 0; }
+
+        /// Copy every block written to or read from the port into <cap>
+        /// (see comcapture.h); NULL stops the copying
+        void SetCapture(CAPTURE *cap) { capture = cap; }
     };  // class COMPORT
 
 }; // namespace com
@@ -0,0 +1,1239 @@
+/**
+    file: comsim.cpp
+
+    Simulated PICASO SGC display: a port which executes the commands
+    written to it on a framebuffer and answers at once, and the images
+    used to compare what was drawn.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+
+*/
+
+#include <time.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "comsim.h"
+
+using namespace com;
+
+#define ERRMSG(fmt, args...) snprintf(errmsg, ERRLEN, "%s:%d: %s(): " fmt,\
+    __FILE__, __LINE__, __FUNCTION__,##args)
+
+#define ACK (0x06)
+#define NACK (0x15)
+
+// longest string accepted by the text commands
+#define SIMMAXSTR (256)
+
+// comment in the header of the shared image which counts the commands
+#define SHMCOUNT "P6\n# commands "
+
+
+static unsigned long long monoUsec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+
+static int getw(const char *p)
+{
+    return ((unsigned char)p[0] << 8) | (unsigned char)p[1];
+}
+
+
+// resolution code reported by Version(); 0 if there is none
+static char resCode(int pixels)
+{
+    switch (pixels)
+    {
+        case 64:
+            return '\x64';
+        case 96:
+            return '\x96';
+        case 128:
+            return '\x28';
+        case 160:
+            return '\x60';
+        case 176:
+            return '\x76';
+        case 220:
+            return '\x22';
+        case 240:
+            return '\x24';
+        case 320:
+            return '\x32';
+        default:
+            break;
+    }
+    return 0;
+}
+
+
+static void toRGB(unsigned short color, unsigned char *rgb)
+{
+    int r = (color >> 11) & 0x1f;
+    int g = (color >> 5) & 0x3f;
+    int b = color & 0x1f;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+    return;
+}
+
+
+
+/*****************************************************
+                    SIMIMAGE
+*****************************************************/
+
+SIMIMAGE::SIMIMAGE()
+{
+    rgb = NULL;
+    width = 0;
+    height = 0;
+    errmsg[0] = 0;
+    return;
+}
+
+
+
+SIMIMAGE::~SIMIMAGE()
+{
+    delete [] rgb;
+    return;
+}
+
+
+
+int
+SIMIMAGE::Create(int width, int height)
+{
+    if ((width < 1) || (height < 1))
+    {
+        ERRMSG("invalid size (%d x %d)", width, height);
+        return -1;
+    }
+    if ((width != this->width) || (height != this->height))
+    {
+        delete [] rgb;
+        rgb = new unsigned char[3 * width * height];
+        this->width = width;
+        this->height = height;
+    }
+    memset(rgb, 0, 3 * width * height);
+    return 0;
+}
+
+
+
+int
+SIMIMAGE::Set(const unsigned short *pixels, int width, int height)
+{
+    if (!pixels)
+    {
+        ERRMSG("invalid pixels (NULL)");
+        return -1;
+    }
+    if (Create(width, height)) return -1;
+    for (int i = 0; i < width * height; ++i) toRGB(pixels[i], &rgb[3 * i]);
+    return 0;
+}
+
+
+
+// read a number from a PPM header, skipping white space and comments
+static int ppmNumber(FILE *fp)
+{
+    int c = fgetc(fp);
+    while (true)
+    {
+        if (c == '#')
+        {
+            while ((c != EOF) && (c != '\n')) c = fgetc(fp);
+        }
+        else if ((c == ' ') || (c == '\t') || (c == '\r') || (c == '\n'))
+        {
+            c = fgetc(fp);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    int val = -1;
+    while ((c >= '0') && (c <= '9'))
+    {
+        val = ((val < 0) ? 0 : val * 10) + (c - '0');
+        if (val > 65535) return -1;
+        c = fgetc(fp);
+    }
+    // a single white space character ends the number
+    if ((c != ' ') && (c != '\t') && (c != '\r') && (c != '\n')) return -1;
+    return val;
+}
+
+
+
+int
+SIMIMAGE::Load(const char *filename)
+{
+    if (!filename)
+    {
+        ERRMSG("invalid file name (NULL)");
+        return -1;
+    }
+    FILE *fp = fopen(filename, "rb");
+    if (!fp)
+    {
+        ERRMSG("could not open '%s': %s", filename, strerror(errno));
+        return -1;
+    }
+
+    int w = -1, h = -1, maxval = -1;
+    if ((fgetc(fp) == 'P') && (fgetc(fp) == '6'))
+    {
+        w = ppmNumber(fp);
+        h = ppmNumber(fp);
+        maxval = ppmNumber(fp);
+    }
+    if ((w < 1) || (h < 1) || (maxval != 255))
+    {
+        ERRMSG("'%s' is not a binary PPM file with 8-bit channels", filename);
+        fclose(fp);
+        return -1;
+    }
+    if (Create(w, h))
+    {
+        fclose(fp);
+        return -1;
+    }
+    if (fread(rgb, 3, w * h, fp) != (size_t)(w * h))
+    {
+        ERRMSG("'%s' is truncated", filename);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    return 0;
+}
+
+
+
+int
+SIMIMAGE::Save(const char *filename)
+{
+    if (!filename)
+    {
+        ERRMSG("invalid file name (NULL)");
+        return -1;
+    }
+    if (!rgb)
+    {
+        ERRMSG("the image is empty");
+        return -1;
+    }
+    FILE *fp = fopen(filename, "wb");
+    if (!fp)
+    {
+        ERRMSG("could not create '%s': %s", filename, strerror(errno));
+        return -1;
+    }
+    fprintf(fp, "P6\n%d %d\n255\n", width, height);
+    size_t n = fwrite(rgb, 3, width * height, fp);
+    if ((fclose(fp)) || (n != (size_t)(width * height)))
+    {
+        ERRMSG("could not write '%s': %s", filename, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+
+
+long
+SIMIMAGE::Compare(const SIMIMAGE &other, SIMDIFF *diff, int tolerance, SIMIMAGE *map)
+{
+    if ((!rgb) || (width != other.width) || (height != other.height))
+    {
+        ERRMSG("the images differ in size (%d x %d, %d x %d)", width, height,
+               other.width, other.height);
+        return -1;
+    }
+    if ((map) && (map->Create(width, height)))
+    {
+        ERRMSG("could not create the map; see message below\n%s", map->GetError());
+        return -1;
+    }
+
+    SIMDIFF d;
+    int x, y, k, delta, worst;
+    const unsigned char *a = rgb;
+    const unsigned char *b = other.rgb;
+    for (y = 0; y < height; ++y)
+    {
+        for (x = 0; x < width; ++x, a += 3, b += 3)
+        {
+            worst = 0;
+            for (k = 0; k < 3; ++k)
+            {
+                delta = abs((int)a[k] - (int)b[k]);
+                if (delta > worst) worst = delta;
+            }
+            if (worst > d.maxdelta) d.maxdelta = worst;
+
+            unsigned char *mp = (map) ? &map->rgb[a - rgb] : NULL;
+            if (worst <= tolerance)
+            {
+                if (mp)
+                {
+                    for (k = 0; k < 3; ++k) mp[k] = a[k] / 3;
+                }
+                continue;
+            }
+
+            if (!d.differ)
+            {
+                d.x1 = d.x2 = x;
+                d.y1 = y;
+            }
+            if (x < d.x1) d.x1 = x;
+            if (x > d.x2) d.x2 = x;
+            d.y2 = y;
+            ++d.differ;
+            if (mp)
+            {
+                mp[0] = 255;
+                mp[1] = 0;
+                mp[2] = 0;
+            }
+        }
+    }
+    d.pixels = (long)width * height;
+    if (diff) *diff = d;
+    return d.differ;
+}
+
+
+
+/*****************************************************
+                    COMSIM
+*****************************************************/
+
+COMSIM::COMSIM()
+{
+    width = SIMWIDTH;
+    height = SIMHEIGHT;
+    fb = new unsigned short[width * height];
+    memset(fb, 0, width * height * sizeof(unsigned short));
+    bg = 0;
+    pen = 0;
+    turns = 0;
+    pattern[0] = 0;
+    snapcmds = 0;
+    snapmsec = 0;
+    lastcmds = 0;
+    lastsnap = 0;
+    seq = 0;
+    shmfd = -1;
+    shm = NULL;
+    shmlen = 0;
+    shmhdr = 0;
+    open = false;
+    portname[0] = 0;
+    errmsg[0] = 0;
+    return;
+}
+
+
+
+COMSIM::~COMSIM()
+{
+    closeShared();
+    delete [] fb;
+    return;
+}
+
+
+
+int
+COMSIM::SetSize(int width, int height)
+{
+    if (open || shm)
+    {
+        ERRMSG("the size cannot be changed while the port or shared image is open");
+        return -1;
+    }
+    if ((!resCode(width)) || (!resCode(height)))
+    {
+        ERRMSG("unsupported size (%d x %d)", width, height);
+        return -1;
+    }
+    delete [] fb;
+    this->width = width;
+    this->height = height;
+    fb = new unsigned short[width * height];
+    reset();
+    return 0;
+}
+
+
+
+void
+COMSIM::reset(void)
+{
+    memset(fb, 0, width * height * sizeof(unsigned short));
+    if (shm) memset(shm + shmhdr, 0, shmlen - shmhdr);
+    bg = 0;
+    pen = 0;
+    turns = 0;
+    bitmaps.clear();
+    cmd.clear();
+    resp.clear();
+    return;
+}
+
+
+
+int
+COMSIM::Open(const char *portname, const COMPARAMS *params, const char * /*lockid*/)
+{
+    if (portname == NULL)
+    {
+        ERRMSG("invalid port name (NULL)");
+        return -1;
+    }
+    if (params) this->params = *params;
+    snprintf(this->portname, MAX_PATH, "%s", portname);
+    stats = SIMSTATS();
+    lastcmds = 0;
+    lastsnap = monoUsec();
+    reset();
+    open = true;
+    return 0;
+}
+
+
+
+int
+COMSIM::Reopen(const char * /*lockid*/)
+{
+    if (!open)
+    {
+        ERRMSG("port not open");
+        return -1;
+    }
+    reset();
+    return 0;
+}
+
+
+
+int
+COMSIM::Close(const char * /*lockid*/)
+{
+    bool wasopen = open;
+    open = false;
+    cmd.clear();
+    resp.clear();
+    return wasopen ? 0 : -1;
+}
+
+
+
+int
+COMSIM::Flush(const char * /*lockid*/)
+{
+    if (!open)
+    {
+        ERRMSG("port not open");
+        return -1;
+    }
+    resp.clear();
+    return 0;
+}
+
+
+
+int
+COMSIM::Select(unsigned int /*duration*/)
+{
+    if (!open)
+    {
+        ERRMSG("port not open");
+        return -1;
+    }
+    // nothing more arrives before the next write
+    return resp.empty() ? 0 : 1;
+}
+
+
+
+int
+COMSIM::SetBaud(speed_t speed, int /*timeout*/, const char * /*lockid*/)
+{
+    if (!open)
+    {
+        ERRMSG("port not open");
+        return -1;
+    }
+    params.speed = speed;
+    return 0;
+}
+
+
+
+int
+COMSIM::Read(char *data, int len, int /*timeout*/, char delim, const char * /*lockid*/)
+{
+    if (!open)
+    {
+        ERRMSG("port not open");
+        return -1;
+    }
+    if ((data == NULL) || (len <= 0))
+    {
+        ERRMSG("invalid buffer (%p, %d)", data, len);
+        return -1;
+    }
+
+    int idx = 0;
+    while ((idx < len) && (idx < (int)resp.size()))
+    {
+        data[idx] = resp[idx];
+        if (delim && (data[idx] == delim))
+        {
+            ++idx;
+            break;
+        }
+        ++idx;
+    }
+    resp.erase(0, idx);
+    return idx;
+}
+
+
+
+int
+COMSIM::Write(const char* data, int len, int /*timeout*/, const char * /*lockid*/)
+{
+    if (!open)
+    {
+        ERRMSG("port not open");
+        return -1;
+    }
+    if ((data == NULL) || (len <= 0))
+    {
+        ERRMSG("invalid data (%p, %d)", data, len);
+        return -1;
+    }
+
+    int i, need;
+    for (i = 0; i < len; ++i)
+    {
+        cmd.push_back(data[i]);
+        need = cmdLength();
+        if (need < 0)
+        {
+            resp.push_back(NACK);
+            ++stats.nacked;
+            cmd.clear();
+            continue;
+        }
+        if ((!need) || ((int)cmd.size() < need)) continue;
+        execute();
+        cmd.clear();
+    }
+    stats.bytes += len;
+    return len;
+}
+
+
+
+int
+COMSIM::WriteRead(const char* dataout, int lenout, char* datain,
+                  int lenin, int timeout, char delim, const char* lockid)
+{
+    if (Write(dataout, lenout, timeout, lockid) != lenout) return -1;
+    return Read(datain, lenin, timeout, delim, lockid);
+}
+
+
+
+int
+COMSIM::cmdLength(void)
+{
+    return CommandLength(cmd.data(), cmd.size());
+}
+
+
+
+int
+COMSIM::CommandLength(const char *cp, int n)
+{
+    static const int blen[3] = { 8, 32, 128 };
+    int len;
+
+    if ((cp == NULL) || (n <= 0)) return 0;
+
+    switch (cp[0])
+    {
+        case 'U':
+        case 'E':
+        case 'd':
+            return 1;
+        case 'V':
+        case 'Q':
+        case 'p':
+        case 'F':
+        case 'O':
+        case 'v':
+            return 2;
+        case 'K':
+        case 'B':
+        case 'Y':
+            return 3;
+        case 'R':
+            return 5;
+        case 'T':
+            return 6;
+        case 'P':
+            return 7;
+        case 'C':
+        case 'D':
+            return 9;
+        case 't':
+            return 10;
+        case 'r':
+        case 'L':
+        case 'e':
+            return 11;
+        case 'c':
+        case 'k':
+            return 13;
+        case 'G':
+            return 15;
+        case 'g':
+            if (n < 2) return 0;
+            return 4 + 4 * (unsigned char)cp[1];
+        case 'A':
+            if (n < 2) return 0;
+            if ((unsigned char)cp[1] > 2) return -1;
+            return 3 + blen[(unsigned char)cp[1]];
+        case 'I':
+            if (n < 10) return 0;
+            if ((cp[9] != 0x08) && (cp[9] != 0x10)) return -1;
+            len = getw(&cp[5]) * getw(&cp[7]) * (cp[9] / 8);
+            // no icon is larger than the screen
+            if (len > 2 * width * height) return -1;
+            return 10 + len;
+        case 's':
+            // strings are terminated; the header is 6, 10 and 13 bytes
+            if ((n > 6) && (!cp[n - 1])) return n;
+            return (n > 7 + SIMMAXSTR) ? -1 : 0;
+        case 'S':
+            if ((n > 10) && (!cp[n - 1])) return n;
+            return (n > 11 + SIMMAXSTR) ? -1 : 0;
+        case 'b':
+            if ((n > 13) && (!cp[n - 1])) return n;
+            return (n > 14 + SIMMAXSTR) ? -1 : 0;
+        default:
+            break;
+    }
+    return -1;
+}
+
+
+
+void
+COMSIM::execute(void)
+{
+    const char *cp = cmd.data();
+    int i, n;
+    int xp[3];
+    int yp[3];
+    bool solid = (pen == 0);
+
+    ++stats.commands;
+    switch (cp[0])
+    {
+        case 'V':
+            resp.push_back(0x00);
+            resp.push_back(0x11);
+            resp.push_back(0x22);
+            resp.push_back(resCode(width));
+            resp.push_back(resCode(height));
+            break;
+        case 'd':
+            resp.push_back(resCode(width));
+            resp.push_back(resCode(height));
+            break;
+        case 'R':
+            n = pixel(getw(&cp[1]), getw(&cp[3]));
+            resp.push_back((n >> 8) & 0xff);
+            resp.push_back(n & 0xff);
+            break;
+        case 'Y':
+            if (cp[1] == 4)
+            {
+                // LANDSCAPE, LANDSCAPE_R, PORTRAIT, PORTRAIT_R
+                static const unsigned char qt[5] = { 0, 0, 2, 1, 3 };
+                if ((cp[2] >= 1) && (cp[2] <= 4)) turns = qt[(int)cp[2]];
+            }
+            break;
+        case 'E':
+            for (i = 0; i < width * height; ++i) plotNative(i % width, i / width, bg);
+            break;
+        case 'B':
+            // the old background color is replaced wherever it is shown
+            n = getw(&cp[1]);
+            for (i = 0; i < width * height; ++i)
+            {
+                if (fb[i] == bg) plotNative(i % width, i / width, n);
+            }
+            bg = n;
+            break;
+        case 'K':
+            bg = getw(&cp[1]);
+            break;
+        case 'p':
+            pen = cp[1];
+            break;
+        case 'A':
+            bitmaps[((unsigned char)cp[1] << 8) | (unsigned char)cp[2]] = cmd.substr(3);
+            break;
+        case 'D':
+            bitmap((unsigned char)cp[1], (unsigned char)cp[2], getw(&cp[3]), getw(&cp[5]),
+                   getw(&cp[7]));
+            break;
+        case 'C':
+            ellipse(getw(&cp[1]), getw(&cp[3]), getw(&cp[5]), getw(&cp[5]), getw(&cp[7]), solid);
+            break;
+        case 'G':
+            for (i = 0; i < 3; ++i)
+            {
+                xp[i] = getw(&cp[1 + 4 * i]);
+                yp[i] = getw(&cp[3 + 4 * i]);
+            }
+            if (solid)
+            {
+                triangle(xp, yp, getw(&cp[13]));
+                break;
+            }
+            for (i = 0; i < 3; ++i)
+                line(xp[i], yp[i], xp[(i + 1) % 3], yp[(i + 1) % 3], getw(&cp[13]));
+            break;
+        case 'I':
+            icon(cp);
+            break;
+        case 'L':
+            line(getw(&cp[1]), getw(&cp[3]), getw(&cp[5]), getw(&cp[7]), getw(&cp[9]));
+            break;
+        case 'g':
+            n = (unsigned char)cp[1];
+            for (i = 0; i < n; ++i)
+            {
+                int j = (i + 1) % n;
+                line(getw(&cp[2 + 4 * i]), getw(&cp[4 + 4 * i]), getw(&cp[2 + 4 * j]),
+                     getw(&cp[4 + 4 * j]), getw(&cp[2 + 4 * n]));
+            }
+            break;
+        case 'r':
+            rect(getw(&cp[1]), getw(&cp[3]), getw(&cp[5]), getw(&cp[7]), getw(&cp[9]), solid);
+            break;
+        case 'e':
+            ellipse(getw(&cp[1]), getw(&cp[3]), getw(&cp[5]), getw(&cp[7]), getw(&cp[9]), solid);
+            break;
+        case 'P':
+            plot(getw(&cp[1]), getw(&cp[3]), getw(&cp[5]));
+            break;
+        case 'c':
+            copy(getw(&cp[1]), getw(&cp[3]), getw(&cp[5]), getw(&cp[7]), getw(&cp[9]),
+                 getw(&cp[11]));
+            break;
+        case 'k':
+            replace(getw(&cp[1]), getw(&cp[3]), getw(&cp[5]), getw(&cp[7]), getw(&cp[9]),
+                    getw(&cp[11]));
+            break;
+        case 'T':
+        case 't':
+        case 's':
+        case 'S':
+        case 'b':
+            ++stats.undrawn;
+            break;
+        default:
+            break;
+    }
+
+    // Version, the resolution query and ReadPixel answer with data instead
+    if ((cp[0] != 'V') && (cp[0] != 'd') && (cp[0] != 'R')) resp.push_back(ACK);
+
+    if (shm)
+    {
+        char count[16];
+        snprintf(count, sizeof(count), "%010lu", stats.commands % 1000000000UL);
+        memcpy(shm + sizeof(SHMCOUNT) - 1, count, 10);
+    }
+    snapshotDue();
+    return;
+}
+
+
+
+void
+COMSIM::plotNative(int x, int y, unsigned short color)
+{
+    if ((x < 0) || (x >= width) || (y < 0) || (y >= height)) return;
+    fb[y * width + x] = color;
+    ++stats.pixels;
+    if (shm) toRGB(color, shm + shmhdr + 3 * (y * width + x));
+    return;
+}
+
+
+
+void
+COMSIM::plot(int x, int y, unsigned short color)
+{
+    switch (turns)
+    {
+        case 1:
+            plotNative(width - 1 - y, x, color);
+            break;
+        case 2:
+            plotNative(width - 1 - x, height - 1 - y, color);
+            break;
+        case 3:
+            plotNative(y, height - 1 - x, color);
+            break;
+        default:
+            plotNative(x, y, color);
+            break;
+    }
+    return;
+}
+
+
+
+unsigned short
+COMSIM::pixel(int x, int y)
+{
+    int nx = x, ny = y;
+    switch (turns)
+    {
+        case 1:
+            nx = width - 1 - y;
+            ny = x;
+            break;
+        case 2:
+            nx = width - 1 - x;
+            ny = height - 1 - y;
+            break;
+        case 3:
+            nx = y;
+            ny = height - 1 - x;
+            break;
+        default:
+            break;
+    }
+    if ((nx < 0) || (nx >= width) || (ny < 0) || (ny >= height)) return 0;
+    return fb[ny * width + nx];
+}
+
+
+
+void
+COMSIM::hline(int x1, int x2, int y, unsigned short color)
+{
+    for (int x = x1; x <= x2; ++x) plot(x, y, color);
+    return;
+}
+
+
+
+void
+COMSIM::line(int x1, int y1, int x2, int y2, unsigned short color)
+{
+    int dx = abs(x2 - x1);
+    int dy = -abs(y2 - y1);
+    int sx = (x1 < x2) ? 1 : -1;
+    int sy = (y1 < y2) ? 1 : -1;
+    int err = dx + dy;
+    while (true)
+    {
+        plot(x1, y1, color);
+        if ((x1 == x2) && (y1 == y2)) break;
+        int e2 = 2 * err;
+        if (e2 >= dy)
+        {
+            err += dy;
+            x1 += sx;
+        }
+        if (e2 <= dx)
+        {
+            err += dx;
+            y1 += sy;
+        }
+    }
+    return;
+}
+
+
+
+void
+COMSIM::rect(int x1, int y1, int x2, int y2, unsigned short color, bool solid)
+{
+    int t;
+    if (x2 < x1)
+    {
+        t = x1;
+        x1 = x2;
+        x2 = t;
+    }
+    if (y2 < y1)
+    {
+        t = y1;
+        y1 = y2;
+        y2 = t;
+    }
+    if (solid)
+    {
+        for (t = y1; t <= y2; ++t) hline(x1, x2, t, color);
+        return;
+    }
+    hline(x1, x2, y1, color);
+    hline(x1, x2, y2, color);
+    for (t = y1 + 1; t < y2; ++t)
+    {
+        plot(x1, t, color);
+        plot(x2, t, color);
+    }
+    return;
+}
+
+
+
+void
+COMSIM::ellipse(int xc, int yc, int rx, int ry, unsigned short color, bool solid)
+{
+    int dx, dy;
+    if ((!rx) || (!ry))
+    {
+        line(xc - rx, yc - ry, xc + rx, yc + ry, color);
+        return;
+    }
+
+    // the half width of each row; the outline also takes the half
+    // height of each column so that it has no gaps
+    for (dy = -ry; dy <= ry; ++dy)
+    {
+        dx = (int)floor(rx * sqrt(1.0 - (double)dy * dy / ((double)ry * ry)) + 0.5);
+        if (solid)
+        {
+            hline(xc - dx, xc + dx, yc + dy, color);
+        }
+        else
+        {
+            plot(xc - dx, yc + dy, color);
+            plot(xc + dx, yc + dy, color);
+        }
+    }
+    if (solid) return;
+
+    for (dx = -rx; dx <= rx; ++dx)
+    {
+        dy = (int)floor(ry * sqrt(1.0 - (double)dx * dx / ((double)rx * rx)) + 0.5);
+        plot(xc + dx, yc - dy, color);
+        plot(xc + dx, yc + dy, color);
+    }
+    return;
+}
+
+
+
+void
+COMSIM::triangle(const int *xp, const int *yp, unsigned short color)
+{
+    int x1 = xp[0], x2 = xp[0], y1 = yp[0], y2 = yp[0];
+    int i, x, y;
+    for (i = 1; i < 3; ++i)
+    {
+        if (xp[i] < x1) x1 = xp[i];
+        if (xp[i] > x2) x2 = xp[i];
+        if (yp[i] < y1) y1 = yp[i];
+        if (yp[i] > y2) y2 = yp[i];
+    }
+
+    // a pixel is inside if it is on the same side of every edge,
+    // whichever way round the vertices are given
+    long e[3];
+    for (y = y1; y <= y2; ++y)
+    {
+        for (x = x1; x <= x2; ++x)
+        {
+            for (i = 0; i < 3; ++i)
+            {
+                int j = (i + 1) % 3;
+                e[i] = (long)(xp[j] - xp[i]) * (y - yp[i]) - (long)(yp[j] - yp[i]) * (x - xp[i]);
+            }
+            if (((e[0] >= 0) && (e[1] >= 0) && (e[2] >= 0))
+                || ((e[0] <= 0) && (e[1] <= 0) && (e[2] <= 0)))
+                plot(x, y, color);
+        }
+    }
+    return;
+}
+
+
+
+void
+COMSIM::icon(const char *data)
+{
+    int x0 = getw(&data[1]);
+    int y0 = getw(&data[3]);
+    int w = getw(&data[5]);
+    int h = getw(&data[7]);
+    bool wide = (data[9] == 0x10);
+    const unsigned char *p = (const unsigned char *)&data[10];
+    int x, y;
+    unsigned short c;
+
+    for (y = 0; y < h; ++y)
+    {
+        for (x = 0; x < w; ++x)
+        {
+            if (wide)
+            {
+                c = (p[0] << 8) | p[1];
+                p += 2;
+            }
+            else
+            {
+                // RRRGGGBB
+                int r = (*p >> 5) & 0x07;
+                int g = (*p >> 2) & 0x07;
+                int b = *p & 0x03;
+                c = (((r << 2) | (r >> 1)) << 11) | (((g << 3) | g) << 5)
+                    | ((b << 3) | (b << 1) | (b >> 1));
+                ++p;
+            }
+            plotNative(x0 + x, y0 + y, c);
+        }
+    }
+    return;
+}
+
+
+
+void
+COMSIM::bitmap(int group, int index, int x, int y, unsigned short color)
+{
+    std::map<int, std::string>::const_iterator it = bitmaps.find((group << 8) | index);
+    if (it == bitmaps.end()) return;
+
+    int size = 8 << group;
+    const unsigned char *p = (const unsigned char *)it->second.data();
+    int i, j;
+    for (j = 0; j < size; ++j)
+    {
+        for (i = 0; i < size; ++i)
+        {
+            if (p[(j * size + i) / 8] & (0x80 >> (i % 8))) plot(x + i, y + j, color);
+        }
+    }
+    return;
+}
+
+
+
+void
+COMSIM::copy(int xs, int ys, int xd, int yd, int w, int h)
+{
+    if ((w < 1) || (h < 1)) return;
+
+    // the source is read in full first in case the areas overlap
+    unsigned short *tmp = new unsigned short[w * h];
+    int x, y;
+    for (y = 0; y < h; ++y)
+        for (x = 0; x < w; ++x)
+            tmp[y * w + x] = pixel(xs + x, ys + y);
+    for (y = 0; y < h; ++y)
+        for (x = 0; x < w; ++x)
+            plot(xd + x, yd + y, tmp[y * w + x]);
+    delete [] tmp;
+    return;
+}
+
+
+
+void
+COMSIM::replace(int x1, int y1, int x2, int y2, unsigned short from, unsigned short to)
+{
+    int x, y;
+    for (y = y1; y <= y2; ++y)
+    {
+        for (x = x1; x <= x2; ++x)
+        {
+            if (pixel(x, y) == from) plot(x, y, to);
+        }
+    }
+    return;
+}
+
+
+
+int
+COMSIM::GetImage(SIMIMAGE *image)
+{
+    if (!image)
+    {
+        ERRMSG("invalid image (NULL)");
+        return -1;
+    }
+    if (image->Set(fb, width, height))
+    {
+        ERRMSG("failed; see message below\n%s", image->GetError());
+        return -1;
+    }
+    return 0;
+}
+
+
+
+int
+COMSIM::Snapshot(const char *filename)
+{
+    SIMIMAGE img;
+    if (GetImage(&img)) return -1;
+    if (img.Save(filename))
+    {
+        ERRMSG("failed; see message below\n%s", img.GetError());
+        return -1;
+    }
+    ++stats.snapshots;
+    return 0;
+}
+
+
+
+int
+COMSIM::SetSnapshots(const char *pattern, unsigned int ncmds, unsigned int msec)
+{
+    this->pattern[0] = 0;
+    if (!pattern) return 0;
+    if ((!ncmds) && (!msec))
+    {
+        ERRMSG("neither an interval nor a number of commands was given");
+        return -1;
+    }
+    snprintf(this->pattern, MAX_PATH, "%s", pattern);
+    snapcmds = ncmds;
+    snapmsec = msec;
+    seq = 0;
+    lastcmds = stats.commands;
+    lastsnap = monoUsec();
+    return 0;
+}
+
+
+
+void
+COMSIM::snapshotDue(void)
+{
+    if (!pattern[0]) return;
+
+    unsigned long long now = 0;
+    bool due = (snapcmds) && (stats.commands - lastcmds >= snapcmds);
+    if ((!due) && (snapmsec))
+    {
+        now = monoUsec();
+        due = (now - lastsnap >= snapmsec * 1000ULL);
+    }
+    if (!due) return;
+
+    char name[MAX_PATH];
+    snprintf(name, MAX_PATH, pattern, seq++);
+    // a failure is left in the error message; the display carries on
+    Snapshot(name);
+    lastcmds = stats.commands;
+    lastsnap = (now) ? now : monoUsec();
+    return;
+}
+
+
+
+int
+COMSIM::SetSharedImage(const char *filename)
+{
+    closeShared();
+    if (!filename) return 0;
+
+    char hdr[64];
+    shmhdr = snprintf(hdr, sizeof(hdr), "%s%010lu\n%d %d\n255\n", SHMCOUNT,
+                      stats.commands % 1000000000UL, width, height);
+    size_t len = shmhdr + 3 * (size_t)width * height;
+
+    shmfd = ::open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (shmfd < 0)
+    {
+        ERRMSG("could not create '%s': %s", filename, strerror(errno));
+        return -1;
+    }
+    if (ftruncate(shmfd, len))
+    {
+        ERRMSG("could not size '%s': %s", filename, strerror(errno));
+        closeShared();
+        return -1;
+    }
+    void *mp = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, shmfd, 0);
+    if (mp == MAP_FAILED)
+    {
+        ERRMSG("could not map '%s': %s", filename, strerror(errno));
+        closeShared();
+        return -1;
+    }
+    shm = (unsigned char *)mp;
+    shmlen = len;
+    memcpy(shm, hdr, shmhdr);
+    for (int i = 0; i < width * height; ++i) toRGB(fb[i], shm + shmhdr + 3 * i);
+    return 0;
+}
+
+
+
+void
+COMSIM::closeShared(void)
+{
+    if (shm) munmap(shm, shmlen);
+    if (shmfd >= 0) close(shmfd);
+    shm = NULL;
+    shmlen = 0;
+    shmhdr = 0;
+    shmfd = -1;
+    return;
+}
@@ -0,0 +1,278 @@
+/**
+    file: comsim.h
+
+    Simulated PICASO SGC display: a port which executes the commands
+    written to it on a framebuffer and answers at once, and the images
+    used to compare what was drawn.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+
+*/
+
+/*
+    Notes:
+        + COMSIM is used with PGD::SetTransport(); the port name passed
+          to Open() is only recorded.  Each command is executed as soon
+          as its last byte is written and the response is available to
+          Read() immediately, so a workload runs as fast as the host can
+          produce it.  SetBaud() only records the rate.
+        + Executed: autobaud, Version, the resolution query, SetBaud,
+          Ctl, Clear, ReplaceBackground, SetBackground, PenSize, SetFont,
+          SetOpacity, AddBitmap, DrawBitmap, Circle, Triangle, DrawIcon,
+          Line, Polygon, Rectangle, Ellipse, WritePixel, ReadPixel,
+          CopyPaste and ReplaceColor.  The text commands and SetVolume
+          are acknowledged but draw nothing (see SIMSTATS::undrawn);
+          anything else is NACKed and its first byte discarded.
+        + Coordinates are taken in the orientation set with Ctl(4, n)
+          except for DrawIcon, which the controller draws in its native
+          orientation.  Shapes are drawn with the usual integer
+          algorithms; they need not match the controller pixel for pixel
+          but the same commands always give the same pixels.
+        + Snapshots are binary PPM (P6) files of the screen in the native
+          orientation.  SetSnapshots() writes one whenever a given number
+          of commands or msec has passed since the last one; the file
+          name is formed with printf() from a pattern and a sequence
+          number.
+        + SetSharedImage() maps a PPM file (e.g. in /dev/shm) which is
+          updated as each pixel is drawn, so that another program can
+          view the screen while it is drawn.  The header holds a comment
+          "# commands nnnnnnnnnn" with the number of commands executed,
+          which a viewer may poll; the header length never changes.
+        + SIMIMAGE::Compare() counts the pixels which differ by more than
+          a tolerance in any channel and can produce a map of them.
+ */
+
+#ifndef __COMSIM_H__
+#define __COMSIM_H__
+
+#include <map>
+#include <string>
+
+#include "comport.h"
+
+namespace com {
+
+// default size of the simulated screen
+#define SIMWIDTH (128)
+#define SIMHEIGHT (128)
+
+    /// Counters of a COMSIM
+    struct SIMSTATS
+    {
+        unsigned long commands;     // commands executed
+        unsigned long bytes;        // bytes written by the host
+        unsigned long nacked;       // bytes rejected as unknown commands
+        unsigned long undrawn;      // commands acknowledged but not drawn
+        unsigned long pixels;       // pixels written
+        unsigned long snapshots;    // snapshot files written
+        SIMSTATS()
+        {
+            commands = 0;
+            bytes = 0;
+            nacked = 0;
+            undrawn = 0;
+            pixels = 0;
+            snapshots = 0;
+        }
+    };
+
+    /// Result of SIMIMAGE::Compare()
+    struct SIMDIFF
+    {
+        long pixels;                // pixels compared
+        long differ;                // pixels which differ
+        int x1;                     // bounds of the differing pixels; x2 < x1 if none
+        int y1;
+        int x2;
+        int y2;
+        int maxdelta;               // largest difference in any channel
+        SIMDIFF()
+        {
+            pixels = 0;
+            differ = 0;
+            x1 = y1 = 0;
+            x2 = y2 = -1;
+            maxdelta = 0;
+        }
+    };
+
+    /// An RGB image as read from or written to a PPM file
+    class SIMIMAGE
+    {
+    private:
+        unsigned char *rgb;
+        int width;
+        int height;
+        char errmsg[ERRLEN];
+        SIMIMAGE(const SIMIMAGE &);
+        SIMIMAGE &operator=(const SIMIMAGE &);
+
+    public:
+        SIMIMAGE();
+        ~SIMIMAGE();
+
+        /// Size the image; the pixels are black
+        /// @return 0 for success, -1 for failure
+        int Create(int width, int height);
+        /// Convert a framebuffer of 16-bit (5-6-5) pixels, row by row
+        /// @return 0 for success, -1 for failure
+        int Set(const unsigned short *pixels, int width, int height);
+        /// Read a binary PPM (P6) file with a maximum value of 255
+        /// @return 0 for success, -1 for failure
+        int Load(const char *filename);
+        /// Write the image as a binary PPM file
+        /// @return 0 for success, -1 for failure
+        int Save(const char *filename);
+
+        /// Compare with <other>; pixels which differ by more than <tolerance>
+        /// in any channel are counted and, if <map> is not NULL, drawn in red
+        /// on a dimmed copy of this image.
+        /// @return the number of differing pixels or -1 if the sizes differ
+        long Compare(const SIMIMAGE &other, SIMDIFF *diff = NULL, int tolerance = 0,
+                     SIMIMAGE *map = NULL);
+
+        int GetWidth(void) const { return width; }
+        int GetHeight(void) const { return height; }
+        const unsigned char *GetData(void) const { return rgb; }
+        const char *GetError(void) { return errmsg; }
+    };  // class SIMIMAGE
+
+    class COMSIM : public COMMIF
+    {
+    private:
+        unsigned short *fb;         // native orientation, row by row
+        int     width;
+        int     height;
+        std::string cmd;            // command being received
+        std::string resp;           // responses not yet read
+        unsigned short bg;
+        unsigned char pen;
+        unsigned char turns;        // quarter turns of the orientation from the native one
+        std::map<int, std::string> bitmaps;     // AddBitmap() data by group and index
+        // periodic snapshots
+        char    pattern[MAX_PATH];
+        unsigned int snapcmds;
+        unsigned int snapmsec;
+        unsigned long lastcmds;     // commands at the last snapshot
+        unsigned long long lastsnap;    // usec at the last snapshot
+        unsigned int seq;
+        // shared image
+        int     shmfd;
+        unsigned char *shm;
+        size_t  shmlen;
+        size_t  shmhdr;             // length of the PPM header
+        bool    open;
+        struct  COMPARAMS params;
+        char    portname[MAX_PATH];
+        char    errmsg[ERRLEN];
+        SIMSTATS stats;
+
+        // length of the command in <cmd>; 0 if more bytes are needed, -1 if unknown
+        int  cmdLength(void);
+        // execute the command in <cmd>
+        void execute(void);
+        void reset(void);
+        // draw in the native orientation / the current orientation
+        void plotNative(int x, int y, unsigned short color);
+        void plot(int x, int y, unsigned short color);
+        unsigned short pixel(int x, int y);
+        void hline(int x1, int x2, int y, unsigned short color);
+        void line(int x1, int y1, int x2, int y2, unsigned short color);
+        void rect(int x1, int y1, int x2, int y2, unsigned short color, bool solid);
+        void ellipse(int xc, int yc, int rx, int ry, unsigned short color, bool solid);
+        void triangle(const int *xp, const int *yp, unsigned short color);
+        void icon(const char *data);
+        void bitmap(int group, int index, int x, int y, unsigned short color);
+        void copy(int xs, int ys, int xd, int yd, int w, int h);
+        void replace(int x1, int y1, int x2, int y2, unsigned short from, unsigned short to);
+        void snapshotDue(void);
+        void closeShared(void);
+        COMSIM(const COMSIM &);
+        COMSIM &operator=(const COMSIM &);
+
+    public:
+        COMSIM();
+        ~COMSIM();
+
+        /// Set the screen size in the native orientation; not while open.
+        /// The size must be one which Version() can report (64, 96, 128,
+        /// 160, 176, 220, 240 or 320).
+        /// @return 0 for success, -1 for failure
+        int SetSize(int width, int height);
+
+        /// Power up the simulated display: the screen is black
+        int Open(const char *portname, const COMPARAMS *params = NULL,
+                const char *lockid = NULL);
+        /// Power up the display again
+        int Reopen(const char *lockid = NULL);
+        int Close(const char *lockid = NULL);
+        /// Discard the responses which have not been read
+        int Flush(const char *lockid = NULL);
+        int Drain(const char * /*lockid*/ = NULL) { return open ? 0 : -1; }
+        /// @return 1 if a response is waiting, otherwise 0; -1 for fault
+        int Select(unsigned int duration);
+        /// Only records the rate
+        int SetBaud(speed_t speed, int timeout = 0, const char* lockid = NULL);
+        /// Return the responses waiting; never waits
+        int Read(char *data, int len, int timeout = 0,
+                char delim = 0, const char *lockid = NULL);
+        /// Execute the commands completed by <data>
+        /// @return <len> or -1 for fault
+        int Write(const char* data, int len, int timeout = 0,
+                const char* lockid = NULL);
+        int WriteRead(const char* dataout, int lenout, char* datain,
+                    int lenin, int timeout, char delim = 0,
+                    const char* lockid = NULL);
+
+        inline int Lock(const char* /*lockid*/ = NULL, int /*timeout*/ = 0) { return 0; }
+        inline int Unlock(const char* /*lockid*/ = NULL) { return 0; }
+
+        const char *GetError(void) { return errmsg; }
+        void ClearError(void) { errmsg[0] = 0; }
+        const char *GetPortName(void) { return portname; }
+        bool IsOpen(void) { return open; }
+
+        /// Length of the command which starts with the <n> bytes at <cmd>
+        /// @return the length, 0 if more bytes are needed, -1 if unknown
+        int CommandLength(const char *cmd, int n);
+
+        /// Write the screen to <filename> as a PPM file
+        /// @return 0 for success, -1 for failure
+        int Snapshot(const char *filename);
+        /// Write a snapshot to the file named by printf(<pattern>, seq) after
+        /// every <ncmds> commands and every <msec> msec (0 = never); a NULL
+        /// pattern stops the snapshots
+        /// @return 0 for success, -1 for failure
+        int SetSnapshots(const char *pattern, unsigned int ncmds, unsigned int msec = 0);
+        /// Keep the screen in the mapped PPM file <filename>; NULL stops
+        /// @return 0 for success, -1 for failure
+        int SetSharedImage(const char *filename);
+        /// Copy the screen into <image>
+        /// @return 0 for success, -1 for failure
+        int GetImage(SIMIMAGE *image);
+
+        const unsigned short *GetFrame(void) { return fb; }
+        int GetWidth(void) { return width; }
+        int GetHeight(void) { return height; }
+        const SIMSTATS &GetStats(void) { return stats; }
+        void ResetStats(void) { stats = SIMSTATS(); lastcmds = 0; }
+    };  // class COMSIM
+
+}; // namespace com
+
+#endif
@@ -0,0 +1,722 @@
+/*
+    file: comtcp.cpp
+
+    Serial port reached through a TCP serial device server.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+*/
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+
+#include "comtcp.h"
+
+using namespace com;
+
+#define ERRMSG(fmt, args...) snprintf(errmsg, ERRLEN, "%s:%d: %s(): " fmt,\
+    __FILE__, __LINE__, __FUNCTION__,##args)
+
+// telnet (RFC 854) and COM-PORT-OPTION (RFC 2217) codes
+#define IAC     (255)
+#define DONT    (254)
+#define DO      (253)
+#define WONT    (252)
+#define WILL    (251)
+#define SB      (250)
+#define SE      (240)
+#define TO_BINARY   (0)
+#define TO_SGA      (3)
+#define TO_COMPORT  (44)
+#define CP_SET_BAUDRATE (1)
+#define CP_SET_DATASIZE (2)
+#define CP_SET_PARITY   (3)
+#define CP_SET_STOPSIZE (4)
+#define CP_SET_CONTROL  (5)
+// the server answers a command with the command + 100
+#define CP_SERVER       (100)
+
+// telnet parser states
+enum TSTATE {
+    TS_DATA = 0,
+    TS_IAC,
+    TS_OPT,
+    TS_SB,
+    TS_SBIAC
+};
+
+
+// numerical rate of a termios speed; 0 if unknown
+static unsigned long baudValue(speed_t speed)
+{
+    static const struct { speed_t code; unsigned long rate; } RATES[] = {
+        { B1200, 1200 }, { B2400, 2400 }, { B4800, 4800 }, { B9600, 9600 },
+        { B19200, 19200 }, { B38400, 38400 }, { B57600, 57600 },
+        { B115200, 115200 }, { B230400, 230400 }, { B460800, 460800 },
+        { B921600, 921600 }
+    };
+    unsigned int i;
+    for (i = 0; i < sizeof(RATES) / sizeof(RATES[0]); ++i)
+        if (RATES[i].code == speed) return RATES[i].rate;
+    return 0;
+}
+
+
+COMTCP::COMTCP(bool rfc2217)
+{
+    sock = -1;
+    this->rfc2217 = rfc2217;
+    portname[0] = 0;
+    errmsg[0] = 0;
+    olen = 0;
+    ihead = 0;
+    itail = 0;
+    tstate = TS_DATA;
+    tverb = 0;
+    sblen = 0;
+    srvbaud = 0;
+    baudreq = 0;
+}
+
+
+
+COMTCP::~COMTCP()
+{
+    if (sock >= 0) Close();
+}
+
+
+
+int
+COMTCP::Open(const char *portname, const COMPARAMS *params, const char * /*lockid*/)
+{
+    if (portname == NULL)
+    {
+        ERRMSG("invalid port name (NULL)");
+        return -1;
+    }
+
+    COMPARAMS lparams;
+    if (params) lparams = *params;
+
+    // split "host:port" or "[addr]:port"
+    char host[MAX_PATH];
+    snprintf(host, MAX_PATH, "%s", portname);
+    char *service = strrchr(host, ':');
+    if ((!service) || (!service[1]) || (service == host))
+    {
+        ERRMSG("invalid address '%s' (expecting host:port)", portname);
+        return -1;
+    }
+    *service++ = 0;
+    char *hp = host;
+    if ((hp[0] == '[') && (hp[strlen(hp) - 1] == ']'))
+    {
+        hp[strlen(hp) - 1] = 0;
+        ++hp;
+    }
+
+    if (sock >= 0) Close();
+
+    struct addrinfo hints;
+    struct addrinfo *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int err = getaddrinfo(hp, service, &hints, &res);
+    if (err)
+    {
+        ERRMSG("could not resolve '%s': %s", portname, gai_strerror(err));
+        return -1;
+    }
+
+    // try each address in turn with a bounded wait for the connection
+    struct addrinfo *ap;
+    errno = 0;
+    for (ap = res; ap; ap = ap->ai_next)
+    {
+        sock = socket(ap->ai_family, ap->ai_socktype, ap->ai_protocol);
+        if (sock < 0) continue;
+
+        int flags = fcntl(sock, F_GETFL);
+        fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+        if ((connect(sock, ap->ai_addr, ap->ai_addrlen) == 0) || (errno == EINPROGRESS))
+        {
+            struct pollfd pfd;
+            pfd.fd = sock;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+            int soerr = ETIMEDOUT;
+            socklen_t sl = sizeof(soerr);
+            if (poll(&pfd, 1, COMTCPCONNTIMEOUT) == 1)
+                getsockopt(sock, SOL_SOCKET, SO_ERROR, &soerr, &sl);
+            if (!soerr)
+            {
+                fcntl(sock, F_SETFL, flags);
+                break;
+            }
+            errno = soerr;
+        }
+        close(sock);
+        sock = -1;
+    }
+    freeaddrinfo(res);
+
+    if (sock < 0)
+    {
+        ERRMSG("could not connect to '%s': %s", portname, strerror(errno));
+        return -1;
+    }
+
+    // commands are small and each one waits for a reply
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    snprintf(this->portname, MAX_PATH, "%s", portname);
+    this->params = lparams;
+    olen = 0;
+    ihead = itail = 0;
+    tstate = TS_DATA;
+    sblen = 0;
+    srvbaud = 0;
+    baudreq = 0;
+
+    if (!rfc2217) return 0;
+
+    static const unsigned char NEG[] = {
+        IAC, WILL, TO_COMPORT, IAC, WILL, TO_BINARY, IAC, DO, TO_BINARY,
+        IAC, WILL, TO_SGA, IAC, DO, TO_SGA
+    };
+    err = queueRaw(NEG, sizeof(NEG));
+    if (!err) err = SetBaud(lparams.speed);
+    if (!err) err = queueOption(CP_SET_DATASIZE, lparams.data, 1);
+    if (!err) err = queueOption(CP_SET_PARITY, lparams.parity ? (lparams.odd ? 2 : 3) : 1, 1);
+    if (!err) err = queueOption(CP_SET_STOPSIZE, (lparams.stop == 2) ? 2 : 1, 1);
+    // no flow control: the displays use a three-wire interface
+    if (!err) err = queueOption(CP_SET_CONTROL, 1, 1);
+    if (!err) err = sendOut();
+    if (err)
+    {
+        char tmpmsg[ERRLEN];
+        snprintf(tmpmsg, ERRLEN, "%s", errmsg);
+        Close();
+        ERRMSG("could not set up the port on '%s'\n%s", portname, tmpmsg);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+
+int
+COMTCP::Reopen(const char * /*lockid*/)
+{
+    char name[MAX_PATH];
+    snprintf(name, MAX_PATH, "%s", portname);
+    COMPARAMS p = params;
+    if (Open(name, &p))
+    {
+        char tmpmsg[ERRLEN];
+        snprintf(tmpmsg, ERRLEN, "%s", errmsg);
+        ERRMSG("failed:\n%s", tmpmsg);
+        return -1;
+    }
+    return 0;
+}
+
+
+
+int
+COMTCP::Close(const char * /*lockid*/)
+{
+    if (sock < 0) return -1;
+    sendOut();
+    close(sock);
+    sock = -1;
+    olen = 0;
+    ihead = itail = 0;
+    return 0;
+}
+
+
+
+int
+COMTCP::sendOut(void)
+{
+    if (sock < 0)
+    {
+        ERRMSG("port not open");
+        return -1;
+    }
+
+    int n = 0;
+    ssize_t nb;
+    while (n < olen)
+    {
+        nb = send(sock, &obuf[n], olen - n, MSG_NOSIGNAL);
+        if (nb < 0)
+        {
+            if (errno == EINTR) continue;
+            ERRMSG("send failed after %d of %d bytes: %s", n, olen, strerror(errno));
+            olen = 0;
+            return -1;
+        }
+        ++stats.segments;
+        stats.bytes += nb;
+        n += nb;
+    }
+    olen = 0;
+    return 0;
+}
+
+
+
+int
+COMTCP::queueRaw(const unsigned char *data, int len)
+{
+    if ((olen + len > (int)sizeof(obuf)) && sendOut()) return -1;
+    memcpy(&obuf[olen], data, len);
+    olen += len;
+    return 0;
+}
+
+
+
+int
+COMTCP::queueOption(unsigned char cmd, unsigned long value, int nb)
+{
+    unsigned char msg[16];
+    int n = 0;
+    int i;
+    msg[n++] = IAC;
+    msg[n++] = SB;
+    msg[n++] = TO_COMPORT;
+    msg[n++] = cmd;
+    for (i = nb - 1; i >= 0; --i)
+    {
+        msg[n] = (value >> (8 * i)) & 0xff;
+        if (msg[n++] == IAC) msg[n++] = IAC;
+    }
+    msg[n++] = IAC;
+    msg[n++] = SE;
+    return queueRaw(msg, n);
+}
+
+
+
+int
+COMTCP::SetBaud(speed_t speed, int timeout, const char * /*lockid*/)
+{
+    if (sock < 0)
+    {
+        ERRMSG("port not open");
+        return -1;
+    }
+
+    params.speed = speed;
+    if (!rfc2217) return 0;
+
+    unsigned long rate = baudValue(speed);
+    if (!rate)
+    {
+        ERRMSG("unsupported speed code: %u", (unsigned int)speed);
+        return -1;
+    }
+
+    // the request travels in order with the data
+    if (queueOption(CP_SET_BAUDRATE, rate, 4)) return -1;
+    ++baudreq;
+    if (timeout <= 0) return 0;
+
+    if (sendOut()) return -1;
+    struct timeval tov, now;
+    gettimeofday(&tov, NULL);
+    tov.tv_sec += timeout / 1000;
+    tov.tv_usec += (timeout % 1000) * 1000;
+    if (tov.tv_usec >= 1000000)
+    {
+        tov.tv_sec += 1;
+        tov.tv_usec -= 1000000;
+    }
+    // earlier requests are confirmed first
+    while (baudreq > 0)
+    {
+        gettimeofday(&now, NULL);
+        int left = (tov.tv_sec - now.tv_sec) * 1000 + (tov.tv_usec - now.tv_usec) / 1000;
+        if (left <= 0)
+        {
+            ERRMSG("no reply from the server to the rate change");
+            return -1;
+        }
+        if (fill(left) < 0) return -1;
+    }
+    if (srvbaud != rate)
+    {
+        ERRMSG("the server set %lu bps instead of %lu", srvbaud, rate);
+        return -1;
+    }
+    return 0;
+}
+
+
+
+void
+COMTCP::negotiate(unsigned char verb, unsigned char opt)
+{
+    // only the options requested in Open() are accepted
+    bool ours = (opt == TO_BINARY) || (opt == TO_SGA) || ((opt == TO_COMPORT) && (verb == DO));
+    if (ours) return;
+
+    unsigned char msg[3];
+    msg[0] = IAC;
+    msg[2] = opt;
+    if (verb == DO)
+        msg[1] = WONT;
+    else if (verb == WILL)
+        msg[1] = DONT;
+    else
+        return;
+    queueRaw(msg, 3);
+    return;
+}
+
+
+
+void
+COMTCP::decode(const unsigned char *data, int len)
+{
+    int i;
+    unsigned char c;
+    for (i = 0; i < len; ++i)
+    {
+        c = data[i];
+        switch (tstate)
+        {
+            case TS_DATA:
+                if ((rfc2217) && (c == IAC))
+                    tstate = TS_IAC;
+                else
+                    ibuf[itail++] = c;
+                break;
+            case TS_IAC:
+                if (c == IAC)
+                {
+                    ibuf[itail++] = c;
+                    tstate = TS_DATA;
+                }
+                else if ((c >= WILL) && (c <= DONT))
+                {
+                    tverb = c;
+                    tstate = TS_OPT;
+                }
+                else if (c == SB)
+                {
+                    sblen = 0;
+                    tstate = TS_SB;
+                }
+                else
+                {
+                    tstate = TS_DATA;
+                }
+                break;
+            case TS_OPT:
+                negotiate(tverb, c);
+                tstate = TS_DATA;
+                break;
+            case TS_SB:
+                if (c == IAC)
+                    tstate = TS_SBIAC;
+                else if (sblen < (int)sizeof(sbbuf))
+                    sbbuf[sblen++] = c;
+                break;
+            case TS_SBIAC:
+                if (c == IAC)
+                {
+                    if (sblen < (int)sizeof(sbbuf)) sbbuf[sblen++] = c;
+                    tstate = TS_SB;
+                    break;
+                }
+                // the server confirms a rate change with the rate it set
+                if ((c == SE) && (sblen >= 6) && (sbbuf[0] == TO_COMPORT)
+                    && (sbbuf[1] == CP_SERVER + CP_SET_BAUDRATE))
+                {
+                    srvbaud = ((unsigned long)sbbuf[2] << 24) | (sbbuf[3] << 16)
+                        | (sbbuf[4] << 8) | sbbuf[5];
+                    if (baudreq > 0) --baudreq;
+                }
+                tstate = TS_DATA;
+                break;
+            default:
+                tstate = TS_DATA;
+                break;
+        }
+    }
+    return;
+}
+
+
+
+int
+COMTCP::fill(int timeout)
+{
+    if (ihead == itail) ihead = itail = 0;
+    if ((ihead) && (itail == COMTCPBUFLEN))
+    {
+        memmove(ibuf, &ibuf[ihead], itail - ihead);
+        itail -= ihead;
+        ihead = 0;
+    }
+    int room = COMTCPBUFLEN - itail;
+    if (!room) return 0;
+
+    struct pollfd pfd;
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int res = poll(&pfd, 1, (timeout > 0) ? timeout : 0);
+    if (res < 0)
+    {
+        if (errno == EINTR) return 0;
+        ERRMSG("poll failed: %s", strerror(errno));
+        return -1;
+    }
+    if (!res) return 0;
+
+    unsigned char raw[COMTCPBUFLEN];
+    ssize_t nb = recv(sock, raw, room, MSG_DONTWAIT);
+    if (nb < 0)
+    {
+        if ((errno == EAGAIN) || (errno == EINTR)) return 0;
+        ERRMSG("recv failed: %s", strerror(errno));
+        return -1;
+    }
+    if (nb == 0)
+    {
+        ERRMSG("connection closed by '%s'", portname);
+        return -1;
+    }
+
+    decode(raw, nb);
+    // replies to the server's negotiation go out at once
+    if ((olen) && rfc2217 && sendOut()) return -1;
+    return nb;
+}
+
+
+
+int
+COMTCP::Flush(const char * /*lockid*/)
+{
+    if (sock < 0) return -1;
+    if (sendOut()) return -1;
+
+    // keep the telnet state but drop the data
+    int res;
+    do
+    {
+        ihead = itail = 0;
+        res = fill(0);
+    } while (res > 0);
+    ihead = itail = 0;
+    return (res < 0) ? -1 : 0;
+}
+
+
+
+int
+COMTCP::Drain(const char * /*lockid*/)
+{
+    if (sock < 0) return -1;
+    return sendOut();
+}
+
+
+
+int
+COMTCP::Select(unsigned int duration)
+{
+    if (sock < 0) return 0;
+    if (olen && sendOut()) return -1;
+    if (ihead < itail) return 1;
+
+    struct timeval tov, now;
+    gettimeofday(&tov, NULL);
+    tov.tv_sec += duration / 1000;
+    tov.tv_usec += (duration % 1000) * 1000;
+    if (tov.tv_usec >= 1000000)
+    {
+        tov.tv_sec += 1;
+        tov.tv_usec -= 1000000;
+    }
+
+    int wait = (int)duration;
+    while (true)
+    {
+        if (fill(wait) < 0) return -1;
+        if (ihead < itail) return 1;
+        // only telnet commands arrived
+        gettimeofday(&now, NULL);
+        wait = (tov.tv_sec - now.tv_sec) * 1000 + (tov.tv_usec - now.tv_usec) / 1000;
+        if (wait <= 0) return 0;
+    }
+}
+
+
+
+int
+COMTCP::Read(char *data, int len, int timeout, char delim, const char * /*lockid*/)
+{
+    if (sock < 0)
+    {
+        ERRMSG("port not open");
+        return -1;
+    }
+    if (len <= 0)
+    {
+        ERRMSG("invalid buffer length: %d", len);
+        return -1;
+    }
+    // the caller waits for a reply; send what it wrote
+    if (olen && sendOut()) return -1;
+
+    if (timeout < 0) timeout = 0;
+    struct timeval tov, now;
+    gettimeofday(&tov, NULL);
+    tov.tv_sec += timeout / 1000;
+    tov.tv_usec += (timeout % 1000) * 1000;
+    if (tov.tv_usec >= 1000000)
+    {
+        tov.tv_sec += 1;
+        tov.tv_usec -= 1000000;
+    }
+
+    int idx = 0;
+    int wait = timeout;
+    char c;
+    while (true)
+    {
+        while ((ihead < itail) && (idx < len))
+        {
+            c = ibuf[ihead++];
+            data[idx++] = c;
+            if (delim && (c == delim)) return idx;
+        }
+        if ((idx == len) || (wait < 0)) return idx;
+
+        if (fill(wait) < 0) return -1;
+
+        wait = -1;
+        if (timeout)
+        {
+            gettimeofday(&now, NULL);
+            int left = (tov.tv_sec - now.tv_sec) * 1000
+                + (tov.tv_usec - now.tv_usec) / 1000;
+            if (left > 0) wait = left;
+        }
+    }
+
+    return idx;
+}
+
+
+
+int
+COMTCP::Write(const char* data, int len, int /*timeout*/, const char* /*lockid*/)
+{
+    if (len <= 0)
+    {
+        ERRMSG("data length < 0 : %d", len);
+        return -1;
+    }
+    if (data == NULL)
+    {
+        ERRMSG("invalid data pointer (NULL)");
+        return -1;
+    }
+    if (sock < 0)
+    {
+        ERRMSG("port not open");
+        return -1;
+    }
+
+    ++stats.writes;
+
+    // a write which does not fit starts a new segment
+    int elen = len;
+    int i;
+    if (rfc2217)
+        for (i = 0; i < len; ++i)
+            if ((unsigned char)data[i] == IAC) ++elen;
+    if ((olen) && (olen + elen > COMTCPSEGLEN) && sendOut()) return -1;
+
+    for (i = 0; i < len; ++i)
+    {
+        obuf[olen++] = data[i];
+        if ((rfc2217) && ((unsigned char)data[i] == IAC)) obuf[olen++] = data[i];
+        // larger writes go out in full segments
+        if ((olen >= COMTCPSEGLEN) && sendOut()) return i ? i : -1;
+    }
+    return len;
+}
+
+
+
+int
+COMTCP::WriteRead(const char* dataout, int lenout, char* datain,
+                  int lenin, int timeout, char delim, const char* /*lockid*/)
+{
+    if (Write(dataout, lenout) != lenout)
+    {
+        char msg[ERRLEN];
+        snprintf(msg, ERRLEN, "%s", errmsg);
+        ERRMSG("WriteRead() failed on Write:\n\t%s\n", msg);
+        return -1;
+    }
+
+    int bread = Read(datain, lenin, timeout, delim);
+    if (bread == -1)
+    {
+        char msg[ERRLEN];
+        snprintf(msg, ERRLEN, "%s", errmsg);
+        ERRMSG("WriteRead() failed on Read:\n\t%s\n", msg);
+    }
+    return bread;
+}
+
+
+
+int
+COMTCP::GetRtt(void)
+{
+    if (sock < 0) return -1;
+    struct tcp_info ti;
+    socklen_t len = sizeof(ti);
+    if (getsockopt(sock, IPPROTO_TCP, TCP_INFO, &ti, &len)) return -1;
+    return (int)ti.tcpi_rtt;
+}
@@ -0,0 +1,146 @@
+/**
+    file: comtcp.h
+
+    Serial port reached through a TCP serial device server.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+
+*/
+
+/*
+    Notes:
+        + The port name is "host:port" (an IPv6 address is written as
+          "[addr]:port").  The connection has Nagle's algorithm disabled.
+        + In raw mode the TCP stream is the serial data and SetBaud()
+          only records the rate; the server's rate is configured on the
+          server.  In RFC 2217 mode the data is sent with the telnet
+          escapes, the port settings are sent to the server on Open()
+          and SetBaud() changes the server's rate.
+        + Write() collects the data and a segment is only sent when the
+          caller waits for a response (Read(), Select(), Drain(), Flush())
+          or when the next Write() would not fit in a segment, so each
+          segment carries whole commands.
+        + Flush() sends the pending data and discards the input which has
+          arrived; it cannot discard data still held by the server.
+ */
+
+#ifndef __COMTCP_H__
+#define __COMTCP_H__
+
+#include "comport.h"
+
+namespace com {
+
+// largest TCP payload collected before sending
+#define COMTCPSEGLEN (1400)
+// size of the decoded input buffer
+#define COMTCPBUFLEN (4096)
+// msec allowed for the connection to be established
+#define COMTCPCONNTIMEOUT (5000)
+
+    /// Traffic counters of a COMTCP port
+    struct COMTCPSTATS
+    {
+        unsigned long writes;       // Write() calls
+        unsigned long segments;     // send() calls
+        unsigned long bytes;        // bytes sent including telnet escapes
+        COMTCPSTATS() { writes = 0; segments = 0; bytes = 0; }
+    };
+
+    class COMTCP : public COMMIF
+    {
+    private:
+        int     sock;               // connected socket; -1 if closed
+        bool    rfc2217;            // telnet framing and COM-PORT-OPTION
+        struct  COMPARAMS params;   // port settings for 'Reopen'
+        char    portname[MAX_PATH]; // "host:port"
+        char    errmsg[ERRLEN];
+        char    obuf[COMTCPSEGLEN * 2]; // data waiting to be sent
+        int     olen;
+        char    ibuf[COMTCPBUFLEN]; // decoded input: ibuf[ihead .. itail - 1]
+        int     ihead;
+        int     itail;
+        int     tstate;             // telnet parser state
+        unsigned char tverb;        // WILL/WONT/DO/DONT being parsed
+        unsigned char sbbuf[16];    // subnegotiation being parsed
+        int     sblen;
+        unsigned long srvbaud;      // rate acknowledged by the server; 0 if none
+        int     baudreq;            // rate changes not yet acknowledged
+        COMTCPSTATS stats;
+
+        // send the collected data
+        int sendOut(void);
+        // append raw bytes (telnet commands) to the output
+        int queueRaw(const unsigned char *data, int len);
+        // send a COM-PORT-OPTION subnegotiation with a value of <nb> bytes
+        int queueOption(unsigned char cmd, unsigned long value, int nb);
+        // wait up to <timeout> msec for data; bytes received, 0 on timeout or -1
+        int fill(int timeout);
+        // decode received bytes into the input buffer
+        void decode(const unsigned char *data, int len);
+        void negotiate(unsigned char verb, unsigned char opt);
+        COMTCP(const COMTCP &);
+        COMTCP &operator=(const COMTCP &);
+
+    public:
+        /// @param rfc2217 true to use RFC 2217 rather than a raw TCP stream
+        COMTCP(bool rfc2217 = false);
+        ~COMTCP();
+
+        int Open(const char *portname, const COMPARAMS *params = NULL,
+                const char *lockid = NULL);
+        int Reopen(const char *lockid = NULL);
+        int Close(const char *lockid = NULL);
+        /// Send the pending data and discard the input received so far
+        int Flush(const char *lockid = NULL);
+        /// Send the pending data
+        int Drain(const char *lockid = NULL);
+        /// Wait up to <duration> msec for input
+        /// @return 1 if there is data, 0 on timeout, -1 for fault
+        int Select(unsigned int duration);
+        /// In RFC 2217 mode ask the server to change its rate; with a
+        /// timeout, wait up to <timeout> msec for the server to confirm it
+        int SetBaud(speed_t speed, int timeout = 0, const char* lockid = NULL);
+        int Read(char *data, int len, int timeout = 0,
+                char delim = 0, const char *lockid = NULL);
+        /// Collect data for sending; see the notes above
+        /// @return <len> or -1 for fault
+        int Write(const char* data, int len, int timeout = 0,
+                const char* lockid = NULL);
+        int WriteRead(const char* dataout, int lenout, char* datain,
+                    int lenin, int timeout, char delim = 0,
+                    const char* lockid = NULL);
+
+        inline int Lock(const char* /*lockid*/ = NULL, int /*timeout*/ = 0) { return 0; }
+        inline int Unlock(const char* /*lockid*/ = NULL) { return 0; }
+
+        const char *GetError(void) { return errmsg; }
+        void ClearError(void) { errmsg[0] = 0; }
+        const char *GetPortName(void) { return portname; }
+        bool IsOpen(void) { return sock >= 0; }
+
+        const COMTCPSTATS &GetStats(void) { return stats; }
+        /// @return the kernel's smoothed round-trip time in usec or -1
+        int GetRtt(void);
+        /// @return the rate last confirmed by an RFC 2217 server; 0 if none
+        unsigned long GetServerBaud(void) { return srvbaud; }
+    };  // class COMTCP
+
+}; // namespace com
+
+#endif
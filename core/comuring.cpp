@@ -0,0 +1,835 @@
+/*
+    file: comuring.cpp
+
+    Serial port which reads and writes through io_uring.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+*/
+
+/*
+    The ring is driven with the raw system calls so that no library
+    beyond the kernel headers is required.
+ */
+
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+
+#include "comuring.h"
+#include "comcapture.h"
+
+using namespace com;
+
+#define ERRMSG(fmt, args...) snprintf(errmsg, ERRLEN, "%s:%d: %s(): " fmt,\
+    __FILE__, __LINE__, __FUNCTION__,##args)
+
+// largest submission queue requested
+#define URINGMAXENTRIES (4096)
+
+
+URING::URING()
+{
+    rfd = -1;
+    sqptr = NULL;
+    sqlen = 0;
+    cqptr = NULL;
+    cqlen = 0;
+    sqes = NULL;
+    sqeslen = 0;
+    sqhead = NULL;
+    sqtail = NULL;
+    sqarray = NULL;
+    sqmask = 0;
+    sqentries = 0;
+    cqhead = NULL;
+    cqtail = NULL;
+    cqmask = 0;
+    cqes = NULL;
+    bufs = NULL;
+    nslots = 0;
+    ports = NULL;
+    dirty = NULL;
+    ndirty = 0;
+    sqlocal = 0;
+    nenter = 0;
+    errmsg[0] = 0;
+}
+
+
+
+URING::~URING()
+{
+    Release();
+}
+
+
+
+int
+URING::Init(int nports)
+{
+    if (rfd >= 0)
+    {
+        ERRMSG("the ring is already initialized");
+        return -1;
+    }
+    if (nports < 1)
+    {
+        ERRMSG("invalid number of ports: %d", nports);
+        return -1;
+    }
+
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register)
+    // each port has at most a write, a read and its timeout in flight
+    unsigned entries = 8;
+    while ((entries < 4 * (unsigned)nports) && (entries < URINGMAXENTRIES)) entries <<= 1;
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (fd < 0)
+    {
+        ERRMSG("io_uring_setup() failed: %s", strerror(errno));
+        return -1;
+    }
+    rfd = fd;
+
+    sqlen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqlen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if ((p.features & IORING_FEAT_SINGLE_MMAP) && (cqlen > sqlen)) sqlen = cqlen;
+
+    void *mp = mmap(NULL, sqlen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    rfd, IORING_OFF_SQ_RING);
+    if (mp == MAP_FAILED)
+    {
+        ERRMSG("could not map the submission queue: %s", strerror(errno));
+        Release();
+        return -1;
+    }
+    sqptr = mp;
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        cqptr = sqptr;
+        cqlen = 0;
+    }
+    else
+    {
+        mp = mmap(NULL, cqlen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  rfd, IORING_OFF_CQ_RING);
+        if (mp == MAP_FAILED)
+        {
+            ERRMSG("could not map the completion queue: %s", strerror(errno));
+            Release();
+            return -1;
+        }
+        cqptr = mp;
+    }
+
+    sqeslen = p.sq_entries * sizeof(struct io_uring_sqe);
+    mp = mmap(NULL, sqeslen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+              rfd, IORING_OFF_SQES);
+    if (mp == MAP_FAILED)
+    {
+        sqeslen = 0;
+        ERRMSG("could not map the submission entries: %s", strerror(errno));
+        Release();
+        return -1;
+    }
+    sqes = (struct io_uring_sqe *)mp;
+
+    char *sp = (char *)sqptr;
+    sqhead = (unsigned *)(sp + p.sq_off.head);
+    sqtail = (unsigned *)(sp + p.sq_off.tail);
+    sqarray = (unsigned *)(sp + p.sq_off.array);
+    sqmask = *(unsigned *)(sp + p.sq_off.ring_mask);
+    sqentries = p.sq_entries;
+    sqlocal = *sqtail;
+
+    char *cp = (char *)cqptr;
+    cqhead = (unsigned *)(cp + p.cq_off.head);
+    cqtail = (unsigned *)(cp + p.cq_off.tail);
+    cqmask = *(unsigned *)(cp + p.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *)(cp + p.cq_off.cqes);
+
+    // one registered region holds the input and output buffers of every port
+    size_t blen = (size_t)nports * 2 * URINGBUFLEN;
+    void *bp = NULL;
+    if (posix_memalign(&bp, 4096, blen))
+    {
+        ERRMSG("could not allocate %lu bytes of buffers", (unsigned long)blen);
+        Release();
+        return -1;
+    }
+    bufs = (char *)bp;
+    memset(bufs, 0, blen);
+
+    struct iovec iov;
+    iov.iov_base = bufs;
+    iov.iov_len = blen;
+    if (syscall(__NR_io_uring_register, rfd, IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+    {
+        ERRMSG("could not register %lu bytes of buffers: %s",
+               (unsigned long)blen, strerror(errno));
+        Release();
+        return -1;
+    }
+
+    ports = new COMURING*[nports];
+    dirty = new int[nports];
+    for (int i = 0; i < nports; ++i) ports[i] = NULL;
+    nslots = nports;
+    ndirty = 0;
+    return 0;
+#else
+    ERRMSG("io_uring is not supported on this system");
+    return -1;
+#endif
+}
+
+
+
+void
+URING::Release(void)
+{
+    int i;
+    for (i = 0; i < nslots; ++i)
+        if (ports[i]) ports[i]->Close();
+
+    if (sqes) munmap(sqes, sqeslen);
+    if (cqptr && (cqptr != sqptr)) munmap(cqptr, cqlen);
+    if (sqptr) munmap(sqptr, sqlen);
+    if (rfd >= 0) close(rfd);
+    if (bufs) free(bufs);
+    delete [] ports;
+    delete [] dirty;
+
+    rfd = -1;
+    sqptr = NULL;
+    cqptr = NULL;
+    sqes = NULL;
+    sqhead = NULL;
+    sqtail = NULL;
+    sqarray = NULL;
+    cqhead = NULL;
+    cqtail = NULL;
+    cqes = NULL;
+    bufs = NULL;
+    ports = NULL;
+    dirty = NULL;
+    nslots = 0;
+    ndirty = 0;
+    return;
+}
+
+
+
+int
+URING::attach(COMURING *port)
+{
+    int i;
+    for (i = 0; i < nslots; ++i)
+    {
+        if (!ports[i])
+        {
+            ports[i] = port;
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+
+void
+URING::detach(int slot)
+{
+    if ((slot < 0) || (slot >= nslots)) return;
+
+    int i, n = 0;
+    for (i = 0; i < ndirty; ++i)
+        if (dirty[i] != slot) dirty[n++] = dirty[i];
+    ndirty = n;
+    ports[slot] = NULL;
+    return;
+}
+
+
+
+void
+URING::mark(COMURING *port)
+{
+    if (port->listed) return;
+    port->listed = true;
+    dirty[ndirty++] = port->slot;
+    return;
+}
+
+
+
+void
+URING::prepWrites(void)
+{
+    int i, n = 0;
+    for (i = 0; i < ndirty; ++i)
+    {
+        COMURING *p = ports[dirty[i]];
+        p->prepWrite();
+        // output added while a write was in progress waits for the next pass
+        if (p->olen > p->oqueued)
+            dirty[n++] = dirty[i];
+        else
+            p->listed = false;
+    }
+    ndirty = n;
+    return;
+}
+
+
+
+int
+URING::reserve(unsigned n)
+{
+    if (sqentries - (sqlocal - __atomic_load_n(sqhead, __ATOMIC_ACQUIRE)) >= n) return 0;
+    if (enter(0)) return -1;
+    if (sqentries - (sqlocal - __atomic_load_n(sqhead, __ATOMIC_ACQUIRE)) >= n) return 0;
+    ERRMSG("no room in the submission queue");
+    return -1;
+}
+
+
+
+struct io_uring_sqe *
+URING::getSqe(void)
+{
+    unsigned idx = sqlocal & sqmask;
+    struct io_uring_sqe *sqe = &sqes[idx];
+    sqarray[idx] = idx;
+    ++sqlocal;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+
+
+int
+URING::enter(unsigned nwait)
+{
+    // publish the new entries
+    __atomic_store_n(sqtail, sqlocal, __ATOMIC_RELEASE);
+
+    int res;
+    unsigned nsub;
+    while (true)
+    {
+        nsub = sqlocal - __atomic_load_n(sqhead, __ATOMIC_ACQUIRE);
+        if ((!nsub) && (!nwait)) break;
+        ++nenter;
+        res = (int)syscall(__NR_io_uring_enter, rfd, nsub, nwait,
+                           nwait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (res >= 0) break;
+        if (errno == EINTR) continue;
+        if (errno == EBUSY)
+        {
+            // the completion queue is full; make room and try again
+            reap();
+            continue;
+        }
+        ERRMSG("io_uring_enter() failed: %s", strerror(errno));
+        return -1;
+    }
+
+    reap();
+    return 0;
+}
+
+
+
+void
+URING::reap(void)
+{
+    unsigned head = *cqhead;
+    unsigned tail = __atomic_load_n(cqtail, __ATOMIC_ACQUIRE);
+    while (head != tail)
+    {
+        struct io_uring_cqe *cqe = &cqes[head & cqmask];
+        URINGOP *op = (URINGOP *)(uintptr_t)cqe->user_data;
+        if (op)
+        {
+            op->res = cqe->res;
+            op->done = true;
+        }
+        ++head;
+    }
+    __atomic_store_n(cqhead, head, __ATOMIC_RELEASE);
+    return;
+}
+
+
+
+int
+URING::Submit(void)
+{
+    if (rfd < 0)
+    {
+        ERRMSG("the ring is not initialized");
+        return -1;
+    }
+    prepWrites();
+    return enter(0);
+}
+
+
+
+COMURING::COMURING(URING *ring)
+{
+    shared = ring;
+    own = NULL;
+    this->ring = NULL;
+    slot = -1;
+    listed = false;
+    obuf = NULL;
+    ibuf = NULL;
+    olen = 0;
+    osent = 0;
+    oqueued = 0;
+    wbusy = false;
+    werr = 0;
+    ihead = 0;
+    itail = 0;
+}
+
+
+
+COMURING::~COMURING()
+{
+    // the base destructor cannot release the ring
+    if (fd >= 0) Close();
+    delete own;
+}
+
+
+
+int
+COMURING::Open(const char *portname, const COMPARAMS *params, const char *lockid)
+{
+    if (COMPORT::Open(portname, params, lockid)) return -1;
+
+    URING *rp = shared;
+    if (!rp)
+    {
+        if (!own) own = new URING;
+        if (!own->IsReady()) own->Init(1);
+        rp = own;
+    }
+    // without io_uring the port works as a COMPORT
+    if (!rp->IsReady()) return 0;
+
+    slot = rp->attach(this);
+    if (slot < 0)
+    {
+        COMPORT::Close();
+        ERRMSG("all %d ports of the ring are in use", rp->nslots);
+        return -1;
+    }
+
+    // the ring waits for the data; the reads must block
+    int flags = fcntl(fd, F_GETFL);
+    if ((flags == -1) || (fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) == -1))
+    {
+        rp->detach(slot);
+        slot = -1;
+        COMPORT::Close();
+        ERRMSG("could not set blocking mode: %s", strerror(errno));
+        return -1;
+    }
+
+    ring = rp;
+    obuf = ring->bufs + (size_t)slot * 2 * URINGBUFLEN;
+    ibuf = obuf + URINGBUFLEN;
+    listed = false;
+    olen = 0;
+    osent = 0;
+    oqueued = 0;
+    wbusy = false;
+    werr = 0;
+    ihead = 0;
+    itail = 0;
+    return 0;
+}
+
+
+
+int
+COMURING::SetBaud(speed_t speed, int timeout, const char *lockid)
+{
+    if (ring)
+    {
+        // pending output goes out at the old rate
+        if (flushOutput()) return -1;
+        ihead = itail = 0;
+    }
+
+    if (COMPORT::SetBaud(speed, timeout, lockid)) return -1;
+
+    // a blocking read returns as soon as there is 1 byte
+    termios term;
+    if (tcgetattr(fd, &term) == 0)
+    {
+        term.c_cc[VMIN] = 1;
+        term.c_cc[VTIME] = 0;
+        tcsetattr(fd, TCSANOW, &term);
+    }
+    return 0;
+}
+
+
+
+int
+COMURING::Close(const char *lockid)
+{
+    if (fd == -1) return -1;
+
+    if (ring)
+    {
+        flushOutput();
+        ring->detach(slot);
+        ring = NULL;
+        slot = -1;
+        obuf = NULL;
+        ibuf = NULL;
+        ihead = itail = 0;
+    }
+
+    return COMPORT::Close(lockid);
+}
+
+
+
+void
+COMURING::settle(void)
+{
+    if ((!wbusy) || (!wop.done)) return;
+
+    wbusy = false;
+    if (wop.res < 0)
+    {
+        werr = -wop.res;
+        olen = osent = oqueued = 0;
+        return;
+    }
+
+    osent += wop.res;
+    oqueued = osent;
+    if (osent >= olen) olen = osent = oqueued = 0;
+    return;
+}
+
+
+
+int
+COMURING::prepWrite(void)
+{
+    settle();
+    if (wbusy || (olen <= osent)) return 0;
+    if (ring->reserve(1))
+    {
+        ERRMSG("failed; see message below\n%s", ring->GetError());
+        return -1;
+    }
+
+    struct io_uring_sqe *sqe = ring->getSqe();
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = fd;
+    sqe->off = (__u64)-1;
+    sqe->addr = (uintptr_t)(obuf + osent);
+    sqe->len = olen - osent;
+    sqe->buf_index = 0;
+    sqe->user_data = (uintptr_t)&wop;
+    wop.done = false;
+    wbusy = true;
+    oqueued = olen;
+    return 0;
+}
+
+
+
+int
+COMURING::flushOutput(void)
+{
+    while (olen || wbusy)
+    {
+        if (prepWrite()) return -1;
+        while (wbusy && (!wop.done))
+        {
+            if (ring->enter(1))
+            {
+                ERRMSG("failed; see message below\n%s", ring->GetError());
+                return -1;
+            }
+        }
+        settle();
+    }
+    return checkWrite();
+}
+
+
+
+int
+COMURING::checkWrite(void)
+{
+    if (!werr) return 0;
+    ERRMSG("write failed: %s", strerror(werr));
+    werr = 0;
+    return -1;
+}
+
+
+
+int
+COMURING::fill(int timeout)
+{
+    ihead = itail = 0;
+
+    if (timeout <= 0)
+    {
+        // no waiting; take whatever has arrived
+        if (ring->Submit())
+        {
+            ERRMSG("failed; see message below\n%s", ring->GetError());
+            return -1;
+        }
+        int nb = 0;
+        if ((ioctl(fd, FIONREAD, &nb) == -1) || (nb <= 0)) return 0;
+        if (nb > URINGBUFLEN) nb = URINGBUFLEN;
+        nb = read(fd, ibuf, nb);
+        if (nb < 0)
+        {
+            if ((errno == EAGAIN) || (errno == EINTR)) return 0;
+            ERRMSG("failed: %s", strerror(errno));
+            return -1;
+        }
+        itail = nb;
+        mirror(CAPRX, ibuf, nb);
+        return nb;
+    }
+
+    // the pending writes (this port's first), the read and its timeout
+    // go in with the same system call
+    prepWrite();
+    ring->prepWrites();
+    if (ring->reserve(2))
+    {
+        ERRMSG("failed; see message below\n%s", ring->GetError());
+        return -1;
+    }
+
+    struct __kernel_timespec ts;
+    ts.tv_sec = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000LL;
+
+    struct io_uring_sqe *sqe = ring->getSqe();
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->fd = fd;
+    sqe->off = (__u64)-1;
+    sqe->addr = (uintptr_t)ibuf;
+    sqe->len = URINGBUFLEN;
+    sqe->buf_index = 0;
+    sqe->user_data = (uintptr_t)&rop;
+    rop.done = false;
+
+    sqe = ring->getSqe();
+    sqe->opcode = IORING_OP_LINK_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (uintptr_t)&ts;
+    sqe->len = 1;
+    sqe->user_data = (uintptr_t)&top;
+    top.done = false;
+
+    // both completions must be in before the buffer or <ts> are reused
+    while ((!rop.done) || (!top.done))
+    {
+        if (ring->enter((rop.done ? 0 : 1) + (top.done ? 0 : 1)))
+        {
+            ERRMSG("failed; see message below\n%s", ring->GetError());
+            return -1;
+        }
+    }
+
+    if (rop.res > 0)
+    {
+        itail = rop.res;
+        mirror(CAPRX, ibuf, rop.res);
+        return rop.res;
+    }
+    if ((rop.res == 0) || (rop.res == -ECANCELED) || (rop.res == -EINTR)
+        || (rop.res == -EAGAIN))
+        return 0;
+
+    ERRMSG("failed: %s", strerror(-rop.res));
+    return -1;
+}
+
+
+
+int
+COMURING::Write(const char* data, int len, int timeout, const char* lockid)
+{
+    if (!ring) return COMPORT::Write(data, len, timeout, lockid);
+
+    if (len <= 0)
+    {
+        ERRMSG("data length < 0 : %d", len);
+        return -1;
+    }
+    if (data == NULL)
+    {
+        ERRMSG("invalid data pointer (NULL)");
+        return -1;
+    }
+
+    settle();
+    if (checkWrite()) return -1;
+
+    int n = 0;
+    int nb;
+    while (n < len)
+    {
+        if (olen == URINGBUFLEN)
+        {
+            // the buffer is full; write it out
+            if (flushOutput()) return n ? n : -1;
+        }
+        nb = len - n;
+        if (nb > URINGBUFLEN - olen) nb = URINGBUFLEN - olen;
+        memcpy(&obuf[olen], &data[n], nb);
+        olen += nb;
+        n += nb;
+    }
+    // the time recorded is when the data was queued
+    mirror(CAPTX, data, len);
+
+    ring->mark(this);
+    return len;
+}
+
+
+
+int
+COMURING::Read(char *data, int len, int timeout, char delim, const char *lockid)
+{
+    if (!ring) return COMPORT::Read(data, len, timeout, delim, lockid);
+
+    if (len <= 0)
+    {
+        ERRMSG("invalid buffer length: %d", len);
+        return -1;
+    }
+
+    settle();
+    if (checkWrite()) return -1;
+
+    if (timeout < 0) timeout = 0;
+    struct timeval tov, now;
+    gettimeofday(&tov, NULL);
+    tov.tv_sec += timeout / 1000;
+    tov.tv_usec += (timeout % 1000) * 1000;
+    if (tov.tv_usec >= 1000000)
+    {
+        tov.tv_sec += 1;
+        tov.tv_usec -= 1000000;
+    }
+
+    int idx = 0;
+    int wait = timeout;
+    char c;
+    while (true)
+    {
+        while ((ihead < itail) && (idx < len))
+        {
+            c = ibuf[ihead++];
+            data[idx++] = c;
+            if (delim && (c == delim)) return idx;
+        }
+        if ((idx == len) || (wait < 0)) return idx;
+
+        if (fill(wait) < 0) return -1;
+
+        // after a wait the time left decides; without a timeout the
+        // data read so far is returned
+        wait = -1;
+        if (timeout)
+        {
+            gettimeofday(&now, NULL);
+            int left = (tov.tv_sec - now.tv_sec) * 1000
+                + (tov.tv_usec - now.tv_usec) / 1000;
+            if (left > 0) wait = left;
+        }
+    }
+
+    return idx;
+}
+
+
+
+int
+COMURING::Flush(const char *lockid)
+{
+    if (!ring) return COMPORT::Flush(lockid);
+    if (fd < 0) return -1;
+
+    ihead = itail = 0;
+    tcflush(fd, TCIFLUSH);
+    return 0;
+}
+
+
+
+int
+COMURING::Drain(const char *lockid)
+{
+    if (!ring) return COMPORT::Drain(lockid);
+    if (fd < 0) return -1;
+
+    if (flushOutput()) return -1;
+    tcdrain(fd);
+    return 0;
+}
+
+
+
+int
+COMURING::Select(unsigned int duration)
+{
+    if (!ring) return COMPORT::Select(duration);
+
+    if (ihead < itail) return 1;
+    int nb = fill((int)duration);
+    if (nb < 0) return -1;
+    return nb ? 1 : 0;
+}
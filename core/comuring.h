@@ -0,0 +1,199 @@
+/**
+    file: comuring.h
+
+    Serial port which reads and writes through io_uring.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+
+*/
+
+/*
+    Notes:
+        + COMURING is a COMPORT whose Read() and Write() go through an
+          io_uring instance (URING) with registered buffers.  The port is
+          opened and configured by COMPORT (termios) as before.
+        + Write() only copies the data into the port's output buffer; the
+          writes of every port on the ring are submitted together with the
+          next read on any of them, or by URING::Submit().  A write error
+          is reported by the next Write(), Read() or Drain() on the port.
+        + Read() submits the pending writes, a read and a timeout in one
+          io_uring_enter() call, so a command and its acknowledgement
+          normally cost one system call (plus the tcflush() of Flush()).
+        + Flush() discards the input but does not wait for the output to
+          drain; Drain() does.
+        + A URING may be shared by many ports but all of them must be used
+          from one thread.  With no ring given, the port creates its own.
+        + If the kernel has no io_uring (or it is disabled) the port
+          behaves exactly as a COMPORT; see UsesRing().
+ */
+
+#ifndef __COMURING_H__
+#define __COMURING_H__
+
+#include "comport.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace com {
+
+// size of each registered input and output buffer of a port
+#define URINGBUFLEN (4096)
+
+    class COMURING;
+
+    /// Result of an operation submitted to the ring
+    struct URINGOP
+    {
+        int res;        // result as for read() / write() but -errno on failure
+        bool done;      // the completion has been reaped
+        URINGOP() { res = 0; done = true; }
+    };
+
+    /// io_uring instance and registered buffers shared by serial ports
+    class URING
+    {
+    private:
+        friend class COMURING;
+        int rfd;                    // ring file descriptor
+        void *sqptr;                // submission queue ring
+        size_t sqlen;
+        void *cqptr;                // completion queue ring (may be sqptr)
+        size_t cqlen;
+        struct io_uring_sqe *sqes;
+        size_t sqeslen;
+        unsigned *sqhead;
+        unsigned *sqtail;
+        unsigned *sqarray;
+        unsigned sqmask;
+        unsigned sqentries;
+        unsigned *cqhead;
+        unsigned *cqtail;
+        unsigned cqmask;
+        struct io_uring_cqe *cqes;
+        char *bufs;                 // registered buffers; 2 per port
+        int nslots;
+        COMURING **ports;           // ports using each buffer pair
+        int *dirty;                 // slots with output not yet queued
+        int ndirty;
+        unsigned sqlocal;           // SQ tail including unpublished SQEs
+        unsigned long nenter;       // io_uring_enter() calls
+        char errmsg[ERRLEN];
+
+        // claim a buffer pair; -1 if all are in use
+        int attach(COMURING *port);
+        void detach(int slot);
+        // add a port to the list of pending writes
+        void mark(COMURING *port);
+        // queue the pending writes of every port
+        void prepWrites(void);
+        // get <n> free SQEs in a row, submitting the queue if necessary
+        int reserve(unsigned n);
+        struct io_uring_sqe *getSqe(void);
+        // submit the queued SQEs and wait for <nwait> completions
+        int enter(unsigned nwait);
+        // record the results of the available completions
+        void reap(void);
+        URING(const URING &);
+        URING &operator=(const URING &);
+
+    public:
+        URING();
+        ~URING();
+
+        /// Create the ring and register the buffers for up to <nports> ports;
+        /// the buffers count against RLIMIT_MEMLOCK
+        /// @return 0 for success, otherwise -1
+        int Init(int nports);
+        bool IsReady(void) { return rfd >= 0; }
+        /// Close any ports still using the ring and release it
+        void Release(void);
+
+        /// Submit the pending writes of every port without waiting
+        /// @return 0 for success, otherwise -1
+        int Submit(void);
+
+        /// @return the number of io_uring_enter() calls so far
+        unsigned long GetEnterCount(void) { return nenter; }
+        const char *GetError(void) { return errmsg; }
+    };  // class URING
+
+    class COMURING : public COMPORT
+    {
+    private:
+        friend class URING;
+        URING *shared;      // ring given to the constructor
+        URING *own;         // private ring created when none was given
+        URING *ring;        // ring in use; NULL if the port does not use one
+        int slot;           // buffer pair on the ring
+        bool listed;        // the port is on the ring's list of pending writes
+        char *obuf;         // registered output buffer
+        char *ibuf;         // registered input buffer
+        int olen;           // bytes waiting in obuf
+        int osent;          // bytes of obuf already written
+        int oqueued;        // end of the bytes submitted for writing
+        bool wbusy;         // a write is in progress
+        int werr;           // errno of a failed write; 0 if none
+        int ihead;          // unread input is ibuf[ihead .. itail - 1]
+        int itail;
+        URINGOP wop;
+        URINGOP rop;
+        URINGOP top;        // read timeout
+        // account for a completed write
+        void settle(void);
+        // queue a write of the pending output unless one is in progress
+        int prepWrite(void);
+        // write out the whole output buffer
+        int flushOutput(void);
+        // report and clear a write error
+        int checkWrite(void);
+        // read into the empty input buffer; bytes read, 0 on timeout or -1
+        int fill(int timeout);
+        COMURING(const COMURING &);
+        COMURING &operator=(const COMURING &);
+
+    public:
+        /// Use the given ring or, if it is NULL, a private one
+        COMURING(URING *ring = NULL);
+        ~COMURING();
+
+        /// @return true if the open port reads and writes through io_uring
+        bool UsesRing(void) { return ring != NULL; }
+
+        int Open(const char *portname, const COMPARAMS *params = NULL,
+                const char *lockid = NULL);
+        int SetBaud(speed_t speed, int timeout = 0, const char* lockid = NULL);
+        int Close(const char *lockid = NULL);
+        /// Queue data for writing; see the notes above
+        /// @return <len> or -1 for fault
+        int Write(const char* data, int len, int timeout = 0,
+                const char* lockid = NULL);
+        int Read(char *data, int len, int timeout = 0,
+                char delim = 0, const char *lockid = NULL);
+        /// Discard the input; pending output is not drained
+        int Flush(const char *lockid = NULL);
+        /// Submit the pending output and wait until it is transmitted
+        int Drain(const char *lockid = NULL);
+        /// Wait up to <duration> msec for input
+        /// @return 1 if there is data, 0 on timeout, -1 for fault
+        int Select(unsigned int duration);
+    };  // class COMURING
+
+}; // namespace com
+
+#endif
@@ -0,0 +1,199 @@
+/**
+    file: digits.cpp
+
+    Large numeric display for the PICASO SGC driver.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "digits.h"
+
+using namespace disp;
+
+#define ERRMSG(fmt, args...) snprintf(errmsg, PGDERRLEN, "%s:%d: %s(): " fmt,\
+    __FILE__, __LINE__, __FUNCTION__,##args)
+
+// characters held in the glyph slots
+static const char GLYPHS[] = "0123456789- ";
+
+
+PGDDIGITS::PGDDIGITS(ushort x, ushort y, int ndigits, uchar font, ushort color,
+                     ushort bgcolor, uchar xmul, uchar ymul)
+{
+    if (ndigits < 1) ndigits = 1;
+    if (ndigits > PGDMAXDIGITS) ndigits = PGDMAXDIGITS;
+    if (xmul < 1) xmul = 1;
+    if (ymul < 1) ymul = 1;
+
+    PGDRECT r = PGDTextExtent(0, 0, font, xmul, ymul, "0");
+    cw = r.x2 + 1;
+    ch = r.y2 + 1;
+    field = PGDRECT(x, y, x + ndigits * cw - 1, y + ch - 1);
+    ndig = ndigits;
+    this->font = font;
+    this->color = color;
+    this->bgcolor = bgcolor;
+    this->xmul = xmul;
+    this->ymul = ymul;
+    loaded = false;
+    rfont = FNT_SMALL;
+    ropacity = TRANSPARENT;
+    memset(shown, 0, sizeof(shown));
+    memset(want, ' ', sizeof(want));
+    want[ndig - 1] = '0';
+    errmsg[0] = 0;
+}
+
+
+
+int
+PGDDIGITS::index(char c)
+{
+    if ((c >= '0') && (c <= '9')) return c - '0';
+    if (c == '-') return 10;
+    return 11;
+}
+
+
+
+int
+PGDDIGITS::SetStage(const PGDRECT &area)
+{
+    int i;
+    stage.SetArea(area);
+    for (i = 0; i < 12; ++i)
+    {
+        if (stage.Alloc(cw, ch, &glyph[i]))
+        {
+            ERRMSG("no room for 12 glyphs of %d x %d in the staging area", cw, ch);
+            stage.Reset();
+            return -1;
+        }
+    }
+    Invalidate();
+    return 0;
+}
+
+
+
+int
+PGDDIGITS::SetValue(long value)
+{
+    char tmp[32];
+    int len = snprintf(tmp, sizeof(tmp), "%ld", value);
+    if (len > ndig)
+    {
+        ERRMSG("%s does not fit %d digits", tmp, ndig);
+        return -1;
+    }
+
+    memset(want, ' ', ndig - len);
+    memcpy(&want[ndig - len], tmp, len);
+    return 0;
+}
+
+
+
+void
+PGDDIGITS::Invalidate(void)
+{
+    loaded = false;
+    memset(shown, 0, sizeof(shown));
+    return;
+}
+
+
+
+int
+PGDDIGITS::Render(PGDCMDBUF *out)
+{
+    if (!out)
+    {
+        ERRMSG("invalid command buffer (NULL)");
+        return -1;
+    }
+    if (stage.GetArea().IsEmpty())
+    {
+        ERRMSG("no staging area");
+        return -1;
+    }
+
+    int i;
+    int res = 0;
+    bool drawn = false;
+    if (!loaded)
+    {
+        const PGDRECT &a = stage.GetArea();
+        res = out->PenSize(SOLID);
+        if (!res) res = out->SetFont(font);
+        if (!res) res = out->SetOpacity(TRANSPARENT);
+        if (!res) res = out->Rectangle(a.x1, a.y1, a.x2, glyph[11].y2, bgcolor);
+        for (i = 0; (i < 11) && (!res); ++i)
+            res = out->ScaleChar(GLYPHS[i], glyph[i].x1, glyph[i].y1, color, xmul, ymul);
+        // leave the text settings as the application expects them
+        if (!res) res = out->SetFont(rfont);
+        if (!res) res = out->SetOpacity(ropacity);
+        drawn = true;
+    }
+
+    for (i = 0; (i < ndig) && (!res); ++i)
+    {
+        if (want[i] == shown[i]) continue;
+        const PGDRECT &g = glyph[index(want[i])];
+        res = out->CopyPaste(g.x1, g.y1, field.x1 + i * cw, field.y1, cw, ch);
+    }
+
+    if (res)
+    {
+        ERRMSG("failed; see message below\n%s", out->GetError());
+        return -1;
+    }
+
+    // the state only changes once every command has been recorded
+    if (drawn) loaded = true;
+    memcpy(shown, want, ndig);
+    return 0;
+}
+
+
+
+int
+PGDDIGITS::Flush(PGD *pgd)
+{
+    if (!pgd)
+    {
+        ERRMSG("invalid display (NULL pointer)");
+        return -1;
+    }
+
+    buf.Clear();
+    if (Render(&buf)) return -1;
+    if (!buf.GetCount()) return 0;
+
+    int res = pgd->Transmit(&buf);
+    if (res)
+    {
+        // the state of the display is unknown
+        Invalidate();
+        ERRMSG("failed; see message below\n%s", pgd->GetError());
+    }
+    return res;
+}
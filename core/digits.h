@@ -0,0 +1,114 @@
+/**
+    file: digits.h
+
+    Large numeric display for the PICASO SGC driver.  The scaled digit
+    glyphs are drawn once into an off-screen staging area and each
+    update copies only the character cells which changed with
+    CopyPaste, instead of clearing the field and sending ScaleString.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+/*
+    Notes:
+        + The glyphs '0'..'9', '-' and a blank cell take 12 slots of
+          one scaled font cell each in the staging area.
+        + Numbers are right-aligned in the field; unused cells on the
+          left are blank.
+        + Commands are recorded in the native orientation and sent with
+          PGD::Transmit(); the glyphs are drawn by the device in its
+          native orientation.
+        + Anything which draws over the staging area destroys the
+          glyphs; call Invalidate() to draw them again.
+        + Drawing the glyphs selects their font and transparent text;
+          the font and opacity set with SetTextMode() are selected again
+          afterwards.
+ */
+
+#ifndef DIGITS_H
+#define DIGITS_H
+
+#include "oled.h"
+#include "cmdbuf.h"
+#include "stage.h"
+
+namespace disp {
+
+// max. number of character cells in a numeric display
+#define PGDMAXDIGITS (16)
+
+    /** Right-aligned number drawn from cached glyphs */
+    class PGDDIGITS {
+        private:
+            PGDRECT field;              // area covered on the screen
+            int ndig;
+            uchar font;
+            ushort color;
+            ushort bgcolor;
+            uchar xmul;
+            uchar ymul;
+            int cw;                     // size of a scaled character cell
+            int ch;
+            PGDSTAGE stage;
+            PGDRECT glyph[12];          // '0'..'9', '-' and blank
+            bool loaded;                // the glyphs have been drawn
+            char shown[PGDMAXDIGITS];   // cells on the screen; 0 = unknown
+            char want[PGDMAXDIGITS];    // cells requested by SetValue()
+            uchar rfont;                // font and opacity left selected
+            uchar ropacity;
+            PGDCMDBUF buf;              // commands sent by Flush()
+            char errmsg[PGDERRLEN];
+            // slot index of a character
+            static int index(char c);
+            PGDDIGITS(const PGDDIGITS &);
+            PGDDIGITS &operator=(const PGDDIGITS &);
+
+        public:
+            /// A field of <ndigits> cells with its top left corner at (x, y); the
+            /// glyphs are drawn as by ScaleChar with the given font and scale
+            PGDDIGITS(ushort x, ushort y, int ndigits, uchar font, ushort color,
+                      ushort bgcolor, uchar xmul, uchar ymul);
+
+            const char *GetError(void) { return errmsg; }
+
+            /// Draw the glyphs into <area> (which the user cannot see)
+            /// @return 0 for success, -1 if the glyphs do not fit
+            int  SetStage(const PGDRECT &area);
+            const PGDRECT &GetRect(void) { return field; }
+            /// Font and opacity which the application uses; they are selected
+            /// again after the glyphs are drawn (default FNT_SMALL, TRANSPARENT)
+            void SetTextMode(uchar font, uchar opacity) { rfont = font; ropacity = opacity; }
+            /// Request a new value
+            /// @return 0 for success, -1 if the number does not fit the field
+            int  SetValue(long value);
+            /// Draw the glyphs and the whole field again (after the display was cleared)
+            void Invalidate(void);
+
+            /// Append the commands which show the requested value to <out>;
+            /// on failure the state is as before the call
+            /// @return 0 for success, -1 for failure
+            int  Render(PGDCMDBUF *out);
+            /// Render into the internal buffer and send it to the display.
+            /// Return values are as for PGD::Transmit().
+            int  Flush(PGD *pgd);
+            /// @return the commands sent by the last Flush()
+            const PGDCMDBUF *GetBuffer(void) { return &buf; }
+    };
+
+};  //namespace disp
+#endif // DIGITS_H
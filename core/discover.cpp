@@ -0,0 +1,248 @@
+/**
+    file: discover.cpp
+
+    Find the serial ports to which displays are attached by probing all
+    candidate ports at the same time.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <glob.h>
+#include <pthread.h>
+
+#include "discover.h"
+#include "comport.h"
+
+using namespace disp;
+
+#define ERRMSG(fmt, args...) snprintf(errmsg, PGDERRLEN, "%s:%d: %s(): " fmt,\
+    __FILE__, __LINE__, __FUNCTION__,##args)
+
+// argument of a probe thread
+struct PROBEARG {
+    PGDDISCOVER *disc;
+    int idx;
+};
+
+
+// msec since <ts>
+static double msecSince(const struct timeval &ts)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - ts.tv_sec) * 1000.0 + (now.tv_usec - ts.tv_usec) / 1000.0;
+}
+
+
+PGDDISCOVER::PGDDISCOVER()
+{
+    found = NULL;
+    nfound = 0;
+    powerwait = PGDDISCWAIT;
+    timeout = PGDDISCTIMEOUT;
+    tries = PGDDISCTRIES;
+    errmsg[0] = 0;
+}
+
+
+
+PGDDISCOVER::~PGDDISCOVER()
+{
+    delete [] found;
+}
+
+
+
+void
+PGDDISCOVER::SetTimeouts(int powerwait, int timeout, int tries)
+{
+    this->powerwait = (powerwait < 0) ? 0 : powerwait;
+    this->timeout = (timeout < 1) ? 1 : timeout;
+    this->tries = (tries < 1) ? 1 : tries;
+    return;
+}
+
+
+
+int
+PGDDISCOVER::Probe(const char *pattern)
+{
+    if (!pattern)
+    {
+        ERRMSG("invalid pattern (NULL pointer)");
+        return -1;
+    }
+
+    glob_t gl;
+    int res = glob(pattern, 0, NULL, &gl);
+    if (res == GLOB_NOMATCH)
+    {
+        delete [] found;
+        found = NULL;
+        nfound = 0;
+        return 0;
+    }
+    if (res)
+    {
+        ERRMSG("could not list the ports matching '%s'", pattern);
+        return -1;
+    }
+
+    res = Probe(gl.gl_pathv, (int)gl.gl_pathc);
+    globfree(&gl);
+    return res;
+}
+
+
+
+int
+PGDDISCOVER::Probe(const char * const *ports, int nports)
+{
+    if ((!ports) || (nports < 0))
+    {
+        ERRMSG("invalid port list");
+        return -1;
+    }
+
+    delete [] found;
+    found = NULL;
+    nfound = 0;
+    if (!nports) return 0;
+
+    found = new PGDFOUND[nports];
+    nfound = nports;
+    pthread_t *tid = new pthread_t[nports];
+    PROBEARG *args = new PROBEARG[nports];
+    bool *started = new bool[nports];
+    int i;
+
+    gettimeofday(&tstart, NULL);
+    for (i = 0; i < nports; ++i)
+    {
+        snprintf(found[i].port, PATH_MAX, "%s", ports[i]);
+        args[i].disc = this;
+        args[i].idx = i;
+        started[i] = !pthread_create(&tid[i], NULL, probeThread, &args[i]);
+        // without a thread the port is probed in turn
+        if (!started[i]) probe(i);
+    }
+
+    int ndisp = 0;
+    for (i = 0; i < nports; ++i)
+    {
+        if (started[i]) pthread_join(tid[i], NULL);
+        if (!found[i].status) ++ndisp;
+    }
+
+    delete [] started;
+    delete [] args;
+    delete [] tid;
+    return ndisp;
+}
+
+
+
+void *
+PGDDISCOVER::probeThread(void *arg)
+{
+    PROBEARG *pa = (PROBEARG *)arg;
+    pa->disc->probe(pa->idx);
+    return NULL;
+}
+
+
+
+void
+PGDDISCOVER::probe(int idx)
+{
+    PGDFOUND &f = found[idx];
+    com::COMPORT port;
+    com::COMPARAMS parm;
+    parm.speed = B9600;
+
+    if (port.Open(f.port, &parm))
+    {
+        snprintf(f.errmsg, PGDERRLEN, "could not open port (see below)\n%s", port.GetError());
+        f.status = -1;
+        f.msec = msecSince(tstart);
+        return;
+    }
+
+    // the power-on wait runs from the start of the probe for all ports
+    double left = powerwait - msecSince(tstart);
+    if (left > 0) usleep((useconds_t)(left * 1000.0));
+
+    char msg[8];
+    int i, res;
+    f.status = 2;
+    snprintf(f.errmsg, PGDERRLEN, "no response to autobaud");
+    for (i = 0; i < tries; ++i)
+    {
+        port.Flush();
+        if (port.Write("U", 1) != 1)
+        {
+            snprintf(f.errmsg, PGDERRLEN, "could not write (see below)\n%s", port.GetError());
+            f.status = -1;
+            break;
+        }
+        res = port.Read(msg, 1, timeout);
+        if ((res == 1) && (msg[0] == 0x06))
+        {
+            f.status = 0;
+            break;
+        }
+    }
+
+    if (!f.status)
+    {
+        port.Flush();
+        if ((port.Write("V\x00", 2) != 2) || (port.Read(msg, 5, timeout) != 5))
+        {
+            snprintf(f.errmsg, PGDERRLEN, "no response to Version");
+            f.status = 2;
+        }
+        else
+        {
+            PGDParseVersion(msg, &f.ver);
+            f.errmsg[0] = 0;
+        }
+    }
+
+    port.Close();
+    f.msec = msecSince(tstart);
+    return;
+}
+
+
+
+const char *
+PGDDISCOVER::GetDisplayPort(int n)
+{
+    int i;
+    for (i = 0; i < nfound; ++i)
+    {
+        if (found[i].status) continue;
+        if (!n--) return found[i].port;
+    }
+    return NULL;
+}
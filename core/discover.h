@@ -0,0 +1,110 @@
+/**
+    file: discover.h
+
+    Find the serial ports to which displays are attached by probing all
+    candidate ports at the same time.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+
+*/
+
+/*
+    Notes:
+        + Each candidate port is probed by its own thread: the port is
+          opened at 9600 bps, and after the power-on wait (shared by all
+          ports) the autobaud byte is sent up to <tries> times; a port
+          which ACKs is asked for its Version.  A probe therefore takes
+          about one power-on wait plus a few replies however many ports
+          there are.
+        + The displays are left at 9600 bps and the ports are closed;
+          PGD::Connect() on a port found here works as usual.  With a
+          capability cache the Version reported here is what Connect()
+          will look up.
+ */
+
+#ifndef DISCOVER_H
+#define DISCOVER_H
+
+#include "oled.h"
+
+namespace disp {
+
+// default msec waited after opening the ports (as in PGD::Connect)
+#define PGDDISCWAIT (500)
+// default msec allowed for each reply
+#define PGDDISCTIMEOUT (100)
+// default number of autobaud attempts
+#define PGDDISCTRIES (3)
+
+    /* Result of probing one port */
+    struct PGDFOUND {
+        char port[PATH_MAX];
+        int status;                 // 0 display found, -1 port fault, +2 no response
+        PGDVER ver;                 // display identification if status == 0
+        double msec;                // time from the start of the probe to the result
+        char errmsg[PGDERRLEN];     // reason if status != 0
+        PGDFOUND() {
+            port[0] = 0;
+            status = 2;
+            msec = 0.0;
+            errmsg[0] = 0;
+        }
+    };
+
+    class PGDDISCOVER {
+        private:
+            PGDFOUND *found;
+            int  nfound;
+            int  powerwait;
+            int  timeout;
+            int  tries;
+            struct timeval tstart;
+            char errmsg[PGDERRLEN];
+            static void *probeThread(void *arg);
+            // identify the display (if any) on found[idx].port
+            void probe(int idx);
+            PGDDISCOVER(const PGDDISCOVER &);
+            PGDDISCOVER &operator=(const PGDDISCOVER &);
+
+        public:
+            PGDDISCOVER();
+            ~PGDDISCOVER();
+
+            const char *GetError(void) { return errmsg; }
+
+            /// Set the power-on wait, the reply timeout (msec) and the
+            /// number of autobaud attempts
+            void SetTimeouts(int powerwait, int timeout, int tries);
+
+            /// Probe the ports whose names match <pattern> (see glob(3))
+            /// @return the number of displays found or -1 for failure
+            int  Probe(const char *pattern = "/dev/ttyUSB*");
+            /// Probe the <nports> ports in <ports>
+            /// @return the number of displays found or -1 for failure
+            int  Probe(const char * const *ports, int nports);
+
+            /// @return the number of ports probed
+            int  GetCount(void) { return nfound; }
+            /// @return the result for port <idx> (0 .. GetCount() - 1)
+            const PGDFOUND &GetResult(int idx) { return found[idx]; }
+            /// @return the name of the <n>th port with a display, NULL if none
+            const char *GetDisplayPort(int n);
+    };
+
+};  //namespace disp
+#endif // DISCOVER_H
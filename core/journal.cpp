@@ -0,0 +1,528 @@
+/**
+    file: journal.cpp
+
+    Screen journal for the PICASO SGC driver: the acknowledged commands
+    which define what is on the screen, less those which later commands
+    have made invisible, so that the screen can be rebuilt after the
+    display resets.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <map>
+#include <vector>
+
+#include "journal.h"
+#include "cmdbuf.h"
+
+using namespace disp;
+
+// coordinate beyond any display; used for areas which extend to the edge
+#define FAR (0x7fff)
+
+// 16-bit value stored MSB first
+static int getw(const char *p)
+{
+    return ((uchar)p[0] << 8) | (uchar)p[1];
+}
+
+
+// rectangle with corners (x1, y1) and (x2, y2) in any order
+static PGDRECT corners(int x1, int y1, int x2, int y2)
+{
+    return PGDRECT((x1 < x2) ? x1 : x2, (y1 < y2) ? y1 : y2,
+                   (x1 < x2) ? x2 : x1, (y1 < y2) ? y2 : y1);
+}
+
+
+// grow <r> to include (x, y)
+static void extend(PGDRECT *r, int x, int y)
+{
+    if (x < r->x1) r->x1 = x;
+    if (x > r->x2) r->x2 = x;
+    if (y < r->y1) r->y1 = y;
+    if (y > r->y2) r->y2 = y;
+    return;
+}
+
+
+// true if <a> lies within <b>
+static bool inside(const PGDRECT &a, const PGDRECT &b)
+{
+    return (a.x1 >= b.x1) && (a.x2 <= b.x2) && (a.y1 >= b.y1) && (a.y2 <= b.y2);
+}
+
+
+PGDJOURNAL::PGDJOURNAL()
+{
+    maxbytes = 0;
+    turns = 0;
+    width = 0;
+    height = 0;
+    Reset();
+}
+
+
+
+void
+PGDJOURNAL::SetLimit(unsigned int maxbytes)
+{
+    this->maxbytes = maxbytes;
+    Reset();
+    stats = PGDJOURNALSTATS();
+    return;
+}
+
+
+
+void
+PGDJOURNAL::Reset(void)
+{
+    entries.clear();
+    stats.entries = 0;
+    stats.bytes = 0;
+    stats.complete = true;
+    pen = SOLID;
+    font = 0;
+    orient = 0;
+    return;
+}
+
+
+
+void
+PGDJOURNAL::SetView(int turns, int width, int height)
+{
+    this->turns = turns & 3;
+    this->width = width;
+    this->height = height;
+    return;
+}
+
+
+
+void
+PGDJOURNAL::Record(const char *cmd, int len, int timeout, const char *data, int dlen)
+{
+    if ((!maxbytes) || (!cmd) || (len < 1)) return;
+
+    ENTRY e;
+    if (!classify(cmd, len, &e)) return;
+    ++stats.recorded;
+
+    if (cmd[0] == 'E')
+    {
+        clear();
+        stats.complete = true;
+    }
+    // nothing is drawn until a Clear makes the journal complete again
+    if (e.draw && (!stats.complete)) return;
+
+    e.timeout = timeout;
+    e.cmd.assign(cmd, len);
+    if (data && (dlen > 0)) e.cmd.append(data, dlen);
+    entries.push_back(e);
+    ++stats.entries;
+    stats.bytes += e.cmd.size();
+
+    if (e.opaque && (!e.area.IsEmpty()))
+    {
+        cover();
+    }
+    else if (!e.draw)
+    {
+        // the same setting made since the last drawing command is superseded
+        std::list<ENTRY>::iterator it = entries.end();
+        --it;
+        while (it != entries.begin())
+        {
+            --it;
+            if (it->draw) break;
+            if (it->key == e.key)
+            {
+                drop(it);
+                ++stats.collapsed;
+                break;
+            }
+        }
+    }
+
+    if (stats.bytes > maxbytes)
+    {
+        ++stats.overflows;
+        stats.complete = false;
+        clear();
+    }
+    return;
+}
+
+
+
+int
+PGDJOURNAL::Fill(PGDCMDBUF *buf)
+{
+    std::list<ENTRY>::iterator it;
+    for (it = entries.begin(); it != entries.end(); ++it)
+    {
+        if (buf->AddEncoded(it->cmd.data(), it->cmd.size(), it->timeout)) return -1;
+    }
+    return 0;
+}
+
+
+
+bool
+PGDJOURNAL::classify(const char *cmd, int len, ENTRY *e)
+{
+    e->draw = true;
+    e->key = 0;
+    e->opaque = false;
+    e->barrier = false;
+
+    int i, x, y, w, h, n;
+    uchar op = cmd[0];
+    switch (op)
+    {
+        // settings
+        case 'K':   // SetBackground
+        case 'u':   // SetRegion
+            e->draw = false;
+            e->key = op << 16;
+            return true;
+        case 'p':   // PenSize
+            if (len < 2) return false;
+            pen = cmd[1];
+            e->draw = false;
+            e->key = op << 16;
+            return true;
+        case 'F':   // SetFont
+            if (len < 2) return false;
+            font = cmd[1];
+            e->draw = false;
+            e->key = op << 16;
+            return true;
+        case 'O':   // SetOpacity
+            e->draw = false;
+            e->key = op << 16;
+            return true;
+        case 'Y':   // Ctl
+            if (len < 3) return false;
+            e->draw = false;
+            e->key = (op << 16) | ((uchar)cmd[1] << 8);
+            if (cmd[1] == DM_ORIENT)
+            {
+                orient = cmd[2];
+                e->barrier = true;
+            }
+            return true;
+        case 'A':   // AddBitmap
+            if (len < 3) return false;
+            e->draw = false;
+            e->key = (op << 16) | ((uchar)cmd[1] << 8) | (uchar)cmd[2];
+            return true;
+
+        // drawing
+        case 'E':   // Clear
+            return true;
+        case 'B':   // ReplaceBackground: reads the whole screen
+            e->barrier = true;
+            return true;
+        case 'r':   // Rectangle
+            if (len < 11) return false;
+            e->area = corners(getw(&cmd[1]), getw(&cmd[3]), getw(&cmd[5]), getw(&cmd[7]));
+            e->opaque = (pen == SOLID);
+            return true;
+        case 'L':   // Line
+            if (len < 11) return false;
+            e->area = corners(getw(&cmd[1]), getw(&cmd[3]), getw(&cmd[5]), getw(&cmd[7]));
+            return true;
+        case 'C':   // Circle
+            if (len < 9) return false;
+            x = getw(&cmd[1]);
+            y = getw(&cmd[3]);
+            w = getw(&cmd[5]);
+            e->area = PGDRECT(x - w, y - w, x + w, y + w);
+            return true;
+        case 'e':   // Ellipse
+            if (len < 11) return false;
+            x = getw(&cmd[1]);
+            y = getw(&cmd[3]);
+            w = getw(&cmd[5]);
+            h = getw(&cmd[7]);
+            e->area = PGDRECT(x - w, y - h, x + w, y + h);
+            return true;
+        case 'G':   // Triangle
+            if (len < 15) return false;
+            e->area = corners(getw(&cmd[1]), getw(&cmd[3]), getw(&cmd[5]), getw(&cmd[7]));
+            extend(&e->area, getw(&cmd[9]), getw(&cmd[11]));
+            return true;
+        case 'g':   // Polygon
+            if (len < 2) return false;
+            n = (uchar)cmd[1];
+            if ((n < 1) || (len < 4 + 4 * n)) return false;
+            e->area = PGDRECT(getw(&cmd[2]), getw(&cmd[4]), getw(&cmd[2]), getw(&cmd[4]));
+            for (i = 1; i < n; ++i)
+                extend(&e->area, getw(&cmd[2 + 4 * i]), getw(&cmd[4 + 4 * i]));
+            return true;
+        case 'P':   // WritePixel
+            if (len < 7) return false;
+            x = getw(&cmd[1]);
+            y = getw(&cmd[3]);
+            e->area = PGDRECT(x, y, x, y);
+            return true;
+        case 'D':   // DrawBitmap: 8x8, 16x16 or 32x32
+            if (len < 9) return false;
+            w = 8 << (((uchar)cmd[1] < 3) ? (uchar)cmd[1] : 2);
+            x = getw(&cmd[3]);
+            y = getw(&cmd[5]);
+            e->area = PGDRECT(x, y, x + w - 1, y + w - 1);
+            return true;
+        case 'I':   // DrawIcon, in native coordinates
+            if (len < 10) return false;
+            if (!width) return true;
+            x = getw(&cmd[1]);
+            y = getw(&cmd[3]);
+            w = getw(&cmd[5]);
+            h = getw(&cmd[7]);
+            if ((!w) || (!h)) return true;
+            switch (turns)
+            {
+                case 1:
+                    e->area = PGDRECT(y, width - x - w, y + h - 1, width - x - 1);
+                    break;
+                case 2:
+                    e->area = PGDRECT(width - x - w, height - y - h, width - x - 1, height - y - 1);
+                    break;
+                case 3:
+                    e->area = PGDRECT(height - y - h, x, height - y - 1, x + w - 1);
+                    break;
+                default:
+                    e->area = PGDRECT(x, y, x + w - 1, y + h - 1);
+                    break;
+            }
+            e->opaque = true;
+            return true;
+        case 'c':   // CopyPaste
+            if (len < 13) return false;
+            w = getw(&cmd[9]);
+            h = getw(&cmd[11]);
+            if ((!w) || (!h)) return false;
+            x = getw(&cmd[1]);
+            y = getw(&cmd[3]);
+            e->src = PGDRECT(x, y, x + w - 1, y + h - 1);
+            x = getw(&cmd[5]);
+            y = getw(&cmd[7]);
+            e->area = PGDRECT(x, y, x + w - 1, y + h - 1);
+            e->opaque = true;
+            return true;
+        case 'k':   // ReplaceColor
+            if (len < 13) return false;
+            e->area = corners(getw(&cmd[1]), getw(&cmd[3]), getw(&cmd[5]), getw(&cmd[7]));
+            e->src = e->area;
+            return true;
+        case 'T':   // ShowChar
+            if (len < 6) return false;
+            do {
+                PGDRECT cell = PGDTextExtent(0, 0, font, 1, 1, "X");
+                e->area = textArea((uchar)cmd[2] * (cell.x2 + 1), (uchar)cmd[3] * (cell.y2 + 1),
+                                   font, 1, 1, 1);
+            } while (0);
+            return true;
+        case 't':   // ScaleChar
+            if (len < 10) return false;
+            e->area = textArea(getw(&cmd[2]), getw(&cmd[4]), font, (uchar)cmd[8],
+                               (uchar)cmd[9], 1);
+            return true;
+        case 's':   // ShowString
+            if (len < 7) return false;
+            do {
+                PGDRECT cell = PGDTextExtent(0, 0, cmd[3], 1, 1, "X");
+                e->area = textArea((uchar)cmd[1] * (cell.x2 + 1), (uchar)cmd[2] * (cell.y2 + 1),
+                                   cmd[3], 1, 1, len - 7);
+            } while (0);
+            return true;
+        case 'S':   // ScaleString
+            if (len < 11) return false;
+            e->area = textArea(getw(&cmd[1]), getw(&cmd[3]), cmd[5], (uchar)cmd[8],
+                               (uchar)cmd[9], len - 11);
+            return true;
+        case 'b':   // Button
+            if (len < 14) return false;
+            e->area = textArea(getw(&cmd[2]), getw(&cmd[4]), cmd[8], (uchar)cmd[11],
+                               (uchar)cmd[12], len - 14);
+            return true;
+
+        case '@':
+            if (len < 2) return false;
+            switch (cmd[1])
+            {
+                case 'i':   // SDInit
+                    e->draw = false;
+                    e->key = (op << 16) | ('i' << 8);
+                    return true;
+                case 'I':   // SDShowImageRaw; the old format gives the size
+                    if (len == 14)
+                    {
+                        x = getw(&cmd[2]);
+                        y = getw(&cmd[4]);
+                        w = getw(&cmd[6]);
+                        h = getw(&cmd[8]);
+                        if ((w) && (h)) e->area = PGDRECT(x, y, x + w - 1, y + h - 1);
+                    }
+                    return true;
+                case 'O':   // SDShowObjectRaw
+                case 'V':   // SDShowVideoRaw
+                case 'm':   // SDShowImageFAT
+                    return true;
+                case 'P':   // SDRunScriptRaw
+                case 'p':   // SDRunScriptFAT
+                    e->barrier = true;
+                    return true;
+                default:
+                    break;
+            }
+            return false;
+
+        default:
+            // commands which do not change the screen
+            break;
+    }
+    return false;
+}
+
+
+
+PGDRECT
+PGDJOURNAL::textArea(int x, int y, uchar font, int xmul, int ymul, int nchars)
+{
+    PGDRECT cell = PGDTextExtent(0, 0, font, xmul, ymul, "X");
+    int cw = cell.x2 + 1;
+    int ch = cell.y2 + 1;
+    if (nchars < 1) nchars = 1;
+
+    // the width of the screen in the current orientation
+    int sw = (turns & 1) ? height : width;
+    if ((!sw) || (x + nchars * cw > sw))
+    {
+        // the text may wrap onto the following lines
+        return PGDRECT(0, y - ch, FAR, FAR);
+    }
+    return PGDRECT(x - cw, y - ch, x + (nchars + 1) * cw - 1, y + 2 * ch - 1);
+}
+
+
+
+std::list<PGDJOURNAL::ENTRY>::iterator
+PGDJOURNAL::drop(std::list<ENTRY>::iterator it)
+{
+    --stats.entries;
+    stats.bytes -= it->cmd.size();
+    return entries.erase(it);
+}
+
+
+
+void
+PGDJOURNAL::cover(void)
+{
+    std::list<ENTRY>::iterator it = entries.end();
+    --it;
+    const PGDRECT area = it->area;
+
+    // areas read after an entry was drawn; the new entry reads before it writes
+    std::vector<PGDRECT> reads;
+    if (!it->src.IsEmpty()) reads.push_back(it->src);
+
+    bool removed = false;
+    size_t i;
+    while (it != entries.begin())
+    {
+        --it;
+        if (it->barrier) break;
+        if (!it->draw) continue;
+
+        if ((!it->area.IsEmpty()) && inside(it->area, area))
+        {
+            for (i = 0; i < reads.size(); ++i)
+                if (reads[i].Intersects(it->area)) break;
+            if (i == reads.size())
+            {
+                it = drop(it);
+                ++stats.collapsed;
+                removed = true;
+                continue;
+            }
+        }
+        if (!it->src.IsEmpty()) reads.push_back(it->src);
+    }
+
+    if (removed) collapse();
+    return;
+}
+
+
+
+void
+PGDJOURNAL::clear(void)
+{
+    std::list<ENTRY>::iterator it = entries.begin();
+    while (it != entries.end())
+    {
+        if (it->draw)
+        {
+            it = drop(it);
+            ++stats.collapsed;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    collapse();
+    return;
+}
+
+
+
+void
+PGDJOURNAL::collapse(void)
+{
+    // the last occurrence of each setting since the last drawing command
+    std::map<int, std::list<ENTRY>::iterator> last;
+    std::map<int, std::list<ENTRY>::iterator>::iterator m;
+    std::list<ENTRY>::iterator it = entries.begin();
+    while (it != entries.end())
+    {
+        if (it->draw)
+        {
+            last.clear();
+            ++it;
+            continue;
+        }
+        m = last.find(it->key);
+        if (m != last.end())
+        {
+            drop(m->second);
+            ++stats.collapsed;
+        }
+        last[it->key] = it;
+        ++it;
+    }
+    return;
+}
@@ -0,0 +1,123 @@
+/**
+    file: journal.h
+
+    Screen journal for the PICASO SGC driver: the acknowledged commands
+    which define what is on the screen, less those which later commands
+    have made invisible, so that the screen can be rebuilt after the
+    display resets.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+/*
+    Notes:
+        + Only commands which affect the screen or settings which are lost
+          in a reset are recorded: drawing and text commands, SetBackground,
+          PenSize, SetFont, SetOpacity, Ctl, SetRegion, AddBitmap, SDInit
+          and the SD image, object and video commands.
+        + A drawing command is removed when a later solid rectangle, icon
+          or CopyPaste destination covers everything it may have drawn,
+          unless a CopyPaste or ReplaceColor in between read from it.
+          Clear removes every drawing command before it.  A setting is
+          removed when the same setting is made again with no drawing
+          command in between.
+        + The area of text is estimated from the font cells (see
+          PGDTextExtent()) plus one cell all round; text which may wrap
+          at the edge of the screen extends to the bottom of the screen.
+          Circles, lines and other outlines are never taken to cover
+          anything.
+        + Areas are compared in the orientation in which the commands were
+          drawn; nothing drawn before an orientation change, ReplaceBackground
+          or a script is removed by a later command other than Clear.
+        + When the journal outgrows its limit its drawing commands are
+          discarded and it is incomplete until the next Clear; settings
+          are still recorded meanwhile.
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "oled.h"
+
+namespace disp {
+
+    class PGDCMDBUF;
+
+    class PGDJOURNAL {
+        private:
+            struct ENTRY {
+                std::string cmd;        // command bytes including any payload
+                int timeout;            // ACK timeout in msec
+                bool draw;              // drawing command; otherwise a setting
+                int key;                // settings: opcode and selector
+                PGDRECT area;           // pixels which may be changed; empty if unknown
+                PGDRECT src;            // pixels which are read; empty if none
+                bool opaque;            // every pixel of <area> is overwritten
+                bool barrier;           // nothing before it may be removed by later commands
+            };
+            std::list<ENTRY> entries;
+            unsigned int maxbytes;
+            uchar pen;                  // current pen size
+            uchar font;                 // current font
+            uchar orient;               // orientation set with Ctl(); 0 = none
+            int turns;                  // icon quarter turns (see PGD::SetNativeOrient())
+            int width;                  // display size in the native orientation; 0 if unknown
+            int height;
+            PGDJOURNALSTATS stats;
+            // describe command <cmd> of <len> bytes in <e>; false if it is not recorded
+            bool classify(const char *cmd, int len, ENTRY *e);
+            // area covered by text of <nchars> characters at (x, y)
+            PGDRECT textArea(int x, int y, uchar font, int xmul, int ymul, int nchars);
+            // remove entry <it>; returns the entry which followed it
+            std::list<ENTRY>::iterator drop(std::list<ENTRY>::iterator it);
+            // remove the drawing commands hidden by the last entry
+            void cover(void);
+            // remove drawing commands before a Clear
+            void clear(void);
+            // remove settings which are made again before any drawing
+            void collapse(void);
+            // disallow copying
+            PGDJOURNAL(const PGDJOURNAL &);
+            PGDJOURNAL &operator=(const PGDJOURNAL &);
+
+        public:
+            PGDJOURNAL();
+
+            /// Set the size limit in bytes; 0 disables the journal. The journal is emptied.
+            void SetLimit(unsigned int maxbytes);
+            bool IsEnabled(void) { return maxbytes > 0; }
+            /// Empty the journal: the screen is as after power-on
+            void Reset(void);
+            /// Set the quarter turns by which icons are rotated and the display
+            /// size in its native orientation; icons are drawn in native coordinates
+            void SetView(int turns, int width, int height);
+            /// Record a command which the display has acknowledged; <data>
+            /// holds any payload which was written separately
+            void Record(const char *cmd, int len, int timeout,
+                        const char *data = NULL, int dlen = 0);
+            /// Append the journal to <buf>; return 0 for success, -1 for failure
+            int  Fill(PGDCMDBUF *buf);
+
+            /// Pen size and orientation which the journal leaves set
+            uchar GetPen(void) { return pen; }
+            uchar GetOrient(void) { return orient; }
+            const PGDJOURNALSTATS &GetStats(void) { return stats; }
+    };
+
+};  //namespace disp
+#endif // JOURNAL_H
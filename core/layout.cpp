@@ -0,0 +1,577 @@
+/**
+    file: layout.cpp
+
+    Declarative screen layouts for the PICASO SGC driver.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "layout.h"
+
+using namespace disp;
+
+#define ERRMSG(fmt, args...) snprintf(errmsg, PGDERRLEN, "%s:%d: %s(): " fmt,\
+    __FILE__, __LINE__, __FUNCTION__,##args)
+
+// max. tokens on a description line
+#define MAXTOK (10)
+
+
+PGDLAYOUT::PGDLAYOUT()
+{
+    compiled = false;
+    lineno = 0;
+    errmsg[0] = 0;
+}
+
+PGDLAYOUT::~PGDLAYOUT()
+{
+    return;
+}
+
+
+
+void
+PGDLAYOUT::Clear(void)
+{
+    items.clear();
+    discard();
+    return;
+}
+
+
+
+void
+PGDLAYOUT::discard(void)
+{
+    fields.clear();
+    statbuf.Clear();
+    slotbuf.Clear();
+    compiled = false;
+    return;
+}
+
+
+
+/*****************************************************
+                    DESCRIPTION
+*****************************************************/
+
+int
+PGDLAYOUT::AddBox(ushort x1, ushort y1, ushort x2, ushort y2, ushort color, bool filled)
+{
+    ITEM it;
+    it.type = filled ? LI_BOX : LI_FRAME;
+    it.x1 = x1;
+    it.y1 = y1;
+    it.x2 = x2;
+    it.y2 = y2;
+    it.color = color;
+    items.push_back(it);
+    discard();
+    return 0;
+}
+
+
+
+int
+PGDLAYOUT::AddLabel(ushort x, ushort y, uchar font, ushort color, const char *text)
+{
+    if ((!text) || (!text[0]))
+    {
+        ERRMSG("invalid label text (NULL or empty)");
+        return -1;
+    }
+
+    ITEM it;
+    it.type = LI_LABEL;
+    it.x1 = x;
+    it.y1 = y;
+    it.font = font;
+    it.color = color;
+    it.text = text;
+    items.push_back(it);
+    discard();
+    return 0;
+}
+
+
+
+int
+PGDLAYOUT::AddButton(ushort x, ushort y, ushort bcolor, uchar font, ushort tcolor,
+                     uchar xmul, uchar ymul, const char *text)
+{
+    if ((!text) || (!text[0]))
+    {
+        ERRMSG("invalid button text (NULL or empty)");
+        return -1;
+    }
+
+    ITEM it;
+    it.type = LI_BUTTON;
+    it.x1 = x;
+    it.y1 = y;
+    it.color = bcolor;
+    it.font = font;
+    it.tcolor = tcolor;
+    it.xmul = xmul;
+    it.ymul = ymul;
+    it.text = text;
+    items.push_back(it);
+    discard();
+    return 0;
+}
+
+
+
+int
+PGDLAYOUT::AddIcon(ushort x, ushort y, ushort width, ushort height,
+                   uchar colormode, const uchar *data, int datalen)
+{
+    if ((colormode != 0x08) && (colormode != 0x10))
+    {
+        ERRMSG("invalid color mode (0x%.2X); valid values are 0x08 and 0x10 only", colormode);
+        return -1;
+    }
+
+    int dsize = width * height;
+    if (colormode == 0x10) dsize *= 2;
+    if ((!data) || (datalen != dsize))
+    {
+        ERRMSG("invalid icon data (size = %d, expected %d)", datalen, dsize);
+        return -1;
+    }
+
+    ITEM it;
+    it.type = LI_ICON;
+    it.x1 = x;
+    it.y1 = y;
+    it.x2 = width;
+    it.y2 = height;
+    it.font = colormode;
+    items.push_back(it);
+    items.back().pix.assign(data, data + datalen);
+    discard();
+    return 0;
+}
+
+
+
+int
+PGDLAYOUT::AddField(const char *name, ushort x, ushort y, uchar font,
+                    ushort color, int width)
+{
+    if ((!name) || (!name[0]) || (strlen(name) >= PGDNAMELEN))
+    {
+        ERRMSG("invalid field name; must be 1..%d characters", PGDNAMELEN - 1);
+        return -1;
+    }
+    if ((width < 1) || (width > PGDFIELDLEN))
+    {
+        ERRMSG("invalid field width (%d); valid range is 1..%d", width, PGDFIELDLEN);
+        return -1;
+    }
+
+    size_t i;
+    for (i = 0; i < items.size(); ++i)
+    {
+        if ((items[i].type == LI_FIELD) && (items[i].text == name))
+        {
+            ERRMSG("duplicate field name '%s'", name);
+            return -1;
+        }
+    }
+
+    ITEM it;
+    it.type = LI_FIELD;
+    it.x1 = x;
+    it.y1 = y;
+    it.font = font;
+    it.color = color;
+    it.xmul = width;
+    it.text = name;
+    items.push_back(it);
+    discard();
+    return 0;
+}
+
+
+
+int
+PGDLAYOUT::Load(const char *filename)
+{
+    if (!filename)
+    {
+        ERRMSG("invalid filename (NULL pointer)");
+        return -1;
+    }
+
+    FILE *fp = fopen(filename, "r");
+    if (!fp)
+    {
+        ERRMSG("could not open '%s': %s", filename, strerror(errno));
+        return -1;
+    }
+
+    std::string text;
+    char buf[512];
+    size_t nb;
+    while ((nb = fread(buf, 1, sizeof(buf), fp)) > 0) text.append(buf, nb);
+    fclose(fp);
+
+    if (Parse(text.c_str()))
+    {
+        char msg[PGDERRLEN];
+        snprintf(msg, PGDERRLEN, "%s", errmsg);
+        ERRMSG("%s: %s", filename, msg);
+        return -1;
+    }
+    return 0;
+}
+
+
+
+int
+PGDLAYOUT::Parse(const char *text)
+{
+    if (!text)
+    {
+        ERRMSG("invalid description (NULL pointer)");
+        return -1;
+    }
+
+    std::string line;
+    const char *sp = text;
+    const char *ep;
+    lineno = 0;
+    while (*sp)
+    {
+        ++lineno;
+        ep = strchr(sp, '\n');
+        if (!ep) ep = sp + strlen(sp);
+        line.assign(sp, ep - sp);
+        if (parseLine(&line[0])) return -1;
+        sp = *ep ? ep + 1 : ep;
+    }
+    return 0;
+}
+
+
+
+// split a line into whitespace separated tokens; quoted text is one token
+static int tokenize(char *line, char **tok)
+{
+    int ntok = 0;
+    char *cp = line;
+    while (*cp)
+    {
+        while ((*cp == ' ') || (*cp == '\t') || (*cp == '\r')) ++cp;
+        if ((!*cp) || (*cp == '#')) break;
+        if (ntok == MAXTOK) return -1;
+        if (*cp == '"')
+        {
+            tok[ntok++] = ++cp;
+            while ((*cp) && (*cp != '"')) ++cp;
+            if (!*cp) return -1;    // unterminated text
+        }
+        else
+        {
+            tok[ntok++] = cp;
+            while ((*cp) && (*cp != ' ') && (*cp != '\t') && (*cp != '\r')) ++cp;
+            if (!*cp) break;
+        }
+        *cp++ = 0;
+    }
+    return ntok;
+}
+
+
+
+int
+PGDLAYOUT::parseLine(char *line)
+{
+    char *tok[MAXTOK];
+    long val[MAXTOK];
+    int ntok = tokenize(line, tok);
+
+    if (ntok < 0)
+    {
+        ERRMSG("line %d: too many items or unterminated text", lineno);
+        return -1;
+    }
+    if (ntok == 0) return 0;
+
+    static const struct {
+        const char *name;
+        int ntok;
+        int text;   // token which is not numeric; 0 for none
+    } syntax[] = {
+        { "box",    6, 0 },
+        { "frame",  6, 0 },
+        { "label",  6, 5 },
+        { "button", 9, 8 },
+        { "icon",   7, 6 },
+        { "field",  7, 1 },
+    };
+
+    int i, k;
+    for (k = 0; k < 6; ++k) if (!strcmp(tok[0], syntax[k].name)) break;
+    if (k == 6)
+    {
+        ERRMSG("line %d: unknown item '%s'", lineno, tok[0]);
+        return -1;
+    }
+    if (ntok != syntax[k].ntok)
+    {
+        ERRMSG("line %d: '%s' takes %d arguments", lineno, tok[0], syntax[k].ntok - 1);
+        return -1;
+    }
+    for (i = 1; i < ntok; ++i)
+    {
+        if (i == syntax[k].text) continue;
+        char *ep;
+        val[i] = strtol(tok[i], &ep, 0);
+        if ((*ep) || (val[i] < 0) || (val[i] > 0xffff))
+        {
+            ERRMSG("line %d: invalid value '%s'", lineno, tok[i]);
+            return -1;
+        }
+    }
+
+    int res = -1;
+    switch (k)
+    {
+        case 0:
+        case 1:
+            res = AddBox(val[1], val[2], val[3], val[4], val[5], k == 0);
+            break;
+        case 2:
+            res = AddLabel(val[1], val[2], val[3], val[4], tok[5]);
+            break;
+        case 3:
+            res = AddButton(val[1], val[2], val[3], val[4], val[5], val[6], val[7], tok[8]);
+            break;
+        case 4:
+            do {
+                FILE *fp = fopen(tok[6], "r");
+                if (!fp)
+                {
+                    ERRMSG("line %d: could not open '%s': %s", lineno, tok[6], strerror(errno));
+                    return -1;
+                }
+                int dsize = val[3] * val[4];
+                if (val[5] == 0x10) dsize *= 2;
+                std::vector<uchar> pix(dsize + 1);
+                int nb = fread(&pix[0], 1, dsize, fp);
+                fclose(fp);
+                res = AddIcon(val[1], val[2], val[3], val[4], val[5], &pix[0], nb);
+            } while (0);
+            break;
+        case 5:
+            res = AddField(tok[1], val[2], val[3], val[4], val[5], val[6]);
+            break;
+    }
+
+    if (res)
+    {
+        char msg[PGDERRLEN];
+        snprintf(msg, PGDERRLEN, "%s", errmsg);
+        ERRMSG("line %d: %s", lineno, msg);
+    }
+    return res;
+}
+
+
+
+/*****************************************************
+                    COMPILATION
+*****************************************************/
+
+int
+PGDLAYOUT::Compile(void)
+{
+    discard();
+
+    int pen = -1;       // pen size last set by the layout
+    int opacity = -1;   // text opacity last set by the layout
+    int res = 0;
+    size_t i;
+    char text[PGDFIELDLEN + 1];
+
+    for (i = 0; (i < items.size()) && (!res); ++i)
+    {
+        ITEM &it = items[i];
+        switch (it.type)
+        {
+            case LI_BOX:
+            case LI_FRAME:
+                if (pen != ((it.type == LI_BOX) ? SOLID : WIREFRAME))
+                {
+                    pen = (it.type == LI_BOX) ? SOLID : WIREFRAME;
+                    res = statbuf.PenSize(pen);
+                }
+                if (!res) res = statbuf.Rectangle(it.x1, it.y1, it.x2, it.y2, it.color);
+                break;
+            case LI_LABEL:
+                if (opacity != TRANSPARENT)
+                {
+                    opacity = TRANSPARENT;
+                    res = statbuf.SetOpacity(TRANSPARENT);
+                }
+                if (!res) res = statbuf.ScaleString(it.x1, it.y1, it.font, it.color,
+                                                     1, 1, it.text.c_str());
+                break;
+            case LI_BUTTON:
+                res = statbuf.Button(false, it.x1, it.y1, it.color, it.font, it.tcolor,
+                                     it.xmul, it.ymul, it.text.c_str());
+                break;
+            case LI_ICON:
+                res = statbuf.DrawIcon(it.x1, it.y1, it.x2, it.y2, it.font,
+                                       &it.pix[0], it.pix.size());
+                break;
+            case LI_FIELD:
+                do {
+                    PGDFIELD fld;
+                    snprintf(fld.name, PGDNAMELEN, "%s", it.text.c_str());
+                    fld.x = it.x1;
+                    fld.y = it.y1;
+                    fld.font = it.font;
+                    fld.color = it.color;
+                    fld.width = it.xmul;
+                    fld.cmd = slotbuf.GetCount();
+                    memset(text, ' ', fld.width);
+                    text[fld.width] = 0;
+                    res = slotbuf.SetOpacity(OPAQUE);
+                    if (!res) res = slotbuf.ScaleString(fld.x, fld.y, fld.font, fld.color,
+                                                         1, 1, text);
+                    fields.push_back(fld);
+                } while (0);
+                break;
+        }
+    }
+
+    if (res)
+    {
+        ERRMSG("could not encode item %d; see message below\n%s\n%s", (int)i,
+               statbuf.GetError(), slotbuf.GetError());
+        statbuf.Clear();
+        slotbuf.Clear();
+        fields.clear();
+        return -1;
+    }
+
+    compiled = true;
+    return 0;
+}
+
+
+
+/*****************************************************
+                      DRAWING
+*****************************************************/
+
+int
+PGDLAYOUT::Draw(PGD *pgd)
+{
+    if (!pgd)
+    {
+        ERRMSG("invalid display (NULL pointer)");
+        return -1;
+    }
+    if (!compiled)
+    {
+        ERRMSG("layout has not been compiled");
+        return -1;
+    }
+
+    int res = pgd->Transmit(&statbuf);
+    if (!res) res = pgd->Transmit(&slotbuf);
+    if (res) ERRMSG("failed; see message below\n%s", pgd->GetError());
+    return res;
+}
+
+
+
+int
+PGDLAYOUT::SetFieldText(int index, const char *text)
+{
+    if ((index < 0) || (index >= (int)fields.size()))
+    {
+        ERRMSG("invalid field index (%d)", index);
+        return -1;
+    }
+    if (!text)
+    {
+        ERRMSG("invalid string pointer (NULL)");
+        return -1;
+    }
+
+    // patch the text of the ScaleString command ('S' + 9 bytes of arguments)
+    PGDFIELD &fld = fields[index];
+    char *cp = slotbuf.GetCommand(fld.cmd + 1) + 10;
+    int i;
+    for (i = 0; (i < fld.width) && (text[i]); ++i) cp[i] = text[i];
+    for (; i < fld.width; ++i) cp[i] = ' ';
+    return 0;
+}
+
+
+
+int
+PGDLAYOUT::SetField(PGD *pgd, int index, const char *text)
+{
+    if (!pgd)
+    {
+        ERRMSG("invalid display (NULL pointer)");
+        return -1;
+    }
+    if (SetFieldText(index, text)) return -1;
+
+    int res = pgd->Transmit(&slotbuf, fields[index].cmd, 2);
+    if (res) ERRMSG("failed; see message below\n%s", pgd->GetError());
+    return res;
+}
+
+
+
+int
+PGDLAYOUT::FindField(const char *name)
+{
+    if (!name) return -1;
+
+    size_t i;
+    for (i = 0; i < fields.size(); ++i)
+    {
+        if (!strcmp(fields[i].name, name)) return i;
+    }
+    return -1;
+}
+
+
+
+const PGDFIELD *
+PGDLAYOUT::GetField(int index)
+{
+    if ((index < 0) || (index >= (int)fields.size())) return NULL;
+    return &fields[index];
+}
@@ -0,0 +1,151 @@
+/**
+    file: layout.h
+
+    Declarative screen layouts for the PICASO SGC driver. A layout is
+    described as a list of boxes, labels, buttons, icons and dynamic
+    text fields; it is compiled once into a prerecorded command buffer
+    for the static part of the screen plus one slot per dynamic field.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+/*
+    Layout description format; one item per line, '#' starts a comment,
+    numbers may be decimal or 0x-prefixed hex and text is double-quoted:
+
+        box    x1 y1 x2 y2 color                    filled rectangle
+        frame  x1 y1 x2 y2 color                    wireframe rectangle
+        label  x y font color "text"                transparent text
+        button x y bcolor font tcolor xmul ymul "text"
+        icon   x y width height colormode file      raw pixel data from host file
+        field  name x y font color width            dynamic text, width in chars
+
+    Coordinates are in pixels; labels and fields are drawn with the
+    'S' (ScaleString) command at a scale of 1.  Fields are drawn with
+    OPAQUE text and are padded to their full width so that an update
+    overwrites the previous value without clearing the area first.
+ */
+
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <vector>
+#include <string>
+
+#include "oled.h"
+#include "cmdbuf.h"
+
+namespace disp {
+
+// max. length of a field name including the terminator
+#define PGDNAMELEN (16)
+// max. width of a field in characters
+#define PGDFIELDLEN (64)
+
+    /* layout item types */
+    enum LAYOUTITEM {
+        LI_BOX = 0,
+        LI_FRAME,
+        LI_LABEL,
+        LI_BUTTON,
+        LI_ICON,
+        LI_FIELD
+    };
+
+    /* dynamic field slot */
+    struct PGDFIELD {
+        char name[PGDNAMELEN];
+        ushort x;
+        ushort y;
+        uchar font;
+        ushort color;
+        int  width;                 // characters
+        int  cmd;                   // index of the opacity command in the slot buffer
+    };
+
+    /** Compiled screen layout */
+    class PGDLAYOUT {
+        private:
+            struct ITEM {
+                LAYOUTITEM type;
+                ushort x1, y1, x2, y2;
+                ushort color;
+                ushort tcolor;
+                uchar font;
+                uchar xmul, ymul;
+                std::string text;       // label / button text, field name
+                std::vector<uchar> pix; // icon data
+            };
+            std::vector<ITEM> items;
+            std::vector<PGDFIELD> fields;
+            PGDCMDBUF statbuf;          // static part of the screen
+            PGDCMDBUF slotbuf;          // dynamic fields, 2 commands each
+            bool compiled;
+            int  lineno;                // line being parsed
+            char errmsg[PGDERRLEN];
+            int  parseLine(char *line);
+            // drop the compiled buffers and fields
+            void discard(void);
+
+        public:
+            PGDLAYOUT();
+            ~PGDLAYOUT();
+
+            const char *GetError(void) { return errmsg; }
+
+            /* DESCRIPTION; all return 0 for success, -1 for failure. Adding an
+               item discards the compiled buffers and fields until Compile()
+               is called again. */
+            /// Read a layout description file
+            int  Load(const char *filename);
+            /// Parse a layout description held in memory
+            int  Parse(const char *text);
+            int  AddBox(ushort x1, ushort y1, ushort x2, ushort y2, ushort color, bool filled);
+            int  AddLabel(ushort x, ushort y, uchar font, ushort color, const char *text);
+            int  AddButton(ushort x, ushort y, ushort bcolor, uchar font, ushort tcolor,
+                           uchar xmul, uchar ymul, const char *text);
+            int  AddIcon(ushort x, ushort y, ushort width, ushort height,
+                         uchar colormode, const uchar *data, int datalen);
+            int  AddField(const char *name, ushort x, ushort y, uchar font,
+                          ushort color, int width);
+            /// Discard the description and the compiled buffers
+            void Clear(void);
+
+            /// Encode the description; must be called before Draw()
+            int  Compile(void);
+            bool IsCompiled(void) { return compiled; }
+
+            /* DRAWING; return values as per PGD commands */
+            /// Draw the static part and all fields in one bulk transmission
+            int  Draw(PGD *pgd);
+            /// Replace the text of a field and redraw only that field
+            int  SetField(PGD *pgd, int index, const char *text);
+            /// Replace the text of a field without sending anything
+            int  SetFieldText(int index, const char *text);
+
+            /// @return index of the named field or -1 if it does not exist
+            int  FindField(const char *name);
+            int  GetFieldCount(void) { return fields.size(); }
+            const PGDFIELD *GetField(int index);
+
+            const PGDCMDBUF *GetStatic(void) { return &statbuf; }
+            const PGDCMDBUF *GetSlots(void) { return &slotbuf; }
+    };
+
+};  //namespace disp
+#endif // LAYOUT_H
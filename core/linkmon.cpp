@@ -0,0 +1,316 @@
+/**
+    file: linkmon.cpp
+
+    Link quality monitor for the PICASO SGC driver: error rates over a
+    sliding window of command results and the choice of bit rate.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <sys/time.h>
+
+#include "linkmon.h"
+
+using namespace disp;
+
+// a higher rate is kept unless its goodput is below this fraction of the rate below
+#define PGDLQMARGIN (0.9)
+
+// the rates in ascending order
+static const DBAUD ladder[PGDLQRATES] = {
+    DB_9600, DB_57600, DB_115200, DB_128000, DB_256000
+};
+
+
+// position of <rate> on the ladder
+static int rateIndex(DBAUD rate)
+{
+    for (int i = 0; i < PGDLQRATES; ++i)
+        if (ladder[i] == rate) return i;
+    return 0;
+}
+
+
+// seconds since the epoch
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+PGDLINKMON::PGDLINKMON()
+{
+    target = DB_9600;
+    why = LQ_NONE;
+    trial = false;
+    txbytes = 0;
+    sending = false;
+    tstart = tmark = tshift = tsend = now();
+    stats.holdoff = params.holdoff;
+    clearWindow();
+}
+
+
+
+int
+PGDLINKMON::SetParams(const PGDLQPARAMS &params)
+{
+    if ((params.window < 4) || (params.window > PGDLQMAXWIN)
+        || (params.minsamples < 1) || (params.minsamples > params.window)
+        || (params.maxerr < 0.0) || (params.maxerr >= 1.0) || (params.upclean < 1)
+        || (params.holdoff < 0) || (params.maxholdoff < params.holdoff))
+        return -1;
+
+    this->params = params;
+    stats.holdoff = params.holdoff;
+    if (!params.autoshift) target = stats.rate;
+    clearWindow();
+    return 0;
+}
+
+
+
+void
+PGDLINKMON::Start(DBAUD rate, DBAUD ceiling)
+{
+    stats.rate = rate;
+    stats.ceiling = (rateIndex(ceiling) < rateIndex(DB_MAX)) ? ceiling : DB_MAX;
+    if (rateIndex(stats.ceiling) < rateIndex(rate)) stats.ceiling = rate;
+    target = rate;
+    trial = false;
+    stats.holdoff = params.holdoff;
+    tshift = now();
+    clearWindow();
+    return;
+}
+
+
+
+void
+PGDLINKMON::Sent(int nbytes)
+{
+    if (nbytes <= 0) return;
+
+    if (!sending)
+    {
+        tsend = now();
+        sending = true;
+    }
+    txbytes += nbytes;
+    stats.bytes += nbytes;
+    return;
+}
+
+
+
+void
+PGDLINKMON::Record(int res)
+{
+    double t = now();
+
+    // a command is busy from its first write, or from the previous
+    // result if it was written ahead of it
+    double busy = t - ((sending && (tsend > tmark)) ? tsend : tmark);
+    if (busy < 0.0) busy = 0.0;
+
+    if (stats.wcount == params.window)
+    {
+        // the oldest result leaves the window
+        SAMPLE &old = ring[head];
+        if (old.res) --stats.werrors;
+        else wokbytes -= old.bytes;
+        wbusy -= old.busy;
+        --stats.wcount;
+    }
+
+    SAMPLE &s = ring[head];
+    s.res = res;
+    s.bytes = txbytes;
+    s.busy = busy;
+    head = (head + 1) % params.window;
+    ++stats.wcount;
+    wbusy += busy;
+
+    ++stats.commands;
+    stats.busy += busy;
+    switch (res)
+    {
+        case 0:
+            stats.okbytes += txbytes;
+            wokbytes += txbytes;
+            ++clean;
+            break;
+        case 1:
+            ++stats.nacks;
+            break;
+        case 2:
+            ++stats.timeouts;
+            break;
+        default:
+            ++stats.faults;
+            break;
+    }
+    if (res)
+    {
+        ++stats.werrors;
+        clean = 0;
+    }
+
+    stats.errrate = (double)stats.werrors / stats.wcount;
+    stats.goodput = (wbusy > 0.0) ? wokbytes / wbusy : 0.0;
+
+    txbytes = 0;
+    sending = false;
+    tmark = t;
+
+    if (params.autoshift && (!Pending())) decide();
+    return;
+}
+
+
+
+void
+PGDLINKMON::decide(void)
+{
+    int idx = rateIndex(stats.rate);
+
+    if ((stats.wcount >= params.minsamples) && (stats.errrate > params.maxerr) && (idx > 0))
+    {
+        if (trial) endTrial();
+        target = ladder[idx - 1];
+        why = LQ_ERRORS;
+        return;
+    }
+
+    if (stats.wcount == params.window)
+    {
+        stats.rategood[idx] = stats.goodput;
+        if (trial)
+        {
+            trial = false;
+            if ((idx > 0) && (stats.rategood[idx - 1] * PGDLQMARGIN > stats.goodput))
+            {
+                endTrial();
+                target = ladder[idx - 1];
+                why = LQ_SLOWER;
+                return;
+            }
+            stats.holdoff = params.holdoff;
+        }
+    }
+
+    if ((!trial) && (idx < rateIndex(stats.ceiling)) && (clean >= params.upclean)
+        && ((now() - tshift) * 1000.0 >= stats.holdoff))
+    {
+        target = ladder[idx + 1];
+        why = LQ_CLEAN;
+    }
+
+    return;
+}
+
+
+
+void
+PGDLINKMON::endTrial(void)
+{
+    trial = false;
+    ++stats.reverts;
+    stats.holdoff *= 2.0;
+    if (stats.holdoff > params.maxholdoff) stats.holdoff = params.maxholdoff;
+    return;
+}
+
+
+
+void
+PGDLINKMON::Shifted(DBAUD rate)
+{
+    double t = now();
+
+    if (rate == target)
+    {
+        stats.from = stats.rate;
+        stats.to = rate;
+        stats.reason = why;
+        stats.when = t - tstart;
+        if (rateIndex(rate) > rateIndex(stats.rate))
+        {
+            ++stats.upshifts;
+            trial = true;
+        }
+        else
+        {
+            ++stats.downshifts;
+        }
+    }
+    else
+    {
+        ++stats.shiftfails;
+        if (rateIndex(target) > rateIndex(stats.rate))
+        {
+            stats.holdoff *= 2.0;
+            if (stats.holdoff > params.maxholdoff) stats.holdoff = params.maxholdoff;
+        }
+    }
+
+    stats.rate = rate;
+    target = rate;
+    why = LQ_NONE;
+    tshift = t;
+    clearWindow();
+    return;
+}
+
+
+
+void
+PGDLINKMON::Reset(void)
+{
+    PGDLINKQUAL tmp;
+    tmp.rate = stats.rate;
+    tmp.ceiling = stats.ceiling;
+    tmp.holdoff = stats.holdoff;
+    for (int i = 0; i < PGDLQRATES; ++i) tmp.rategood[i] = stats.rategood[i];
+    stats = tmp;
+    tstart = now();
+    clearWindow();
+    return;
+}
+
+
+
+void
+PGDLINKMON::clearWindow(void)
+{
+    head = 0;
+    stats.wcount = 0;
+    stats.werrors = 0;
+    stats.errrate = 0.0;
+    stats.goodput = 0.0;
+    wokbytes = 0;
+    wbusy = 0.0;
+    clean = 0;
+    txbytes = 0;
+    sending = false;
+    tmark = now();
+    return;
+}
@@ -0,0 +1,109 @@
+/**
+    file: linkmon.h
+
+    Link quality monitor for the PICASO SGC driver: error rates over a
+    sliding window of command results and the choice of bit rate.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+/*
+    Notes:
+        + The monitor only decides; PGD changes the rate at the start of
+          the next command, verifies the new rate with a Version query
+          and reports the outcome with Shifted().
+        + Rates are stepped one at a time along DB_9600, DB_57600,
+          DB_115200, DB_128000, DB_256000 and never above the rate set
+          with PGD::SetBaud().
+        + A downshift happens as soon as the window holds <minsamples>
+          results and more than <maxerr> of them failed.  A higher rate
+          is tried after <upclean> consecutive successes and <holdoff>
+          msec; it is on trial until its window is full.  A trial which
+          fails, or which moves clearly (10%) fewer bytes per second
+          than the last full window at the rate below, is abandoned and
+          the holdoff is doubled (up to <maxholdoff>); a successful trial
+          restores it.
+        + Goodput is measured while commands are outstanding, so idle
+          time in the application does not count against a rate; the
+          goodput of different rates is only comparable if the mix of
+          commands is similar.
+ */
+
+#ifndef LINKMON_H
+#define LINKMON_H
+
+#include "oled.h"
+
+namespace disp {
+
+    class PGDLINKMON {
+        private:
+            struct SAMPLE {
+                int res;                // 0 ACK, 1 NACK, 2 timeout, < 0 fault
+                unsigned int bytes;     // bytes written for the command
+                double busy;            // sec
+            };
+            SAMPLE ring[PGDLQMAXWIN];
+            int head;                   // next slot to be written
+            unsigned long wokbytes;     // bytes of acknowledged commands in the window
+            double wbusy;               // busy time in the window
+            PGDLQPARAMS params;
+            PGDLINKQUAL stats;
+            DBAUD target;               // rate wanted; differs from stats.rate if a change is due
+            PGDLQREASON why;            // reason for the change which is due
+            int clean;                  // consecutive successes
+            bool trial;                 // the current rate is on trial
+            unsigned int txbytes;       // bytes written since the last result
+            bool sending;               // bytes have been written since the last result
+            double tsend;               // time of the first write since the last result
+            double tmark;               // time of the last result or rate change
+            double tshift;              // time of the last rate change
+            double tstart;              // time of the last Reset()
+            // clear the window
+            void clearWindow(void);
+            // choose the next rate after a result
+            void decide(void);
+            // give up the trial of the current rate
+            void endTrial(void);
+
+        public:
+            PGDLINKMON();
+
+            /// @return 0 for success, -1 if the parameters are invalid
+            int  SetParams(const PGDLQPARAMS &params);
+            const PGDLQPARAMS &GetParams(void) { return params; }
+
+            /// Start measuring at <rate>; <ceiling> is the highest rate to be tried
+            void Start(DBAUD rate, DBAUD ceiling);
+            /// Account for <nbytes> written to the display
+            void Sent(int nbytes);
+            /// Record a command result (0 ACK, 1 NACK, 2 timeout, < 0 fault)
+            void Record(int res);
+            /// @return true if the rate should be changed to GetTarget()
+            bool Pending(void) { return target != stats.rate; }
+            DBAUD GetTarget(void) { return target; }
+            /// Report the rate in use after an attempt to change to GetTarget()
+            void Shifted(DBAUD rate);
+
+            const PGDLINKQUAL &GetStats(void) { return stats; }
+            /// Clear the counters; the rate and the goodput of each rate are kept
+            void Reset(void);
+    };
+
+};  //namespace disp
+#endif // LINKMON_H
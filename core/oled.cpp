@@ -64,6 +64,11 @@
 
 #include "oled.h"
 #include "comport.h"
+#include "cmdbuf.h"
+#include "capcache.h"
+#include "rotate.h"
+#include "linkmon.h"
+#include "journal.h"
 
 using namespace disp;
 
@@ -90,6 +95,22 @@ using namespace disp;
     if (state == LCD_BUSY) {\
         ERRMSG("display busy");\
         return -1; }\
+    if (connecting && (!pthread_equal(pthread_self(), linker))) {\
+        ERRMSG("display connecting");\
+        return -1; }\
+    } while (0)
+
+// make the rate change decided by the link monitor before a command;
+// the command fails only if the display was lost
+#define CHECK_SHIFT do {\
+    if (lmon->Pending() && (state == LCD_IDLE) && (!shifting) && (shiftBaud() < 0))\
+        return -1;\
+    } while (0)
+
+// record the command while ConnectAsync() is in progress
+#define CHECK_CONNECTING(call) do {\
+    if (connecting && (!pthread_equal(pthread_self(), linker)) && lockPending())\
+        return unlockPending(pending->call);\
     } while (0)
 
 // thread callback routine
@@ -110,8 +131,27 @@ void *procthread(void *arg)
 
 
 
+// thread callback routine for ConnectAsync()
+void *connthread(void *arg)
+{
+    PGD *pp;
+    if (!arg)
+    {
+        ERROUT("argument is NULL");
+        exit(-1);
+    }
+
+    pp = (PGD *)arg;
+    if (!pp->Link()) while (!pp->Process());
+
+    pthread_exit(NULL);
+}
+
+
+
 PGD::PGD()
 {
+    port = &serial;
     halt = 0;
     state = LCD_INACTIVE;
     procloop = 0;
@@ -122,6 +162,28 @@ PGD::PGD()
     brcv = 0;
     callback = NULL;
     usrobj = NULL;
+    txwin = PGDTXWIN;
+    capfile[0] = 0;
+    nwidth = 0;
+    nheight = 0;
+    orient = 0;
+    norient = LANDSCAPE;
+    iconrot = true;
+    pen = SOLID;
+    nclip = 0;
+    updateClip();
+    connecting = false;
+    linker = 0;
+    linkport[0] = 0;
+    pthread_mutex_init(&pmutex, NULL);
+    pending = new PGDCMDBUF;
+    flushing = new PGDCMDBUF;
+    lmon = new PGDLINKMON;
+    shifting = false;
+    maxretry = PGDRETRIES;
+    journal = new PGDJOURNAL;
+    replay = new PGDCMDBUF;
+    replaying = false;
 }
 
 PGD::~PGD()
@@ -129,6 +191,12 @@ PGD::~PGD()
     Close();
     callback = NULL;
     usrobj = NULL;
+    delete pending;
+    delete flushing;
+    delete lmon;
+    delete journal;
+    delete replay;
+    pthread_mutex_destroy(&pmutex);
     return;
 }
 
@@ -153,22 +221,77 @@ int
 PGD::Connect(const char *portname)
 {
     CHECK_BUSY;
+    if (openPort(portname)) return -1;
+    if (link(portname)) return -1;
+
+    if (pthread_create(&procloop, NULL, procthread, this))
+    {
+        ERRMSG("could not create processing thread: %s\n", strerror(errno));
+        Close();
+        return -1;
+    }
+
+    return 0;
+}
+
+
+
+// open a port and connect on the I/O thread
+int
+PGD::ConnectAsync(const char *portname)
+{
+    CHECK_BUSY;
+    if (openPort(portname)) return -1;
+
+    snprintf(linkport, PATH_MAX, "%s", portname);
+    pending->Clear();
+    lstats = PGDLINKSTATS();
+    gettimeofday(&tconnect, NULL);
+    linker = 0;
+    connecting = true;
+
+    if (pthread_create(&procloop, NULL, connthread, this))
+    {
+        ERRMSG("could not create processing thread: %s\n", strerror(errno));
+        connecting = false;
+        procloop = 0;
+        port->Close();
+        return -1;
+    }
+
+    return 0;
+}
+
+
+
+int
+PGD::openPort(const char *portname)
+{
     curcmd = PG_NONE;
     curdata = NULL;
     brcv = 0;
 
-    if (port.IsOpen()) Close();
+    if (port->IsOpen()) Close();
+    halt = false;
 
     com::COMPARAMS parm;
     /* W32 */
     parm.speed = B9600;
 
-    if (port.Open(portname, &parm))
+    if (port->Open(portname, &parm))
     {
-        ERRMSG("could not open port (see below)\n%s", port.GetError());
+        ERRMSG("could not open port (see below)\n%s", port->GetError());
         return -1;
     }
 
+    return 0;
+}
+
+
+
+int
+PGD::link(const char *portname)
+{
     // as per the manual, waste 500ms before communicating
     /* W32 */
     struct timeval tov;
@@ -185,63 +308,648 @@ PGD::Connect(const char *portname)
     }
 
     while ((now.tv_sec < tov.tv_sec) || ((now.tv_sec == tov.tv_sec)
-            && (now.tv_usec < tov.tv_sec)))
+            && (now.tv_usec < tov.tv_usec)))
     {
-        usleep(50000);
+        if (halt)
+        {
+            ERRMSG("connection cancelled");
+            return -1;
+        }
+        long usec = (tov.tv_sec - now.tv_sec) * 1000000L + (tov.tv_usec - now.tv_usec);
+        usleep((usec < 50000) ? usec : 50000);
         gettimeofday(&now, NULL);
     }
 
     if (autobaud()) return -1;
 
-    if(SetBaud(DB_MAX)) ERROUT("\n%s\n", errmsg);
+    // identify the display; with a cache hit there is nothing to probe
+    // and the rate which worked last time is used directly
+    caps = PGDCAPS();
+    PGDCAPCACHE cache;
+    bool cached = false;
+    if (capfile[0])
+    {
+        if (cache.Load(capfile)) ERROUT("\n%s\n", cache.GetError());
+        if (!Version(&caps.ver, false))
+        {
+            if (!cache.Find(portname, caps.ver, &caps))
+                cached = true;
+            else
+                caps.rev = probeRev();
+        }
+    }
 
-    if (pthread_create(&procloop, NULL, procthread, this))
+    bool rated = true;
+    if (SetBaud(((cached) && (caps.baud != DB_MAX)) ? caps.baud : DB_MAX))
     {
-        ERRMSG("could not create processing thread: %s\n", strerror(errno));
-        Close();
-        return -1;
+        ERROUT("\n%s\n", errmsg);
+        rated = false;
+    }
+
+    // only a rate which the display has accepted is recorded; after a
+    // failed change the file is left as it was
+    if ((capfile[0]) && (!cached) && (rated) && (caps.rev != SGC_UNKNOWN))
+    {
+        caps.baud = baud;
+        cache.Store(portname, caps);
+        if (cache.Save(capfile)) ERROUT("\n%s\n", cache.GetError());
     }
 
+    // the display starts in its native orientation with a solid pen
+    orient = 0;
+    pen = SOLID;
+    if ((caps.ver.hres) && (caps.ver.vres))
+    {
+        nwidth = caps.ver.hres;
+        nheight = caps.ver.vres;
+    }
+    updateClip();
+    journal->Reset();
+
     return 0;
 }
 
 
 
+// msec since <ts>
+static double msecSince(const struct timeval &ts)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - ts.tv_sec) * 1000.0 + (now.tv_usec - ts.tv_usec) / 1000.0;
+}
+
+
+
+// the I/O thread's part of ConnectAsync()
+int
+PGD::Link(void)
+{
+    linker = pthread_self();
+
+    int res = link(linkport);
+    if (!res)
+    {
+        lstats.linkup = msecSince(tconnect);
+        lstats.flushres = flushPending();
+        lstats.flushed = msecSince(tconnect);
+    }
+    else
+    {
+        // the queued commands cannot be sent
+        pthread_mutex_lock(&pmutex);
+        pending->Clear();
+        connecting = false;
+        pthread_mutex_unlock(&pmutex);
+        port->Close();
+        state = LCD_INACTIVE;
+    }
+
+    if (callback) callback(this, PG_CONNECT, !res, usrobj);
+    return res;
+}
+
+
+
+int
+PGD::flushPending(void)
+{
+    int res = 0;
+    int r;
+
+    // commands queued while a batch is sent go out in the next batch
+    while (true)
+    {
+        pthread_mutex_lock(&pmutex);
+        if ((!pending->GetCount()) || halt)
+        {
+            pending->Clear();
+            connecting = false;
+            pthread_mutex_unlock(&pmutex);
+            return res;
+        }
+        flushing->Clear();
+        r = flushing->Append(*pending);
+        pending->Clear();
+        pthread_mutex_unlock(&pmutex);
+
+        if (r)
+        {
+            ERRMSG("could not take the queued commands; see message below\n%s",
+                   flushing->GetError());
+            r = -1;
+        }
+        else
+        {
+            r = Transmit(flushing);
+        }
+        // a fault is reported and the remaining commands are still tried
+        if ((r < 0) || ((r > res) && (res >= 0))) res = r;
+    }
+}
+
+
+
+bool
+PGD::lockPending(void)
+{
+    pthread_mutex_lock(&pmutex);
+    if (connecting) return true;
+    pthread_mutex_unlock(&pmutex);
+    return false;
+}
+
+
+
+int
+PGD::unlockPending(int res, int ncmds)
+{
+    if (res)
+        ERRMSG("could not queue the command; see message below\n%s", pending->GetError());
+    else
+        lstats.queued += ncmds;
+    pthread_mutex_unlock(&pmutex);
+    return res;
+}
+
+
+
 
 
 // close a port
 void
 PGD::Close(void)
 {
-    if (!port.IsOpen()) return;
-    errmsg[0] = 0;
-    halt = true;
+    if (connecting)
+    {
+        // stop the background connection first
+        halt = true;
+        pthread_join(procloop, NULL);
+        procloop = 0;
+    }
+    if (!port->IsOpen())
+    {
+        // a background connection which failed leaves its thread behind
+        if (procloop) pthread_join(procloop, NULL);
+        procloop = 0;
+        return;
+    }
+    errmsg[0] = 0;
+    halt = true;
+
+    if (state == LCD_BUSY)
+    {
+        ERRMSG("port is closing");
+        PGDCMD tmpcmd = curcmd;
+        curcmd = PG_NONE;
+        curdata = NULL;
+        state = LCD_IDLE;
+        if (callback) callback(this, tmpcmd, false, usrobj);
+    }
+
+    if (state != LCD_INACTIVE)
+    {
+        if (setRate(DB_9600))
+        {
+            ERROUT("cannot restore default bitrate; device will require manual reset\n%s\n",
+                  errmsg);
+        }
+    }
+
+    port->Close();
+    state = LCD_INACTIVE;
+    /* W32 */
+    if (procloop) pthread_join(procloop, NULL);
+    procloop = 0;
+
+    return;
+}
+
+
+
+// select the transport used by Connect()
+int
+PGD::SetTransport(com::COMMIF *transport)
+{
+    CHECK_BUSY;
+
+    if (port->IsOpen())
+    {
+        ERRMSG("cannot change the transport while connected");
+        return -1;
+    }
+
+    port = transport ? transport : &serial;
+    return 0;
+}
+
+
+/*****************************************************
+                  STAGING MEMORY
+*****************************************************/
+
+int
+PGD::SetArena(unsigned int size)
+{
+    CHECK_BUSY;
+
+    if (arena.Init(size))
+    {
+        ERRMSG("could not allocate arena (%u bytes)", size);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+
+/*****************************************************
+                DEVICE CAPABILITIES
+*****************************************************/
+
+int
+PGD::SetCapCache(const char *filename)
+{
+    if (!filename)
+    {
+        capfile[0] = 0;
+        return 0;
+    }
+
+    if (snprintf(capfile, PATH_MAX, "%s", filename) >= PATH_MAX)
+    {
+        capfile[0] = 0;
+        ERRMSG("filename too long");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+
+int
+PGD::ProbeCaps(void)
+{
+    CHECK_INACTIVE;
+    CHECK_BUSY;
+    CHECK_SHIFT;
+
+    PGDCAPS tmp;
+    int res = Version(&tmp.ver, false);
+    if (res) return res;
+
+    tmp.rev = probeRev();
+    if (tmp.rev == SGC_UNKNOWN)
+    {
+        ERRMSG("no response to the resolution query");
+        return 2;
+    }
+
+    tmp.baud = baud;
+    caps = tmp;
+
+    if (capfile[0])
+    {
+        PGDCAPCACHE cache;
+        if (!cache.Load(capfile))
+        {
+            cache.Store(port->GetPortName(), caps);
+            if (!cache.Save(capfile)) return 0;
+        }
+        ERRMSG("could not update the capability cache; see message below\n%s",
+               cache.GetError());
+        return -1;
+    }
+
+    return 0;
+}
+
+
+
+DSGCREV
+PGD::probeRev(void)
+{
+    // R11 responds to 'd' with 2 resolution codes; R4 NACKs it
+    char msg[4];
+    port->Flush();
+    if (portWrite("d", 1) != 1) return SGC_UNKNOWN;
+
+    int res = port->Read(msg, 2, 50);
+    if ((res == 1) && (msg[0] == '\x15')) return SGC_R4;
+    if ((res == 2) && (convertRes(msg[0])) && (convertRes(msg[1]))) return SGC_R11;
+
+    port->Flush();
+    return SGC_UNKNOWN;
+}
+
+
+
+/*****************************************************
+                HOST-SIDE CLIPPING
+*****************************************************/
+
+PGDRECT
+disp::PGDTextExtent(int x, int y, uchar font, int xmul, int ymul, const char *text)
+{
+    // character cells of the fixed fonts: 5x7, 8x8, 8x12, 12x16
+    static const int cw[4] = { 6, 8, 8, 12 };
+    static const int ch[4] = { 8, 8, 12, 16 };
+
+    int len = text ? strlen(text) : 0;
+    if (!len) return PGDRECT();
+    font &= 0x03;
+    if (xmul < 1) xmul = 1;
+    if (ymul < 1) ymul = 1;
+    return PGDRECT(x, y, x + len * cw[font] * xmul - 1, y + ch[font] * ymul - 1);
+}
+
+
+
+int
+PGD::SetNativeOrient(uchar orient)
+{
+    if ((orient < LANDSCAPE) || (orient > PORTRAIT_R))
+    {
+        ERRMSG("invalid orientation (%d); valid values are 1..4", orient);
+        return -1;
+    }
+
+    norient = orient;
+    updateClip();
+    return 0;
+}
+
+
+
+int
+PGD::turns(void)
+{
+    // quarter turns of each DORIENT value from LANDSCAPE
+    static const int qt[5] = { 0, 0, 2, 1, 3 };
+
+    if (!orient) return 0;
+    return (qt[orient] - qt[norient]) & 3;
+}
+
+
+
+int
+PGD::SetBounds(ushort width, ushort height)
+{
+    if ((!width) != (!height))
+    {
+        ERRMSG("invalid bounds (%u x %u)", width, height);
+        return -1;
+    }
+
+    nwidth = width;
+    nheight = height;
+    updateClip();
+    return 0;
+}
+
+
+
+int
+PGD::PushClip(const PGDRECT &area)
+{
+    if (nclip >= PGDCLIPDEPTH)
+    {
+        ERRMSG("clip stack is full (%d entries)", PGDCLIPDEPTH);
+        return -1;
+    }
+
+    cstack[nclip++] = area;
+    updateClip();
+    return 0;
+}
+
+
+
+int
+PGD::PopClip(void)
+{
+    if (!nclip)
+    {
+        ERRMSG("clip stack is empty");
+        return -1;
+    }
+
+    --nclip;
+    updateClip();
+    return 0;
+}
+
+
+
+void
+PGD::updateClip(void)
+{
+    // coordinates are 16-bit; without known bounds that is the limit
+    clip = PGDRECT(0, 0, 0xffff, 0xffff);
+    if (nwidth)
+    {
+        // the axes are swapped after an odd number of quarter turns
+        if (turns() & 1)
+            clip = PGDRECT(0, 0, nheight - 1, nwidth - 1);
+        else
+            clip = PGDRECT(0, 0, nwidth - 1, nheight - 1);
+    }
+
+    int i;
+    for (i = 0; i < nclip; ++i)
+    {
+        if (cstack[i].x1 > clip.x1) clip.x1 = cstack[i].x1;
+        if (cstack[i].y1 > clip.y1) clip.y1 = cstack[i].y1;
+        if (cstack[i].x2 < clip.x2) clip.x2 = cstack[i].x2;
+        if (cstack[i].y2 < clip.y2) clip.y2 = cstack[i].y2;
+    }
+
+    return;
+}
+
+
+
+int
+PGD::clipRect(PGDRECT *r)
+{
+    if ((r->IsEmpty()) || (!r->Intersects(clip))) return -1;
+
+    int res = 0;
+    if (r->x1 < clip.x1) { r->x1 = clip.x1; res = 1; }
+    if (r->y1 < clip.y1) { r->y1 = clip.y1; res = 1; }
+    if (r->x2 > clip.x2) { r->x2 = clip.x2; res = 1; }
+    if (r->y2 > clip.y2) { r->y2 = clip.y2; res = 1; }
+    return res;
+}
+
+
+
+// outcodes for the line clipper
+#define OC_LEFT     (1)
+#define OC_RIGHT    (2)
+#define OC_TOP      (4)
+#define OC_BOTTOM   (8)
+
+int
+PGD::clipLine(int *x1, int *y1, int *x2, int *y2)
+{
+    int c1, c2, c, x, y;
+    int res = 0;
+
+    while (1)
+    {
+        c1 = ((*x1 < clip.x1) ? OC_LEFT : 0) | ((*x1 > clip.x2) ? OC_RIGHT : 0)
+            | ((*y1 < clip.y1) ? OC_TOP : 0) | ((*y1 > clip.y2) ? OC_BOTTOM : 0);
+        c2 = ((*x2 < clip.x1) ? OC_LEFT : 0) | ((*x2 > clip.x2) ? OC_RIGHT : 0)
+            | ((*y2 < clip.y1) ? OC_TOP : 0) | ((*y2 > clip.y2) ? OC_BOTTOM : 0);
+
+        if (!(c1 | c2)) return res;
+        if (c1 & c2) return -1;
+
+        // move the outside end point to the clip boundary
+        c = c1 ? c1 : c2;
+        if (c & OC_LEFT)
+        {
+            x = clip.x1;
+            y = *y1 + (*y2 - *y1) * (x - *x1) / (*x2 - *x1);
+        }
+        else if (c & OC_RIGHT)
+        {
+            x = clip.x2;
+            y = *y1 + (*y2 - *y1) * (x - *x1) / (*x2 - *x1);
+        }
+        else if (c & OC_TOP)
+        {
+            y = clip.y1;
+            x = *x1 + (*x2 - *x1) * (y - *y1) / (*y2 - *y1);
+        }
+        else
+        {
+            y = clip.y2;
+            x = *x1 + (*x2 - *x1) * (y - *y1) / (*y2 - *y1);
+        }
+
+        if (c == c1)
+        {
+            *x1 = x;
+            *y1 = y;
+        }
+        else
+        {
+            *x2 = x;
+            *y2 = y;
+        }
+        res = 1;
+    }
+
+    return res;
+}
+
+
+
+/*****************************************************
+             PRERECORDED COMMAND SEQUENCES
+*****************************************************/
+
+int
+PGD::SetTxWindow(int ncmds)
+{
+    CHECK_BUSY;
+
+    if ((ncmds < 1) || (ncmds > 64))
+    {
+        ERRMSG("invalid window (%d); valid values are 1..64", ncmds);
+        return -1;
+    }
+
+    txwin = ncmds;
+    return 0;
+}
+
+
+
+int
+PGD::Transmit(const PGDCMDBUF *buf, int first, int count)
+{
+    // a whole buffer can be queued while connecting
+    if (connecting && (!pthread_equal(pthread_self(), linker)) && buf && (first == 0)
+        && ((count < 0) || (count == buf->GetCount())) && lockPending())
+        return unlockPending(pending->Append(*buf), buf->GetCount());
+    CHECK_INACTIVE;
+    CHECK_BUSY;
+    CHECK_SHIFT;
 
-    if (state == LCD_BUSY)
+    if (!buf)
     {
-        ERRMSG("port is closing");
-        PGDCMD tmpcmd = curcmd;
-        curcmd = PG_NONE;
-        curdata = NULL;
-        state = LCD_IDLE;
-        if (callback) callback(this, tmpcmd, false, usrobj);
+        ERRMSG("invalid command buffer (NULL)");
+        return -1;
     }
 
-    if (state != LCD_INACTIVE)
+    int ncmd = buf->GetCount();
+    if (count < 0) count = ncmd - first;
+    if ((first < 0) || (first + count > ncmd))
+    {
+        ERRMSG("invalid command range (%d + %d); buffer holds %d commands",
+               first, count, ncmd);
+        return -1;
+    }
+    if (!count) return 0;
+
+    int last = first + count;
+    int sent = first;   // next command to write
+    int done = first;   // next command awaiting an ACK
+    int nacks = 0;
+    int stop, ofs, len, res;
+    const char *dp = buf->GetData();
+
+    port->Flush();
+    while (done < last)
     {
-        if (SetBaud(DB_9600))
+        // top up the window with as many commands as we can write at once
+        stop = sent;
+        while ((stop < last) && (stop - done < txwin)) ++stop;
+        if (stop > sent)
         {
-            ERROUT("cannot restore default bitrate; device will require manual reset\n%s\n",
-                  errmsg);
+            ofs = buf->GetOffset(sent);
+            len = buf->GetOffset(stop) - ofs;
+            if ((res = portWrite(&dp[ofs], len)) != len)
+            {
+                ERRMSG("failed at command %d of %d; see message below\n%s",
+                       sent - first + 1, count, port->GetError());
+                if ((res > 0) || (sent > done)) return -2;
+                return -1;
+            }
+            sent = stop;
         }
-    }
 
-    port.Close();
-    state = LCD_INACTIVE;
-    /* W32 */
-    if (procloop) pthread_join(procloop, NULL);
+        int nacked = nacks;
+        if ((res = waitACKs(1, buf->GetTimeout(done), &nacks)))
+        {
+            char msg[PGDERRLEN];
+            snprintf(msg, PGDERRLEN, "%s", errmsg);
+            ERRMSG("no response to command %d of %d (%d in flight)\n%s",
+                   done - first + 1, count, sent - done, msg);
+            return res;
+        }
+        if (nacks == nacked)
+        {
+            // keep track of the pen size set by the acknowledged commands
+            ofs = buf->GetOffset(done);
+            if (dp[ofs] == 'p') pen = dp[ofs + 1];
+            journalCmd(&dp[ofs], buf->GetOffset(done + 1) - ofs, buf->GetTimeout(done), NULL, 0);
+        }
+        ++done;
+    }
 
-    return;
+    if (nacks)
+    {
+        ERRMSG("%d of %d commands were rejected (NACK)", nacks, count);
+        return 1;
+    }
+    return 0;
 }
 
 
@@ -256,8 +964,8 @@ PGD::autobaud(void)
     int res;
     while (i--)
     {
-        port.Flush();
-        if ((res = port.Write("U", 1)) < 0) usleep(20);
+        port->Flush();
+        if ((res = portWrite("U", 1)) < 0) usleep(20);
         if ((res >= 0) && (!waitACK(20))) break;
         if (i == 0)
         {
@@ -270,6 +978,7 @@ PGD::autobaud(void)
     /* W32 */
     portspeed = B9600;
     state = LCD_IDLE;
+    lmon->Start(DB_9600, DB_9600);
     return 0;
 }
 
@@ -280,6 +989,16 @@ PGD::SetBaud(enum disp::DBAUD speed)
     CHECK_INACTIVE;
     CHECK_BUSY;
 
+    int res = setRate(speed);
+    if (!res) lmon->Start(baud, baud);
+    return res;
+}
+
+
+
+int
+PGD::setRate(enum disp::DBAUD speed)
+{
     if (speed == baud) return 0;    // nothing to be done
 
     // test if the selected speed is supported
@@ -322,14 +1041,14 @@ PGD::SetBaud(enum disp::DBAUD speed)
             ERRMSG("unsupported bitrate: %d", speed);
             return -1;
     }
-    if (port.SetBaud(tspeed))
+    if (port->SetBaud(tspeed))
     {
         ERRMSG("bitrate not supported on system/hardware (see below)\n%s",
-               port.GetError());
+               port->GetError());
         return -1;
     }
     usleep(50);
-    if (port.SetBaud(portspeed) < 0)
+    if (port->SetBaud(portspeed) < 0)
     {
         ERRMSG("cannot revert to original bitrate");
         return -1;
@@ -338,28 +1057,31 @@ PGD::SetBaud(enum disp::DBAUD speed)
 
     char cmd[8] = "Q      ";
     cmd[1] = speed & 0xff;
-    port.Flush();
+    // R11 moved the 128000 and 256000 rates to new codes
+    if ((caps.rev == SGC_R11) && (speed == DB_128000)) cmd[1] = 0x10;
+    if ((caps.rev == SGC_R11) && (speed == DB_256000)) cmd[1] = 0x11;
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 2)) != 2)
+    if ((res = portWrite(cmd, 2)) != 2)
     {
-        ERRMSG("failed to send SetBaud command (see below)\n%s", port.GetError());
+        ERRMSG("failed to send SetBaud command (see below)\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
     // the PICASO chip seems to always return 0xFF so we ignore the result
     // unless it is a NACK
-    if (waitACKNACK(100) == 1)
+    if (waitACKNACK(100, false) == 1)
     {
         ERRMSG("NACK on SetBaud() request");
         return 1;
     }
 
-    if (port.SetBaud(tspeed))
+    if (port->SetBaud(tspeed))
     {
         ERRMSG("could not switch host bitrate after switching display bitrate;\n"
                 "\n\tdisplay will require a manual reset. See message below.\n%s",
-                port.GetError());
+                port->GetError());
         return -2;
     }
 
@@ -371,33 +1093,210 @@ PGD::SetBaud(enum disp::DBAUD speed)
 
 
 
+// write to the port, counting the bytes for the link monitor
+int
+PGD::portWrite(const char *data, int len)
+{
+    int res = port->Write(data, len);
+    if (res > 0) lmon->Sent(res);
+    return res;
+}
+
+
+
+// make the rate change decided by the link monitor; the display must
+// answer a Version query at the new rate.  Otherwise it is looked for at
+// the old rate and then at the new one again.  Returns 0 if the rate was
+// changed, +1 if the old rate is kept and -1 if the display answers at
+// neither rate.
+int
+PGD::shiftBaud(void)
+{
+    DBAUD from = baud;
+    DBAUD to = lmon->GetTarget();
+    unsigned int fromspeed = portspeed;
+
+    shifting = true;
+    int res = setRate(to);
+    if ((!res) && (baud != from) && Version(NULL, false)) res = -1;
+    if (res < 0)
+    {
+        // portspeed is still fromspeed unless the host has switched
+        unsigned int tospeed = portspeed;
+        if (!probeRate(from, fromspeed))
+        {
+            res = 1;
+        }
+        else if ((tospeed != fromspeed) && (!probeRate(to, tospeed)))
+        {
+            res = 0;
+        }
+        else
+        {
+            ERRMSG("display does not answer at the old rate (0x%.2X) or at the new"
+                   " rate (0x%.2X); it may need a reset", from, to);
+            if (!port->SetBaud(fromspeed))
+            {
+                baud = from;
+                portspeed = fromspeed;
+            }
+        }
+    }
+    if (res)
+    {
+        char msg[PGDERRLEN];
+        snprintf(msg, PGDERRLEN, "%s", errmsg);
+        ERROUT("could not change the rate from 0x%.2X to 0x%.2X; see message below\n%s\n",
+               from, to, msg);
+    }
+    shifting = false;
+
+    lmon->Shifted(baud);
+    return res;
+}
+
+
+
+// switch the port to <speed> and see whether the display answers there
+int
+PGD::probeRate(enum disp::DBAUD rate, unsigned int speed)
+{
+    if (port->SetBaud(speed))
+    {
+        ERRMSG("could not switch the host bitrate (see below)\n%s", port->GetError());
+        return -1;
+    }
+    usleep(50);
+    baud = rate;
+    portspeed = speed;
+    port->Flush();
+    return Version(NULL, false) ? -1 : 0;
+}
+
+
+
+int
+PGD::SetRetries(int nretries)
+{
+    CHECK_BUSY;
+
+    if ((nretries < 0) || (nretries > 8))
+    {
+        ERRMSG("invalid number of retries (%d); valid values are 0..8", nretries);
+        return -1;
+    }
+
+    maxretry = nretries;
+    return 0;
+}
+
+
+
+int
+PGD::SetJournal(unsigned int maxbytes)
+{
+    CHECK_BUSY;
+    journal->SetLimit(maxbytes);
+    return 0;
+}
+
+
+
+const PGDJOURNALSTATS &
+PGD::GetJournalStats(void)
+{
+    return journal->GetStats();
+}
+
+
+
+int
+PGD::CheckReset(void)
+{
+    CHECK_INACTIVE;
+    CHECK_BUSY;
+
+    if (!journal->IsEnabled())
+    {
+        ERRMSG("the journal is not enabled (see SetJournal())");
+        return -1;
+    }
+
+    return recover();
+}
+
+
+
+int
+PGD::SetLinkMonitor(const PGDLQPARAMS &params)
+{
+    CHECK_BUSY;
+
+    if (lmon->SetParams(params))
+    {
+        ERRMSG("invalid parameters; window must be 4..%d and hold at least minsamples,"
+               " maxerr 0..1, upclean >= 1 and 0 <= holdoff <= maxholdoff", PGDLQMAXWIN);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+
+const PGDLQPARAMS &
+PGD::GetLinkMonitor(void)
+{
+    return lmon->GetParams();
+}
+
+
+
+const PGDLINKQUAL &
+PGD::GetLinkQuality(void)
+{
+    return lmon->GetStats();
+}
+
+
+
+void
+PGD::ResetLinkQuality(void)
+{
+    lmon->Reset();
+    return;
+}
+
+
+
 int
 PGD::Version(struct disp::PGDVER *ver, bool display)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char msg[8];
     int res;
 
     /* W32 */
-    port.Flush();
+    port->Flush();
     if (display)
-        res = port.Write("V\x01", 2);
+        res = portWrite("V\x01", 2);
     else
-        res = port.Write("V\x00", 2);
+        res = portWrite("V\x00", 2);
 
     if (res != 2)
     {
-        ERRMSG("could not query version (see message below)\n%s", port.GetError());
+        ERRMSG("could not query version (see message below)\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
     if (display)
-        res = port.Read(msg, 5, 500);
+        res = port->Read(msg, 5, 500);
     else
-        res = port.Read(msg, 5, 50);
+        res = port->Read(msg, 5, 50);
 
     if (res < 0)
     {
@@ -412,31 +1311,22 @@ PGD::Version(struct disp::PGDVER *ver, bool display)
 
     if (ver)
     {
-        switch (msg[0])
+        PGDParseVersion(msg, ver);
+
+        if ((!nwidth) && (ver->hres) && (ver->vres))
         {
-            case 0:
-            case 1:
-            case 2:
-                ver->display_type = msg[0];
-                break;
-            default:
-                ver->display_type = DEV_UNKNOWN;
-                break;
+            nwidth = ver->hres;
+            nheight = ver->vres;
+            updateClip();
         }
-
-        ver->hardware_rev = msg[1] & 0xff;
-        ver->firmware_rev = msg[2] & 0xff;
-
-        ver->hres = convertRes(msg[3]);
-        ver->vres = convertRes(msg[4]);
     }
 
     return 0;
 }
 
 
-unsigned int
-PGD::convertRes(char rescode)
+// convert a resolution code to pixels; 0 = unknown
+static unsigned int resolution(char rescode)
 {
     switch (rescode)
     {
@@ -463,26 +1353,153 @@ PGD::convertRes(char rescode)
 
 
 
+unsigned int
+PGD::convertRes(char rescode)
+{
+    return resolution(rescode);
+}
+
+
+
+void
+disp::PGDParseVersion(const char *msg, PGDVER *ver)
+{
+    switch (msg[0])
+    {
+        case 0:
+        case 1:
+        case 2:
+            ver->display_type = msg[0];
+            break;
+        default:
+            ver->display_type = DEV_UNKNOWN;
+            break;
+    }
+
+    ver->hardware_rev = msg[1] & 0xff;
+    ver->firmware_rev = msg[2] & 0xff;
+
+    ver->hres = resolution(msg[3]);
+    ver->vres = resolution(msg[4]);
+    return;
+}
+
+
+
+bool
+disp::PGDIdempotent(const char *cmd, int len)
+{
+    if ((!cmd) || (len < 1)) return false;
+
+    switch (cmd[0])
+    {
+        // drawing with absolute coordinates and colors
+        case 'C':   // Circle
+        case 'G':   // Triangle
+        case 'I':   // DrawIcon
+        case 'L':   // Line
+        case 'g':   // Polygon
+        case 'r':   // Rectangle
+        case 'e':   // Ellipse
+        case 'P':   // WritePixel
+        case 'D':   // DrawBitmap
+        case 'T':   // ShowChar
+        case 't':   // ScaleChar
+        case 's':   // ShowString
+        case 'S':   // ScaleString
+        case 'b':   // Button
+        case 'E':   // Clear
+        case 'B':   // ReplaceBackground
+        case 'k':   // ReplaceColor; nothing of the old color is left the second time
+        // settings
+        case 'A':   // AddBitmap
+        case 'K':   // SetBackground
+        case 'p':   // PenSize
+        case 'F':   // SetFont
+        case 'O':   // SetOpacity
+        case 'Y':   // Ctl
+        case 'u':   // SetRegion
+        case 'y':   // WritePin
+        case 'W':   // WriteBus
+            return true;
+        case 'v':
+            // SetVolume: absolute levels, mute and unmute; not the relative steps
+            if (len < 2) return false;
+            switch ((uchar)cmd[1])
+            {
+                case VOL_DOWN8:
+                case VOL_DOWN:
+                case VOL_UP:
+                case VOL_UP8:
+                    return false;
+                default:
+                    break;
+            }
+            return true;
+        case 'c':
+            // CopyPaste: only if the destination does not overlap the source
+            if (len < 13) return false;
+            do {
+                int xs = ((uchar)cmd[1] << 8) | (uchar)cmd[2];
+                int ys = ((uchar)cmd[3] << 8) | (uchar)cmd[4];
+                int xd = ((uchar)cmd[5] << 8) | (uchar)cmd[6];
+                int yd = ((uchar)cmd[7] << 8) | (uchar)cmd[8];
+                int w = ((uchar)cmd[9] << 8) | (uchar)cmd[10];
+                int h = ((uchar)cmd[11] << 8) | (uchar)cmd[12];
+                PGDRECT src(xs, ys, xs + w - 1, ys + h - 1);
+                PGDRECT dst(xd, yd, xd + w - 1, yd + h - 1);
+                return !src.Intersects(dst);
+            } while (0);
+        case '@':
+            if (len < 2) return false;
+            switch (cmd[1])
+            {
+                case 'i':   // SDInit
+                case 'A':   // SDSetAddrRaw
+                case 'W':   // SDWriteSectRaw
+                case 'C':   // SDScreenCopyRaw
+                case 'I':   // SDShowImageRaw
+                case 'V':   // SDShowVideoRaw
+                case 'c':   // SDScreenCopyFAT; the file is written again
+                case 'm':   // SDShowImageFAT
+                    return true;
+                default:
+                    // writes at the card's address pointer, appends, erases,
+                    // objects (which may be commands), audio and scripts
+                    break;
+            }
+            return false;
+        default:
+            // Suspend, SetBaud, WaitTouch and commands which return data
+            break;
+    }
+
+    return false;
+}
+
+
+
 int
 PGD::ReplaceBackground(ushort color)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[8] = "B      ";
     cmd[2] = color & 0xff;
     cmd[1] = (color >> 8) & 0xff;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 3)) != 3)
+    if ((res = portWrite(cmd, 3)) != 3)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(2500);
+    return waitCmd(cmd, 3, 2500);
 }
 
 
@@ -494,16 +1511,17 @@ PGD::Clear(void)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write("E", 1)) != 1)
+    if ((res = portWrite("E", 1)) != 1)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         return -1;
     }
 
-    return waitACKNACK(100);
+    return waitCmd("E", 1, 100);
 }
 
 
@@ -515,6 +1533,7 @@ PGD::Ctl(uchar mode, uchar value)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[8] = "Y      ";
 
@@ -586,16 +1605,22 @@ PGD::Ctl(uchar mode, uchar value)
 
     cmd[1] = mode;
     cmd[2] = value;
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 3) != 3))
+    if ((res = portWrite(cmd, 3) != 3))
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(100);
+    res = waitCmd(cmd, 3, 100);
+    if ((!res) && (mode == DM_ORIENT))
+    {
+        orient = value;
+        updateClip();
+    }
+    return res;
 }
 
 
@@ -605,6 +1630,7 @@ PGD::SetVolume(uchar value)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[8] = "v      ";
 
@@ -617,16 +1643,16 @@ PGD::SetVolume(uchar value)
     }
 
     cmd[1] = value;
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 2)) != 2)
+    if ((res = portWrite(cmd, 2)) != 2)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(100);
+    return waitCmd(cmd, 2, 100);
 }
 
 
@@ -638,6 +1664,7 @@ PGD::Suspend(uchar options, uchar duration)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[8] = "Z      ";
 
@@ -656,11 +1683,11 @@ PGD::Suspend(uchar options, uchar duration)
 
     cmd[1] = options;
     cmd[2] = duration;
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 3)) != 3)
+    if ((res = portWrite(cmd, 3)) != 3)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
@@ -693,6 +1720,7 @@ PGD::ReadPin(uchar pin, uchar *status)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[8] = "i      ";
 
@@ -709,19 +1737,19 @@ PGD::ReadPin(uchar pin, uchar *status)
     }
 
     cmd[1] = pin;
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 2)) != 2)
+    if ((res = portWrite(cmd, 2)) != 2)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    res = port.Read(cmd, 1, 100);
+    res = port->Read(cmd, 1, 100);
     if (res != 1)
     {
-        ERRMSG("no response (see below)\n%s", port.GetError());
+        ERRMSG("no response (see below)\n%s", port->GetError());
         return -1;
     }
 
@@ -737,6 +1765,7 @@ PGD::WritePin(uchar pin, uchar value)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[8] = "y      ";
 
@@ -754,16 +1783,16 @@ PGD::WritePin(uchar pin, uchar value)
 
     cmd[1] = pin;
     cmd[2] = value;
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 3)) != 3)
+    if ((res = portWrite(cmd, 3)) != 3)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(100);
+    return waitCmd(cmd, 3, 100);
 }
 
 
@@ -775,6 +1804,7 @@ PGD::ReadBus(uchar *status)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[2] = "a";
 
@@ -784,18 +1814,18 @@ PGD::ReadBus(uchar *status)
         return -1;
     }
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 1)) != 1)
+    if ((res = portWrite(cmd, 1)) != 1)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         return -1;
     }
 
-    res = port.Read(cmd, 1, 100);
+    res = port->Read(cmd, 1, 100);
     if (res != 1)
     {
-        ERRMSG("no response (see below)\n%s", port.GetError());
+        ERRMSG("no response (see below)\n%s", port->GetError());
         return -1;
     }
 
@@ -810,19 +1840,20 @@ PGD::WriteBus(uchar value)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[2] = "W";
 
     cmd[1] = value;
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 2)) != 2)
+    if ((res = portWrite(cmd, 2)) != 2)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
-    return waitACKNACK(100);
+    return waitCmd(cmd, 2, 100);
 }
 
 
@@ -834,8 +1865,10 @@ PGD::WriteBus(uchar value)
 int
 PGD::AddBitmap(uchar group, uchar index, const uchar *data, int datalen)
 {
+    CHECK_CONNECTING(AddBitmap(group, index, data, datalen));
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[160];
 
@@ -891,17 +1924,17 @@ PGD::AddBitmap(uchar group, uchar index, const uchar *data, int datalen)
     memcpy(&cmd[3], data, datalen);
     datalen += 3;
 
-    port.Flush();
+    port->Flush();
     int wr;
-    if ((wr = port.Write(cmd, datalen)) != datalen)
+    if ((wr = portWrite(cmd, datalen)) != datalen)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (wr > 0) return -2;
         return -1;
     }
-    port.Drain();
+    port->Drain();
 
-    return waitACKNACK(200);
+    return waitCmd(cmd, datalen, 200);
 }
 
 
@@ -912,8 +1945,10 @@ PGD::AddBitmap(uchar group, uchar index, const uchar *data, int datalen)
 int
 PGD::DrawBitmap(uchar group, uchar index, ushort x, ushort y, ushort color)
 {
+    CHECK_CONNECTING(DrawBitmap(group, index, x, y, color));
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[10];
 
@@ -958,16 +1993,16 @@ PGD::DrawBitmap(uchar group, uchar index, ushort x, ushort y, ushort color)
     cmd[7] = (color >> 8) & 0xff;
     cmd[8] = color & 0xff;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 9)) != 9)
+    if ((res = portWrite(cmd, 9)) != 9)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(100);
+    return waitCmd(cmd, 9, 100);
 }
 
 
@@ -977,8 +2012,13 @@ PGD::DrawBitmap(uchar group, uchar index, ushort x, ushort y, ushort color)
 int
 PGD::Circle(ushort x, ushort y, ushort radius, ushort color)
 {
+    CHECK_CONNECTING(Circle(x, y, radius, color));
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
+
+    PGDRECT ext(x - radius, y - radius, x + radius, y + radius);
+    if (!ext.Intersects(clip)) return dropped(9);
 
     char cmd[10];
 
@@ -992,16 +2032,16 @@ PGD::Circle(ushort x, ushort y, ushort radius, ushort color)
     cmd[7] = (color >> 8) & 0xff;
     cmd[8] = color & 0xff;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 9)) != 9)
+    if ((res = portWrite(cmd, 9)) != 9)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(100);
+    return waitCmd(cmd, 9, 100);
 }
 
 
@@ -1012,8 +2052,10 @@ int
 PGD::Triangle(ushort x1, ushort y1, ushort x2, ushort y2,
                       ushort x3, ushort y3, ushort color)
 {
+    CHECK_CONNECTING(Triangle(x1, y1, x2, y2, x3, y3, color));
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[16];
 
@@ -1033,16 +2075,16 @@ PGD::Triangle(ushort x1, ushort y1, ushort x2, ushort y2,
     cmd[13] = (color >> 8) & 0xff;
     cmd[14] = color & 0xff;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 15)) != 15)
+    if ((res = portWrite(cmd, 15)) != 15)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(200);
+    return waitCmd(cmd, 15, 200);
 }
 
 
@@ -1053,8 +2095,10 @@ int
 PGD::DrawIcon(ushort x, ushort y, ushort width, ushort height,
               uchar colormode, const uchar *data, int datalen)
 {
+    CHECK_CONNECTING(DrawIcon(x, y, width, height, colormode, data, datalen));
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     if ((colormode != 0x08)&&(colormode != 0x10))
     {
@@ -1074,30 +2118,145 @@ PGD::DrawIcon(ushort x, ushort y, ushort width, ushort height,
         return -1;
     }
 
-    char *cmd = new char[dsize + 10];
-    if (cmd == NULL)
+    // send only the visible part of the image
+    PGDRECT vis(x, y, x + width - 1, y + height - 1);
+    int trim = clipRect(&vis);
+    if (trim < 0) return dropped(dsize + 10);
+
+    int bpp = (colormode == 0x10) ? 2 : 1;
+    int vsize = dsize;
+    ushort vw = vis.x2 - vis.x1 + 1;
+    ushort vh = vis.y2 - vis.y1 + 1;
+    if (trim)
     {
-        ERRMSG("could not allocate memory");
-        return -1;
+        vsize = vw * vh * bpp;
+        ++cstats.trimmed;
+        cstats.saved += dsize - vsize;
+    }
+
+    // position and size of the image in the native orientation;
+    // the display size is needed to map the position
+    int rot = (iconrot && nwidth) ? turns() : 0;
+    int nx = vis.x1;
+    int ny = vis.y1;
+    ushort nw = vw;
+    ushort nh = vh;
+    switch (rot)
+    {
+        case 1:
+            nx = nwidth - vis.y1 - vh;
+            ny = vis.x1;
+            nw = vh;
+            nh = vw;
+            break;
+        case 2:
+            nx = nwidth - vis.x1 - vw;
+            ny = nheight - vis.y1 - vh;
+            break;
+        case 3:
+            nx = vis.y1;
+            ny = nheight - vis.x1 - vw;
+            nw = vh;
+            nh = vw;
+            break;
+    }
+
+    // stage the whole command in the arena if it fits; a trimmed or
+    // rotated image must be staged, so if it does not fit it is sent as
+    // bands of native rows staged in iconbuf.  Otherwise the header and
+    // the caller's data are sent separately.
+    unsigned int mark = arena.GetMark();
+    char hdr[10];
+    int rows = nh;  // rows of the native image in each command
+    char *cmd = (char *)arena.Alloc(vsize + 10);
+    if ((!cmd) && ((trim) || (rot)))
+    {
+        cmd = iconbuf;
+        rows = PGDICONBUF / (nw * bpp);
+        if (!rows)
+        {
+            ERRMSG("icon too wide (%d pixels)", nw);
+            return -1;
+        }
     }
+    if (!cmd) cmd = hdr;
+
     cmd[0] = 'I';
-    cmd[1] = (x >> 8) & 0xff;
-    cmd[2] = x & 0xff;
-    cmd[3] = (y >> 8) & 0xff;
-    cmd[4] = y & 0xff;
-    cmd[5] = (width >> 8) & 0xff;
-    cmd[6] = width & 0xff;
-    cmd[7] = (height >> 8) & 0xff;
-    cmd[8] = height & 0xff;
+    cmd[1] = (nx >> 8) & 0xff;
+    cmd[2] = nx & 0xff;
+    cmd[5] = (nw >> 8) & 0xff;
+    cmd[6] = nw & 0xff;
     cmd[9] = colormode;
-    memcpy(&cmd[10], data, datalen);
 
-    dsize += 10;
-    int res = port.Write(cmd, dsize);
-    delete [] cmd;
-    if (res != dsize) return res;
+    port->Flush();
+    int res;
+    if (cmd != hdr)
+    {
+        const uchar *src = data + ((vis.y1 - y) * width + (vis.x1 - x)) * bpp;
+        int r, n, len;
+        res = 0;
+        for (r = 0; (r < nh) && (!res); r += n)
+        {
+            n = (nh - r < rows) ? nh - r : rows;
+            len = nw * n * bpp + 10;
+            cmd[3] = ((ny + r) >> 8) & 0xff;
+            cmd[4] = (ny + r) & 0xff;
+            cmd[7] = (n >> 8) & 0xff;
+            cmd[8] = n & 0xff;
+            // the native rows r .. r + n - 1 come from these source
+            // rows (0, 2 turns) or columns (1, 3 turns)
+            switch (rot)
+            {
+                case 0:
+                    if (trim)
+                        PGDRotate(src + r * width * bpp, width, vw, n, bpp, 0, (uchar *)&cmd[10]);
+                    else
+                        memcpy(&cmd[10], data, datalen);
+                    break;
+                case 1:
+                    PGDRotate(src + r * bpp, width, n, vh, bpp, 1, (uchar *)&cmd[10]);
+                    break;
+                case 2:
+                    PGDRotate(src + (vh - r - n) * width * bpp, width, vw, n, bpp, 2,
+                              (uchar *)&cmd[10]);
+                    break;
+                default:
+                    PGDRotate(src + (vw - r - n) * bpp, width, n, vh, bpp, 3, (uchar *)&cmd[10]);
+                    break;
+            }
+            res = portWrite(cmd, len);
+            if (res == len)
+            {
+                // the staged command is kept until it is acknowledged
+                res = waitCmd(cmd, len, 400);
+            }
+            else
+            {
+                ERRMSG("failed; see message below\n%s", port->GetError());
+                res = (res > 0) ? -2 : -1;
+            }
+        }
+        arena.Release(mark);
+        return res;
+    }
+
+    cmd[3] = (ny >> 8) & 0xff;
+    cmd[4] = ny & 0xff;
+    cmd[7] = (nh >> 8) & 0xff;
+    cmd[8] = nh & 0xff;
+    if ((res = portWrite(hdr, 10)) != 10)
+    {
+        ERRMSG("failed; see message below\n%s", port->GetError());
+        if (res > 0) return -2;
+        return -1;
+    }
+    if ((res = portWrite((const char *)data, datalen)) != datalen)
+    {
+        ERRMSG("failed; see message below\n%s", port->GetError());
+        return -2;
+    }
 
-    return waitACKNACK(400);
+    return waitCmd(hdr, 10, 400, (const char *)data, datalen);
 }
 
 
@@ -1105,23 +2264,25 @@ PGD::DrawIcon(ushort x, ushort y, ushort width, ushort height,
 int
 PGD::SetBackground(ushort color)
 {
+    CHECK_CONNECTING(SetBackground(color));
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[4] = "K  ";
     cmd[1] = (color >> 8) & 0xff;
     cmd[2] = color & 0xff;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 3)) != 3)
+    if ((res = portWrite(cmd, 3)) != 3)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(100);
+    return waitCmd(cmd, 3, 100);
 }
 
 
@@ -1129,8 +2290,24 @@ PGD::SetBackground(ushort color)
 int
 PGD::Line(ushort x1, ushort y1, ushort x2, ushort y2, ushort color)
 {
+    CHECK_CONNECTING(Line(x1, y1, x2, y2, color));
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
+
+    int cx1 = x1, cy1 = y1, cx2 = x2, cy2 = y2;
+    switch (clipLine(&cx1, &cy1, &cx2, &cy2))
+    {
+        case -1:
+            return dropped(11);
+        case 1:
+            ++cstats.trimmed;
+            x1 = cx1;
+            y1 = cy1;
+            x2 = cx2;
+            y2 = cy2;
+            break;
+    }
 
     char cmd[12];
     cmd[0] = 'L';
@@ -1145,16 +2322,16 @@ PGD::Line(ushort x1, ushort y1, ushort x2, ushort y2, ushort color)
     cmd[9] = (color >> 8) & 0xff;
     cmd[10] = color & 0xff;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 11)) != 11)
+    if ((res = portWrite(cmd, 11)) != 11)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(100);
+    return waitCmd(cmd, 11, 100);
 }
 
 
@@ -1164,8 +2341,10 @@ PGD::Line(ushort x1, ushort y1, ushort x2, ushort y2, ushort color)
 int
 PGD::Polygon(uchar vertices, ushort *xp, ushort *yp, ushort color)
 {
+    CHECK_CONNECTING(Polygon(vertices, xp, yp, color));
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     if ((vertices < 3) || (vertices > 7))
     {
@@ -1198,24 +2377,43 @@ PGD::Polygon(uchar vertices, ushort *xp, ushort *yp, ushort color)
     cmd[++idx] = color & 0xff;
     ++idx;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, idx)) != idx)
+    if ((res = portWrite(cmd, idx)) != idx)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(100);
+    return waitCmd(cmd, idx, 100);
 }
 
 
 int
 PGD::Rectangle(ushort x1, ushort y1, ushort x2, ushort y2, ushort color)
 {
+    CHECK_CONNECTING(Rectangle(x1, y1, x2, y2, color));
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
+
+    PGDRECT vis((x1 < x2) ? x1 : x2, (y1 < y2) ? y1 : y2,
+                (x1 < x2) ? x2 : x1, (y1 < y2) ? y2 : y1);
+    switch (clipRect(&vis))
+    {
+        case -1:
+            return dropped(11);
+        case 1:
+            // a clipped wireframe would gain edges along the clip boundary
+            if (pen != SOLID) break;
+            ++cstats.trimmed;
+            x1 = vis.x1;
+            y1 = vis.y1;
+            x2 = vis.x2;
+            y2 = vis.y2;
+            break;
+    }
 
     char cmd[12];
 
@@ -1231,16 +2429,16 @@ PGD::Rectangle(ushort x1, ushort y1, ushort x2, ushort y2, ushort color)
     cmd[9] = (color >> 8) & 0xff;
     cmd[10] = color & 0xff;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 11)) != 11)
+    if ((res = portWrite(cmd, 11)) != 11)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(100);
+    return waitCmd(cmd, 11, 100);
 }
 
 
@@ -1250,8 +2448,13 @@ PGD::Rectangle(ushort x1, ushort y1, ushort x2, ushort y2, ushort color)
 int
 PGD::Ellipse(ushort x, ushort y, ushort rx, ushort ry, ushort color)
 {
+    CHECK_CONNECTING(Ellipse(x, y, rx, ry, color));
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
+
+    PGDRECT ext(x - rx, y - ry, x + rx, y + ry);
+    if (!ext.Intersects(clip)) return dropped(11);
 
     char cmd[12];
 
@@ -1267,16 +2470,16 @@ PGD::Ellipse(ushort x, ushort y, ushort rx, ushort ry, ushort color)
     cmd[9] = (color >> 8) & 0xff;
     cmd[10] = color & 0xff;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 11)) != 11)
+    if ((res = portWrite(cmd, 11)) != 11)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(200);
+    return waitCmd(cmd, 11, 200);
 }
 
 
@@ -1284,8 +2487,13 @@ PGD::Ellipse(ushort x, ushort y, ushort rx, ushort ry, ushort color)
 int
 PGD::WritePixel(ushort x, ushort y, ushort color)
 {
+    CHECK_CONNECTING(WritePixel(x, y, color));
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
+
+    if ((x < clip.x1) || (x > clip.x2) || (y < clip.y1) || (y > clip.y2))
+        return dropped(7);
 
     char cmd[8];
 
@@ -1297,16 +2505,16 @@ PGD::WritePixel(ushort x, ushort y, ushort color)
     cmd[5] = (color >> 8) & 0xff;
     cmd[6] = color & 0xff;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 7)) != 7)
+    if ((res = portWrite(cmd, 7)) != 7)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(200);
+    return waitCmd(cmd, 7, 200);
 }
 
 
@@ -1316,6 +2524,7 @@ PGD::ReadPixel(ushort x, ushort y, ushort *color)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[6];
 
@@ -1325,17 +2534,17 @@ PGD::ReadPixel(ushort x, ushort y, ushort *color)
     cmd[3] = (y >> 8) & 0xff;
     cmd[4] = y & 0xff;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 5)) != 5)
+    if ((res = portWrite(cmd, 5)) != 5)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
 
-    res = port.Read(cmd, 2, 200);
+    res = port->Read(cmd, 2, 200);
     if (res < 0)
     {
         ERRMSG("no response");
@@ -1357,8 +2566,10 @@ int
 PGD::CopyPaste(ushort xsrc, ushort ysrc, ushort xdst, ushort ydst,
                        ushort width, ushort height)
 {
+    CHECK_CONNECTING(CopyPaste(xsrc, ysrc, xdst, ydst, width, height));
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[16];
 
@@ -1376,16 +2587,16 @@ PGD::CopyPaste(ushort xsrc, ushort ysrc, ushort xdst, ushort ydst,
     cmd[11] = (height >> 8) & 0xff;
     cmd[12] = height & 0xff;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 13)) != 13)
+    if ((res = portWrite(cmd, 13)) != 13)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(2000);
+    return waitCmd(cmd, 13, 2000);
 }
 
 
@@ -1393,8 +2604,10 @@ PGD::CopyPaste(ushort xsrc, ushort ysrc, ushort xdst, ushort ydst,
 int PGD::ReplaceColor(ushort x1, ushort y1, ushort x2, ushort y2,
                       ushort oldcolor, ushort newcolor)
 {
+    CHECK_CONNECTING(ReplaceColor(x1, y1, x2, y2, oldcolor, newcolor));
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[16];
 
@@ -1412,16 +2625,16 @@ int PGD::ReplaceColor(ushort x1, ushort y1, ushort x2, ushort y2,
     cmd[11] = (newcolor >> 8) & 0xff;
     cmd[12] = newcolor & 0xff;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 13)) != 13)
+    if ((res = portWrite(cmd, 13)) != 13)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(5000);
+    return waitCmd(cmd, 13, 5000);
 }
 
 
@@ -1431,8 +2644,10 @@ int PGD::ReplaceColor(ushort x1, ushort y1, ushort x2, ushort y2,
 int
 PGD::PenSize(uchar size)
 {
+    CHECK_CONNECTING(PenSize(size));
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     if ((size != 0) && (size != 1))
     {
@@ -1440,21 +2655,20 @@ PGD::PenSize(uchar size)
         return -1;
     }
 
-    port.Flush();
-    int res;
-    if (size)
-        res = port.Write("p\x01", 2);
-    else
-        res = port.Write("p\x00", 2);
+    const char *cmd = (size) ? "p\x01" : "p\x00";
+    port->Flush();
+    int res = portWrite(cmd, 2);
 
     if (res != 2)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(100);
+    res = waitCmd(cmd, 2, 100);
+    if (!res) pen = size;
+    return res;
 }
 
 
@@ -1466,8 +2680,10 @@ PGD::PenSize(uchar size)
 int
 PGD::SetFont(uchar size)
 {
+    CHECK_CONNECTING(SetFont(size));
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     if ((size < 0) || (size > 3))
     {
@@ -1479,16 +2695,16 @@ PGD::SetFont(uchar size)
     cmd[0] = 'F';
     cmd[1] = size;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 2)) != 2)
+    if ((res = portWrite(cmd, 2)) != 2)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(100);
+    return waitCmd(cmd, 2, 100);
 }
 
 
@@ -1496,8 +2712,10 @@ PGD::SetFont(uchar size)
 int
 PGD::SetOpacity(uchar mode)
 {
+    CHECK_CONNECTING(SetOpacity(mode));
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     if ((mode != 0) && (mode != 1))
     {
@@ -1505,21 +2723,18 @@ PGD::SetOpacity(uchar mode)
         return -1;
     }
 
-    port.Flush();
-    int res;
-    if (mode)
-        res = port.Write("O\x01", 2);
-    else
-        res = port.Write("O\x00", 2);
+    const char *cmd = (mode) ? "O\x01" : "O\x00";
+    port->Flush();
+    int res = portWrite(cmd, 2);
 
     if (res != 2)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(100);
+    return waitCmd(cmd, 2, 100);
 }
 
 
@@ -1527,8 +2742,10 @@ PGD::SetOpacity(uchar mode)
 int
 PGD::ShowChar(uchar glyph, uchar col, uchar row, ushort color)
 {
+    CHECK_CONNECTING(ShowChar(glyph, col, row, color));
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[6];
 
@@ -1539,16 +2756,16 @@ PGD::ShowChar(uchar glyph, uchar col, uchar row, ushort color)
     cmd[4] = (color >> 8) & 0xff;
     cmd[5] = color & 0xff;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 6)) != 6)
+    if ((res = portWrite(cmd, 6)) != 6)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(100);
+    return waitCmd(cmd, 6, 100);
 }
 
 
@@ -1556,8 +2773,10 @@ PGD::ShowChar(uchar glyph, uchar col, uchar row, ushort color)
 int
 PGD::ScaleChar(uchar glyph, ushort x, ushort y, ushort color, uchar xmul, uchar ymul)
 {
+    CHECK_CONNECTING(ScaleChar(glyph, x, y, color, xmul, ymul));
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[10];
 
@@ -1572,16 +2791,16 @@ PGD::ScaleChar(uchar glyph, ushort x, ushort y, ushort color, uchar xmul, uchar
     cmd[8] = xmul;
     cmd[9] = ymul;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 10)) != 10)
+    if ((res = portWrite(cmd, 10)) != 10)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(5000);
+    return waitCmd(cmd, 10, 5000);
 }
 
 
@@ -1589,8 +2808,10 @@ PGD::ScaleChar(uchar glyph, ushort x, ushort y, ushort color, uchar xmul, uchar
 int
 PGD::ShowString(uchar col, uchar row, uchar font, ushort color, const char *data)
 {
+    CHECK_CONNECTING(ShowString(col, row, font, color, data));
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[270];
     int dlen;
@@ -1603,6 +2824,11 @@ PGD::ShowString(uchar col, uchar row, uchar font, ushort color, const char *data
     if ((dlen = strlen(data)) == 0) return 0; // nothing to do
     if (dlen > 256) dlen = 256;
 
+    // long strings may wrap onto the following rows, so the string
+    // is only dropped if its first row is below the clipping area
+    PGDRECT ext = PGDTextExtent(0, 0, font, 1, 1, "X");
+    if (row * (ext.y2 + 1) > clip.y2) return dropped(dlen + 7);
+
     cmd[0] = 's';
     cmd[1] = col;
     cmd[2] = row;
@@ -1613,16 +2839,16 @@ PGD::ShowString(uchar col, uchar row, uchar font, ushort color, const char *data
     cmd[dlen + 6] = 0;
     dlen += 7;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, dlen)) != dlen)
+    if ((res = portWrite(cmd, dlen)) != dlen)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(400);
+    return waitCmd(cmd, dlen, 400);
 }
 
 
@@ -1633,8 +2859,10 @@ int
 PGD::ScaleString(ushort x, ushort y, uchar font, ushort color, uchar width,
                  uchar height, const char *data)
 {
+    CHECK_CONNECTING(ScaleString(x, y, font, color, width, height, data));
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[270];
     int dlen;
@@ -1647,6 +2875,28 @@ PGD::ScaleString(ushort x, ushort y, uchar font, ushort color, uchar width,
     if ((dlen = strlen(data)) == 0) return 0; // nothing to do
     if (dlen > 256) dlen = 256;
 
+    // drop the string if it is not visible, otherwise drop the leading
+    // and trailing characters which are entirely outside the clipping area
+    PGDRECT ext = PGDTextExtent(x, y, font, width, height, "X");
+    int cw = ext.x2 - ext.x1 + 1;
+    ext.x2 = x + dlen * cw - 1;
+    if (!ext.Intersects(clip)) return dropped(dlen + 11);
+    if (!(font & FPROPORTIONAL))
+    {
+        int first = 0;
+        int last = dlen;
+        if (x < clip.x1) first = (clip.x1 - x) / cw;
+        if (ext.x2 > clip.x2) last = (clip.x2 - x) / cw + 1;
+        if ((first) || (last < dlen))
+        {
+            ++cstats.trimmed;
+            cstats.saved += dlen - (last - first);
+            x += first * cw;
+            data += first;
+            dlen = last - first;
+        }
+    }
+
     cmd[0] = 'S';
     cmd[1] = (x >> 8) & 0xff;
     cmd[2] = x & 0xff;
@@ -1661,16 +2911,16 @@ PGD::ScaleString(ushort x, ushort y, uchar font, ushort color, uchar width,
     cmd[dlen + 10] = 0;
     dlen += 11;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, dlen)) != dlen)
+    if ((res = portWrite(cmd, dlen)) != dlen)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(5000);
+    return waitCmd(cmd, dlen, 5000);
 }
 
 
@@ -1681,8 +2931,10 @@ int
 PGD::Button(bool pressed, ushort x, ushort y, ushort bcolor, uchar font,
             ushort tcolor, uchar xmul, uchar ymul, const char *text)
 {
+    CHECK_CONNECTING(Button(pressed, x, y, bcolor, font, tcolor, xmul, ymul, text));
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[270];
     int dlen;
@@ -1715,16 +2967,16 @@ PGD::Button(bool pressed, ushort x, ushort y, ushort bcolor, uchar font,
     cmd[dlen + 13] = 0;
     dlen += 14;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, dlen)) != dlen)
+    if ((res = portWrite(cmd, dlen)) != dlen)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(2000);
+    return waitCmd(cmd, dlen, 2000);
 }
 
 
@@ -1739,15 +2991,16 @@ int PGD::GetTouch(uchar mode, ushort *points)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[5] = "o   ";
 
     cmd[1] = mode;
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 2)) != 2)
+    if ((res = portWrite(cmd, 2)) != 2)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
@@ -1761,7 +3014,7 @@ int PGD::GetTouch(uchar mode, ushort *points)
         return 2;
     }
 
-    res = port.Read(cmd, 4, 100);
+    res = port->Read(cmd, 4, 100);
 
     if (res < 0)
     {
@@ -1794,21 +3047,22 @@ PGD::WaitTouch(ushort timeout)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[4] = "w  ";
 
     cmd[1] = (timeout >> 8) & 0xff;
     cmd[2] = timeout & 0xff;
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 3)) != 3)
+    if ((res = portWrite(cmd, 3)) != 3)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    switch (waitACKNACK(0))
+    switch (waitACKNACK(0, false))
     {
         case 0:
             return 0;
@@ -1832,6 +3086,7 @@ PGD::SetRegion(ushort x1, ushort y1, ushort x2, ushort y2)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[10] = "u        ";
 
@@ -1844,16 +3099,16 @@ PGD::SetRegion(ushort x1, ushort y1, ushort x2, ushort y2)
     cmd[7] = (y2 >> 8) & 0xff;
     cmd[8] = y2 & 0xff;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 9)) != 9)
+    if ((res = portWrite(cmd, 9)) != 9)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(200);
+    return waitCmd(cmd, 9, 200);
 }
 
 
@@ -1885,12 +3140,12 @@ PGD::waitACK(int timeout)
     int i, nb;
     char msg[64];
     while ((now.tv_sec < tov.tv_sec) || ((now.tv_sec == tov.tv_sec)
-            && (now.tv_usec < tov.tv_sec)))
+            && (now.tv_usec < tov.tv_usec)))
     {
-        nb = port.Read(msg, 64, 10);
+        nb = port->Read(msg, 64, 10);
         if (nb == -1)
         {
-            ERRMSG("failed (see message below)\n%s", port.GetError());
+            ERRMSG("failed (see message below)\n%s", port->GetError());
             return -1;
         }
         for (i = 0; i < nb; ++i) if (msg[i] == '\x06') return 0;
@@ -1927,12 +3182,12 @@ PGD::waitNACK(int timeout)
     int i, nb;
     char msg[64];
     while ((now.tv_sec < tov.tv_sec) || ((now.tv_sec == tov.tv_sec)
-            && (now.tv_usec < tov.tv_sec)))
+            && (now.tv_usec < tov.tv_usec)))
     {
-        nb = port.Read(msg, 64, 10);
+        nb = port->Read(msg, 64, 10);
         if (nb == -1)
         {
-            ERRMSG("failed (see message below)\n%s", port.GetError());
+            ERRMSG("failed (see message below)\n%s", port->GetError());
             return -1;
         }
         for (i = 0; i < nb; ++i) if (msg[i] == '\x15') return 1;
@@ -1944,7 +3199,7 @@ PGD::waitNACK(int timeout)
 // wait for either an ACK or a NACK while rejecting other characters
 // return -1 for comms fault, 0 for ACK, +1 for NACK, +2 for timeout
 int
-PGD::waitACKNACK(int timeout)
+PGD::waitACKNACK(int timeout, bool monitor)
 {
     /* W32 */
     struct timeval tov;
@@ -1965,25 +3220,260 @@ PGD::waitACKNACK(int timeout)
     }
 
     int i, nb;
+    int res = 2;
     char msg[4];
     while ((now.tv_sec < tov.tv_sec) || ((now.tv_sec == tov.tv_sec)
-            && (now.tv_usec <= tov.tv_sec)))
+            && (now.tv_usec <= tov.tv_usec)))
+    {
+        // Read() waits for all <len> bytes, so take the response as it comes
+        nb = port->Read(msg, 1, 10);
+        if (nb == -1)
+        {
+            ERRMSG("failed (see message below)\n%s", port->GetError());
+            res = -1;
+            break;
+        }
+        for (i = 0; (i < nb) && (res == 2); ++i)
+        {
+            if (msg[i] == '\x06') res = 0;
+            if (msg[i] == '\x15') res = 1;
+        }
+        if (res != 2) break;
+        gettimeofday(&now, NULL);
+    }
+    if (res == 2) ERRMSG("timeout");
+    if (monitor) lmon->Record(res);
+    return res;
+}
+
+
+
+
+// collect <count> ACK/NACK responses, counting NACKs in <nacks>;
+// return -1 for comms fault, 0 for success, +2 for timeout
+int
+PGD::waitACKs(int count, int timeout, int *nacks)
+{
+    /* W32 */
+    struct timeval tov;
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    tov = now;
+
+    if (timeout >= 1000)
+    {
+        tov.tv_sec += (timeout / 1000);
+    }
+    tov.tv_usec += (timeout % 1000) * 1000;
+    if (tov.tv_usec >= 1000000)
+    {
+        tov.tv_sec += 1;
+        tov.tv_usec %= 1000000;
+    }
+
+    int i, nb;
+    char msg[64];
+    while (count)
     {
-        nb = port.Read(msg, 4, 10);
+        // never read beyond the responses we expect
+        nb = port->Read(msg, (count > 64) ? 64 : count, 10);
         if (nb == -1)
         {
-            ERRMSG("failed (see message below)\n%s", port.GetError());
+            ERRMSG("failed (see message below)\n%s", port->GetError());
+            lmon->Record(-1);
             return -1;
         }
         for (i = 0; i < nb; ++i)
         {
-            if (msg[i] == '\x06') return 0;
-            if (msg[i] == '\x15') return 1;
+            if (msg[i] == '\x06')
+            {
+                --count;
+                lmon->Record(0);
+            }
+            if (msg[i] == '\x15')
+            {
+                --count;
+                lmon->Record(1);
+                if (nacks) ++(*nacks);
+            }
         }
+        if (!count) break;
+
         gettimeofday(&now, NULL);
+        if ((now.tv_sec > tov.tv_sec) || ((now.tv_sec == tov.tv_sec)
+            && (now.tv_usec > tov.tv_usec)))
+        {
+            ERRMSG("timeout; %d responses outstanding", count);
+            lmon->Record(2);
+            return 2;
+        }
     }
-    ERRMSG("timeout");
-    return 2;
+    return 0;
+}
+
+
+
+// wait for the response to a command; acknowledged commands are
+// recorded in the journal
+int
+PGD::waitCmd(const char *cmd, int len, int timeout, const char *data, int dlen)
+{
+    int res = waitACKNACK(timeout);
+    if (res == 2) res = retryCmd(cmd, len, timeout, data, dlen);
+    if (!res) journalCmd(cmd, len, timeout, data, dlen);
+    return res;
+}
+
+
+
+// after a timeout: if the journal is enabled the display is checked for
+// a reset, then an idempotent command is sent again with the timeout
+// doubled each time
+int
+PGD::retryCmd(const char *cmd, int len, int timeout, const char *data, int dlen)
+{
+    int res = 2;
+    ++rstats.timeouts;
+
+    // a display which has reset answers neither the command nor its
+    // retries; the screen is restored before the command is sent again
+    if (journal->IsEnabled() && (!replaying) && (recover() < 0)) return -1;
+
+    if (!PGDIdempotent(cmd, len))
+    {
+        ++rstats.unsafe;
+        return res;
+    }
+    if (!maxretry) return res;
+
+    ++rstats.retried;
+    int i, nb;
+    for (i = 0; (i < maxretry) && (res == 2); ++i)
+    {
+        // a late response to the previous attempt is discarded
+        port->Flush();
+        ++rstats.resends;
+        if (((nb = portWrite(cmd, len)) != len)
+            || ((dlen > 0) && ((nb = portWrite(data, dlen)) != dlen)))
+        {
+            ERRMSG("could not send the command again; see message below\n%s",
+                   port->GetError());
+            ++rstats.failed;
+            if (nb > 0) return -2;
+            return -1;
+        }
+        timeout *= 2;
+        res = waitACKNACK(timeout);
+    }
+
+    if (res == 2)
+    {
+        ERRMSG("timeout; the command was sent %d times", i + 1);
+        ++rstats.failed;
+    }
+    else
+    {
+        ++rstats.recovered;
+    }
+    return res;
+}
+
+
+
+// record an acknowledged command in the journal
+void
+PGD::journalCmd(const char *cmd, int len, int timeout, const char *data, int dlen)
+{
+    if ((!journal->IsEnabled()) || replaying) return;
+
+    journal->SetView(turns(), nwidth, nheight);
+    journal->Record(cmd, len, timeout, data, dlen);
+    return;
+}
+
+
+
+// a display which resets comes back blank at 9600 and waits for autobaud
+int
+PGD::recover(void)
+{
+    struct timeval t0;
+    gettimeofday(&t0, NULL);
+    ++xstats.probes;
+
+    // a display which is still running answers at the current rate
+    if (!Version(NULL, false)) return 0;
+
+    DBAUD rate = baud;
+    DBAUD ceiling = lmon->GetStats().ceiling;
+    unsigned int speed = portspeed;
+    /* W32 */
+    if ((rate != DB_9600) && port->SetBaud(B9600))
+    {
+        ERRMSG("could not change the host rate (see below)\n%s", port->GetError());
+        return -1;
+    }
+
+    // the display may still be in its power-on delay
+    int res;
+    while ((res = autobaud()) && (msecSince(t0) < PGDRESETWAIT));
+    if (res)
+    {
+        if (rate != DB_9600) port->SetBaud(speed);
+        ERRMSG("the display does not answer at the current rate or to autobaud");
+        return 2;
+    }
+
+    ++xstats.resets;
+    xstats.detect = msecSince(t0);
+
+    struct timeval t1;
+    gettimeofday(&t1, NULL);
+    // the display starts over in its native orientation with a solid pen
+    orient = 0;
+    pen = SOLID;
+    updateClip();
+    if ((rate != DB_9600) && setRate(rate))
+        ERROUT("could not restore the rate; see message below\n%s\n", errmsg);
+    lmon->Start(baud, ceiling);
+
+    if (!journal->GetStats().complete)
+    {
+        ERRMSG("the display was reset and the journal is incomplete; the screen must be redrawn");
+        ++xstats.failed;
+        return -1;
+    }
+
+    replay->Clear();
+    if (journal->Fill(replay))
+    {
+        ERRMSG("could not prepare the replay; see message below\n%s", replay->GetError());
+        ++xstats.failed;
+        return -1;
+    }
+    xstats.replayed = replay->GetCount();
+
+    replaying = true;
+    res = Transmit(replay);
+    replaying = false;
+    pen = journal->GetPen();
+    orient = journal->GetOrient();
+    updateClip();
+    xstats.replay = msecSince(t1);
+
+    if (res)
+    {
+        char msg[PGDERRLEN];
+        snprintf(msg, PGDERRLEN, "%s", errmsg);
+        ERRMSG("the display was reset and the journal could not be replayed;"
+               " see message below\n%s", msg);
+        ++xstats.failed;
+        return -1;
+    }
+
+    ++xstats.restored;
+    return 1;
 }
 
 
@@ -2009,7 +3499,7 @@ PGD::Process(void)
             return 0;
         case PG_SLEEP:
         case PG_TOUCH_WAIT:
-            switch (waitACKNACK(200))
+            switch (waitACKNACK(200, false))
             {
                 case 0:
                     curcmd = PG_NONE;
@@ -2039,11 +3529,11 @@ PGD::Process(void)
             break;
         case PG_TOUCH_DATA:
             do {
-                int nb = port.Read(&datain[brcv], 4 - brcv, 100);
+                int nb = port->Read(&datain[brcv], 4 - brcv, 100);
                 if (nb < 0)
                 {
                     ERRMSG("PG_TOUCH_DATA: communications fault, see message below\n%s",
-                           port.GetError());
+                           port->GetError());
                     curcmd = PG_NONE;
                     state = LCD_IDLE;
                     if (callback) callback(this, tmpcmd, false, usrobj);
@@ -2096,17 +3586,18 @@ int PGD::SDInit(void)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write("@i", 2)) != 2)
+    if ((res = portWrite("@i", 2)) != 2)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(200);
+    return waitCmd("@i", 2, 200);
 }
 
 /* Set Address Pointer of Card */
@@ -2114,6 +3605,7 @@ int PGD::SDSetAddrRaw(unsigned int addr)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[10] = "@A       ";
 
@@ -2122,16 +3614,16 @@ int PGD::SDSetAddrRaw(unsigned int addr)
     cmd[4] = (addr >> 8) & 0xff;
     cmd[5] = addr & 0xff;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 6)) != 6)
+    if ((res = portWrite(cmd, 6)) != 6)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(200);
+    return waitCmd(cmd, 6, 200);
 }
 
 /* Read Byte from Card */
@@ -2139,17 +3631,18 @@ int PGD::SDReadByteRaw(char *data)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write("@r", 2)) != 2)
+    if ((res = portWrite("@r", 2)) != 2)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return port.Read(data, 1, 200);
+    return port->Read(data, 1, 200);
 }
 
 /* Write Byte to Card */
@@ -2157,20 +3650,21 @@ int PGD::SDWriteByteRaw(char data)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[4] = "@w ";
     cmd[2] = data;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 3)) != 3)
+    if ((res = portWrite(cmd, 3)) != 3)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(200);
+    return waitCmd(cmd, 3, 200);
 }
 
 
@@ -2180,6 +3674,7 @@ int PGD::SDReadSectRaw(unsigned int sectaddr, char *data, int datalen)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     if (datalen < 512)
     {
@@ -2198,16 +3693,16 @@ int PGD::SDReadSectRaw(unsigned int sectaddr, char *data, int datalen)
     cmd[3] = (sectaddr >> 8) & 0xff;
     cmd[4] = sectaddr & 0xff;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 5)) != 5)
+    if ((res = portWrite(cmd, 5)) != 5)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return port.Read(data, 512, 500);
+    return port->Read(data, 512, 500);
 }
 
 
@@ -2217,6 +3712,7 @@ int PGD::SDWriteSectRaw(unsigned int sectaddr, const char *data, int datalen)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     if (sectaddr > 0x00ffffff)
     {
@@ -2238,16 +3734,16 @@ int PGD::SDWriteSectRaw(unsigned int sectaddr, const char *data, int datalen)
         return -1;
     }
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 517)) != 517)
+    if ((res = portWrite(cmd, 517)) != 517)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(200);
+    return waitCmd(cmd, 517, 200);
 }
 
 
@@ -2257,6 +3753,7 @@ int PGD::SDScreenCopyRaw(ushort x, ushort y, ushort width, ushort height,
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     if (sectaddr > 0x00ffffff)
     {
@@ -2277,16 +3774,16 @@ int PGD::SDScreenCopyRaw(ushort x, ushort y, ushort width, ushort height,
     cmd[11] = (sectaddr >> 8) & 0xff;
     cmd[12] = sectaddr & 0xff;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 13)) != 13)
+    if ((res = portWrite(cmd, 13)) != 13)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(200);
+    return waitCmd(cmd, 13, 200);
 }
 
 
@@ -2297,6 +3794,7 @@ int PGD::SDShowImageRaw(ushort x, ushort y, ushort width, ushort height,
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     if (sectaddr > 0x00ffffff)
     {
@@ -2324,16 +3822,58 @@ int PGD::SDShowImageRaw(ushort x, ushort y, ushort width, ushort height,
     cmd[12] = (sectaddr >> 8) & 0xff;
     cmd[13] = sectaddr & 0xff;
 
-    port.Flush();
+    port->Flush();
+    int res;
+    if ((res = portWrite(cmd, 14)) != 14)
+    {
+        ERRMSG("failed; see message below\n%s", port->GetError());
+        if (res > 0) return -2;
+        return -1;
+    }
+
+    return waitCmd(cmd, 14, 200);
+}
+
+
+
+/* Display Image / Icon from Card (new format) */
+int PGD::SDShowImageRaw(ushort x, ushort y, unsigned int sectaddr)
+{
+    CHECK_INACTIVE;
+    CHECK_BUSY;
+    CHECK_SHIFT;
+
+    if (caps.rev == SGC_R4)
+    {
+        ERRMSG("the new image format is not supported by R4 devices");
+        return -1;
+    }
+
+    if (sectaddr > 0x00ffffff)
+    {
+        ERRMSG("invalid sector address (%.8X), must be <= 0x00ffffff", sectaddr);
+        return -1;
+    }
+
+    char cmd[10] = "@I       ";
+    cmd[2] = (x >> 8) & 0xff;
+    cmd[3] = x & 0xff;
+    cmd[4] = (y >> 8) & 0xff;
+    cmd[5] = y & 0xff;
+    cmd[6] = (sectaddr >> 16) & 0xff;
+    cmd[7] = (sectaddr >> 8) & 0xff;
+    cmd[8] = sectaddr & 0xff;
+
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 14)) != 14)
+    if ((res = portWrite(cmd, 9)) != 9)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(200);
+    return waitCmd(cmd, 9, 200);
 }
 
 
@@ -2343,6 +3883,7 @@ int PGD::SDShowObjectRaw(unsigned int byteaddr)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[6] = "@O   ";
     cmd[2] = (byteaddr >> 24) & 0xff;
@@ -2350,16 +3891,16 @@ int PGD::SDShowObjectRaw(unsigned int byteaddr)
     cmd[4] = (byteaddr >> 8) & 0xff;
     cmd[5] = byteaddr & 0xff;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 6)) != 6)
+    if ((res = portWrite(cmd, 6)) != 6)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(200);
+    return waitCmd(cmd, 6, 200);
 }
 
 
@@ -2369,6 +3910,7 @@ int PGD::SDShowVideoRaw(ushort x, ushort y, uchar delay, unsigned int sectaddr)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     // XXX - can we test if we have the video format set correctly (new format)
 
@@ -2388,16 +3930,16 @@ int PGD::SDShowVideoRaw(ushort x, ushort y, uchar delay, unsigned int sectaddr)
     cmd[8] = (sectaddr >> 8) & 0xff;
     cmd[9] = sectaddr & 0xff;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 10)) != 10)
+    if ((res = portWrite(cmd, 10)) != 10)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(200);
+    return waitCmd(cmd, 10, 200);
 }
 
 /* Display Video / Animation from Card, old format image data */
@@ -2407,6 +3949,7 @@ int PGD::SDShowVideoRaw(ushort x, ushort y, ushort width, ushort height,
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     // XXX - can we test if we have the video format set correctly (old format)
 
@@ -2439,16 +3982,16 @@ int PGD::SDShowVideoRaw(ushort x, ushort y, ushort width, ushort height,
     cmd[15] = (sectaddr >> 8) & 0xff;
     cmd[16] = sectaddr & 0xff;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 17)) != 17)
+    if ((res = portWrite(cmd, 17)) != 17)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(200);
+    return waitCmd(cmd, 17, 200);
 }
 
 
@@ -2458,6 +4001,7 @@ int PGD::SDRunScriptRaw(unsigned int byteaddr)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     char cmd[6] = "@P   ";
     cmd[2] = (byteaddr >> 24) & 0xff;
@@ -2465,11 +4009,11 @@ int PGD::SDRunScriptRaw(unsigned int byteaddr)
     cmd[4] = (byteaddr >> 8) & 0xff;
     cmd[5] = byteaddr & 0xff;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, 6)) != 6)
+    if ((res = portWrite(cmd, 6)) != 6)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
@@ -2484,6 +4028,7 @@ int PGD::SDReadFileFAT(void **data, unsigned int *size, const char *filename)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     if (!data)
     {
@@ -2497,6 +4042,80 @@ int PGD::SDReadFileFAT(void **data, unsigned int *size, const char *filename)
         return -1;
     }
 
+    unsigned int fs;
+    int res = openFileFAT(filename, &fs);
+    if (res) return res;
+    if (fs == 0)
+    {
+        // file size is zero; there is nothing to read
+        portWrite("\x15", 1);
+        *size = 0;
+        return 0;
+    }
+
+    char *dp = new char[fs];
+    if (!dp)
+    {
+        portWrite("\x15", 1);
+        ERRMSG("could not allocate data (%u bytes)", fs);
+        return -1;
+    }
+
+    res = readFileFAT(dp, fs);
+    if (res < 0)
+    {
+        *data = NULL;
+        *size = 0;
+        delete [] dp;
+        return res;
+    }
+
+    *data = dp;
+    *size = fs;
+    return res;
+}
+
+
+/* Read File From Card into a caller-supplied buffer */
+int PGD::SDReadFileFAT(void *buf, unsigned int buflen, unsigned int *size, const char *filename)
+{
+    CHECK_INACTIVE;
+    CHECK_BUSY;
+    CHECK_SHIFT;
+
+    if ((!buf) && (buflen))
+    {
+        ERRMSG("invalid buffer (NULL)");
+        return -1;
+    }
+
+    if (!size)
+    {
+        ERRMSG("invalid size pointer (NULL)");
+        return -1;
+    }
+
+    unsigned int fs;
+    int res = openFileFAT(filename, &fs);
+    if (res) return res;
+    if ((fs == 0) || (fs > buflen))
+    {
+        portWrite("\x15", 1);
+        *size = fs;
+        if (fs == 0) return 0;
+        ERRMSG("file size (%u bytes) exceeds the buffer (%u bytes)", fs, buflen);
+        return -1;
+    }
+
+    *size = fs;
+    res = readFileFAT((char *)buf, fs);
+    if (res < 0) *size = 0;
+    return res;
+}
+
+
+int PGD::openFileFAT(const char *filename, unsigned int *fs)
+{
     if (!filename)
     {
         ERRMSG("invalid filename (NULL pointer)");
@@ -2518,58 +4137,47 @@ int PGD::SDReadFileFAT(void **data, unsigned int *size, const char *filename)
     snprintf(&cmd[3], 13, "%s", filename);
     len += 4;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, len)) != len)
+    if ((res = portWrite(cmd, len)) != len)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
     int nb;
-    if ((nb = port.Read(cmd, 4, 500)) == -1)
+    if ((nb = port->Read(cmd, 4, 500)) == -1)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         return -1;
     }
     if (!nb)
     {
-        port.Write("\x15", 1);  // attempt to cancel the transaction
+        portWrite("\x15", 1);  // attempt to cancel the transaction
         ERRMSG("timeout: no response");
         return -2;
     }
     if ((nb == 1) && (cmd[0] == '\x15')) return 1;
     if (nb != 4)
     {
-        port.Write("\x15", 1);
+        portWrite("\x15", 1);
         ERRMSG("unexpected response size (%d); expected 4", nb);
         return -2;
     }
 
-    unsigned int fs = ((cmd[0] & 0xff) << 24) | ((cmd[1] & 0xff) << 16)
+    *fs = ((cmd[0] & 0xff) << 24) | ((cmd[1] & 0xff) << 16)
             | ((cmd[2] & 0xff) << 8) | (cmd[3] & 0xff);
-    if (fs == 0)
-    {
-        // file size is zero; there is nothing to read
-        port.Write("\x15", 1);
-        *size = 0;
-        return 0;
-    }
+    return 0;
+}
 
-    char *dp = new char[fs];
-    if (!dp)
-    {
-        port.Write("\x15", 1);
-        ERRMSG("could not allocate data (%u bytes)", fs);
-        return -1;
-    }
-    *data = dp;
-    *size = fs;
 
+int PGD::readFileFAT(char *dp, unsigned int fs)
+{
     // calculate the number of blocks and the size of the last block
     unsigned int nblk, nres;
     unsigned int i, idx, bs;
+    int nb;
     nblk = fs / 50;
     nres = fs % 50;
     if (nres) ++nblk;
@@ -2577,28 +4185,22 @@ int PGD::SDReadFileFAT(void **data, unsigned int *size, const char *filename)
     // read in each block
     for (i = 0; i < nblk; ++i)
     {
-        port.Write("\x06", 1);
+        portWrite("\x06", 1);
         idx = i * 50;
         bs = 50;
         if ((i == nblk -1) && (nres)) bs = nres;
         while (bs)
         {
-            nb = port.Read(&dp[idx], bs, 500);
+            nb = port->Read(&dp[idx], bs, 500);
             if (nb == -1)
             {
-                *data = NULL;
-                *size = 0;
-                delete [] dp;
-                ERRMSG("failed to read %d bytes of data; see message below\n%s",
-                       fs, port.GetError());
+                ERRMSG("failed to read %u bytes of data; see message below\n%s",
+                       fs, port->GetError());
                 return -2;
             }
             if (nb == 0)
             {
-                *data = NULL;
-                *size = 0;
-                delete [] dp;
-                ERRMSG("failed to read %d bytes of data (timeout)", fs);
+                ERRMSG("failed to read %u bytes of data (timeout)", fs);
                 return -2;
             }
             idx += nb;
@@ -2615,6 +4217,7 @@ int PGD::SDWriteFileFAT(const void *data, unsigned int size, const char *filenam
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     if (!data)
     {
@@ -2648,7 +4251,7 @@ int PGD::SDWriteFileFAT(const void *data, unsigned int size, const char *filenam
     cmd[len + 7] = size & 0xff;
 
     unsigned int nblk, nresid;
-    port.Flush();
+    port->Flush();
     if (size <= 100)
     {
         cmd[2] = 0;     // no handshaking
@@ -2684,9 +4287,9 @@ int PGD::SDWriteFileFAT(const void *data, unsigned int size, const char *filenam
                 return -1;
         }
         idx = i * 50;
-        if (port.Write(&dp[idx], bs) != (int) bs)
+        if (portWrite(&dp[idx], bs) != (int) bs)
         {
-            ERRMSG("failed; see message below\n%s", port.GetError());
+            ERRMSG("failed; see message below\n%s", port->GetError());
             return -2;
         }
     }
@@ -2700,6 +4303,7 @@ int PGD::SDEraseFileFAT(const char *filename)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     if (!filename)
     {
@@ -2721,24 +4325,50 @@ int PGD::SDEraseFileFAT(const char *filename)
     snprintf(&cmd[2], 13, "%s", filename);
     len += 3;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, len)) != len)
+    if ((res = portWrite(cmd, len)) != len)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(200);
+    return waitCmd(cmd, len, 200);
 }
 
 /* List Directory From Card */
+// appends a directory entry to a std::list<std::string>
+static bool addDirEntry(const char *name, int len, void *obj)
+{
+    ((std::list<std::string> *)obj)->push_back(std::string(name, len));
+    return true;
+}
+
 int PGD::SDListDirFAT(const char *pattern, std::list<std::string> *dir)
+{
+    if (!dir)
+    {
+        ERRMSG("invalid list pointer (NULL)");
+        return -1;
+    }
+
+    dir->clear();
+    return SDListDirFAT(pattern, addDirEntry, dir);
+}
+
+int PGD::SDListDirFAT(const char *pattern,
+                      bool (*cb)(const char *name, int len, void *obj), void *obj)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
+    if (!cb)
+    {
+        ERRMSG("invalid callback (NULL pointer)");
+        return -1;
+    }
     if (!pattern)
     {
         ERRMSG("invalid filename (NULL pointer)");
@@ -2758,49 +4388,68 @@ int PGD::SDListDirFAT(const char *pattern, std::list<std::string> *dir)
     snprintf(&cmd[2], 13, "%s", pattern);
     len += 3;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, len)) != len)
+    if ((res = portWrite(cmd, len)) != len)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
+    // Entries are passed on as soon as their terminator arrives. Once the
+    // callback declines further entries the rest of the listing is
+    // discarded, since the transaction must still run to its ACK.
     int i;
     int nb;
-    char buf[512];
-    std::string direntry;
-    dir->clear();
-    direntry.clear();
-    while ((nb = port.Read(buf, 512, 500)) > 0)
-    {
+    int nent = 0;           // number of entries passed to the callback
+    int elen = 0;           // length of the current entry
+    bool want = true;       // false once the callback stops the listing
+    char buf[64];
+    char entry[PGDDIRLEN];
+    while (1)
+    {
+        if ((nb = port->Select(500)) == -1)
+        {
+            if (errno == EINTR) continue;
+            ERRMSG("failed after %d entries: %s", nent, strerror(errno));
+            return -1;
+        }
+        if (nb == 0) break;
+
+        // collect whatever has arrived without waiting for a full buffer
+        if ((nb = port->Read(buf, sizeof(buf), 1)) == -1)
+        {
+            ERRMSG("failed after %d entries; see message below\n%s",
+                   nent, port->GetError());
+            return -1;
+        }
         for (i = 0; i < nb; ++i)
         {
-            if ((buf[i] == '\x0a') || (buf[i] == '\x06') || (buf[i] != '\x15'))
+            if ((buf[i] == '\x0a') || (buf[i] == '\x06') || (buf[i] == '\x15'))
             {
-                if (direntry.size()) dir->push_back(direntry);
-                direntry.clear();
-                if (buf[i] == '\x06') return dir->size();
+                if ((elen) && (want))
+                {
+                    entry[elen] = 0;
+                    ++nent;
+                    want = cb(entry, elen, obj);
+                }
+                elen = 0;
+                if (buf[i] == '\x06') return nent;
                 if (buf[i] == '\x15')
                 {
-                    ERRMSG("failed after acquiring %d entries (NACK)", dir->size());
+                    ERRMSG("failed after %d entries (NACK)", nent);
                     return -1;
                 }
                 continue;
             }
-            direntry += buf[i];
+            // names are at most 8.3 characters; anything longer is truncated
+            if (elen < PGDDIRLEN - 1) entry[elen++] = buf[i];
         }
     }
-    if (nb == -1)
-    {
-        ERRMSG("failed after acquiring %d entries; see message below\n%s",
-               dir->size(), port.GetError());
-        return -1;
-    }
 
-    ERROUT("TIMEOUT; no ACK or NACK detected; %d entries", dir->size());
-    ERRMSG("TIMEOUT; no ACK or NACK detected; %d entries", dir->size());
+    ERROUT("TIMEOUT; no ACK or NACK detected; %d entries\n", nent);
+    ERRMSG("TIMEOUT; no ACK or NACK detected; %d entries", nent);
     return -1;
 }
 
@@ -2810,6 +4459,7 @@ int PGD::SDScreenCopyFAT(ushort x, ushort y, ushort width, ushort height,
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     if (!filename)
     {
@@ -2838,16 +4488,16 @@ int PGD::SDScreenCopyFAT(ushort x, ushort y, ushort width, ushort height,
     snprintf(&cmd[10], 13, "%s", filename);
     len += 11;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, len)) != len)
+    if ((res = portWrite(cmd, len)) != len)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(200);
+    return waitCmd(cmd, len, 200);
 }
 
 
@@ -2857,8 +4507,9 @@ int PGD::SDShowImageFAT(const char *filename, ushort x, ushort y, unsigned int i
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
-    if (imgaddr > 0x00ffffff)
+    if ((caps.rev != SGC_R11) && (imgaddr > 0x00ffffff))
     {
         ERRMSG("invalid image sector address (%.8X), must be <= 0x00ffffff", imgaddr);
         return -1;
@@ -2876,7 +4527,7 @@ int PGD::SDShowImageFAT(const char *filename, ushort x, ushort y, unsigned int i
         return -1;
     }
 
-    char cmd[24];
+    char cmd[26];
     cmd[0] = '@';
     cmd[1] = 'm';
     /* W32 */
@@ -2885,21 +4536,26 @@ int PGD::SDShowImageFAT(const char *filename, ushort x, ushort y, unsigned int i
     cmd[4 + len] = x & 0xff;
     cmd[5 + len] = (y >> 8) & 0xff;
     cmd[6 + len] = y & 0xff;
+    if (caps.rev == SGC_R11)
+    {
+        cmd[7 + len] = (imgaddr >> 24) & 0xff;
+        ++len;
+    }
     cmd[7 + len] = (imgaddr >> 16) & 0xff;
     cmd[8 + len] = (imgaddr >> 8) & 0xff;
     cmd[9 + len] = imgaddr & 0xff;
     len += 10;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, len)) != len)
+    if ((res = portWrite(cmd, len)) != len)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(200);
+    return waitCmd(cmd, len, 200);
 }
 
 
@@ -2909,6 +4565,7 @@ int PGD::SDPlayAudioFAT(const char *filename, uchar option)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     if (!filename)
     {
@@ -2936,16 +4593,16 @@ int PGD::SDPlayAudioFAT(const char *filename, uchar option)
     snprintf(&cmd[3], 13, "%s", filename);
     len += 4;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, len)) != len)
+    if ((res = portWrite(cmd, len)) != len)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(200);
+    return waitCmd(cmd, len, 200);
 }
 
 /* Run 4DSL Script from Card */
@@ -2953,6 +4610,7 @@ int PGD::SDRunScriptFAT(const char *filename)
 {
     CHECK_INACTIVE;
     CHECK_BUSY;
+    CHECK_SHIFT;
 
     if (!filename)
     {
@@ -2973,14 +4631,14 @@ int PGD::SDRunScriptFAT(const char *filename)
     snprintf(&cmd[2], 13, "%s", filename);
     len += 3;
 
-    port.Flush();
+    port->Flush();
     int res;
-    if ((res = port.Write(cmd, len)) != len)
+    if ((res = portWrite(cmd, len)) != len)
     {
-        ERRMSG("failed; see message below\n%s", port.GetError());
+        ERRMSG("failed; see message below\n%s", port->GetError());
         if (res > 0) return -2;
         return -1;
     }
 
-    return waitACKNACK(200);
+    return waitCmd(cmd, len, 200);
 }
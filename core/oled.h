@@ -37,11 +37,13 @@
 #define OLED_H
 
 #include <pthread.h>
+#include <sys/time.h>
 #include <linux/limits.h>
 #include <list>
 #include <string>
 
 #include "comport.h"
+#include "arena.h"
 
 namespace disp {
 
@@ -54,6 +56,19 @@ namespace disp {
 #define PGDERRLEN (512)
 // max. length of incoming data for callback
 #define PGDDLEN (4)
+// default max. number of commands awaiting an ACK in Transmit()
+#define PGDTXWIN (4)
+// max. length of a directory entry passed by SDListDirFAT(), including the terminator
+#define PGDDIRLEN (16)
+// max. depth of the clip rectangle stack
+#define PGDCLIPDEPTH (8)
+// bytes of pixels staged for each part of a trimmed or rotated icon
+// which does not fit in the arena
+#define PGDICONBUF (4096)
+// default number of times a command which timed out is sent again
+#define PGDRETRIES (2)
+// msec during which a display which may have been reset is offered autobaud
+#define PGDRESETWAIT (1000)
     /* machine states for the display controller */
     enum DSTATE {
         LCD_INACTIVE = 0,   /* no established connection */
@@ -217,19 +232,217 @@ namespace disp {
         }
     };
 
+    /* SGC command set revision (see notes/notes_sgc_revisions) */
+    enum DSGCREV {
+        SGC_UNKNOWN = 0,
+        SGC_R4,             // no 'd' command, old image format only
+        SGC_R11             // 'd' command, new image format, 4-byte 'm' sector address
+    };
+
+    /* Device capabilities; probed once and kept in the capability cache */
+    struct PGDCAPS {
+        PGDVER ver;         // response to Version()
+        DSGCREV rev;        // command set revision
+        DBAUD baud;         // highest rate which has been negotiated successfully
+        PGDCAPS() {
+            rev = SGC_UNKNOWN;
+            baud = DB_9600;
+        }
+    };
+
+    /* Rectangular screen area; coordinates are inclusive */
+    struct PGDRECT {
+        int x1;
+        int y1;
+        int x2;
+        int y2;
+        PGDRECT() {
+            x1 = y1 = 0;
+            x2 = y2 = -1;
+        }
+        PGDRECT(int ax1, int ay1, int ax2, int ay2) {
+            x1 = ax1;
+            y1 = ay1;
+            x2 = ax2;
+            y2 = ay2;
+        }
+        bool IsEmpty(void) const { return (x2 < x1) || (y2 < y1); }
+        bool Intersects(const PGDRECT &r) const {
+            return (r.x1 <= x2) && (r.x2 >= x1) && (r.y1 <= y2) && (r.y2 >= y1);
+        }
+    };
+
+    /// Estimate the area covered by text drawn at (x, y) with a scale of (xmul, ymul)
+    PGDRECT PGDTextExtent(int x, int y, uchar font, int xmul, int ymul, const char *text);
+
+    /// Decode the 5-byte response to Version(); resolutions are in pixels (0 = unknown)
+    void PGDParseVersion(const char *msg, PGDVER *ver);
+
+    /// @return true if the <len>-byte command <cmd> leaves the display in the same
+    /// state whether it is executed once or twice, so that it may be sent again
+    /// when its response is lost
+    bool PGDIdempotent(const char *cmd, int len);
+
+    /* Host-side clipping statistics */
+    struct PGDCLIPSTATS {
+        unsigned long dropped;      // commands not sent because they would draw nothing
+        unsigned long trimmed;      // commands reduced to their visible part
+        unsigned long saved;        // bytes not sent
+        PGDCLIPSTATS() {
+            dropped = trimmed = saved = 0;
+        }
+    };
+
+    /* Timing of the last ConnectAsync(); times in msec from the call */
+    struct PGDLINKSTATS {
+        double linkup;              // link established (autobaud and rate done)
+        double flushed;             // commands queued meanwhile sent; < 0 if not yet
+        int queued;                 // commands queued while connecting
+        int flushres;               // result of sending them (as for Transmit)
+        PGDLINKSTATS() {
+            linkup = flushed = -1.0;
+            queued = 0;
+            flushres = 0;
+        }
+    };
+
+    /* Link quality monitor settings (see linkmon.h) */
+    struct PGDLQPARAMS {
+        int window;             // command results in the sliding window (4..PGDLQMAXWIN)
+        int minsamples;         // results needed before the error rate is acted on
+        double maxerr;          // fraction of failed commands which causes a downshift
+        int upclean;            // consecutive successes before a higher rate is tried
+        int holdoff;            // msec after a rate change before a higher rate is tried;
+                                // doubled after each failed attempt up to <maxholdoff>
+        int maxholdoff;
+        bool autoshift;         // change the rate; otherwise the link is only measured
+        PGDLQPARAMS() {
+            window = 32;
+            minsamples = 8;
+            maxerr = 0.05;
+            upclean = 200;
+            holdoff = 2000;
+            maxholdoff = 60000;
+            autoshift = false;
+        }
+    };
+
+// max. length of the link quality window
+#define PGDLQMAXWIN (256)
+// number of rates on the link quality ladder (DB_9600 .. DB_256000)
+#define PGDLQRATES (5)
+
+    /* Reason for a rate change made by the link quality monitor */
+    enum PGDLQREASON {
+        LQ_NONE = 0,
+        LQ_ERRORS,      // downshift: too many NACKs, timeouts or faults
+        LQ_CLEAN,       // upshift: the link has been clean long enough
+        LQ_SLOWER       // downshift: the higher rate moved fewer bytes per second
+    };
+
+    /* Link quality metrics; a command fails if it is NACKed, times out or
+       causes a comms fault. Goodput is the number of bytes of acknowledged
+       commands per second spent waiting for commands. */
+    struct PGDLINKQUAL {
+        unsigned long commands;     // command results recorded
+        unsigned long nacks;
+        unsigned long timeouts;
+        unsigned long faults;
+        unsigned long bytes;        // bytes written
+        unsigned long okbytes;      // bytes of acknowledged commands
+        double busy;                // seconds spent on commands
+        int wcount;                 // results in the window (current rate only)
+        int werrors;                // failed commands in the window
+        double errrate;             // werrors / wcount
+        double goodput;             // bytes/s in the window
+        double rategood[PGDLQRATES];// bytes/s of the last full window at each rate; 0 = unknown
+        DBAUD rate;                 // current rate
+        DBAUD ceiling;              // highest rate which will be tried
+        unsigned long downshifts;
+        unsigned long upshifts;
+        unsigned long reverts;      // higher rates abandoned after a trial
+        unsigned long shiftfails;   // rate changes which did not take effect
+        double holdoff;             // msec before a higher rate may be tried
+        PGDLQREASON reason;         // last decision
+        DBAUD from;
+        DBAUD to;
+        double when;                // sec since the monitor was started
+        PGDLINKQUAL() {
+            commands = nacks = timeouts = faults = 0;
+            bytes = okbytes = 0;
+            busy = 0.0;
+            wcount = werrors = 0;
+            errrate = goodput = 0.0;
+            for (int i = 0; i < PGDLQRATES; ++i) rategood[i] = 0.0;
+            rate = ceiling = from = to = DB_9600;
+            downshifts = upshifts = reverts = shiftfails = 0;
+            holdoff = 0.0;
+            reason = LQ_NONE;
+            when = 0.0;
+        }
+    };
+
+    /* Automatic retries of commands whose response timed out */
+    struct PGDRETRYSTATS {
+        unsigned long timeouts;     // commands whose first response timed out
+        unsigned long unsafe;       // of which not sent again (not idempotent)
+        unsigned long retried;      // of which sent again
+        unsigned long resends;      // number of times commands were sent again
+        unsigned long recovered;    // retried commands which then got a response
+        unsigned long failed;       // retried commands which still got no response
+        PGDRETRYSTATS() {
+            timeouts = unsafe = retried = resends = recovered = failed = 0;
+        }
+    };
+
+    /* Screen journal (see journal.h) */
+    struct PGDJOURNALSTATS {
+        unsigned long recorded;     // commands recorded
+        unsigned long collapsed;    // commands removed because later ones hide them
+        unsigned long entries;      // commands in the journal
+        unsigned long bytes;        // bytes in the journal
+        unsigned long overflows;    // times the journal outgrew its size limit
+        bool complete;              // the journal describes the whole screen
+        PGDJOURNALSTATS() {
+            recorded = collapsed = entries = bytes = overflows = 0;
+            complete = true;
+        }
+    };
+
+    /* Detection of display resets and restoration of the screen */
+    struct PGDRESETSTATS {
+        unsigned long probes;       // checks for a reset
+        unsigned long resets;       // resets found
+        unsigned long restored;     // screens restored from the journal
+        unsigned long failed;       // resets after which the screen could not be restored
+        double detect;              // msec from the last check to the display answering autobaud
+        double replay;              // msec taken to restore the rate and replay the journal
+        unsigned long replayed;     // commands in the last replay
+        PGDRESETSTATS() {
+            probes = resets = restored = failed = replayed = 0;
+            detect = replay = 0.0;
+        }
+    };
+
     /* Commands used in callback notification */
     enum PGDCMD {
         PG_NONE = 0,
         PG_SLEEP,       // result: ACK/NACK
         PG_TOUCH_DATA,  // result: 4-byte X,Y coord.
         PG_TOUCH_WAIT,  // result: ACK/NACK
+        PG_CONNECT,     // result: true if ConnectAsync() established the link
         // to be extended as parts are implemented
     };
 
+    class PGDCMDBUF;
+    class PGDLINKMON;
+    class PGDJOURNAL;
+
     /** PICASSO Graphics DEVICE */
     class PGD {
         private:
-            com::COMPORT port;          // serial communications port
+            com::COMPORT serial;        // built-in serial communications port
+            com::COMMIF *port;          // transport in use (normally &serial)
             DBAUD baud;                 // current communications rate
             unsigned int portspeed;     // baud parameter used by COMPORT
             PGDCMD curcmd;              // current command
@@ -243,10 +456,94 @@ namespace disp {
             volatile DSTATE state;      // state machine variable
             char errmsg[PGDERRLEN];
             bool halt;                  // flag to indicate we are halting
+            int  txwin;                 // max. commands in flight in Transmit()
+            PGDARENA arena;             // staging memory for commands and data
+            char iconbuf[PGDICONBUF + 10];  // a part of an icon, when not in the arena
+            PGDCAPS caps;               // capabilities of the connected display
+            char capfile[PATH_MAX];     // capability cache file; empty if not used
+            /* background connection */
+            volatile bool connecting;   // ConnectAsync() has not finished
+            pthread_t linker;           // thread making the connection
+            char linkport[PATH_MAX];    // port being connected
+            pthread_mutex_t pmutex;     // guards 'pending' and 'connecting'
+            PGDCMDBUF *pending;         // commands submitted while connecting
+            PGDCMDBUF *flushing;        // commands being sent after the link is up
+            struct timeval tconnect;    // time of ConnectAsync()
+            PGDLINKSTATS lstats;
+            /* link quality */
+            PGDLINKMON *lmon;           // error rates and rate decisions
+            bool shifting;              // a rate change is in progress
+            // write to the port, counting the bytes for the link monitor
+            int  portWrite(const char *data, int len);
+            // make the rate change decided by the link monitor
+            int  shiftBaud(void);
+            // look for the display at <rate>
+            int  probeRate(enum disp::DBAUD rate, unsigned int speed);
+            // change the rate of the display and the port
+            int  setRate(enum disp::DBAUD speed);
+            /* automatic retries */
+            int  maxretry;              // times a command is sent again after a timeout
+            PGDRETRYSTATS rstats;
+            // wait for the response to the <len>-byte command <cmd>, which has
+            // been written (followed by <dlen> bytes of <data>); after a timeout
+            // an idempotent command is sent again with the timeout doubled
+            int  waitCmd(const char *cmd, int len, int timeout,
+                         const char *data = NULL, int dlen = 0);
+            // the part of waitCmd() which follows a timeout
+            int  retryCmd(const char *cmd, int len, int timeout,
+                          const char *data, int dlen);
+            /* screen journal and reset recovery */
+            PGDJOURNAL *journal;        // commands which define the screen
+            PGDCMDBUF *replay;          // the journal as sent after a reset
+            bool replaying;             // the journal is being sent
+            PGDRESETSTATS xstats;
+            // record an acknowledged command in the journal
+            void journalCmd(const char *cmd, int len, int timeout,
+                            const char *data, int dlen);
+            // check whether the display has reset; if so restore the rate and
+            // replay the journal. Returns 0 if the display answers at the
+            // current rate, 1 if it had reset and the screen was restored,
+            // -1 if it had reset and the screen could not be restored and
+            // +2 if the display does not answer at all
+            int  recover(void);
+            // open the port at the power-on rate
+            int openPort(const char *portname);
+            // power-on wait, autobaud, identification and rate upgrade
+            int link(const char *portname);
+            // send the commands queued while connecting
+            int flushPending(void);
+            // take the queue lock if a background connection is in progress
+            bool lockPending(void);
+            // release the queue lock after queueing <ncmds> commands with result <res>
+            int unlockPending(int res, int ncmds = 1);
+            /* host-side clipping */
+            ushort nwidth;              // display size in its native orientation; 0 if unknown
+            ushort nheight;
+            uchar orient;               // orientation set with Ctl(); 0 = native
+            uchar norient;              // native orientation (DORIENT)
+            bool iconrot;               // rotate DrawIcon data to the current orientation
+            // clockwise quarter turns from the native to the current orientation
+            int  turns(void);
+            uchar pen;                  // current pen size (DPENTYPE)
+            PGDRECT cstack[PGDCLIPDEPTH]; // clip rectangle stack
+            int nclip;
+            PGDRECT clip;               // effective clipping area
+            PGDCLIPSTATS cstats;
+            // recalculate the clipping area from the bounds and the stack
+            void updateClip(void);
+            // clip a rectangle; return -1 if nothing is visible, 0 if the
+            // rectangle is unchanged and 1 if it was trimmed
+            int clipRect(PGDRECT *r);
+            // clip a line (Cohen-Sutherland); return values as for clipRect()
+            int clipLine(int *x1, int *y1, int *x2, int *y2);
+            // account for a command which is not sent
+            int dropped(int nbytes) { ++cstats.dropped; cstats.saved += nbytes; return 0; }
             /* response processing routines */
             int autobaud(void);         // p.9, PICASO-SGC-COMMANDS-SIS-rev3.pdf
             // convert resolution code to a number; 0 = unknown
             unsigned int convertRes(char rescode);
+            // identify the command set revision with the 'd' (R11 only) command
+            DSGCREV probeRev(void);
             // wait for an ACK; all other characters are rejected.
             // returns 0 for success, -1 for comms fault, +2 for timeout
             int waitACK(int timeout);
@@ -254,8 +551,17 @@ namespace disp {
             // returns 0 for success, -1 for comms fault, +2 for timeout
             int waitNACK(int timeout);
             // wait for either an ACK or a NACK while rejecting other characters
-            // return -1 for comms fault, 0 for ACK, +1 for NACK, +2 for timeout
-            int waitACKNACK(int timeout);
+            // return -1 for comms fault, 0 for ACK, +1 for NACK, +2 for timeout;
+            // the result is passed to the link monitor if <monitor> is true
+            int waitACKNACK(int timeout, bool monitor = true);
+            // collect <count> ACK/NACK responses, counting NACKs in <nacks>;
+            // return -1 for comms fault, 0 for success, +2 for timeout
+            int waitACKs(int count, int timeout, int *nacks);
+            // request a file from the card; on success <fs> holds its size
+            // and the caller must read the data with readFileFAT()
+            int openFileFAT(const char *filename, unsigned int *fs);
+            // read <fs> bytes of an open file in 50-byte handshake blocks
+            int readFileFAT(char *dp, unsigned int fs);
 
 
         public:
@@ -264,13 +570,111 @@ namespace disp {
 
             // data processing routine; not to be called by the user
             int  Process(void);
+            // background connection routine; not to be called by the user
+            int  Link(void);
             // user callback to support Touch routines
             int  SetCallback(void (*cb)(class PGD*, PGDCMD, bool, void *), void *obj);
             /* port access routines */
             int  Connect(const char *portname);
+            /* Connect without blocking: the port is opened and the power-on
+               wait, autobaud and rate upgrade are done on the I/O thread.
+               Meanwhile the commands which PGDCMDBUF can record (and
+               Transmit() of a whole buffer) are queued and return 0; they are
+               not clipped. DrawIcon data is queued as given and is not
+               rotated (see SetIconRotation), so queued icons are drawn in the
+               native orientation. Other commands fail. The queue is sent as
+               soon as the link is up and the callback then receives
+               PG_CONNECT.
+               Returns 0 or -1 if the port could not be opened. */
+            int  ConnectAsync(const char *portname);
+            bool IsConnecting(void) { return connecting; }
+            const PGDLINKSTATS &GetLinkStats(void) { return lstats; }
             void Close(void);
+            /* Alternative transport (see commif.h) used by Connect() and all
+               commands; NULL restores the built-in serial port. The transport
+               cannot be changed while connected and must outlive its use.
+               Returns 0 or -1. */
+            int  SetTransport(com::COMMIF *transport);
             const char *GetError(void) { return errmsg; }
 
+            /* Memory arena used to stage large commands (DrawIcon) and
+               available to the user for response buffers; a size of 0
+               (the default) disables it and large payloads are then
+               written without staging. A trimmed or rotated icon which
+               does not fit is sent as several icons of a few rows each.
+               Returns 0 or -1. */
+            int  SetArena(unsigned int size);
+            PGDARENA *GetArena(void) { return &arena; }
+            const PGDMEMSTATS &GetMemStats(void) { return arena.GetStats(); }
+
+            /* Capability cache file (see capcache.h); NULL disables the cache.
+               With a cache Connect() identifies the display with a quick
+               Version() query, takes its capabilities from the cache and
+               only probes displays which are not in the cache. A display is
+               only recorded once it has accepted the new rate. */
+            int  SetCapCache(const char *filename);
+            /* Probe the capabilities of the connected display */
+            int  ProbeCaps(void);
+            /* capabilities of the connected display; rev is SGC_UNKNOWN if
+               they have not been probed */
+            const PGDCAPS &GetCaps(void) { return caps; }
+
+            /* Host-side clipping. Lines, rectangles, icons and text are clipped
+               against the display bounds and the clip stack before they are
+               sent; commands which would draw nothing are not sent and return 0.
+               Circles, ellipses and pixels are only dropped when they are
+               entirely outside. Text cannot be cut by the device, so only whole
+               characters are removed. Wireframe rectangles are sent unclipped
+               unless they are entirely outside. Prerecorded sequences
+               (Transmit) are not clipped. */
+            /* display size in the native orientation; it is taken from Version()
+               if not set; 0,0 disables clipping against the display */
+            int  SetBounds(ushort width, ushort height);
+            /* intersect the clipping area with <area> (inclusive coordinates) */
+            int  PushClip(const PGDRECT &area);
+            int  PopClip(void);
+            const PGDRECT &GetClip(void) { return clip; }
+            const PGDCLIPSTATS &GetClipStats(void) { return cstats; }
+            void ResetClipStats(void) { cstats = PGDCLIPSTATS(); }
+
+            /* The controller renders DrawIcon data in its native orientation;
+               DrawIcon rotates the data on the host so that images appear
+               upright in the orientation set with Ctl(DM_ORIENT). The native
+               orientation is the one in which the bounds are given (default
+               LANDSCAPE). Orientations are taken to be clockwise quarter turns
+               in the order LANDSCAPE, PORTRAIT, LANDSCAPE_R, PORTRAIT_R. */
+            int  SetNativeOrient(uchar orient);
+            void SetIconRotation(bool enable) { iconrot = enable; }
+
+            /* Automatic retries. When the response to a command times out the
+               application cannot tell whether the command was executed; a
+               command for which PGDIdempotent() is true is sent again up to
+               <nretries> times (default PGDRETRIES), doubling the timeout each
+               time. Other commands return +2 as before. Commands sent with
+               Transmit() are not retried. Returns 0 or -1. */
+            int  SetRetries(int nretries);
+            const PGDRETRYSTATS &GetRetryStats(void) { return rstats; }
+            void ResetRetryStats(void) { rstats = PGDRETRYSTATS(); }
+
+            /* Screen journal. The acknowledged commands which define the
+               screen are kept, less those hidden by later commands, up to
+               <maxbytes> bytes (0, the default, disables the journal). With
+               the journal enabled a command whose response times out makes
+               PGD check whether the display has reset: if the display does
+               not answer a Version() query at the current rate but answers
+               autobaud within PGDRESETWAIT msec, the rate is restored and the
+               journal is replayed before an idempotent command is sent again.
+               The journal starts empty at Connect() and when it is enabled;
+               anything drawn before then is not restored. Returns 0 or -1. */
+            int  SetJournal(unsigned int maxbytes);
+            const PGDJOURNALSTATS &GetJournalStats(void);
+            /* Check for a reset while idle. Returns 0 if the display did not
+               reset, 1 if it had reset and the screen was restored, -1 if the
+               screen could not be restored and +2 if the display does not
+               answer at all. */
+            int  CheckReset(void);
+            const PGDRESETSTATS &GetResetStats(void) { return xstats; }
+
             /*
                 LOW LEVEL COMMANDS
 
@@ -279,8 +683,27 @@ namespace disp {
                 a timeout on ACK/NACK, and -2 if the command failed
                 in such a way that the display will require a manual reset.
             */
-            int  SetBaud(enum disp::DBAUD);                         /* p.10 */
+            /* Send a prerecorded command sequence (see cmdbuf.h); up to <txwin>
+               commands are written ahead of their ACK. <count> = -1 sends all
+               commands from <first>. Returns +1 if any command was NACKed.
+               An acknowledged PenSize command updates GetPenSize(). */
+            int  Transmit(const PGDCMDBUF *buf, int first = 0, int count = -1);
+            /* set the max. number of commands written ahead of their ACK */
+            int  SetTxWindow(int ncmds);
+            /* p.10; the rate set here is the highest which the link monitor will use */
+            int  SetBaud(enum disp::DBAUD);
             enum disp::DBAUD GetBaud(void) { return baud; }
+            /* Link quality monitor. The results of commands are kept over a
+               sliding window; with <autoshift> set the rate is lowered when too
+               many commands fail and raised again when the link has been clean
+               for a while. A higher rate is abandoned if it turns out to move
+               fewer bytes per second than the rate below it. Rate changes are
+               made at the start of the next command, which fails if the display
+               then answers at neither the old nor the new rate. */
+            int  SetLinkMonitor(const PGDLQPARAMS &params);
+            const PGDLQPARAMS &GetLinkMonitor(void);
+            const PGDLINKQUAL &GetLinkQuality(void);
+            void ResetLinkQuality(void);
             int  Version(struct disp::PGDVER *ver, bool display);   /* p.11 */
             int  ReplaceBackground(ushort color);                   /* p.12, immediately replaces the background color */
             int  Clear(void);                                       /* p.13 */
@@ -305,8 +728,9 @@ namespace disp {
             // CAVEAT: points must be in anticlockwise order
             int  Triangle(ushort x1, ushort y1, ushort x2, ushort y2,
                           ushort x3, ushort y3, ushort color);
-            /* p.27 note: ORIENTATION *may* have no effect; the configuration tool must be used to
-            set the PICASO controller to use the desired orientation by default */
+            /* p.27 note: ORIENTATION *may* have no effect; the controller may draw icons in
+            its default orientation. The data is then rotated on the host (see
+            SetNativeOrient and SetIconRotation) */
             int  DrawIcon(ushort x, ushort y, ushort width, ushort height,
                           uchar colormode, const uchar *data, int datalen);
             /* p.28 note: background color only changes for future commands, unlike replacebackground() */
@@ -331,6 +755,7 @@ namespace disp {
                               ushort oldcolor, ushort newcolor);
             /* p.37 */
             int  PenSize(uchar size);
+            uchar GetPenSize(void) { return pen; }
 
             /* TEXT COMMANDS */
             /* p.39 */
@@ -383,7 +808,8 @@ namespace disp {
                                 unsigned int sectaddr);
             /* Display Image / Icon from Card */
             int SDShowImageRaw(ushort x, ushort y, ushort width, ushort height,
-                               uchar colormode, unsigned int sectaddr);
+                               uchar colormode, unsigned int sectaddr); /* old format */
+            int SDShowImageRaw(ushort x, ushort y, unsigned int sectaddr);  /* new format, R11 only */
             /* Display Object from Card */
             int SDShowObjectRaw(unsigned int byteaddr);
             /* Display Video / Animation from Card */
@@ -397,6 +823,11 @@ namespace disp {
             /* SD FAT16 COMMANDS, starts at p.63 */
             /* Read File From Card */
             int SDReadFileFAT(void **data, unsigned int *size, const char *filename);
+            /* Read File From Card into a caller-supplied buffer (for example
+               from GetArena()); fails with -1 and <size> set to the file size
+               if the file does not fit in <buflen> bytes */
+            int SDReadFileFAT(void *buf, unsigned int buflen, unsigned int *size,
+                              const char *filename);
             /* Write File To Card */
             int SDWriteFileFAT(const void *data, unsigned int size,
                                const char *filename, bool append);
@@ -404,10 +835,16 @@ namespace disp {
             int SDEraseFileFAT(const char *filename);
             /* List Directory From Card; returns -1 for failure, otherwise # of entries */
             int SDListDirFAT(const char *pattern, std::list<std::string> *dir);
+            /* List Directory From Card; each entry is passed to <cb> as soon as it
+               arrives (<name> is terminated and only valid during the call);
+               <cb> returns false to stop. Returns -1 for failure, otherwise
+               the number of entries passed to <cb>. */
+            int SDListDirFAT(const char *pattern,
+                             bool (*cb)(const char *name, int len, void *obj), void *obj);
             /* Screen Copy and Save to Card */
             int SDScreenCopyFAT(ushort x, ushort y, ushort width, ushort height,
                                 const char *filename);
-            /* Display Image / Icon from Card */
+            /* Display Image / Icon from Card; the sector address is 4 bytes on R11, else 3 */
             int SDShowImageFAT(const char *filename, ushort x, ushort y, unsigned int imgaddr);
             /* Play Audio WAV file from Card */
             int SDPlayAudioFAT(const char *filename, uchar option);
@@ -0,0 +1,439 @@
+/**
+    file: pixbatch.cpp
+
+    Pixel batches for the PICASO SGC driver.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pixbatch.h"
+
+using namespace disp;
+
+#define ERRMSG(fmt, args...) snprintf(errmsg, PGDERRLEN, "%s:%d: %s(): " fmt,\
+    __FILE__, __LINE__, __FUNCTION__,##args)
+
+// command lengths
+#define PIXLEN (7)
+#define ICONHDR (10)
+
+
+PGDPIXBATCH::PGDPIXBATCH()
+{
+    pix = NULL;
+    npix = 0;
+    psize = 0;
+    cost = PGDPIXCMDCOST;
+    errmsg[0] = 0;
+    return;
+}
+
+
+
+PGDPIXBATCH::~PGDPIXBATCH()
+{
+    delete [] pix;
+    return;
+}
+
+
+
+int
+PGDPIXBATCH::Reserve(int npixels)
+{
+    if (npixels <= psize) return 0;
+
+    PIX *tp = new PIX[npixels];
+    if (!tp)
+    {
+        ERRMSG("could not allocate memory (%d pixels)", npixels);
+        return -1;
+    }
+    if (npix) memcpy(tp, pix, npix * sizeof(PIX));
+    delete [] pix;
+    pix = tp;
+    psize = npixels;
+    return 0;
+}
+
+
+
+int
+PGDPIXBATCH::WritePixel(ushort x, ushort y, ushort color)
+{
+    if ((npix == psize) && (Reserve(psize ? psize * 2 : 256))) return -1;
+
+    pix[npix].x = x;
+    pix[npix].y = y;
+    pix[npix].color = color;
+    pix[npix].seq = npix;
+    ++npix;
+    return 0;
+}
+
+
+
+int
+PGDPIXBATCH::cmpRow(const void *a, const void *b)
+{
+    const PIX *pa = (const PIX *)a;
+    const PIX *pb = (const PIX *)b;
+    if (pa->y != pb->y) return (pa->y < pb->y) ? -1 : 1;
+    if (pa->x != pb->x) return (pa->x < pb->x) ? -1 : 1;
+    return pa->seq - pb->seq;
+}
+
+
+
+int
+PGDPIXBATCH::cmpColumn(const void *a, const void *b)
+{
+    const PIX *pa = (const PIX *)a;
+    const PIX *pb = (const PIX *)b;
+    if (pa->x != pb->x) return (pa->x < pb->x) ? -1 : 1;
+    if (pa->y != pb->y) return (pa->y < pb->y) ? -1 : 1;
+    return 0;
+}
+
+
+
+int
+PGDPIXBATCH::cmpCell(const void *a, const void *b)
+{
+    const PIX *pa = (const PIX *)a;
+    const PIX *pb = (const PIX *)b;
+    int ca = pa->y / PGDPIXCELL;
+    int cb = pb->y / PGDPIXCELL;
+    if (ca != cb) return (ca < cb) ? -1 : 1;
+    ca = pa->x / PGDPIXCELL;
+    cb = pb->x / PGDPIXCELL;
+    if (ca != cb) return (ca < cb) ? -1 : 1;
+    return cmpRow(a, b);
+}
+
+
+
+void
+PGDPIXBATCH::dedupe(void)
+{
+    qsort(pix, npix, sizeof(PIX), cmpRow);
+
+    // keep the last write to each position; the sequence is renumbered
+    // so that later writes still sort after the pixels kept
+    int i, n = 0;
+    for (i = 0; i < npix; ++i)
+    {
+        if ((i + 1 < npix) && (pix[i + 1].x == pix[i].x) && (pix[i + 1].y == pix[i].y))
+            continue;
+        pix[n] = pix[i];
+        pix[n].seq = n;
+        ++n;
+    }
+    npix = n;
+    return;
+}
+
+
+
+int
+PGDPIXBATCH::find(ushort x, ushort y)
+{
+    int lo = 0;
+    int hi = npix - 1;
+    int mid;
+    while (lo <= hi)
+    {
+        mid = (lo + hi) / 2;
+        if ((pix[mid].y < y) || ((pix[mid].y == y) && (pix[mid].x < x)))
+            lo = mid + 1;
+        else if ((pix[mid].y == y) && (pix[mid].x == x))
+            return mid;
+        else
+            hi = mid - 1;
+    }
+    return -1;
+}
+
+
+
+int
+PGDPIXBATCH::findRun(const RUN *runs, int nruns, ushort y, ushort x1)
+{
+    int lo = 0;
+    int hi = nruns - 1;
+    int mid;
+    while (lo <= hi)
+    {
+        mid = (lo + hi) / 2;
+        if ((runs[mid].y1 < y) || ((runs[mid].y1 == y) && (runs[mid].x1 < x1)))
+            lo = mid + 1;
+        else if ((runs[mid].y1 == y) && (runs[mid].x1 == x1))
+            return mid;
+        else
+            hi = mid - 1;
+    }
+    return -1;
+}
+
+
+
+bool
+PGDPIXBATCH::within(const RUN &run, const RUN *blk, int nblk)
+{
+    int i;
+    for (i = 0; i < nblk; ++i)
+    {
+        if ((run.x1 >= blk[i].x1) && (run.x2 <= blk[i].x2)
+            && (run.y1 >= blk[i].y1) && (run.y2 <= blk[i].y2))
+            return true;
+    }
+    return false;
+}
+
+
+
+int
+PGDPIXBATCH::Render(PGDCMDBUF *out, bool solid)
+{
+    stats = PGDPIXSTATS();
+    if (!out)
+    {
+        ERRMSG("invalid command buffer (NULL)");
+        return -1;
+    }
+    stats.writes = npix;
+    stats.rawbytes = npix * PIXLEN;
+    if (!npix) return 0;
+
+    dedupe();
+    stats.pixels = npix;
+
+    uchar *done = new uchar[npix];      // pixel is drawn by a run or block
+    uchar *used = new uchar[npix];      // run is merged into a rectangle
+    RUN *hr = new RUN[npix];
+    RUN *vr = new RUN[npix];
+    RUN *blk = new RUN[npix];
+    PIX *rest = new PIX[npix];
+    if ((!done) || (!used) || (!hr) || (!vr) || (!blk) || (!rest))
+    {
+        delete [] done;
+        delete [] used;
+        delete [] hr;
+        delete [] vr;
+        delete [] blk;
+        delete [] rest;
+        ERRMSG("could not allocate memory (%d pixels)", npix);
+        return -1;
+    }
+    memset(done, 0, npix);
+    memset(used, 0, npix);
+    int nhr = 0;
+    int nvr = 0;
+    int nblk = 0;
+    int nrest;
+    int i, j, k, n;
+
+    // runs within rows
+    for (i = 0; i < npix; i = j)
+    {
+        for (j = i + 1; (j < npix) && (pix[j].y == pix[i].y)
+             && (pix[j].x == pix[j - 1].x + 1) && (pix[j].color == pix[i].color); ++j);
+        if (j - i < 2) continue;
+        hr[nhr].x1 = pix[i].x;
+        hr[nhr].y1 = pix[i].y;
+        hr[nhr].x2 = pix[j - 1].x;
+        hr[nhr].y2 = pix[i].y;
+        hr[nhr].color = pix[i].color;
+        ++nhr;
+        memset(&done[i], 1, j - i);
+    }
+
+    // runs within columns of the remaining pixels; seq holds the index in pix
+    for (i = 0, nrest = 0; i < npix; ++i)
+    {
+        if (done[i]) continue;
+        rest[nrest] = pix[i];
+        rest[nrest++].seq = i;
+    }
+    qsort(rest, nrest, sizeof(PIX), cmpColumn);
+    for (i = 0; i < nrest; i = j)
+    {
+        for (j = i + 1; (j < nrest) && (rest[j].x == rest[i].x)
+             && (rest[j].y == rest[j - 1].y + 1) && (rest[j].color == rest[i].color); ++j);
+        if (j - i < 2) continue;
+        vr[nvr].x1 = rest[i].x;
+        vr[nvr].y1 = rest[i].y;
+        vr[nvr].x2 = rest[i].x;
+        vr[nvr].y2 = rest[j - 1].y;
+        vr[nvr].color = rest[i].color;
+        ++nvr;
+        for (k = i; k < j; ++k) done[rest[k].seq] = 1;
+    }
+
+    // blocks of the remaining pixels within each cell
+    for (i = 0, nrest = 0; i < npix; ++i)
+    {
+        if (done[i]) continue;
+        rest[nrest] = pix[i];
+        rest[nrest++].seq = i;
+    }
+    qsort(rest, nrest, sizeof(PIX), cmpCell);
+    int x1, y1, x2, y2, xx, yy;
+    bool full;
+    for (i = 0; i < nrest; i = j)
+    {
+        x1 = x2 = rest[i].x;
+        y1 = y2 = rest[i].y;
+        for (j = i + 1; (j < nrest) && (rest[j].x / PGDPIXCELL == rest[i].x / PGDPIXCELL)
+             && (rest[j].y / PGDPIXCELL == rest[i].y / PGDPIXCELL); ++j)
+        {
+            if (rest[j].x < x1) x1 = rest[j].x;
+            if (rest[j].x > x2) x2 = rest[j].x;
+            y2 = rest[j].y;
+        }
+        n = (x2 - x1 + 1) * (y2 - y1 + 1);
+        if (ICONHDR + 2 * n + cost >= (j - i) * (PIXLEN + cost)) continue;
+
+        full = true;
+        for (yy = y1; (full) && (yy <= y2); ++yy)
+        {
+            for (xx = x1; xx <= x2; ++xx)
+            {
+                if (find(xx, yy) < 0)
+                {
+                    full = false;
+                    break;
+                }
+            }
+        }
+        if (!full) continue;
+
+        blk[nblk].x1 = x1;
+        blk[nblk].y1 = y1;
+        blk[nblk].x2 = x2;
+        blk[nblk].y2 = y2;
+        ++nblk;
+        for (k = i; k < j; ++k) done[rest[k].seq] = 1;
+    }
+
+    int len0 = out->GetLength();
+    int res = 0;
+    RUN r;
+    uchar data[PGDPIXCELL * PGDPIXCELL * 2];
+
+    // horizontal runs, merged into rectangles where possible; runs which
+    // lie within a block are drawn by the block
+    for (i = 0; i < nhr; ++i)
+    {
+        if (used[i]) continue;
+        r = hr[i];
+        while (solid)
+        {
+            k = findRun(hr, nhr, r.y2 + 1, r.x1);
+            if ((k < 0) || (used[k]) || (hr[k].x2 != r.x2) || (hr[k].color != r.color))
+                break;
+            used[k] = 1;
+            ++r.y2;
+        }
+        if (within(r, blk, nblk)) continue;
+        if (r.y2 > r.y1)
+        {
+            res |= out->Rectangle(r.x1, r.y1, r.x2, r.y2, r.color);
+            ++stats.rects;
+        }
+        else
+        {
+            res |= out->Line(r.x1, r.y1, r.x2, r.y2, r.color);
+            ++stats.lines;
+        }
+    }
+
+    for (i = 0; i < nvr; ++i)
+    {
+        if (within(vr[i], blk, nblk)) continue;
+        res |= out->Line(vr[i].x1, vr[i].y1, vr[i].x2, vr[i].y2, vr[i].color);
+        ++stats.lines;
+    }
+
+    for (i = 0; i < nblk; ++i)
+    {
+        n = 0;
+        for (yy = blk[i].y1; yy <= blk[i].y2; ++yy)
+        {
+            for (xx = blk[i].x1; xx <= blk[i].x2; ++xx)
+            {
+                k = find(xx, yy);
+                data[n++] = (pix[k].color >> 8) & 0xff;
+                data[n++] = pix[k].color & 0xff;
+            }
+        }
+        res |= out->DrawIcon(blk[i].x1, blk[i].y1, blk[i].x2 - blk[i].x1 + 1,
+                             blk[i].y2 - blk[i].y1 + 1, 0x10, data, n);
+        ++stats.icons;
+    }
+
+    for (i = 0; i < npix; ++i)
+    {
+        if (done[i]) continue;
+        res |= out->WritePixel(pix[i].x, pix[i].y, pix[i].color);
+        ++stats.points;
+    }
+
+    delete [] done;
+    delete [] used;
+    delete [] hr;
+    delete [] vr;
+    delete [] blk;
+    delete [] rest;
+
+    stats.bytes = out->GetLength() - len0;
+    if (res)
+    {
+        ERRMSG("failed; see message below\n%s", out->GetError());
+        return -1;
+    }
+    return 0;
+}
+
+
+
+int
+PGDPIXBATCH::Flush(PGD *pgd)
+{
+    if (!pgd)
+    {
+        ERRMSG("invalid display (NULL pointer)");
+        return -1;
+    }
+    if (!npix) return 0;
+
+    buf.Clear();
+    if (Render(&buf, pgd->GetPenSize() == SOLID)) return -1;
+
+    // the pixels are kept so that they can be sent again if the display fails
+    int res = pgd->Transmit(&buf);
+    if (res)
+        ERRMSG("failed; see message below\n%s", pgd->GetError());
+    else
+        npix = 0;
+    return res;
+}
@@ -0,0 +1,148 @@
+/**
+    file: pixbatch.h
+
+    Pixel batches for the PICASO SGC driver.  Individual pixel writes
+    are accumulated and sent as the cheapest mix of Line, Rectangle,
+    DrawIcon and WritePixel commands which produces the same result.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+/*
+    Notes:
+        + When a pixel is written more than once only the last color
+          is sent.
+        + Runs of 2 or more pixels of one color in a row or column are
+          sent as Line; horizontal runs of equal extent and color on
+          consecutive rows are merged into a Rectangle when the pen is
+          SOLID.  Rows are considered before columns.
+        + The remaining pixels are grouped in 8x8 cells; a cell is sent
+          as a single DrawIcon if every pixel within the bounding box
+          of its remaining pixels is part of the batch and that is
+          cheaper than writing the pixels one at a time.
+        + Commands are compared by their length plus a fixed cost per
+          command for the ACK (see SetCommandCost()).
+        + Commands are sent with PGD::Transmit() and are not clipped.
+ */
+
+#ifndef PIXBATCH_H
+#define PIXBATCH_H
+
+#include "oled.h"
+#include "cmdbuf.h"
+
+namespace disp {
+
+// edge of the cells considered for DrawIcon blocks
+#define PGDPIXCELL (8)
+// default cost of a command in addition to its length, in bytes
+#define PGDPIXCMDCOST (4)
+
+    /* statistics of the last Render() */
+    struct PGDPIXSTATS {
+        int writes;                     // calls to WritePixel()
+        int pixels;                     // distinct pixels
+        int points;                     // WritePixel commands
+        int lines;                      // Line commands
+        int rects;                      // Rectangle commands
+        int icons;                      // DrawIcon commands
+        int bytes;                      // bytes of all commands
+        int rawbytes;                   // bytes as individual WritePixel commands
+
+        PGDPIXSTATS()
+        {
+            writes = 0;
+            pixels = 0;
+            points = 0;
+            lines = 0;
+            rects = 0;
+            icons = 0;
+            bytes = 0;
+            rawbytes = 0;
+        }
+    };
+
+    /** Accumulated pixel writes */
+    class PGDPIXBATCH {
+        private:
+            struct PIX {
+                ushort x;
+                ushort y;
+                ushort color;
+                int seq;                // order of writing
+            };
+            struct RUN {
+                ushort x1;
+                ushort y1;
+                ushort x2;
+                ushort y2;
+                ushort color;
+            };
+            PIX *pix;
+            int npix;
+            int psize;                  // pixels allocated
+            int cost;                   // cost of a command in addition to its length
+            PGDPIXSTATS stats;
+            PGDCMDBUF buf;
+            char errmsg[PGDERRLEN];
+            // sort the pixels by position and discard overwritten pixels
+            void dedupe(void);
+            // index of the pixel at x, y or -1
+            int  find(ushort x, ushort y);
+            // orders used with qsort()
+            static int cmpRow(const void *a, const void *b);
+            static int cmpColumn(const void *a, const void *b);
+            static int cmpCell(const void *a, const void *b);
+            // index of the run starting at x1 in row y of a list sorted by row, or -1
+            static int findRun(const RUN *runs, int nruns, ushort y, ushort x1);
+            // true if the run lies within one of the blocks
+            static bool within(const RUN &run, const RUN *blk, int nblk);
+            PGDPIXBATCH(const PGDPIXBATCH &);
+            PGDPIXBATCH &operator=(const PGDPIXBATCH &);
+
+        public:
+            PGDPIXBATCH();
+            ~PGDPIXBATCH();
+
+            const char *GetError(void) { return errmsg; }
+
+            /// Preallocate space for <npixels> writes
+            /// @return 0 for success, -1 for failure
+            int  Reserve(int npixels);
+            /// Add a pixel; the arguments are as for PGD::WritePixel()
+            /// @return 0 for success, -1 for failure
+            int  WritePixel(ushort x, ushort y, ushort color);
+            /// Discard all pixels but keep the allocated memory
+            void Clear(void) { npix = 0; }
+            int  GetCount(void) { return npix; }
+            /// Set the cost of a command in addition to its length, in bytes
+            void SetCommandCost(int nbytes) { cost = (nbytes < 0) ? 0 : nbytes; }
+
+            /// Append the commands which draw the pixels to <out>; Rectangle is
+            /// used only if <solid> is true (the pen is SOLID).
+            /// @return 0 for success, -1 for failure
+            int  Render(PGDCMDBUF *out, bool solid = true);
+            /// Render into the internal buffer, send it to the display and
+            /// discard the pixels. Return values are as for PGD::Transmit().
+            int  Flush(PGD *pgd);
+            /// @return the statistics of the last Render()
+            const PGDPIXSTATS &GetStats(void) { return stats; }
+    };
+
+};  //namespace disp
+#endif // PIXBATCH_H
@@ -0,0 +1,291 @@
+/**
+    file: quantize.cpp
+
+    Colour quantisation for 8-bit DrawIcon uploads.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "quantize.h"
+
+using namespace disp;
+
+// 4x4 Bayer matrix
+static const int bayer[4][4] = {
+    {  0,  8,  2, 10 },
+    { 12,  4, 14,  6 },
+    {  3, 11,  1,  9 },
+    { 15,  7, 13,  5 }
+};
+
+// 8-bit values of the 3-bit (red, green) and 2-bit (blue) levels
+static const int lvl3[8] = { 0, 36, 73, 109, 146, 182, 219, 255 };
+static const int lvl2[4] = { 0, 85, 170, 255 };
+
+
+// expand a row of source pixels into 8-bit red, green and blue planes
+static void expandRow(const unsigned char *src, PGDPIXFMT fmt, int w,
+                      unsigned short *r, unsigned short *g, unsigned short *b, bool simd)
+{
+    int x = 0;
+    unsigned int p;
+
+    if (fmt == PF_RGB888)
+    {
+        for (x = 0; x < w; ++x, src += 3)
+        {
+            r[x] = src[0];
+            g[x] = src[1];
+            b[x] = src[2];
+        }
+        return;
+    }
+
+#ifdef __SSE2__
+    if (simd)
+    {
+        const __m128i m6 = _mm_set1_epi16(0x3f);
+        const __m128i m5 = _mm_set1_epi16(0x1f);
+        __m128i v, c;
+        for (; x + 8 <= w; x += 8)
+        {
+            // 8 pixels, most significant byte first
+            v = _mm_loadu_si128((const __m128i *)(src + x * 2));
+            v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+            c = _mm_srli_epi16(v, 11);
+            _mm_storeu_si128((__m128i *)(r + x),
+                             _mm_or_si128(_mm_slli_epi16(c, 3), _mm_srli_epi16(c, 2)));
+            c = _mm_and_si128(_mm_srli_epi16(v, 5), m6);
+            _mm_storeu_si128((__m128i *)(g + x),
+                             _mm_or_si128(_mm_slli_epi16(c, 2), _mm_srli_epi16(c, 4)));
+            c = _mm_and_si128(v, m5);
+            _mm_storeu_si128((__m128i *)(b + x),
+                             _mm_or_si128(_mm_slli_epi16(c, 3), _mm_srli_epi16(c, 2)));
+        }
+    }
+#endif
+
+    for (; x < w; ++x)
+    {
+        p = (src[x * 2] << 8) | src[x * 2 + 1];
+        r[x] = ((p >> 8) & 0xf8) | (p >> 13);
+        g[x] = ((p >> 3) & 0xfc) | ((p >> 9) & 0x03);
+        b[x] = ((p << 3) & 0xf8) | ((p >> 2) & 0x07);
+    }
+
+    return;
+}
+
+
+// level of <v> (0..255) with <n> steps and threshold <t> (0..254):
+// floor((v * n + t) / 255) limited to n; x / 255 is computed
+// as (x + 1 + (x >> 8)) >> 8, which is exact for x < 65535
+static inline int quant(int v, int n, int t)
+{
+    int x = v * n + t;
+    x = (x + 1 + (x >> 8)) >> 8;
+    return (x > n) ? n : x;
+}
+
+
+// quantise a row with a threshold per column (repeating every 4 columns)
+static void thresholdRow(const unsigned short *r, const unsigned short *g,
+                         const unsigned short *b, int w, const int *t,
+                         unsigned char *dst, bool simd)
+{
+    int x = 0;
+
+#ifdef __SSE2__
+    if (simd)
+    {
+        const __m128i tv = _mm_setr_epi16(t[0], t[1], t[2], t[3], t[0], t[1], t[2], t[3]);
+        const __m128i one = _mm_set1_epi16(1);
+        const __m128i n7 = _mm_set1_epi16(7);
+        const __m128i n3 = _mm_set1_epi16(3);
+        __m128i vr, vg, vb;
+        for (; x + 8 <= w; x += 8)
+        {
+            vr = _mm_add_epi16(_mm_mullo_epi16(_mm_loadu_si128((const __m128i *)(r + x)), n7), tv);
+            vg = _mm_add_epi16(_mm_mullo_epi16(_mm_loadu_si128((const __m128i *)(g + x)), n7), tv);
+            vb = _mm_add_epi16(_mm_mullo_epi16(_mm_loadu_si128((const __m128i *)(b + x)), n3), tv);
+            vr = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(vr, one), _mm_srli_epi16(vr, 8)), 8);
+            vg = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(vg, one), _mm_srli_epi16(vg, 8)), 8);
+            vb = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(vb, one), _mm_srli_epi16(vb, 8)), 8);
+            vr = _mm_min_epi16(vr, n7);
+            vg = _mm_min_epi16(vg, n7);
+            vb = _mm_min_epi16(vb, n3);
+            vr = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(vr, 5), _mm_slli_epi16(vg, 2)), vb);
+            _mm_storel_epi64((__m128i *)(dst + x), _mm_packus_epi16(vr, vr));
+        }
+    }
+#endif
+
+    for (; x < w; ++x)
+        dst[x] = (quant(r[x], 7, t[x & 3]) << 5) | (quant(g[x], 7, t[x & 3]) << 2)
+                | quant(b[x], 3, t[x & 3]);
+
+    return;
+}
+
+
+// add a diffused error (scaled by 16) to a value and limit the result
+static inline int addError(int v, int e)
+{
+    v += (e >= 0) ? (e + 8) / 16 : (e - 8) / 16;
+    if (v < 0) return 0;
+    if (v > 255) return 255;
+    return v;
+}
+
+
+int
+disp::PGDQuantize(const unsigned char *src, PGDPIXFMT fmt, int width, int height,
+                  PGDDITHER method, unsigned char *dst, bool simd)
+{
+    if ((!src) || (!dst) || (width < 1) || (height < 1)
+        || ((fmt != PF_RGB565) && (fmt != PF_RGB888))
+        || ((method != DI_NONE) && (method != DI_ORDERED) && (method != DI_DIFFUSION)))
+        return -1;
+
+#ifndef __SSE2__
+    simd = false;
+#endif
+
+    int bpp = (fmt == PF_RGB565) ? 2 : 3;
+    unsigned short *plane = new unsigned short[width * 3];
+    if (!plane) return -1;
+    unsigned short *r = plane;
+    unsigned short *g = plane + width;
+    unsigned short *b = plane + 2 * width;
+
+    int x, y, i;
+    int t[4];
+
+    if (method != DI_DIFFUSION)
+    {
+        for (i = 0; i < 4; ++i) t[i] = 127;
+        for (y = 0; y < height; ++y)
+        {
+            expandRow(src + y * width * bpp, fmt, width, r, g, b, simd);
+            if (method == DI_ORDERED)
+            {
+                // thresholds evenly spaced within 0..254
+                for (i = 0; i < 4; ++i) t[i] = (bayer[y & 3][i] * 2 + 1) * 255 / 32;
+            }
+            thresholdRow(r, g, b, width, t, dst + y * width, simd);
+        }
+        delete [] plane;
+        return 0;
+    }
+
+    // Floyd-Steinberg: the errors of the current and next rows, scaled
+    // by 16, with a guard entry at each end
+    int *err = new int[(width + 2) * 6];
+    if (!err)
+    {
+        delete [] plane;
+        return -1;
+    }
+    memset(err, 0, (width + 2) * 6 * sizeof(int));
+    int *ecur[3] = { err, err + (width + 2), err + 2 * (width + 2) };
+    int *enext[3] = { err + 3 * (width + 2), err + 4 * (width + 2), err + 5 * (width + 2) };
+    int *tp;
+    unsigned short *pl[3] = { r, g, b };
+    static const int nlev[3] = { 7, 7, 3 };
+    int v, q, e, c;
+    unsigned char px;
+
+    for (y = 0; y < height; ++y)
+    {
+        expandRow(src + y * width * bpp, fmt, width, r, g, b, simd);
+        for (x = 0; x < width; ++x)
+        {
+            px = 0;
+            for (c = 0; c < 3; ++c)
+            {
+                v = addError(pl[c][x], ecur[c][x + 1]);
+                q = quant(v, nlev[c], 127);
+                e = v - ((c < 2) ? lvl3[q] : lvl2[q]);
+                ecur[c][x + 2] += e * 7;
+                enext[c][x] += e * 3;
+                enext[c][x + 1] += e * 5;
+                enext[c][x + 2] += e;
+                px = (px << ((c < 2) ? 3 : 2)) | q;
+            }
+            dst[y * width + x] = px;
+        }
+        for (c = 0; c < 3; ++c)
+        {
+            tp = ecur[c];
+            ecur[c] = enext[c];
+            enext[c] = tp;
+            memset(enext[c], 0, (width + 2) * sizeof(int));
+        }
+    }
+
+    delete [] err;
+    delete [] plane;
+    return 0;
+}
+
+
+
+double
+disp::PGDPsnr(const unsigned char *src, PGDPIXFMT fmt, int width, int height,
+              const unsigned char *rgb332)
+{
+    if ((!src) || (!rgb332) || (width < 1) || (height < 1)
+        || ((fmt != PF_RGB565) && (fmt != PF_RGB888)))
+        return -1.0;
+
+    int bpp = (fmt == PF_RGB565) ? 2 : 3;
+    unsigned short *plane = new unsigned short[width * 3];
+    if (!plane) return -1.0;
+    unsigned short *r = plane;
+    unsigned short *g = plane + width;
+    unsigned short *b = plane + 2 * width;
+
+    double sum = 0.0;
+    int x, y, d;
+    unsigned char q;
+    for (y = 0; y < height; ++y)
+    {
+        expandRow(src + y * width * bpp, fmt, width, r, g, b, true);
+        for (x = 0; x < width; ++x)
+        {
+            q = rgb332[y * width + x];
+            d = r[x] - lvl3[q >> 5];
+            sum += d * d;
+            d = g[x] - lvl3[(q >> 2) & 7];
+            sum += d * d;
+            d = b[x] - lvl2[q & 3];
+            sum += d * d;
+        }
+    }
+    delete [] plane;
+
+    if (sum == 0.0) return 99.0;
+    return 10.0 * log10(255.0 * 255.0 * 3.0 * width * height / sum);
+}
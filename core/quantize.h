@@ -0,0 +1,71 @@
+/**
+    file: quantize.h
+
+    Colour quantisation for 8-bit DrawIcon uploads.  Images are reduced
+    to the display's 8-bit 'truecolor' format (R2R1R0G2G1G0B1B0) with
+    optional ordered or error-diffusion dithering, and the loss can be
+    measured as a PSNR so the caller can decide whether the halved
+    upload size is worth it.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+/*
+    Notes:
+        + 16-bit source data is in the byte order used by DrawIcon
+          (most significant byte first).
+        + The ordered and undithered conversions use SSE2 when it is
+          available and give the same result as the scalar code.
+          Error diffusion carries the error from pixel to pixel along
+          a row and is not vectorised.
+        + Levels are expanded to 8 bits by bit replication for the
+          dithering error and the PSNR.
+ */
+
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+namespace disp {
+
+    /* source pixel formats */
+    enum PGDPIXFMT {
+        PF_RGB565 = 0,      // 16-bit, as sent with DrawIcon colour mode 0x10
+        PF_RGB888           // 24-bit, R G B byte order
+    };
+
+    /* dithering methods */
+    enum PGDDITHER {
+        DI_NONE = 0,        // nearest level
+        DI_ORDERED,         // 4x4 Bayer matrix
+        DI_DIFFUSION        // Floyd-Steinberg error diffusion
+    };
+
+    /// Convert a <width> x <height> image to 8-bit colour; <dst> receives
+    /// width * height bytes suitable for DrawIcon colour mode 0x08.
+    /// <simd> = false forces the scalar implementation.
+    /// @return 0 for success, -1 for invalid arguments
+    int PGDQuantize(const unsigned char *src, PGDPIXFMT fmt, int width, int height,
+                    PGDDITHER method, unsigned char *dst, bool simd = true);
+
+    /// @return the peak signal to noise ratio in dB of the 8-bit image <rgb332>
+    /// relative to <src>, 99.0 if they are identical or -1.0 for invalid arguments
+    double PGDPsnr(const unsigned char *src, PGDPIXFMT fmt, int width, int height,
+                   const unsigned char *rgb332);
+
+};  //namespace disp
+#endif // QUANTIZE_H
@@ -0,0 +1,243 @@
+/**
+    file: rotate.cpp
+
+    Image rotation for the PICASO SGC driver.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "rotate.h"
+
+using namespace disp;
+
+// edge of the square tiles in pixels; must be a multiple of 8.
+// 64x64 16-bit pixels in and out fit in a 32kB L1 data cache.
+#define ROTTILE (64)
+
+
+/*
+    Rotate the part of a tile given by rows i0..i1-1 and columns j0..j1-1
+    one pixel at a time; in(i, j) goes to:
+        0 turns: out(i, j)
+        1 turn:  out(j, h-1-i)          (clockwise)
+        2 turns: out(h-1-i, w-1-j)
+        3 turns: out(w-1-j, i)          (anticlockwise)
+ */
+template <class T>
+static void rotScalar(const T *src, int stride, int w, int h, T *dst, int turns,
+                      int i0, int i1, int j0, int j1)
+{
+    int i, j;
+    const T *sp;
+
+    for (i = i0; i < i1; ++i)
+    {
+        sp = src + i * stride;
+        switch (turns)
+        {
+            case 0:
+                memcpy(&dst[i * w + j0], &sp[j0], (j1 - j0) * sizeof(T));
+                break;
+            case 1:
+                for (j = j0; j < j1; ++j) dst[j * h + (h - 1 - i)] = sp[j];
+                break;
+            case 2:
+                for (j = j0; j < j1; ++j) dst[(h - 1 - i) * w + (w - 1 - j)] = sp[j];
+                break;
+            default:
+                for (j = j0; j < j1; ++j) dst[(w - 1 - j) * h + i] = sp[j];
+                break;
+        }
+    }
+
+    return;
+}
+
+
+#ifdef __SSE2__
+/*
+    Transpose an 8x8 block: source row k starts at s + k * ss and
+    the transposed row k is written at d + k * ds; either stride may
+    be negative to mirror the block.
+ */
+static void block16(const unsigned short *s, int ss, unsigned short *d, int ds)
+{
+    __m128i a0 = _mm_loadu_si128((const __m128i *)(s));
+    __m128i a1 = _mm_loadu_si128((const __m128i *)(s + ss));
+    __m128i a2 = _mm_loadu_si128((const __m128i *)(s + 2 * ss));
+    __m128i a3 = _mm_loadu_si128((const __m128i *)(s + 3 * ss));
+    __m128i a4 = _mm_loadu_si128((const __m128i *)(s + 4 * ss));
+    __m128i a5 = _mm_loadu_si128((const __m128i *)(s + 5 * ss));
+    __m128i a6 = _mm_loadu_si128((const __m128i *)(s + 6 * ss));
+    __m128i a7 = _mm_loadu_si128((const __m128i *)(s + 7 * ss));
+
+    // interleave pairs of rows, then pairs of pairs, then quads
+    __m128i t0 = _mm_unpacklo_epi16(a0, a1);
+    __m128i t1 = _mm_unpackhi_epi16(a0, a1);
+    __m128i t2 = _mm_unpacklo_epi16(a2, a3);
+    __m128i t3 = _mm_unpackhi_epi16(a2, a3);
+    __m128i t4 = _mm_unpacklo_epi16(a4, a5);
+    __m128i t5 = _mm_unpackhi_epi16(a4, a5);
+    __m128i t6 = _mm_unpacklo_epi16(a6, a7);
+    __m128i t7 = _mm_unpackhi_epi16(a6, a7);
+
+    __m128i u0 = _mm_unpacklo_epi32(t0, t2);
+    __m128i u1 = _mm_unpackhi_epi32(t0, t2);
+    __m128i u2 = _mm_unpacklo_epi32(t1, t3);
+    __m128i u3 = _mm_unpackhi_epi32(t1, t3);
+    __m128i u4 = _mm_unpacklo_epi32(t4, t6);
+    __m128i u5 = _mm_unpackhi_epi32(t4, t6);
+    __m128i u6 = _mm_unpacklo_epi32(t5, t7);
+    __m128i u7 = _mm_unpackhi_epi32(t5, t7);
+
+    _mm_storeu_si128((__m128i *)(d), _mm_unpacklo_epi64(u0, u4));
+    _mm_storeu_si128((__m128i *)(d + ds), _mm_unpackhi_epi64(u0, u4));
+    _mm_storeu_si128((__m128i *)(d + 2 * ds), _mm_unpacklo_epi64(u1, u5));
+    _mm_storeu_si128((__m128i *)(d + 3 * ds), _mm_unpackhi_epi64(u1, u5));
+    _mm_storeu_si128((__m128i *)(d + 4 * ds), _mm_unpacklo_epi64(u2, u6));
+    _mm_storeu_si128((__m128i *)(d + 5 * ds), _mm_unpackhi_epi64(u2, u6));
+    _mm_storeu_si128((__m128i *)(d + 6 * ds), _mm_unpacklo_epi64(u3, u7));
+    _mm_storeu_si128((__m128i *)(d + 7 * ds), _mm_unpackhi_epi64(u3, u7));
+    return;
+}
+
+static void block8(const unsigned char *s, int ss, unsigned char *d, int ds)
+{
+    __m128i a0 = _mm_loadl_epi64((const __m128i *)(s));
+    __m128i a1 = _mm_loadl_epi64((const __m128i *)(s + ss));
+    __m128i a2 = _mm_loadl_epi64((const __m128i *)(s + 2 * ss));
+    __m128i a3 = _mm_loadl_epi64((const __m128i *)(s + 3 * ss));
+    __m128i a4 = _mm_loadl_epi64((const __m128i *)(s + 4 * ss));
+    __m128i a5 = _mm_loadl_epi64((const __m128i *)(s + 5 * ss));
+    __m128i a6 = _mm_loadl_epi64((const __m128i *)(s + 6 * ss));
+    __m128i a7 = _mm_loadl_epi64((const __m128i *)(s + 7 * ss));
+
+    __m128i t0 = _mm_unpacklo_epi8(a0, a1);
+    __m128i t1 = _mm_unpacklo_epi8(a2, a3);
+    __m128i t2 = _mm_unpacklo_epi8(a4, a5);
+    __m128i t3 = _mm_unpacklo_epi8(a6, a7);
+
+    __m128i u0 = _mm_unpacklo_epi16(t0, t1);
+    __m128i u1 = _mm_unpackhi_epi16(t0, t1);
+    __m128i u2 = _mm_unpacklo_epi16(t2, t3);
+    __m128i u3 = _mm_unpackhi_epi16(t2, t3);
+
+    // each register now holds two transposed rows
+    __m128i v0 = _mm_unpacklo_epi32(u0, u2);
+    __m128i v1 = _mm_unpackhi_epi32(u0, u2);
+    __m128i v2 = _mm_unpacklo_epi32(u1, u3);
+    __m128i v3 = _mm_unpackhi_epi32(u1, u3);
+
+    _mm_storel_epi64((__m128i *)(d), v0);
+    _mm_storel_epi64((__m128i *)(d + ds), _mm_srli_si128(v0, 8));
+    _mm_storel_epi64((__m128i *)(d + 2 * ds), v1);
+    _mm_storel_epi64((__m128i *)(d + 3 * ds), _mm_srli_si128(v1, 8));
+    _mm_storel_epi64((__m128i *)(d + 4 * ds), v2);
+    _mm_storel_epi64((__m128i *)(d + 5 * ds), _mm_srli_si128(v2, 8));
+    _mm_storel_epi64((__m128i *)(d + 6 * ds), v3);
+    _mm_storel_epi64((__m128i *)(d + 7 * ds), _mm_srli_si128(v3, 8));
+    return;
+}
+
+static void block(const unsigned short *s, int ss, unsigned short *d, int ds)
+{
+    block16(s, ss, d, ds);
+}
+
+static void block(const unsigned char *s, int ss, unsigned char *d, int ds)
+{
+    block8(s, ss, d, ds);
+}
+#endif
+
+
+template <class T>
+static void rotate(const T *src, int stride, int w, int h, T *dst, int turns, bool simd)
+{
+    int ti, tj, i1, j1;
+
+#ifndef __SSE2__
+    simd = false;
+#endif
+    // only the quarter turns are transposes; the others are row
+    // copies or reversals which are already sequential
+    if (!(turns & 1)) simd = false;
+
+    for (ti = 0; ti < h; ti += ROTTILE)
+    {
+        i1 = (ti + ROTTILE < h) ? ti + ROTTILE : h;
+        for (tj = 0; tj < w; tj += ROTTILE)
+        {
+            j1 = (tj + ROTTILE < w) ? tj + ROTTILE : w;
+            if (!simd)
+            {
+                rotScalar(src, stride, w, h, dst, turns, ti, i1, tj, j1);
+                continue;
+            }
+
+#ifdef __SSE2__
+            // whole 8x8 blocks; the remainder only occurs at the image edges
+            int i, j, ib, jb;
+            ib = ti + ((i1 - ti) & ~7);
+            jb = tj + ((j1 - tj) & ~7);
+            for (i = ti; i < ib; i += 8)
+            {
+                for (j = tj; j < jb; j += 8)
+                {
+                    if (turns == 1)
+                        // read the rows bottom-up so the transpose is a clockwise turn
+                        block(src + (i + 7) * stride + j, -stride,
+                              dst + j * h + (h - 8 - i), h);
+                    else
+                        block(src + i * stride + j, stride,
+                              dst + (w - 1 - j) * h + i, -h);
+                }
+            }
+            if (jb < j1) rotScalar(src, stride, w, h, dst, turns, ti, ib, jb, j1);
+            if (ib < i1) rotScalar(src, stride, w, h, dst, turns, ib, i1, tj, j1);
+#endif
+        }
+    }
+
+    return;
+}
+
+
+int
+disp::PGDRotate(const unsigned char *src, int stride, int width, int height,
+                int bpp, int turns, unsigned char *dst, bool simd)
+{
+    if ((!src) || (!dst) || (width < 1) || (height < 1) || (stride < width)
+        || ((bpp != 1) && (bpp != 2)))
+        return -1;
+
+    turns &= 3;
+    if (bpp == 2)
+        rotate((const unsigned short *)src, stride, width, height,
+               (unsigned short *)dst, turns, simd);
+    else
+        rotate(src, stride, width, height, dst, turns, simd);
+
+    return 0;
+}
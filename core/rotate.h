@@ -0,0 +1,51 @@
+/**
+    file: rotate.h
+
+    Image rotation for the PICASO SGC driver.  The controller renders
+    DrawIcon data in its native orientation; these routines rotate
+    pixel data on the host so that images appear upright in the
+    current orientation.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+/*
+    Notes:
+        + Images are processed in square tiles which fit in the L1
+          cache; with SSE2 each tile is rotated as 8x8 pixel blocks
+          transposed in registers.
+        + 16-bit pixels are moved as 2-byte units, so the byte order of
+          the data does not matter.
+ */
+
+#ifndef ROTATE_H
+#define ROTATE_H
+
+namespace disp {
+
+    /// Rotate a <width> x <height> image clockwise by <turns> quarter turns.
+    /// <stride> is the distance between source rows in pixels, so a part of
+    /// a larger image may be rotated; <dst> receives the packed result, which
+    /// is <height> pixels wide for odd <turns>. <bpp> is 1 or 2 bytes per pixel.
+    /// <simd> = false forces the scalar implementation.
+    /// @return 0 for success, -1 for invalid arguments
+    int PGDRotate(const unsigned char *src, int stride, int width, int height,
+                  int bpp, int turns, unsigned char *dst, bool simd = true);
+
+};  //namespace disp
+#endif // ROTATE_H
@@ -0,0 +1,520 @@
+/**
+    file: shadow.cpp
+
+    Display shadow for the PICASO SGC driver: the host's copy of the
+    pixels on the screen, optionally kept in a memory-mapped file so that
+    a restarted process can carry on sending only the differences
+    instead of clearing and redrawing the screen.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shadow.h"
+
+using namespace disp;
+
+#define ERRMSG(fmt, args...) snprintf(errmsg, PGDERRLEN, "%s:%d: %s(): " fmt,\
+    __FILE__, __LINE__, __FUNCTION__,##args)
+
+// identification of the shadow file
+#define SHADOWMAGIC "PGDSHAD"
+#define SHADOWVERSION (1)
+
+// tile states
+#define TILE_KNOWN (0)
+#define TILE_UNKNOWN (1)
+#define TILE_PENDING (2)
+
+// command lengths
+#define RECTLEN (11)
+#define ICONHDR (10)
+
+
+PGDSHADOW::PGDSHADOW()
+{
+    hdr = NULL;
+    pixels = NULL;
+    state = NULL;
+    map = NULL;
+    maplen = 0;
+    fd = -1;
+    width = 0;
+    height = 0;
+    tcols = 0;
+    trows = 0;
+    areas = NULL;
+    asize = 0;
+    errmsg[0] = 0;
+    return;
+}
+
+
+
+PGDSHADOW::~PGDSHADOW()
+{
+    Close();
+    delete [] areas;
+    return;
+}
+
+
+
+int
+PGDSHADOW::Open(const char *filename, ushort width, ushort height)
+{
+    Close();
+    if ((!width) || (!height))
+    {
+        ERRMSG("invalid display size (%u x %u)", width, height);
+        return -1;
+    }
+
+    tcols = (width + PGDSHADOWTILE - 1) / PGDSHADOWTILE;
+    trows = (height + PGDSHADOWTILE - 1) / PGDSHADOWTILE;
+    size_t len = sizeof(HEADER) + 2 * (size_t)width * height + (size_t)tcols * trows;
+    bool resume = false;
+
+    if (filename)
+    {
+        fd = open(filename, O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+        {
+            ERRMSG("could not open '%s': %s", filename, strerror(errno));
+            return -1;
+        }
+        struct stat st;
+        if (fstat(fd, &st))
+        {
+            ERRMSG("could not examine '%s': %s", filename, strerror(errno));
+            close(fd);
+            fd = -1;
+            return -1;
+        }
+        resume = ((size_t)st.st_size == len);
+        // a file of another size is discarded rather than reinterpreted
+        if ((!resume) && (ftruncate(fd, 0) || ftruncate(fd, len)))
+        {
+            ERRMSG("could not size '%s': %s", filename, strerror(errno));
+            close(fd);
+            fd = -1;
+            return -1;
+        }
+        map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    else
+    {
+        map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+
+    if (map == MAP_FAILED)
+    {
+        ERRMSG("could not map the shadow (%lu bytes): %s", (unsigned long)len,
+               strerror(errno));
+        map = NULL;
+        if (fd >= 0) close(fd);
+        fd = -1;
+        return -1;
+    }
+
+    maplen = len;
+    this->width = width;
+    this->height = height;
+    hdr = (HEADER *)map;
+    pixels = (ushort *)((char *)map + sizeof(HEADER));
+    state = (uchar *)(pixels + (size_t)width * height);
+
+    if (resume)
+    {
+        resume = (!memcmp(hdr->magic, SHADOWMAGIC, sizeof(SHADOWMAGIC)))
+                 && (hdr->version == SHADOWVERSION) && (hdr->width == width)
+                 && (hdr->height == height) && (hdr->tile == PGDSHADOWTILE);
+    }
+
+    int i, ntiles = tcols * trows;
+    if (resume)
+    {
+        // commands which were in flight when the previous owner stopped
+        // may or may not have been executed
+        for (i = 0; i < ntiles; ++i)
+        {
+            if (state[i] != TILE_KNOWN) state[i] = TILE_UNKNOWN;
+        }
+        return 0;
+    }
+
+    // the header is written last so that an interrupted initialization is not resumed
+    memset(hdr, 0, sizeof(HEADER));
+    memset(pixels, 0, 2 * (size_t)width * height);
+    memset(state, TILE_UNKNOWN, ntiles);
+    hdr->version = SHADOWVERSION;
+    hdr->width = width;
+    hdr->height = height;
+    hdr->tile = PGDSHADOWTILE;
+    __sync_synchronize();
+    memcpy(hdr->magic, SHADOWMAGIC, sizeof(SHADOWMAGIC));
+    return 1;
+}
+
+
+
+void
+PGDSHADOW::Close(void)
+{
+    if (map)
+    {
+        if (fd >= 0) msync(map, maplen, MS_SYNC);
+        munmap(map, maplen);
+    }
+    if (fd >= 0) close(fd);
+    map = NULL;
+    maplen = 0;
+    fd = -1;
+    hdr = NULL;
+    pixels = NULL;
+    state = NULL;
+    width = height = 0;
+    tcols = trows = 0;
+    return;
+}
+
+
+
+int
+PGDSHADOW::Sync(void)
+{
+    if ((!map) || (fd < 0)) return 0;
+    if (msync(map, maplen, MS_SYNC))
+    {
+        ERRMSG("could not write the shadow: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+
+
+void
+PGDSHADOW::Invalidate(const PGDRECT &area)
+{
+    if (!map) return;
+    int x1 = (area.x1 < 0) ? 0 : area.x1;
+    int y1 = (area.y1 < 0) ? 0 : area.y1;
+    int x2 = (area.x2 >= width) ? width - 1 : area.x2;
+    int y2 = (area.y2 >= height) ? height - 1 : area.y2;
+    if ((x2 < x1) || (y2 < y1)) return;
+
+    int tx, ty;
+    for (ty = y1 / PGDSHADOWTILE; ty <= y2 / PGDSHADOWTILE; ++ty)
+    {
+        for (tx = x1 / PGDSHADOWTILE; tx <= x2 / PGDSHADOWTILE; ++tx)
+            state[ty * tcols + tx] = TILE_UNKNOWN;
+    }
+    return;
+}
+
+
+
+void
+PGDSHADOW::Invalidate(void)
+{
+    if (map) memset(state, TILE_UNKNOWN, tcols * trows);
+    return;
+}
+
+
+
+int
+PGDSHADOW::GetUnknown(void)
+{
+    int i, n = 0;
+    for (i = 0; i < tcols * trows; ++i)
+    {
+        if (state[i] != TILE_KNOWN) ++n;
+    }
+    return n;
+}
+
+
+
+bool
+PGDSHADOW::GetPixel(ushort x, ushort y, ushort *color)
+{
+    if ((!map) || (x >= width) || (y >= height)) return false;
+    if (color) *color = pixels[(size_t)y * width + x];
+    return state[(y / PGDSHADOWTILE) * tcols + x / PGDSHADOWTILE] == TILE_KNOWN;
+}
+
+
+
+int
+PGDSHADOW::Update(PGD *pgd, ushort x, ushort y, ushort w, ushort h, const ushort *data)
+{
+    if ((!data) || (!w) || (!h))
+    {
+        ERRMSG("invalid image (%u x %u at %p)", w, h, data);
+        return -1;
+    }
+    return draw(pgd, x, y, x + w - 1, y + h - 1, data, x, y, w, 0);
+}
+
+
+
+int
+PGDSHADOW::Fill(PGD *pgd, const PGDRECT &area, ushort color)
+{
+    return draw(pgd, area.x1, area.y1, area.x2, area.y2, NULL, 0, 0, 0, color);
+}
+
+
+
+int
+PGDSHADOW::draw(PGD *pgd, int x1, int y1, int x2, int y2, const ushort *src,
+                int x0, int y0, int w, ushort color)
+{
+    if (!pgd)
+    {
+        ERRMSG("invalid display (NULL pointer)");
+        return -1;
+    }
+    if (!map)
+    {
+        ERRMSG("the shadow is not open");
+        return -1;
+    }
+
+    if (x1 < 0) x1 = 0;
+    if (y1 < 0) y1 = 0;
+    if (x2 >= width) x2 = width - 1;
+    if (y2 >= height) y2 = height - 1;
+    if ((x2 < x1) || (y2 < y1)) return 0;
+
+    ++stats.updates;
+    bool solid = (pgd->GetPenSize() == SOLID);
+    if (src || !solid)
+        stats.rawbytes += ICONHDR + 2 * (x2 - x1 + 1) * (y2 - y1 + 1);
+    else
+        stats.rawbytes += RECTLEN;
+
+    int tx1 = x1 / PGDSHADOWTILE;
+    int tx2 = x2 / PGDSHADOWTILE;
+    int ty1 = y1 / PGDSHADOWTILE;
+    int ty2 = y2 / PGDSHADOWTILE;
+    int ntiles = (tx2 - tx1 + 1) * (ty2 - ty1 + 1);
+    if (ntiles > asize)
+    {
+        AREA *ap = new AREA[ntiles];
+        if (!ap)
+        {
+            ERRMSG("could not allocate memory (%d areas)", ntiles);
+            return -1;
+        }
+        delete [] areas;
+        areas = ap;
+        asize = ntiles;
+    }
+
+    // find the tiles which differ and merge neighbours in a row of tiles
+    int nareas = 0;
+    int tx, ty, xx, yy, bx1, by1, bx2, by2, cx1, cy1, cx2, cy2;
+    ushort pc;
+    const ushort *sp;
+    bool inrun;
+    for (ty = ty1; ty <= ty2; ++ty)
+    {
+        cy1 = (ty * PGDSHADOWTILE < y1) ? y1 : ty * PGDSHADOWTILE;
+        cy2 = (ty * PGDSHADOWTILE + PGDSHADOWTILE - 1 > y2) ? y2 : ty * PGDSHADOWTILE + PGDSHADOWTILE - 1;
+        inrun = false;
+        for (tx = tx1; tx <= tx2; ++tx)
+        {
+            ++stats.tiles;
+            cx1 = (tx * PGDSHADOWTILE < x1) ? x1 : tx * PGDSHADOWTILE;
+            cx2 = (tx * PGDSHADOWTILE + PGDSHADOWTILE - 1 > x2) ? x2 : tx * PGDSHADOWTILE + PGDSHADOWTILE - 1;
+
+            if (state[ty * tcols + tx] != TILE_KNOWN)
+            {
+                bx1 = cx1;
+                by1 = cy1;
+                bx2 = cx2;
+                by2 = cy2;
+            }
+            else
+            {
+                bx1 = by1 = 0x7fff;
+                bx2 = by2 = -1;
+                for (yy = cy1; yy <= cy2; ++yy)
+                {
+                    sp = (src) ? src + (yy - y0) * w : NULL;
+                    for (xx = cx1; xx <= cx2; ++xx)
+                    {
+                        pc = (sp) ? sp[xx - x0] : color;
+                        if (pixels[(size_t)yy * width + xx] == pc) continue;
+                        if (xx < bx1) bx1 = xx;
+                        if (xx > bx2) bx2 = xx;
+                        if (yy < by1) by1 = yy;
+                        by2 = yy;
+                    }
+                }
+            }
+
+            if (bx2 < 0)
+            {
+                inrun = false;
+                continue;
+            }
+
+            ++stats.changed;
+            if ((inrun) && (areas[nareas - 1].tx2 - areas[nareas - 1].tx1 + 1 < PGDSHADOWRUN))
+            {
+                AREA &a = areas[nareas - 1];
+                a.x2 = bx2;
+                if (by1 < a.y1) a.y1 = by1;
+                if (by2 > a.y2) a.y2 = by2;
+                a.tx2 = tx;
+                continue;
+            }
+
+            AREA &a = areas[nareas++];
+            a.x1 = bx1;
+            a.y1 = by1;
+            a.x2 = bx2;
+            a.y2 = by2;
+            a.tx1 = a.tx2 = tx;
+            a.ty = ty;
+            inrun = true;
+        }
+    }
+
+    if (!nareas) return 0;
+
+    // the tiles are marked before the shadow and the display are changed
+    int i, res = 0;
+    buf.Clear();
+    for (i = 0; i < nareas; ++i)
+    {
+        for (tx = areas[i].tx1; tx <= areas[i].tx2; ++tx)
+        {
+            uchar &ts = state[areas[i].ty * tcols + tx];
+            if (ts == TILE_KNOWN) ts = TILE_PENDING;
+        }
+    }
+    __sync_synchronize();
+    for (i = 0; i < nareas; ++i)
+    {
+        for (yy = areas[i].y1; yy <= areas[i].y2; ++yy)
+        {
+            sp = (src) ? src + (yy - y0) * w : NULL;
+            for (xx = areas[i].x1; xx <= areas[i].x2; ++xx)
+                pixels[(size_t)yy * width + xx] = (sp) ? sp[xx - x0] : color;
+        }
+        res |= render(areas[i], src, x0, y0, w, color, solid);
+    }
+    stats.bytes += buf.GetLength();
+    if (res)
+    {
+        ERRMSG("failed; see message below\n%s", buf.GetError());
+        res = -1;
+    }
+    else
+    {
+        res = pgd->Transmit(&buf);
+        if (res) ERRMSG("failed; see message below\n%s", pgd->GetError());
+    }
+    __sync_synchronize();
+
+    // a tile which was unknown is known once a command has drawn all of it
+    int ux1, uy1, ux2, uy2;
+    for (i = 0; i < nareas; ++i)
+    {
+        const AREA &a = areas[i];
+        uy1 = a.ty * PGDSHADOWTILE;
+        uy2 = uy1 + PGDSHADOWTILE - 1;
+        if (uy2 >= height) uy2 = height - 1;
+        for (tx = a.tx1; tx <= a.tx2; ++tx)
+        {
+            uchar &ts = state[a.ty * tcols + tx];
+            if (res)
+            {
+                ts = TILE_UNKNOWN;
+                continue;
+            }
+            ux1 = tx * PGDSHADOWTILE;
+            ux2 = ux1 + PGDSHADOWTILE - 1;
+            if (ux2 >= width) ux2 = width - 1;
+            if ((ts == TILE_PENDING) || ((ux1 >= a.x1) && (ux2 <= a.x2)
+                && (uy1 >= a.y1) && (uy2 <= a.y2)))
+                ts = TILE_KNOWN;
+        }
+    }
+
+    if (res) ++stats.failed;
+    return res;
+}
+
+
+
+int
+PGDSHADOW::render(const AREA &a, const ushort *src, int x0, int y0, int w,
+                  ushort color, bool solid)
+{
+    int xx, yy, n = 0;
+    const ushort *sp;
+    ushort c0 = (src) ? src[(a.y1 - y0) * w + a.x1 - x0] : color;
+    bool uniform = true;
+
+    for (yy = a.y1; (src) && (uniform) && (yy <= a.y2); ++yy)
+    {
+        sp = src + (yy - y0) * w;
+        for (xx = a.x1; xx <= a.x2; ++xx)
+        {
+            if (sp[xx - x0] != c0)
+            {
+                uniform = false;
+                break;
+            }
+        }
+    }
+
+    if ((uniform) && (solid))
+    {
+        ++stats.rects;
+        return buf.Rectangle(a.x1, a.y1, a.x2, a.y2, c0);
+    }
+
+    uchar data[PGDSHADOWRUN * PGDSHADOWTILE * PGDSHADOWTILE * 2];
+    for (yy = a.y1; yy <= a.y2; ++yy)
+    {
+        sp = (src) ? src + (yy - y0) * w : NULL;
+        for (xx = a.x1; xx <= a.x2; ++xx)
+        {
+            ushort pc = (sp) ? sp[xx - x0] : color;
+            data[n++] = (pc >> 8) & 0xff;
+            data[n++] = pc & 0xff;
+        }
+    }
+    ++stats.icons;
+    return buf.DrawIcon(a.x1, a.y1, a.x2 - a.x1 + 1, a.y2 - a.y1 + 1, 0x10, data, n);
+}
@@ -0,0 +1,176 @@
+/**
+    file: shadow.h
+
+    Display shadow for the PICASO SGC driver: the host's copy of the
+    pixels on the screen, optionally kept in a memory-mapped file so that
+    a restarted process can carry on sending only the differences
+    instead of clearing and redrawing the screen.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+/*
+    Notes:
+        + The shadow is divided into PGDSHADOWTILE x PGDSHADOWTILE tiles,
+          each of which is known, unknown or pending.  Only known tiles
+          are compared; an unknown tile is always drawn.
+        + Before commands are sent their tiles are marked pending and the
+          new pixels are written to the shadow; the tiles become known
+          once every command has been acknowledged and unknown if any
+          command fails.  A process which dies while commands are in
+          flight therefore leaves pending tiles, which are treated as
+          unknown when the file is opened again.
+        + Changed tiles which are adjacent in a row of tiles are sent as
+          one Rectangle if the area is of one color and the pen is SOLID,
+          otherwise as one 16-bit DrawIcon.
+        + Commands are sent with PGD::Transmit() and are neither clipped
+          nor rotated; coordinates are those of the display's native
+          orientation and the areas drawn must lie within the clip area.
+        + Anything drawn on the display other than through the shadow is
+          not seen; call Invalidate() for its area.  The shadow knows
+          nothing of a display reset or power cycle; call Invalidate()
+          for the whole screen (or Clear the display and Fill() the
+          shadow with the background color) in that case.
+ */
+
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include "oled.h"
+#include "cmdbuf.h"
+
+namespace disp {
+
+// edge of the tiles in which the shadow tracks what is known
+#define PGDSHADOWTILE (8)
+// max. tiles merged into one command
+#define PGDSHADOWRUN (8)
+
+    /* statistics since the shadow was opened or ResetStats() was called */
+    struct PGDSHADOWSTATS {
+        unsigned long updates;          // calls to Update() and Fill()
+        unsigned long tiles;            // tiles compared
+        unsigned long changed;          // tiles which were sent
+        unsigned long rects;            // Rectangle commands
+        unsigned long icons;            // DrawIcon commands
+        unsigned long bytes;            // bytes of all commands
+        unsigned long rawbytes;         // bytes had every area been sent in full
+        unsigned long failed;           // Update() or Fill() calls which failed
+
+        PGDSHADOWSTATS()
+        {
+            updates = 0;
+            tiles = 0;
+            changed = 0;
+            rects = 0;
+            icons = 0;
+            bytes = 0;
+            rawbytes = 0;
+            failed = 0;
+        }
+    };
+
+    /** Host copy of the display contents */
+    class PGDSHADOW {
+        private:
+            // header of the shadow file; followed by the pixels and the tile states
+            struct HEADER {
+                char magic[8];
+                unsigned int version;
+                unsigned int width;
+                unsigned int height;
+                unsigned int tile;
+            };
+            // a rectangle to send and the tiles it spans
+            struct AREA {
+                ushort x1;
+                ushort y1;
+                ushort x2;
+                ushort y2;
+                ushort tx1;             // first and last tile in the row of tiles
+                ushort tx2;
+                ushort ty;
+            };
+            HEADER *hdr;
+            ushort *pixels;             // width x height, row by row
+            uchar *state;               // tiles, row by row
+            void *map;                  // mapped memory
+            size_t maplen;
+            int fd;                     // shadow file; -1 if anonymous
+            ushort width;
+            ushort height;
+            ushort tcols;               // tiles per row and column
+            ushort trows;
+            AREA *areas;
+            int asize;                  // areas allocated
+            PGDSHADOWSTATS stats;
+            PGDCMDBUF buf;
+            char errmsg[PGDERRLEN];
+            // compare and send the area x1..x2, y1..y2; <src> holds w pixels per row
+            // starting at (x0, y0) or is NULL to fill with <color>
+            int  draw(PGD *pgd, int x1, int y1, int x2, int y2, const ushort *src,
+                      int x0, int y0, int w, ushort color);
+            // add the commands for area <a> to the buffer
+            int  render(const AREA &a, const ushort *src, int x0, int y0, int w,
+                        ushort color, bool solid);
+            PGDSHADOW(const PGDSHADOW &);
+            PGDSHADOW &operator=(const PGDSHADOW &);
+
+        public:
+            PGDSHADOW();
+            ~PGDSHADOW();
+
+            const char *GetError(void) { return errmsg; }
+
+            /// Open the shadow of a <width> x <height> display.  If <filename> is
+            /// not NULL the shadow is kept in that file, which is created if need be;
+            /// otherwise it is kept in memory only.
+            /// @return 0 if a shadow of the same size was found in the file and is
+            /// resumed, 1 if the shadow starts out unknown, -1 for failure
+            int  Open(const char *filename, ushort width, ushort height);
+            /// Write the shadow to its file (if any) and release it
+            void Close(void);
+            bool IsOpen(void) { return map != NULL; }
+            /// Write changes to the file now rather than when the system chooses
+            /// @return 0 for success, -1 for failure
+            int  Sync(void);
+
+            /// Forget what is in <area> so that it is drawn in full next time
+            void Invalidate(const PGDRECT &area);
+            /// Forget the whole screen
+            void Invalidate(void);
+            /// @return the number of tiles which are not known
+            int  GetUnknown(void);
+            /// Retrieve the color of a pixel
+            /// @return true if the pixel is known
+            bool GetPixel(ushort x, ushort y, ushort *color);
+
+            /// Draw <w> x <h> pixels of <data> (row by row) at (x, y); only the
+            /// tiles which differ from the shadow are sent.
+            /// Return values are as for PGD::Transmit().
+            int  Update(PGD *pgd, ushort x, ushort y, ushort w, ushort h, const ushort *data);
+            /// Fill <area> with <color>; only the tiles which differ are sent.
+            /// Return values are as for PGD::Transmit().
+            int  Fill(PGD *pgd, const PGDRECT &area, ushort color);
+
+            const PGDSHADOWSTATS &GetStats(void) { return stats; }
+            void ResetStats(void) { stats = PGDSHADOWSTATS(); }
+    };
+
+};  //namespace disp
+#endif // SHADOW_H
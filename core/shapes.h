@@ -0,0 +1,208 @@
+/**
+    file: shapes.h
+
+    Composite shapes for the PICASO SGC driver.  Rounded rectangles,
+    arc bands and thick lines are decomposed into the device's own
+    Rectangle, Circle, Triangle and Line commands so they need not be
+    sent as images.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+/*
+    Notes:
+        + The routines are templates which accept anything with the
+          PGD drawing commands; with a PGDCMDBUF the whole shape is
+          recorded and can be sent as one batch with PGD::Transmit().
+        + Shapes are filled, so the pen must be SOLID.  Each routine
+          sets the pen first unless <setpen> is false, which saves a
+          command when several shapes are drawn in a row.
+        + Angles are in degrees, clockwise from 3 o'clock as seen on
+          the screen.  Arcs are made of triangles whose outer edge
+          departs from the true arc by at most half a pixel.
+        + Triangles are sent in anticlockwise order as the device
+          requires; triangles which round to a line are dropped.
+        + Return values are those of the underlying commands; drawing
+          stops at the first command which does not return 0.
+ */
+
+#ifndef SHAPES_H
+#define SHAPES_H
+
+#include <math.h>
+
+#include "oled.h"
+
+namespace disp {
+
+    // round to the nearest screen coordinate
+    inline ushort PGDShapeCoord(double v)
+    {
+        if (v < 0.0) return 0;
+        if (v > 65535.0) return 65535;
+        return (ushort)floor(v + 0.5);
+    }
+
+    /// Draw a filled triangle with its vertices in the order required by the device
+    template <class T>
+    int PGDSolidTriangle(T *dev, ushort x1, ushort y1, ushort x2, ushort y2,
+                         ushort x3, ushort y3, ushort color)
+    {
+        long cross = (long)(x2 - x1) * (y3 - y1) - (long)(y2 - y1) * (x3 - x1);
+        if (!cross) return 0;
+        // with y increasing downwards a positive cross product is clockwise
+        if (cross > 0) return dev->Triangle(x1, y1, x3, y3, x2, y2, color);
+        return dev->Triangle(x1, y1, x2, y2, x3, y3, color);
+    }
+
+    /// Draw a filled rectangle with corners of radius <r>; (x1, y1) is the top left
+    template <class T>
+    int PGDRoundRect(T *dev, ushort x1, ushort y1, ushort x2, ushort y2, ushort r,
+                     ushort color, bool setpen = true)
+    {
+        int res;
+        if ((setpen) && ((res = dev->PenSize(SOLID)))) return res;
+        if ((x2 < x1) || (y2 < y1)) return 0;
+        if (2 * r > x2 - x1) r = (x2 - x1) / 2;
+        if (2 * r > y2 - y1) r = (y2 - y1) / 2;
+        if (!r) return dev->Rectangle(x1, y1, x2, y2, color);
+
+        // a cross of two rectangles and a disc in each corner
+        if ((res = dev->Rectangle(x1 + r, y1, x2 - r, y2, color))) return res;
+        if ((res = dev->Rectangle(x1, y1 + r, x2, y2 - r, color))) return res;
+        if ((res = dev->Circle(x1 + r, y1 + r, r, color))) return res;
+        if ((res = dev->Circle(x2 - r, y1 + r, r, color))) return res;
+        if ((res = dev->Circle(x1 + r, y2 - r, r, color))) return res;
+        return dev->Circle(x2 - r, y2 - r, r, color);
+    }
+
+    /// Draw a rounded rectangle filled with <fill> and a border <thick> pixels wide
+    template <class T>
+    int PGDRoundFrame(T *dev, ushort x1, ushort y1, ushort x2, ushort y2, ushort r,
+                      ushort thick, ushort color, ushort fill, bool setpen = true)
+    {
+        int res;
+        if ((res = PGDRoundRect(dev, x1, y1, x2, y2, r, color, setpen))) return res;
+        if ((x2 < x1) || (y2 < y1) || (2 * thick > x2 - x1) || (2 * thick > y2 - y1))
+            return 0;
+        return PGDRoundRect(dev, x1 + thick, y1 + thick, x2 - thick, y2 - thick,
+                            (r > thick) ? r - thick : 0, fill, false);
+    }
+
+    /// Draw a band between radii <rin> and <rout> about <cx>, <cy> from angle
+    /// <a0> to <a1>; <rin> = 0 draws a sector
+    template <class T>
+    int PGDArc(T *dev, ushort cx, ushort cy, ushort rin, ushort rout, double a0, double a1,
+               ushort color, bool setpen = true)
+    {
+        int res;
+        if ((setpen) && ((res = dev->PenSize(SOLID)))) return res;
+        if ((!rout) || (rin >= rout) || (a1 == a0)) return 0;
+        if (a1 < a0)
+        {
+            double t = a0;
+            a0 = a1;
+            a1 = t;
+        }
+        if (a1 - a0 > 360.0) a1 = a0 + 360.0;
+
+        // largest step for which the chord stays within half a pixel of the arc
+        double step = (rout > 1) ? 2.0 * acos(1.0 - 0.5 / rout) : M_PI / 2.0;
+        double span = (a1 - a0) * M_PI / 180.0;
+        int n = (int)ceil(span / step);
+        if (n < 1) n = 1;
+        step = span / n;
+
+        int i;
+        double a, c, s;
+        ushort ox0, oy0, ix0, iy0, ox1, oy1, ix1, iy1;
+        a = a0 * M_PI / 180.0;
+        ox0 = PGDShapeCoord(cx + rout * cos(a));
+        oy0 = PGDShapeCoord(cy + rout * sin(a));
+        ix0 = PGDShapeCoord(cx + rin * cos(a));
+        iy0 = PGDShapeCoord(cy + rin * sin(a));
+        for (i = 1; i <= n; ++i)
+        {
+            a = a0 * M_PI / 180.0 + i * step;
+            c = cos(a);
+            s = sin(a);
+            ox1 = PGDShapeCoord(cx + rout * c);
+            oy1 = PGDShapeCoord(cy + rout * s);
+            ix1 = PGDShapeCoord(cx + rin * c);
+            iy1 = PGDShapeCoord(cy + rin * s);
+            if ((res = PGDSolidTriangle(dev, ox0, oy0, ox1, oy1, ix1, iy1, color)))
+                return res;
+            if ((rin) && ((res = PGDSolidTriangle(dev, ox0, oy0, ix1, iy1, ix0, iy0, color))))
+                return res;
+            ox0 = ox1;
+            oy0 = oy1;
+            ix0 = ix1;
+            iy0 = iy1;
+        }
+
+        return 0;
+    }
+
+    /// Draw a line <width> pixels wide, optionally with round ends
+    template <class T>
+    int PGDThickLine(T *dev, ushort x1, ushort y1, ushort x2, ushort y2, ushort width,
+                     ushort color, bool round = false, bool setpen = true)
+    {
+        int res;
+        if (width < 2) return dev->Line(x1, y1, x2, y2, color);
+        if ((setpen) && ((res = dev->PenSize(SOLID)))) return res;
+
+        int h1 = (width - 1) / 2;       // pixels on either side of the line
+        int h2 = width - 1 - h1;
+        if (y1 == y2)
+        {
+            res = dev->Rectangle((x1 < x2) ? x1 : x2, PGDShapeCoord(y1 - h1),
+                                 (x1 < x2) ? x2 : x1, y1 + h2, color);
+        }
+        else if (x1 == x2)
+        {
+            res = dev->Rectangle(PGDShapeCoord(x1 - h1), (y1 < y2) ? y1 : y2,
+                                 x1 + h2, (y1 < y2) ? y2 : y1, color);
+        }
+        else
+        {
+            // two triangles covering the quadrilateral about the line
+            double dx = (double)x2 - x1;
+            double dy = (double)y2 - y1;
+            double len = sqrt(dx * dx + dy * dy);
+            double nx = -dy / len * width / 2.0;
+            double ny = dx / len * width / 2.0;
+            ushort ax = PGDShapeCoord(x1 + nx);
+            ushort ay = PGDShapeCoord(y1 + ny);
+            ushort bx = PGDShapeCoord(x1 - nx);
+            ushort by = PGDShapeCoord(y1 - ny);
+            ushort cx = PGDShapeCoord(x2 - nx);
+            ushort cy = PGDShapeCoord(y2 - ny);
+            ushort ex = PGDShapeCoord(x2 + nx);
+            ushort ey = PGDShapeCoord(y2 + ny);
+            if ((res = PGDSolidTriangle(dev, ax, ay, bx, by, cx, cy, color))) return res;
+            res = PGDSolidTriangle(dev, ax, ay, cx, cy, ex, ey, color);
+        }
+        if ((res) || (!round)) return res;
+
+        if ((res = dev->Circle(x1, y1, width / 2, color))) return res;
+        return dev->Circle(x2, y2, width / 2, color);
+    }
+
+};  //namespace disp
+#endif // SHAPES_H
@@ -0,0 +1,268 @@
+/**
+    file: sprite.cpp
+
+    Sprites for the PICASO SGC driver.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sprite.h"
+
+using namespace disp;
+
+#define ERRMSG(fmt, args...) snprintf(errmsg, PGDERRLEN, "%s:%d: %s(): " fmt,\
+    __FILE__, __LINE__, __FUNCTION__,##args)
+
+
+PGDSPRITES::PGDSPRITES()
+{
+    nspr = 0;
+    errmsg[0] = 0;
+    return;
+}
+
+
+
+void
+PGDSPRITES::SetStage(const PGDRECT &area)
+{
+    stage.SetArea(area);
+    nspr = 0;
+    return;
+}
+
+
+
+int
+PGDSPRITES::Add(ushort width, ushort height, uchar colormode, const uchar *data, int datalen)
+{
+    if (nspr >= PGDMAXSPRITES)
+    {
+        ERRMSG("too many sprites (max. %d)", PGDMAXSPRITES);
+        return -1;
+    }
+    if ((colormode != 0x08)&&(colormode != 0x10))
+    {
+        ERRMSG("invalid color mode (%ud); valid values are 0x08 and 0x10 only", colormode);
+        return -1;
+    }
+    int dsize = width * height;
+    if (colormode == 0x10) dsize *= 2;
+    if ((!dsize) || (dsize != datalen) || (!data))
+    {
+        ERRMSG("invalid data length for color mode 0x%.2d (size = %d, expected %d)",
+               colormode, datalen, dsize);
+        return -1;
+    }
+
+    SPRITE *sp = &spr[nspr];
+    if ((stage.Alloc(width, height, &sp->image)) || (stage.Alloc(width, height, &sp->save)))
+    {
+        ERRMSG("no room for a %d x %d sprite in the staging area", width, height);
+        return -1;
+    }
+    sp->data = data;
+    sp->colormode = colormode;
+    sp->loaded = false;
+    sp->x = sp->nx = 0;
+    sp->y = sp->ny = 0;
+    sp->shown = sp->nshow = false;
+    return nspr++;
+}
+
+
+
+int
+PGDSPRITES::Move(int id, int x, int y)
+{
+    if ((id < 0) || (id >= nspr) || (x < 0) || (y < 0))
+    {
+        ERRMSG("invalid arguments (sprite %d, position %d, %d)", id, x, y);
+        return -1;
+    }
+    spr[id].nx = x;
+    spr[id].ny = y;
+    return 0;
+}
+
+
+
+int
+PGDSPRITES::Show(int id, bool show)
+{
+    if ((id < 0) || (id >= nspr))
+    {
+        ERRMSG("invalid sprite (%d)", id);
+        return -1;
+    }
+    spr[id].nshow = show;
+    return 0;
+}
+
+
+
+void
+PGDSPRITES::Invalidate(void)
+{
+    int i;
+    for (i = 0; i < nspr; ++i)
+    {
+        spr[i].loaded = false;
+        spr[i].shown = false;
+    }
+    return;
+}
+
+
+
+PGDRECT
+PGDSPRITES::rect(int id, bool requested)
+{
+    const SPRITE &s = spr[id];
+    int w = s.image.x2 - s.image.x1;
+    int h = s.image.y2 - s.image.y1;
+    if (requested) return PGDRECT(s.nx, s.ny, s.nx + w, s.ny + h);
+    return PGDRECT(s.x, s.y, s.x + w, s.y + h);
+}
+
+
+
+int
+PGDSPRITES::Render(PGDCMDBUF *out)
+{
+    if (!out)
+    {
+        ERRMSG("invalid command buffer (NULL)");
+        return -1;
+    }
+
+    int i, j;
+    int res = 0;
+    SPRITE *sp;
+
+    // the state is restored if a command cannot be encoded
+    SPRITE prev[PGDMAXSPRITES];
+    for (i = 0; i < nspr; ++i) prev[i] = spr[i];
+
+    for (i = 0; i < nspr; ++i)
+    {
+        sp = &spr[i];
+        if (sp->loaded) continue;
+        int w = sp->image.x2 - sp->image.x1 + 1;
+        int h = sp->image.y2 - sp->image.y1 + 1;
+        res |= out->DrawIcon(sp->image.x1, sp->image.y1, w, h, sp->colormode, sp->data,
+                             w * h * ((sp->colormode == 0x10) ? 2 : 1));
+        sp->loaded = true;
+    }
+
+    // sprites which change, and everything overlapping them
+    bool lift[PGDMAXSPRITES];
+    bool more = false;
+    for (i = 0; i < nspr; ++i)
+    {
+        sp = &spr[i];
+        lift[i] = (sp->shown != sp->nshow)
+                  || ((sp->shown) && ((sp->x != sp->nx) || (sp->y != sp->ny)));
+        if (lift[i]) more = true;
+    }
+    while (more)
+    {
+        more = false;
+        for (i = 0; i < nspr; ++i)
+        {
+            if ((lift[i]) || (!spr[i].shown)) continue;
+            for (j = 0; j < nspr; ++j)
+            {
+                if (!lift[j]) continue;
+                if (((spr[j].shown) && (rect(i, false).Intersects(rect(j, false))))
+                    || ((spr[j].nshow) && (rect(i, false).Intersects(rect(j, true)))))
+                {
+                    lift[i] = true;
+                    more = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    // restore the backgrounds from the top down
+    int w, h;
+    for (i = nspr - 1; i >= 0; --i)
+    {
+        sp = &spr[i];
+        if ((!lift[i]) || (!sp->shown)) continue;
+        w = sp->save.x2 - sp->save.x1 + 1;
+        h = sp->save.y2 - sp->save.y1 + 1;
+        res |= out->CopyPaste(sp->save.x1, sp->save.y1, sp->x, sp->y, w, h);
+        sp->shown = false;
+    }
+
+    // save the backgrounds and draw the sprites from the bottom up
+    for (i = 0; i < nspr; ++i)
+    {
+        sp = &spr[i];
+        if ((!lift[i]) || (!sp->nshow)) continue;
+        w = sp->save.x2 - sp->save.x1 + 1;
+        h = sp->save.y2 - sp->save.y1 + 1;
+        res |= out->CopyPaste(sp->nx, sp->ny, sp->save.x1, sp->save.y1, w, h);
+        res |= out->CopyPaste(sp->image.x1, sp->image.y1, sp->nx, sp->ny, w, h);
+        sp->x = sp->nx;
+        sp->y = sp->ny;
+        sp->shown = true;
+    }
+
+    if (res)
+    {
+        for (i = 0; i < nspr; ++i) spr[i] = prev[i];
+        ERRMSG("failed; see message below\n%s", out->GetError());
+        return -1;
+    }
+    return 0;
+}
+
+
+
+int
+PGDSPRITES::Flush(PGD *pgd)
+{
+    if (!pgd)
+    {
+        ERRMSG("invalid display (NULL pointer)");
+        return -1;
+    }
+
+    buf.Clear();
+    if (Render(&buf))
+    {
+        Invalidate();
+        return -1;
+    }
+    if (!buf.GetCount()) return 0;
+
+    int res = pgd->Transmit(&buf);
+    if (res)
+    {
+        // the state of the display is unknown
+        Invalidate();
+        ERRMSG("failed; see message below\n%s", pgd->GetError());
+    }
+    return res;
+}
@@ -0,0 +1,122 @@
+/**
+    file: sprite.h
+
+    Sprites for the PICASO SGC driver.  Sprite images are uploaded once
+    into an off-screen staging area; the background under each sprite
+    is saved next to its image and sprites are moved by the device with
+    CopyPaste, so a move costs the same few commands whatever the size
+    of the sprite.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+/*
+    Notes:
+        + Image data is not copied; it must remain valid while the
+          sprite exists.
+        + Each sprite takes two slots of its own size in the staging
+          area: one for the image and one for the saved background.
+        + Sprites are opaque rectangles; CopyPaste has no transparent
+          color.
+        + Sprites are stacked in the order they were added.  When a
+          sprite moves, every sprite which overlaps its old or new
+          position is lifted as well: the backgrounds are restored from
+          the top down and saved again and the sprites drawn from the
+          bottom up, so overlapping sprites stay correct.
+        + The background is saved when a sprite is shown; anything drawn
+          under a visible sprite afterwards is lost when it moves.
+          Hide the sprite, draw, then show it again.
+        + Commands are recorded in the native orientation and sent with
+          PGD::Transmit().
+ */
+
+#ifndef SPRITE_H
+#define SPRITE_H
+
+#include "oled.h"
+#include "cmdbuf.h"
+#include "stage.h"
+
+namespace disp {
+
+// max. number of sprites
+#define PGDMAXSPRITES (16)
+
+    /** Sprites moved by the device */
+    class PGDSPRITES {
+        private:
+            struct SPRITE {
+                const uchar *data;      // image data (not copied)
+                uchar colormode;
+                bool loaded;            // image is in its slot
+                PGDRECT image;          // slot holding the image
+                PGDRECT save;           // slot holding the background
+                int x;                  // position on the screen
+                int y;
+                bool shown;             // drawn on the screen
+                int nx;                 // requested position
+                int ny;
+                bool nshow;             // requested visibility
+            };
+            SPRITE spr[PGDMAXSPRITES];
+            int nspr;
+            PGDSTAGE stage;
+            PGDCMDBUF buf;              // commands sent by Flush()
+            char errmsg[PGDERRLEN];
+            // screen area covered at the shown or requested position
+            PGDRECT rect(int id, bool requested);
+            PGDSPRITES(const PGDSPRITES &);
+            PGDSPRITES &operator=(const PGDSPRITES &);
+
+        public:
+            PGDSPRITES();
+
+            const char *GetError(void) { return errmsg; }
+
+            /// Use <area> (which the user cannot see) as the staging area; all
+            /// sprites are discarded
+            void SetStage(const PGDRECT &area);
+            /// Add a sprite; the arguments are as for PGD::DrawIcon(). The image
+            /// is uploaded by the next Render() and the sprite is hidden.
+            /// @return the sprite ID or -1 for failure
+            int  Add(ushort width, ushort height, uchar colormode, const uchar *data, int datalen);
+            int  GetCount(void) { return nspr; }
+            /// Request a new position for a sprite
+            int  Move(int id, int x, int y);
+            /// Request that a sprite is shown or hidden
+            int  Show(int id, bool show);
+            /// Upload the images again (after the display was cleared); the
+            /// sprites are taken to be hidden
+            void Invalidate(void);
+
+            /// Append the commands which carry out the requests to <out>; the
+            /// sprites are taken to be in their new state afterwards. If it
+            /// fails the state is unchanged but <out> may hold some commands.
+            /// @return 0 for success, -1 for failure
+            int  Render(PGDCMDBUF *out);
+            /// Render into the internal buffer and send it to the display; if
+            /// that fails the sprites are invalidated (see Invalidate()) and
+            /// the screen under them should be redrawn.
+            /// Return values are as for PGD::Transmit().
+            int  Flush(PGD *pgd);
+            /// @return the commands sent by the last Flush()
+            const PGDCMDBUF *GetBuffer(void) { return &buf; }
+    };
+
+};  //namespace disp
+#endif // SPRITE_H
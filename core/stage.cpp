@@ -0,0 +1,68 @@
+/**
+    file: stage.cpp
+
+    Off-screen staging area for the PICASO SGC driver.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include "stage.h"
+
+using namespace disp;
+
+
+void
+PGDSTAGE::SetArea(const PGDRECT &rect)
+{
+    area = rect;
+    Reset();
+    return;
+}
+
+
+
+void
+PGDSTAGE::Reset(void)
+{
+    cx = area.x1;
+    cy = area.y1;
+    ch = 0;
+    return;
+}
+
+
+
+int
+PGDSTAGE::Alloc(int width, int height, PGDRECT *slot)
+{
+    if ((!slot) || (width < 1) || (height < 1) || (area.IsEmpty())) return -1;
+
+    // start a new shelf if the current one is full
+    if (cx + width - 1 > area.x2)
+    {
+        cx = area.x1;
+        cy += ch;
+        ch = 0;
+    }
+    if ((cx + width - 1 > area.x2) || (cy + height - 1 > area.y2)) return -1;
+
+    *slot = PGDRECT(cx, cy, cx + width - 1, cy + height - 1);
+    cx += width;
+    if (height > ch) ch = height;
+    return 0;
+}
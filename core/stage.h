@@ -0,0 +1,67 @@
+/**
+    file: stage.h
+
+    Off-screen staging area for the PICASO SGC driver.  A part of the
+    display memory which the user never sees (a reserved strip, or an
+    area under an opaque overlay) holds pre-drawn images which are
+    copied into view with CopyPaste.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+/*
+    Notes:
+        + Space is handed out in shelves: slots are placed left to
+          right and a new shelf is started below the tallest slot when
+          a row is full.  Slots cannot be freed individually.
+        + Coordinates are those of the controller's native orientation,
+          as used by PGD::Transmit().
+        + Anything which draws over the area (PGD::Clear() for example)
+          destroys its contents; the owner must upload them again.
+ */
+
+#ifndef STAGE_H
+#define STAGE_H
+
+#include "oled.h"
+
+namespace disp {
+
+    /** Allocator for an off-screen area */
+    class PGDSTAGE {
+        private:
+            PGDRECT area;
+            int cx;                     // next free column in the current shelf
+            int cy;                     // top of the current shelf
+            int ch;                     // height of the current shelf
+
+        public:
+            PGDSTAGE() { cx = cy = ch = 0; }
+
+            /// Use <rect> as the staging area and discard all slots
+            void SetArea(const PGDRECT &rect);
+            const PGDRECT &GetArea(void) { return area; }
+            /// Discard all slots
+            void Reset(void);
+            /// Reserve a <width> x <height> slot; <slot> receives its position
+            /// @return 0 for success, -1 if there is no room
+            int  Alloc(int width, int height, PGDRECT *slot);
+    };
+
+};  //namespace disp
+#endif // STAGE_H
@@ -0,0 +1,883 @@
+/**
+    file: widget.cpp
+
+    Retained-mode widgets for the PICASO SGC driver.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "widget.h"
+
+using namespace disp;
+
+#define ERRMSG(fmt, args...) snprintf(errmsg, PGDERRLEN, "%s:%d: %s(): " fmt,\
+    __FILE__, __LINE__, __FUNCTION__,##args)
+
+// estimated margin around the text of a button
+#define BTNMARGIN (4)
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+// intersection of two areas; the result may be empty
+static PGDRECT intersect(const PGDRECT &a, const PGDRECT &b)
+{
+    return PGDRECT(MAX(a.x1, b.x1), MAX(a.y1, b.y1), MIN(a.x2, b.x2), MIN(a.y2, b.y2));
+}
+
+// smallest area which contains both areas
+static PGDRECT unite(const PGDRECT &a, const PGDRECT &b)
+{
+    if (a.IsEmpty()) return b;
+    if (b.IsEmpty()) return a;
+    return PGDRECT(MIN(a.x1, b.x1), MIN(a.y1, b.y1), MAX(a.x2, b.x2), MAX(a.y2, b.y2));
+}
+
+static bool contains(const PGDRECT &outer, const PGDRECT &inner)
+{
+    return (inner.x1 >= outer.x1) && (inner.x2 <= outer.x2)
+        && (inner.y1 >= outer.y1) && (inner.y2 <= outer.y2);
+}
+
+static int rectArea(const PGDRECT &r)
+{
+    if (r.IsEmpty()) return 0;
+    return (r.x2 - r.x1 + 1) * (r.y2 - r.y1 + 1);
+}
+
+
+/*****************************************************
+                    BASE WIDGET
+*****************************************************/
+
+// next widget after <w> in drawing order within the subtree of <top>
+PGDWIDGET *
+PGDWIDGET::nextInTree(PGDWIDGET *top)
+{
+    if (child) return child;
+
+    PGDWIDGET *wp = this;
+    while ((wp != top) && (!wp->next)) wp = wp->parent;
+    return (wp == top) ? NULL : wp->next;
+}
+
+
+PGDWIDGET::PGDWIDGET()
+{
+    screen = NULL;
+    parent = NULL;
+    child = NULL;
+    next = NULL;
+    visible = true;
+    pending = false;
+}
+
+PGDWIDGET::~PGDWIDGET()
+{
+    if (screen) screen->Remove(this);
+    // orphan the children; they remain owned by the caller
+    PGDWIDGET *wp = child;
+    PGDWIDGET *np;
+    while (wp)
+    {
+        np = wp->next;
+        wp->parent = NULL;
+        wp->next = NULL;
+        wp = np;
+    }
+    child = NULL;
+    return;
+}
+
+
+
+void
+PGDWIDGET::damage(const PGDRECT &area)
+{
+    if (!screen) return;
+
+    PGDWIDGET *wp;
+    for (wp = this; wp; wp = wp->parent) if (!wp->visible) return;
+    screen->Damage(area);
+    return;
+}
+
+
+
+void
+PGDWIDGET::resize(const PGDRECT &area)
+{
+    damage(rect);
+    rect = area;
+    damage(rect);
+    return;
+}
+
+
+
+void
+PGDWIDGET::update(const PGDRECT &area)
+{
+    if (!screen) return;
+
+    PGDWIDGET *wp;
+    for (wp = this; wp; wp = wp->parent) if (!wp->visible) return;
+    parea = pending ? unite(parea, area) : area;
+    pending = true;
+    screen->pend = true;
+    return;
+}
+
+
+
+void
+PGDWIDGET::SetVisible(bool show)
+{
+    if (show == visible) return;
+
+    // the area is damaged whether the widget appears or disappears
+    visible = true;
+    PGDWIDGET *wp;
+    for (wp = this; wp; wp = wp->nextInTree(this)) wp->damage(wp->rect);
+    visible = show;
+    return;
+}
+
+
+
+/*****************************************************
+                      WIDGETS
+*****************************************************/
+
+PGDPANEL::PGDPANEL(ushort x1, ushort y1, ushort x2, ushort y2, ushort color)
+{
+    rect = PGDRECT(x1, y1, x2, y2);
+    this->color = color;
+    bcolor = color;
+    border = false;
+}
+
+
+
+int
+PGDPANEL::Paint(PGDCMDBUF *buf, const PGDRECT *clip)
+{
+    PGDRECT c = clip ? intersect(rect, *clip) : rect;
+    if (c.IsEmpty()) return 0;
+
+    if (buf->Rectangle(c.x1, c.y1, c.x2, c.y2, color)) return -1;
+    if (!border) return 0;
+
+    // draw the visible parts of the border as lines
+    if ((rect.y1 >= c.y1) && (rect.y1 <= c.y2)
+        && buf->Line(c.x1, rect.y1, c.x2, rect.y1, bcolor)) return -1;
+    if ((rect.y2 >= c.y1) && (rect.y2 <= c.y2)
+        && buf->Line(c.x1, rect.y2, c.x2, rect.y2, bcolor)) return -1;
+    if ((rect.x1 >= c.x1) && (rect.x1 <= c.x2)
+        && buf->Line(rect.x1, c.y1, rect.x1, c.y2, bcolor)) return -1;
+    if ((rect.x2 >= c.x1) && (rect.x2 <= c.x2)
+        && buf->Line(rect.x2, c.y1, rect.x2, c.y2, bcolor)) return -1;
+    return 0;
+}
+
+
+
+void
+PGDPANEL::SetColor(ushort color)
+{
+    if (color == this->color) return;
+    this->color = color;
+    damage(rect);
+    return;
+}
+
+
+
+void
+PGDPANEL::SetBorder(bool show, ushort color)
+{
+    if ((show == border) && ((!show) || (color == bcolor))) return;
+    border = show;
+    bcolor = color;
+    damage(rect);
+    return;
+}
+
+
+
+PGDLABEL::PGDLABEL(ushort x, ushort y, uchar font, ushort color, const char *text,
+                   uchar xmul, uchar ymul)
+{
+    this->x = x;
+    this->y = y;
+    this->font = font;
+    this->color = color;
+    this->xmul = xmul;
+    this->ymul = ymul;
+    snprintf(this->text, PGDTEXTLEN, "%s", text ? text : "");
+    rect = PGDTextExtent(x, y, font, xmul, ymul, this->text);
+}
+
+
+
+int
+PGDLABEL::Paint(PGDCMDBUF *buf, const PGDRECT * /*clip*/)
+{
+    if (!text[0]) return 0;
+    return buf->ScaleString(x, y, font, color, xmul, ymul, text);
+}
+
+
+
+void
+PGDLABEL::SetText(const char *text)
+{
+    if (!text) text = "";
+    if (!strncmp(text, this->text, PGDTEXTLEN - 1)) return;
+    snprintf(this->text, PGDTEXTLEN, "%s", text);
+    resize(PGDTextExtent(x, y, font, xmul, ymul, this->text));
+    return;
+}
+
+
+
+void
+PGDLABEL::SetColor(ushort color)
+{
+    if (color == this->color) return;
+    this->color = color;
+    damage(rect);
+    return;
+}
+
+
+
+PGDBUTTON::PGDBUTTON(ushort x, ushort y, ushort bcolor, uchar font, ushort tcolor,
+                     uchar xmul, uchar ymul, const char *text)
+{
+    pressed = false;
+    this->x = x;
+    this->y = y;
+    this->bcolor = bcolor;
+    this->font = font;
+    this->tcolor = tcolor;
+    this->xmul = xmul;
+    this->ymul = ymul;
+    this->text[0] = 0;
+    SetText(text);
+}
+
+
+
+int
+PGDBUTTON::Paint(PGDCMDBUF *buf, const PGDRECT * /*clip*/)
+{
+    if (!text[0]) return 0;
+    return buf->Button(pressed, x, y, bcolor, font, tcolor, xmul, ymul, text);
+}
+
+
+
+void
+PGDBUTTON::SetPressed(bool pressed)
+{
+    if (pressed == this->pressed) return;
+    this->pressed = pressed;
+    damage(rect);
+    return;
+}
+
+
+
+void
+PGDBUTTON::SetText(const char *text)
+{
+    if (!text) text = "";
+    snprintf(this->text, PGDTEXTLEN, "%s", text);
+    PGDRECT r = PGDTextExtent(x, y, font, xmul, ymul, this->text);
+    if (!r.IsEmpty()) r.x2 += 2 * BTNMARGIN, r.y2 += 2 * BTNMARGIN;
+    resize(r);
+    return;
+}
+
+
+
+PGDGAUGE::PGDGAUGE(ushort x1, ushort y1, ushort x2, ushort y2, int vmin, int vmax,
+                   ushort fgcolor, ushort bgcolor, bool vertical)
+{
+    rect = PGDRECT(x1, y1, x2, y2);
+    if (vmax <= vmin) vmax = vmin + 1;
+    this->vmin = vmin;
+    this->vmax = vmax;
+    value = vmin;
+    drawn = vmin;
+    this->fgcolor = fgcolor;
+    this->bgcolor = bgcolor;
+    this->vertical = vertical;
+}
+
+
+
+PGDRECT
+PGDGAUGE::bar(int val)
+{
+    if (val < vmin) val = vmin;
+    if (val > vmax) val = vmax;
+
+    PGDRECT r = rect;
+    if (vertical)
+    {
+        int len = (val - vmin) * (rect.y2 - rect.y1 + 1) / (vmax - vmin);
+        r.y1 = rect.y2 - len + 1;
+    }
+    else
+    {
+        int len = (val - vmin) * (rect.x2 - rect.x1 + 1) / (vmax - vmin);
+        r.x2 = rect.x1 + len - 1;
+    }
+    return r;
+}
+
+
+
+int
+PGDGAUGE::Paint(PGDCMDBUF *buf, const PGDRECT *clip)
+{
+    PGDRECT fg = bar(value);
+    PGDRECT bg = rect;
+    if (vertical)
+        bg.y2 = fg.y1 - 1;
+    else
+        bg.x1 = fg.x2 + 1;
+
+    if (clip)
+    {
+        fg = intersect(fg, *clip);
+        bg = intersect(bg, *clip);
+    }
+    if ((!fg.IsEmpty()) && buf->Rectangle(fg.x1, fg.y1, fg.x2, fg.y2, fgcolor)) return -1;
+    if ((!bg.IsEmpty()) && buf->Rectangle(bg.x1, bg.y1, bg.x2, bg.y2, bgcolor)) return -1;
+    // the display shows the current value if the part which changed was drawn
+    if ((drawn != value) && ((!clip) || contains(*clip, span(drawn, value)))) drawn = value;
+    return 0;
+}
+
+
+
+// only the part between the old and new end of the bar changes
+PGDRECT
+PGDGAUGE::span(int from, int to)
+{
+    PGDRECT ob = bar(from);
+    PGDRECT nb = bar(to);
+    PGDRECT d = rect;
+    if (vertical)
+    {
+        d.y1 = MIN(ob.y1, nb.y1);
+        d.y2 = MAX(ob.y1, nb.y1) - 1;
+    }
+    else
+    {
+        d.x1 = MIN(ob.x2, nb.x2) + 1;
+        d.x2 = MAX(ob.x2, nb.x2);
+    }
+    return d;
+}
+
+
+
+int
+PGDGAUGE::Update(PGDCMDBUF *buf)
+{
+    PGDRECT d = span(drawn, value);
+    if (!d.IsEmpty())
+    {
+        if (buf->Rectangle(d.x1, d.y1, d.x2, d.y2, (value > drawn) ? fgcolor : bgcolor))
+            return -1;
+    }
+    drawn = value;
+    return 0;
+}
+
+
+
+void
+PGDGAUGE::SetValue(int value)
+{
+    if (value < vmin) value = vmin;
+    if (value > vmax) value = vmax;
+    if (value == this->value) return;
+
+    PGDRECT d = span(this->value, value);
+    this->value = value;
+    if (!d.IsEmpty()) update(d);
+    return;
+}
+
+
+
+PGDNEEDLE::PGDNEEDLE(ushort cx, ushort cy, ushort radius, int vmin, int vmax,
+                     int a0, int a1, int nticks, ushort fcolor, ushort ncolor, ushort tcolor)
+{
+    rect = PGDRECT(cx - radius, cy - radius, cx + radius, cy + radius);
+    this->cx = cx;
+    this->cy = cy;
+    this->radius = radius;
+    if (vmax <= vmin) vmax = vmin + 1;
+    this->vmin = vmin;
+    this->vmax = vmax;
+    value = vmin;
+    this->a0 = a0;
+    this->a1 = a1;
+    this->nticks = (nticks < 2) ? 0 : nticks;
+    this->fcolor = fcolor;
+    this->ncolor = ncolor;
+    this->tcolor = tcolor;
+    drawn = false;
+    tip(value, &nx, &ny);
+}
+
+
+
+// the needle reaches 3/4 of the radius; the tick marks start beyond it
+#define NEEDLELEN(r) ((r) * 3 / 4)
+#define TICKLEN(r) ((r) / 6)
+
+void
+PGDNEEDLE::tip(int val, int *x, int *y)
+{
+    if (val < vmin) val = vmin;
+    if (val > vmax) val = vmax;
+    double a = (a0 + (double)(val - vmin) * (a1 - a0) / (vmax - vmin)) * M_PI / 180.0;
+    *x = cx + (int)floor(NEEDLELEN(radius) * cos(a) + 0.5);
+    *y = cy + (int)floor(NEEDLELEN(radius) * sin(a) + 0.5);
+    return;
+}
+
+
+
+int
+PGDNEEDLE::Paint(PGDCMDBUF *buf, const PGDRECT * /*clip*/)
+{
+    if (buf->Circle(cx, cy, radius, fcolor)) return -1;
+
+    int i;
+    double a, c, s;
+    for (i = 0; i < nticks; ++i)
+    {
+        a = (a0 + (double)i * (a1 - a0) / (nticks - 1)) * M_PI / 180.0;
+        c = cos(a);
+        s = sin(a);
+        if (buf->Line(cx + (int)floor((radius - TICKLEN(radius)) * c + 0.5),
+                      cy + (int)floor((radius - TICKLEN(radius)) * s + 0.5),
+                      cx + (int)floor((radius - 1) * c + 0.5),
+                      cy + (int)floor((radius - 1) * s + 0.5), tcolor)) return -1;
+    }
+
+    tip(value, &nx, &ny);
+    if (buf->Line(cx, cy, nx, ny, ncolor)) return -1;
+    drawn = true;
+    return 0;
+}
+
+
+
+int
+PGDNEEDLE::Update(PGDCMDBUF *buf)
+{
+    int x, y;
+    tip(value, &x, &y);
+    if ((!drawn) || ((x == nx) && (y == ny))) return 0;
+
+    // the face under the needle is plain, so the old needle is erased
+    // by drawing it again in the face color
+    if (buf->Line(cx, cy, nx, ny, fcolor)) return -1;
+    if (buf->Line(cx, cy, x, y, ncolor)) return -1;
+    nx = x;
+    ny = y;
+    return 0;
+}
+
+
+
+void
+PGDNEEDLE::SetValue(int value)
+{
+    if (value < vmin) value = vmin;
+    if (value > vmax) value = vmax;
+    if (value == this->value) return;
+
+    int x, y;
+    tip(value, &x, &y);
+    this->value = value;
+    update(unite(PGDRECT(MIN(cx, nx), MIN(cy, ny), MAX(cx, nx), MAX(cy, ny)),
+                 PGDRECT(MIN(cx, x), MIN(cy, y), MAX(cx, x), MAX(cy, y))));
+    return;
+}
+
+
+
+PGDIMAGE::PGDIMAGE(ushort x, ushort y, ushort width, ushort height,
+                   uchar colormode, const uchar *data)
+{
+    rect = PGDRECT(x, y, x + width - 1, y + height - 1);
+    this->colormode = colormode;
+    this->data = data;
+}
+
+
+
+int
+PGDIMAGE::Paint(PGDCMDBUF *buf, const PGDRECT * /*clip*/)
+{
+    if (!data) return 0;
+
+    int w = rect.x2 - rect.x1 + 1;
+    int h = rect.y2 - rect.y1 + 1;
+    int len = w * h;
+    if (colormode == 0x10) len *= 2;
+    return buf->DrawIcon(rect.x1, rect.y1, w, h, colormode, data, len);
+}
+
+
+
+void
+PGDIMAGE::SetData(const uchar *data)
+{
+    this->data = data;
+    damage(rect);
+    return;
+}
+
+
+
+/*****************************************************
+                      SCREEN
+*****************************************************/
+
+PGDSCREEN::PGDSCREEN(ushort width, ushort height, ushort bgcolor)
+{
+    first = NULL;
+    area = PGDRECT(0, 0, width - 1, height - 1);
+    this->bgcolor = bgcolor;
+    ndmg = 0;
+    nrep = 0;
+    pend = false;
+    errmsg[0] = 0;
+}
+
+PGDSCREEN::~PGDSCREEN()
+{
+    while (first) Remove(first);
+    return;
+}
+
+
+
+
+int
+PGDSCREEN::Add(PGDWIDGET *widget, PGDWIDGET *parent)
+{
+    if (!widget)
+    {
+        ERRMSG("invalid widget (NULL)");
+        return -1;
+    }
+    if ((widget->screen) || (widget->parent))
+    {
+        ERRMSG("widget is already attached");
+        return -1;
+    }
+    if ((parent) && (parent->screen != this))
+    {
+        ERRMSG("parent is not attached to this screen");
+        return -1;
+    }
+
+    PGDWIDGET **wpp = parent ? &parent->child : &first;
+    while (*wpp) wpp = &(*wpp)->next;
+    *wpp = widget;
+    widget->parent = parent;
+    widget->next = NULL;
+
+    // attach and damage the widget's subtree
+    PGDWIDGET *wp;
+    for (wp = widget; wp; wp = wp->nextInTree(widget)) wp->screen = this;
+    for (wp = widget; wp; wp = wp->nextInTree(widget)) wp->damage(wp->rect);
+    return 0;
+}
+
+
+
+int
+PGDSCREEN::Remove(PGDWIDGET *widget)
+{
+    if ((!widget) || (widget->screen != this))
+    {
+        ERRMSG("widget is not attached to this screen");
+        return -1;
+    }
+
+    // damage and detach the subtree
+    PGDWIDGET *wp;
+    for (wp = widget; wp; wp = wp->nextInTree(widget)) wp->damage(wp->rect);
+    for (wp = widget; wp; wp = wp->nextInTree(widget))
+    {
+        wp->screen = NULL;
+        wp->pending = false;
+    }
+
+    PGDWIDGET **wpp = widget->parent ? &widget->parent->child : &first;
+    while ((*wpp) && (*wpp != widget)) wpp = &(*wpp)->next;
+    if (*wpp) *wpp = widget->next;
+    widget->parent = NULL;
+    widget->next = NULL;
+    return 0;
+}
+
+
+
+void
+PGDSCREEN::addRect(PGDRECT *list, int *count, const PGDRECT &r)
+{
+    int i;
+    for (i = 0; i < *count; ++i)
+    {
+        if (contains(list[i], r)) return;
+        if (contains(r, list[i]))
+        {
+            list[i] = r;
+            return;
+        }
+    }
+
+    if (*count < PGDMAXDAMAGE)
+    {
+        list[(*count)++] = r;
+        return;
+    }
+
+    // merge with the area which grows the least
+    int best = 0;
+    int growth;
+    int bgrowth = -1;
+    for (i = 0; i < *count; ++i)
+    {
+        growth = rectArea(unite(list[i], r)) - rectArea(list[i]);
+        if ((bgrowth < 0) || (growth < bgrowth))
+        {
+            bgrowth = growth;
+            best = i;
+        }
+    }
+    list[best] = unite(list[best], r);
+    return;
+}
+
+
+
+void
+PGDSCREEN::Damage(const PGDRECT &area)
+{
+    PGDRECT r = intersect(area, this->area);
+    if (r.IsEmpty()) return;
+    addRect(dmg, &ndmg, r);
+    return;
+}
+
+
+
+// true if a visible panel or gauge in the list covers the whole area
+bool
+PGDSCREEN::covered(PGDWIDGET *w, const PGDRECT &r)
+{
+    for (; w; w = w->next)
+    {
+        if ((w->visible) && (w->Clippable()) && contains(w->rect, r)) return true;
+    }
+    return false;
+}
+
+
+
+bool
+PGDSCREEN::overlapped(PGDWIDGET *w)
+{
+    PGDWIDGET *wp;
+    for (wp = w->nextInTree(NULL); wp; wp = wp->nextInTree(NULL))
+    {
+        if ((wp->visible) && (wp->rect.Intersects(w->rect))) return true;
+    }
+    return false;
+}
+
+
+
+int
+PGDSCREEN::updateTree(PGDWIDGET *w, PGDCMDBUF *out)
+{
+    for (; w; w = w->next)
+    {
+        if (!w->visible)
+        {
+            // hidden widgets are drawn whole when they are shown again
+            PGDWIDGET *wp;
+            for (wp = w; wp; wp = wp->nextInTree(w)) wp->pending = false;
+            continue;
+        }
+
+        if (w->pending)
+        {
+            if (!out)
+            {
+                if (overlapped(w))
+                {
+                    addRect(dmg, &ndmg, intersect(w->parea, area));
+                    w->pending = false;
+                }
+            }
+            else
+            {
+                if (w->Update(out)) return -1;
+                w->pending = false;
+            }
+        }
+
+        if ((w->child) && updateTree(w->child, out)) return -1;
+    }
+    return 0;
+}
+
+
+
+int
+PGDSCREEN::renderTree(PGDWIDGET *w, PGDCMDBUF *out)
+{
+    int i;
+    for (; w; w = w->next)
+    {
+        if (!w->visible) continue;
+
+        if (!w->rect.IsEmpty())
+        {
+            if (w->Clippable())
+            {
+                for (i = 0; i < nrep; ++i)
+                {
+                    if (!w->rect.Intersects(rep[i])) continue;
+                    PGDRECT c = intersect(w->rect, rep[i]);
+                    // no need to paint what a child will paint over
+                    if (covered(w->child, c)) continue;
+                    if (w->Paint(out, &c)) return -1;
+                }
+            }
+            else
+            {
+                for (i = 0; i < nrep; ++i) if (w->rect.Intersects(rep[i])) break;
+                if (i < nrep)
+                {
+                    // everything drawn later which overlaps this widget is redrawn
+                    if (w->Paint(out, NULL)) return -1;
+                    addRect(rep, &nrep, intersect(w->rect, area));
+                }
+            }
+        }
+
+        if ((w->child) && renderTree(w->child, out)) return -1;
+    }
+    return 0;
+}
+
+
+
+
+int
+PGDSCREEN::Render(PGDCMDBUF *out)
+{
+    if (!out)
+    {
+        ERRMSG("invalid command buffer (NULL)");
+        return -1;
+    }
+    if ((!ndmg) && (!pend)) return 0;
+
+    // widgets which cannot change in place are repaired like damage
+    if (pend) updateTree(first, NULL);
+
+    int i;
+    nrep = ndmg;
+    for (i = 0; i < ndmg; ++i) rep[i] = dmg[i];
+    ndmg = 0;
+
+    int res = out->PenSize(SOLID);
+    if (!res) res = out->SetOpacity(TRANSPARENT);
+
+    // clear the background unless a top-level panel or gauge will cover it
+    for (i = 0; (i < nrep) && (!res); ++i)
+    {
+        if (!covered(first, rep[i]))
+            res = out->Rectangle(rep[i].x1, rep[i].y1, rep[i].x2, rep[i].y2, bgcolor);
+    }
+
+    if (!res) res = renderTree(first, out);
+    if ((!res) && (pend)) res = updateTree(first, out);
+    pend = false;
+    if (res)
+    {
+        ERRMSG("could not record commands; see message below\n%s", out->GetError());
+        return -1;
+    }
+    return 0;
+}
+
+
+
+int
+PGDSCREEN::Flush(PGD *pgd)
+{
+    if (!pgd)
+    {
+        ERRMSG("invalid display (NULL pointer)");
+        return -1;
+    }
+    if ((!ndmg) && (!pend)) return 0;
+
+    // keep the damage so that it can be restored if the display fails
+    PGDRECT sdmg[PGDMAXDAMAGE];
+    int sndmg = ndmg;
+    bool spend = pend;
+    int i;
+    for (i = 0; i < ndmg; ++i) sdmg[i] = dmg[i];
+
+    buf.Clear();
+    if (Render(&buf)) return -1;
+
+    int res = pgd->Transmit(&buf);
+    if (res)
+    {
+        for (i = 0; i < sndmg; ++i) addRect(dmg, &ndmg, sdmg[i]);
+        // in-place updates cannot be restored; repaint everything
+        if (spend) Invalidate();
+        ERRMSG("failed; see message below\n%s", pgd->GetError());
+    }
+    return res;
+}
@@ -0,0 +1,291 @@
+/**
+    file: widget.h
+
+    Retained-mode widgets for the PICASO SGC driver. Widgets are
+    arranged in a tree which defines their drawing (z) order; property
+    changes mark damaged areas and PGDSCREEN::Flush() sends only the
+    commands needed to repair those areas.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+/*
+    Notes:
+        + Widgets are owned by the caller and linked into the tree;
+          nothing is allocated while rendering provided the screen's
+          command buffer was sized with PGDSCREEN::Reserve().
+        + A widget is drawn after its parent and after its older
+          siblings.  Children are not clipped to their parent.
+        + Panels and gauges are made of filled rectangles and lines
+          and are redrawn only where they intersect the damage.  Labels,
+          buttons, images and dials cannot be clipped by the device; they
+          are redrawn whole and everything above them which they overlap
+          is redrawn as well.
+        + Text extents are estimated from the fixed font cell sizes
+          (see PGDTextExtent()).
+        + Gauges and dials change in place: a new value records the few commands
+          which turn the drawn state into the new one (PGDWIDGET::Update())
+          instead of damaging the widget.  If anything drawn later
+          overlaps the widget the changed area is damaged instead.
+ */
+
+#ifndef WIDGET_H
+#define WIDGET_H
+
+#include "oled.h"
+#include "cmdbuf.h"
+
+namespace disp {
+
+// max. number of separate damaged areas; further areas are merged
+#define PGDMAXDAMAGE (16)
+// max. length of label and button text including the terminator
+#define PGDTEXTLEN (64)
+
+    class PGDSCREEN;
+
+    /** Base class of all widgets */
+    class PGDWIDGET {
+        friend class PGDSCREEN;
+        private:
+            PGDSCREEN *screen;          // screen the widget is attached to
+            PGDWIDGET *parent;
+            PGDWIDGET *child;           // first child
+            PGDWIDGET *next;            // next sibling (drawn later)
+            bool visible;
+            bool pending;               // waiting for Update()
+            PGDRECT parea;              // area changed since the last update
+            PGDWIDGET *nextInTree(PGDWIDGET *top);
+            PGDWIDGET(const PGDWIDGET &);
+            PGDWIDGET &operator=(const PGDWIDGET &);
+
+        protected:
+            PGDRECT rect;               // area covered by the widget
+            /// mark an area of the screen for repair
+            void damage(const PGDRECT &area);
+            /// change the covered area and mark both the old and new areas
+            void resize(const PGDRECT &area);
+            /// request an in-place update; <area> is the part which changed
+            void update(const PGDRECT &area);
+
+        public:
+            PGDWIDGET();
+            virtual ~PGDWIDGET();
+
+            /// Record the commands which draw the widget; <clip> is NULL to draw the
+            /// whole widget, otherwise only the part within <clip> must be drawn.
+            /// @return 0 for success, -1 for failure
+            virtual int Paint(PGDCMDBUF *buf, const PGDRECT *clip) = 0;
+            /// @return true if Paint() honours the clipping rectangle
+            virtual bool Clippable(void) { return false; }
+            /// Record the commands which turn the drawn widget into its current
+            /// state; only called after update() and when nothing drawn later
+            /// overlaps the widget.
+            /// @return 0 for success, -1 for failure
+            virtual int Update(PGDCMDBUF * /*buf*/) { return 0; }
+
+            void SetVisible(bool show);
+            bool IsVisible(void) { return visible; }
+            const PGDRECT &GetRect(void) { return rect; }
+            PGDWIDGET *GetParent(void) { return parent; }
+    };
+
+    /** Filled rectangle with an optional 1-pixel border */
+    class PGDPANEL : public PGDWIDGET {
+        private:
+            ushort color;
+            ushort bcolor;
+            bool border;
+
+        public:
+            PGDPANEL(ushort x1, ushort y1, ushort x2, ushort y2, ushort color);
+            int  Paint(PGDCMDBUF *buf, const PGDRECT *clip);
+            bool Clippable(void) { return true; }
+            void SetColor(ushort color);
+            void SetBorder(bool show, ushort color);
+    };
+
+    /** Transparent text drawn with ScaleString */
+    class PGDLABEL : public PGDWIDGET {
+        private:
+            ushort x;
+            ushort y;
+            uchar font;
+            ushort color;
+            uchar xmul;
+            uchar ymul;
+            char text[PGDTEXTLEN];
+
+        public:
+            PGDLABEL(ushort x, ushort y, uchar font, ushort color, const char *text,
+                     uchar xmul = 1, uchar ymul = 1);
+            int  Paint(PGDCMDBUF *buf, const PGDRECT *clip);
+            void SetText(const char *text);
+            void SetColor(ushort color);
+            const char *GetText(void) { return text; }
+    };
+
+    /** Button drawn by the device (PGD::Button) */
+    class PGDBUTTON : public PGDWIDGET {
+        private:
+            bool pressed;
+            ushort x;
+            ushort y;
+            ushort bcolor;
+            uchar font;
+            ushort tcolor;
+            uchar xmul;
+            uchar ymul;
+            char text[PGDTEXTLEN];
+
+        public:
+            PGDBUTTON(ushort x, ushort y, ushort bcolor, uchar font, ushort tcolor,
+                      uchar xmul, uchar ymul, const char *text);
+            int  Paint(PGDCMDBUF *buf, const PGDRECT *clip);
+            void SetPressed(bool pressed);
+            bool IsPressed(void) { return pressed; }
+            void SetText(const char *text);
+    };
+
+    /** Horizontal or vertical bar gauge */
+    class PGDGAUGE : public PGDWIDGET {
+        private:
+            int vmin;
+            int vmax;
+            int value;
+            ushort fgcolor;
+            ushort bgcolor;
+            bool vertical;              // vertical bars grow upwards
+            int drawn;                  // value shown on the display
+            // area covered by the bar for the given value
+            PGDRECT bar(int val);
+            // area which changes between two values
+            PGDRECT span(int from, int to);
+
+        public:
+            PGDGAUGE(ushort x1, ushort y1, ushort x2, ushort y2, int vmin, int vmax,
+                     ushort fgcolor, ushort bgcolor, bool vertical = false);
+            int  Paint(PGDCMDBUF *buf, const PGDRECT *clip);
+            bool Clippable(void) { return true; }
+            int  Update(PGDCMDBUF *buf);
+            void SetValue(int value);
+            int  GetValue(void) { return value; }
+    };
+
+    /** Round dial with tick marks and a needle */
+    class PGDNEEDLE : public PGDWIDGET {
+        private:
+            int cx;                     // center and radius of the dial
+            int cy;
+            int radius;
+            int a0;                     // angles of vmin and vmax in degrees
+            int a1;
+            int vmin;
+            int vmax;
+            int value;
+            int nticks;
+            ushort fcolor;              // face
+            ushort ncolor;              // needle
+            ushort tcolor;              // tick marks
+            int nx;                     // tip of the needle as drawn
+            int ny;
+            bool drawn;
+            // tip of the needle for the given value
+            void tip(int val, int *x, int *y);
+
+        public:
+            /// A dial of radius <radius> centered at (cx, cy); the needle sweeps from
+            /// <a0> to <a1> degrees, measured clockwise from 3 o'clock
+            PGDNEEDLE(ushort cx, ushort cy, ushort radius, int vmin, int vmax,
+                      int a0, int a1, int nticks, ushort fcolor, ushort ncolor, ushort tcolor);
+            int  Paint(PGDCMDBUF *buf, const PGDRECT *clip);
+            int  Update(PGDCMDBUF *buf);
+            void SetValue(int value);
+            int  GetValue(void) { return value; }
+    };
+
+    /** Image drawn with DrawIcon; the pixel data is not copied */
+    class PGDIMAGE : public PGDWIDGET {
+        private:
+            uchar colormode;
+            const uchar *data;
+
+        public:
+            PGDIMAGE(ushort x, ushort y, ushort width, ushort height,
+                     uchar colormode, const uchar *data);
+            int  Paint(PGDCMDBUF *buf, const PGDRECT *clip);
+            /// Replace the pixel data (same size and color mode)
+            void SetData(const uchar *data);
+    };
+
+    /** Root of a widget tree */
+    class PGDSCREEN {
+        friend class PGDWIDGET;
+        private:
+            PGDWIDGET *first;           // first top-level widget
+            PGDRECT area;               // the whole screen
+            ushort bgcolor;
+            PGDRECT dmg[PGDMAXDAMAGE];  // damaged areas
+            int ndmg;
+            PGDRECT rep[PGDMAXDAMAGE];  // areas being repaired during Render()
+            int nrep;
+            PGDCMDBUF buf;
+            char errmsg[PGDERRLEN];
+            // add an area to a list, merging areas when the list is full
+            static void addRect(PGDRECT *list, int *count, const PGDRECT &r);
+            bool pend;                  // widgets are waiting for Update()
+            // true if a visible panel or gauge in the sibling list covers the area
+            static bool covered(PGDWIDGET *w, const PGDRECT &r);
+            // true if a visible widget drawn after <w> overlaps it
+            bool overlapped(PGDWIDGET *w);
+            int  renderTree(PGDWIDGET *w, PGDCMDBUF *out);
+            // with <out> NULL damage the waiting widgets which cannot be updated
+            // in place, otherwise record the updates of the others
+            int  updateTree(PGDWIDGET *w, PGDCMDBUF *out);
+            PGDSCREEN(const PGDSCREEN &);
+            PGDSCREEN &operator=(const PGDSCREEN &);
+
+        public:
+            PGDSCREEN(ushort width, ushort height, ushort bgcolor);
+            ~PGDSCREEN();
+
+            const char *GetError(void) { return errmsg; }
+
+            /// Attach a widget as the last (topmost) child of <parent> or of the screen
+            int  Add(PGDWIDGET *widget, PGDWIDGET *parent = NULL);
+            /// Detach a widget and its children
+            int  Remove(PGDWIDGET *widget);
+
+            /// Mark an area for repair
+            void Damage(const PGDRECT &area);
+            /// Mark the whole screen for repair
+            void Invalidate(void) { Damage(area); }
+            bool IsDamaged(void) { return (ndmg > 0) || pend; }
+
+            /// Preallocate the command buffer used by Flush()
+            int  Reserve(int nbytes, int ncmds) { return buf.Reserve(nbytes, ncmds); }
+            /// Record the commands which repair the damage and clear the damage
+            int  Render(PGDCMDBUF *out);
+            /// Render into the internal buffer and send it to the display
+            int  Flush(PGD *pgd);
+            /// @return the commands sent by the last Flush()
+            const PGDCMDBUF *GetBuffer(void) { return &buf; }
+    };
+
+};  //namespace disp
+#endif // WIDGET_H
@@ -0,0 +1,126 @@
+/**
+    file: imgcmp.cpp
+
+    This program compares two binary PPM images, such as the snapshots
+    written by the simulated display (see comsim.h), and reports the
+    pixels which differ.  It exits with 0 if the images match, 1 if they
+    differ and -1 if they cannot be compared.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "comsim.h"
+
+extern char *optarg;
+extern int optind;
+extern int optopt;
+
+using namespace com;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: imgcmp {-t tolerance} {-d map.ppm} {-h} image1.ppm image2.ppm\n");
+    fprintf(stderr, "\t-t: ignore differences up to this value in each channel (default: 0)\n");
+    fprintf(stderr, "\t-d: write a map of the differing pixels (red on the dimmed first image)\n");
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+int main(int argc, char **argv)
+{
+    int tolerance = 0;
+    const char *mapname = NULL;
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":t:d:h")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 't')
+        {
+            tolerance = atoi(optarg);
+            if ((tolerance < 0) || (tolerance > 255))
+            {
+                fprintf(stderr, "invalid tolerance: '%s'\n", optarg);
+                return -1;
+            }
+            continue;
+        }
+        if (inchar == 'd')
+        {
+            mapname = optarg;
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+    if (argc - optind != 2)
+    {
+        printUsage();
+        return -1;
+    }
+
+    SIMIMAGE a, b, map;
+    if (a.Load(argv[optind]))
+    {
+        fprintf(stderr, "%s\n", a.GetError());
+        return -1;
+    }
+    if (b.Load(argv[optind + 1]))
+    {
+        fprintf(stderr, "%s\n", b.GetError());
+        return -1;
+    }
+
+    SIMDIFF diff;
+    long n = a.Compare(b, &diff, tolerance, (mapname) ? &map : NULL);
+    if (n < 0)
+    {
+        fprintf(stderr, "%s\n", a.GetError());
+        return -1;
+    }
+
+    printf("%ld of %ld pixels differ (%.3f%%)", n, diff.pixels, 100.0 * n / diff.pixels);
+    if (n)
+        printf(" within (%d, %d)-(%d, %d)", diff.x1, diff.y1, diff.x2, diff.y2);
+    printf("; largest channel difference %d\n", diff.maxdelta);
+
+    if ((mapname) && (map.Save(mapname)))
+    {
+        fprintf(stderr, "%s\n", map.GetError());
+        return -1;
+    }
+    return (n) ? 1 : 0;
+}
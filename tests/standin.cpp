@@ -0,0 +1,333 @@
+/**
+    file: standin.cpp
+
+    A stand-in for a PICASO SGC display on a pseudo-terminal, shared by
+    the test programs which exercise the serial link without a display.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/wait.h>
+
+#include "oled.h"
+#include "standin.h"
+
+using namespace disp;
+using namespace com;
+
+#define ACK (0x06)
+#define NACK (0x15)
+// largest command: an icon of the whole screen
+#define MAXCMD (10 + 2 * STANDINW * STANDINH)
+
+static volatile sig_atomic_t resetreq = 0;
+static volatile sig_atomic_t notifyreq = 0;
+
+static void resetSignal(int)
+{
+    resetreq = 1;
+    return;
+}
+
+static void notifySignal(int)
+{
+    notifyreq = 1;
+    return;
+}
+
+static int bitRate(char code)
+{
+    switch (code)
+    {
+        case DB_57600:
+            return 57600;
+        case DB_115200:
+            return 115200;
+        case DB_128000:
+            return 128000;
+        case DB_256000:
+            return 256000;
+        default:
+            break;
+    }
+    return 9600;
+}
+
+// time taken by <nbytes> on a serial line at <rate>
+static void byteTime(int nbytes, char rate)
+{
+    usleep(nbytes * 10 * 1000000.0 / bitRate(rate));
+    return;
+}
+
+static void reply(int fd, const void *data, int len)
+{
+    if (write(fd, data, len) != len) _exit(1);
+    return;
+}
+
+
+
+double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+
+
+STANDIN::STANDIN()
+{
+    devname[0] = 0;
+    pid = 0;
+    keep = -1;
+    timed = false;
+    rate = DB_9600;
+    return;
+}
+
+
+
+STANDIN::~STANDIN()
+{
+    Stop();
+    return;
+}
+
+
+
+int
+STANDIN::Start(bool timed)
+{
+    if (pid > 0) return 0;
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((master < 0) || grantpt(master) || unlockpt(master))
+    {
+        perror("could not create the stand-in device");
+        if (master >= 0) close(master);
+        return -1;
+    }
+    snprintf(devname, sizeof(devname), "%s", ptsname(master));
+    // keep the terminal alive between connections
+    keep = open(devname, O_RDWR | O_NOCTTY);
+    this->timed = timed;
+
+    pid = fork();
+    if (pid < 0)
+    {
+        perror("could not start the stand-in");
+        close(master);
+        close(keep);
+        keep = -1;
+        pid = 0;
+        return -1;
+    }
+    if (!pid)
+    {
+        close(keep);
+        run(master);
+    }
+    close(master);
+    return 0;
+}
+
+
+
+void
+STANDIN::Stop(void)
+{
+    if (pid <= 0) return;
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    pid = 0;
+    if (keep >= 0) close(keep);
+    keep = -1;
+    return;
+}
+
+
+
+int
+STANDIN::GetReport(void *data, int len)
+{
+    int fd = open(devname, O_RDWR | O_NOCTTY);
+    if (fd < 0) return -1;
+    if (write(fd, "X", 1) != 1)
+    {
+        close(fd);
+        return -1;
+    }
+    char *p = (char *)data;
+    int got = 0;
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while ((got < len) && (poll(&pfd, 1, 1000) == 1))
+    {
+        int nb = read(fd, p + got, len - got);
+        if (nb <= 0) break;
+        got += nb;
+    }
+    close(fd);
+    return (got == len) ? 0 : -1;
+}
+
+
+
+void
+STANDIN::Reset(void)
+{
+    if (pid <= 0) return;
+    kill(pid, SIGUSR1);
+    usleep(20000);
+    return;
+}
+
+
+
+void
+STANDIN::Notify(void)
+{
+    if (pid <= 0) return;
+    kill(pid, SIGUSR2);
+    return;
+}
+
+
+
+void
+STANDIN::run(int fd)
+{
+    enum { RUN, BOOT, AUTOBAUD } state = RUN;
+    char buf[256];
+    static char cmd[MAXCMD];
+    static char resp[256];
+    int n = 0;
+    int len, nb, nr, i;
+    double treset = 0.0;
+    struct pollfd pfd;
+
+    signal(SIGUSR1, resetSignal);
+    signal(SIGUSR2, notifySignal);
+    if (sim.Open("standin")) _exit(1);
+    rate = DB_9600;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while (true)
+    {
+        if (notifyreq)
+        {
+            notifyreq = 0;
+            Notified();
+        }
+        if (resetreq)
+        {
+            resetreq = 0;
+            Resetting();
+            sim.Reopen();
+            rate = DB_9600;
+            n = 0;
+            state = BOOT;
+            treset = now();
+        }
+        if (poll(&pfd, 1, -1) <= 0)
+        {
+            if (errno == EINTR) continue;
+            break;
+        }
+        nb = read(fd, buf, sizeof(buf));
+        if (nb <= 0)
+        {
+            // no slave is open; wait for the next connection
+            usleep(1000);
+            continue;
+        }
+        if (resetreq) continue;
+
+        if (state == BOOT)
+        {
+            if (now() - treset < STANDINBOOT) continue;
+            state = AUTOBAUD;
+        }
+        if (state == AUTOBAUD)
+        {
+            if ((nb == 1) && (buf[0] == 'U'))
+            {
+                if (timed) byteTime(2, rate);
+                char c = ACK;
+                reply(fd, &c, 1);
+                state = RUN;
+            }
+            continue;
+        }
+
+        for (i = 0; i < nb; ++i)
+        {
+            if ((!n) && (buf[i] == 'X'))
+            {
+                nr = Report(resp, sizeof(resp));
+                if (nr > 0) reply(fd, resp, nr);
+                continue;
+            }
+            cmd[n++] = buf[i];
+            len = sim.CommandLength(cmd, n);
+            if ((len < 0) || (len > MAXCMD) || ((!len) && (n == MAXCMD)))
+            {
+                char c = NACK;
+                reply(fd, &c, 1);
+                n = 0;
+                continue;
+            }
+            if ((!len) || (n < len)) continue;
+            n = 0;
+
+            if (timed) byteTime(len + 1, rate);
+            SIACTION act = Filter(cmd, len);
+            if (act == SI_LOSE) continue;
+            if (act == SI_NACK)
+            {
+                char c = NACK;
+                reply(fd, &c, 1);
+                continue;
+            }
+
+            sim.Write(cmd, len);
+            nr = sim.Read(resp, sizeof(resp));
+            // the remaining bytes of a longer response
+            if ((timed) && (nr > 1)) byteTime(nr - 1, rate);
+            if ((act == SI_EXEC) && (nr > 0)) reply(fd, resp, nr);
+            if (cmd[0] == 'U') rate = DB_9600;
+            // the new rate applies after the ACK
+            if ((cmd[0] == 'Q') && (nr == 1) && (resp[0] == ACK)) rate = cmd[1];
+            Executed(cmd, len);
+        }
+    }
+    _exit(0);
+}
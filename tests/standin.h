@@ -0,0 +1,137 @@
+/**
+    file: standin.h
+
+    A stand-in for a PICASO SGC display on a pseudo-terminal, shared by
+    the test programs which exercise the serial link without a display.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+
+*/
+
+/*
+    Notes:
+        + Start() creates the terminal and forks a process which answers
+          on it until Stop().  The commands are executed by a COMSIM, so
+          the stand-in understands and draws what the simulated display
+          does.  PGD is connected to the device named by GetDevice().
+        + When timed, each command takes as long as the command and its
+          response would take on a serial line at the rate set with
+          SetBaud(); autobaud returns to 9600 bps.
+        + A test derives from STANDIN to change the behaviour; the hooks
+          are called in the stand-in's process:
+          - Filter() decides whether a command is executed, NACKed or
+            lost and whether it is answered.
+          - Executed() is called after each command has been answered.
+          - Report() fills in the answer to 'X', which GetReport() sends
+            on a second descriptor of the terminal.  'X' is not a display
+            command and is not passed to the hooks.
+          - Notified() is called after Notify().
+        + Reset() powers the stand-in up again: the screen is cleared,
+          everything received during the boot time is ignored, and then
+          only a lone 'U' (autobaud) is accepted, as bytes sent at another
+          rate arrive as garbage.
+        + Reset() and Notify() use SIGUSR1 and SIGUSR2.
+ */
+
+#ifndef __STANDIN_H__
+#define __STANDIN_H__
+
+#include <sys/types.h>
+
+#include "comsim.h"
+
+// size of the stand-in's screen
+#define STANDINW (SIMWIDTH)
+#define STANDINH (SIMHEIGHT)
+
+// msec during which the stand-in ignores everything after Reset()
+#define STANDINBOOT (500)
+
+/// monotonic time in msec; comparable between processes
+double now(void);
+
+/// What is done with a command
+enum SIACTION
+{
+    SI_EXEC = 0,    // execute and answer
+    SI_MUTE,        // execute but do not answer
+    SI_NACK,        // answer with NACK without executing it
+    SI_LOSE         // neither execute nor answer
+};
+
+class STANDIN
+{
+private:
+    com::COMSIM sim;
+    char    devname[64];
+    pid_t   pid;
+    int     keep;           // slave descriptor which keeps the terminal alive
+    bool    timed;
+    char    rate;           // DBAUD code of the current rate
+
+    // stand-in loop; never returns
+    void run(int fd);
+    STANDIN(const STANDIN &);
+    STANDIN &operator=(const STANDIN &);
+
+protected:
+    /// Decide what is done with <cmd> of <len> bytes
+    virtual SIACTION Filter(const char * /*cmd*/, int /*len*/) { return SI_EXEC; }
+    /// Called after <cmd> of <len> bytes has been executed and answered
+    virtual void Executed(const char * /*cmd*/, int /*len*/) { return; }
+    /// Write the answer to 'X' into <data>
+    /// @return the length of the answer
+    virtual int Report(char * /*data*/, int /*maxlen*/) { return 0; }
+    /// Called when the stand-in is about to be reset
+    virtual void Resetting(void) { return; }
+    /// Called after Notify()
+    virtual void Notified(void) { return; }
+
+    /// The stand-in's screen, STANDINW x STANDINH pixels in rows
+    const ushort *GetFrame(void) { return sim.GetFrame(); }
+    /// Bytes and number of the commands executed since ResetCounts()
+    unsigned long GetBytes(void) { return sim.GetStats().bytes; }
+    unsigned long GetCommands(void) { return sim.GetStats().commands; }
+    void ResetCounts(void) { sim.ResetStats(); }
+    /// DBAUD code of the current rate
+    char GetRate(void) { return rate; }
+
+public:
+    STANDIN();
+    virtual ~STANDIN();
+
+    /// Create the terminal and start the stand-in; <timed> sets whether
+    /// the commands take as long as on a serial line
+    /// @return 0 for success, -1 for failure
+    int  Start(bool timed = false);
+    /// Stop the stand-in and close the terminal
+    void Stop(void);
+
+    /// Send 'X' on a second descriptor and read <len> bytes of the answer
+    /// @return 0 for success, -1 for failure
+    int  GetReport(void *data, int len);
+    /// Reset the stand-in and wait until it has taken the signal
+    void Reset(void);
+    /// Have Notified() called in the stand-in
+    void Notify(void);
+
+    const char *GetDevice(void) { return devname; }
+    bool IsRunning(void) { return pid > 0; }
+};  // class STANDIN
+
+#endif
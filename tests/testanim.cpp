@@ -0,0 +1,197 @@
+/**
+    file: testanim.cpp
+
+    This program builds a test animation (a dot circling over a
+    gradient), reports the size of the changed tiles sent per frame and
+    with a serial device plays the animation and reports the frame rate
+    achieved, the frames dropped and the bytes sent per frame.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <math.h>
+
+#include "oled.h"
+#include "anim.h"
+
+extern char *optarg;
+extern int optopt;
+
+using namespace disp;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: testanim {-p serial_device} {-f fps} {-n frames} {-t tile} {-h}\n");
+    fprintf(stderr, "\t-p: serial_device (default: none, host-side figures only)\n");
+    fprintf(stderr, "\t-f: target frame rate (default 10)\n");
+    fprintf(stderr, "\t-n: number of frame periods to play (default 120)\n");
+    fprintf(stderr, "\t-t: tile edge in pixels (default %d)\n", PGDANIMTILE);
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+#define ANIMW (128)
+#define ANIMH (128)
+#define NFRAMES (24)
+#define DOTR (10)
+#define ORBIT (40)
+
+// 16-bit color, most significant byte first
+static void putPixel(uchar *fp, int x, int y, int r, int g, int b)
+{
+    ushort c = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+    fp[(y * ANIMW + x) * 2] = c >> 8;
+    fp[(y * ANIMW + x) * 2 + 1] = c & 0xff;
+}
+
+int main(int argc, char **argv)
+{
+    const char *port = NULL;
+    int fps = 10;
+    int count = 120;
+    int tile = PGDANIMTILE;
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":p:f:n:t:h")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 'p')
+        {
+            port = optarg;
+            continue;
+        }
+        if (inchar == 'f')
+        {
+            fps = atoi(optarg);
+            if (fps < 1) fps = 1;
+            continue;
+        }
+        if (inchar == 'n')
+        {
+            count = atoi(optarg);
+            if (count < 1) count = 1;
+            continue;
+        }
+        if (inchar == 't')
+        {
+            tile = atoi(optarg);
+            if (tile < 1) tile = 1;
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+
+    // a dot circling over a static gradient
+    uchar *data = new uchar[ANIMW * ANIMH * 2 * NFRAMES];
+    const uchar *frames[NFRAMES];
+    int f, i, j, cx, cy;
+    uchar *fp;
+    for (f = 0; f < NFRAMES; ++f)
+    {
+        fp = data + f * ANIMW * ANIMH * 2;
+        frames[f] = fp;
+        cx = ANIMW / 2 + (int)(ORBIT * cos(f * 2.0 * M_PI / NFRAMES));
+        cy = ANIMH / 2 + (int)(ORBIT * sin(f * 2.0 * M_PI / NFRAMES));
+        for (j = 0; j < ANIMH; ++j)
+        {
+            for (i = 0; i < ANIMW; ++i)
+            {
+                if ((i - cx) * (i - cx) + (j - cy) * (j - cy) <= DOTR * DOTR)
+                    putPixel(fp, i, j, 255, 200, 0);
+                else
+                    putPixel(fp, i, j, i * 2, 0, j * 2);
+            }
+        }
+    }
+
+    PGDANIM anim;
+    printf("* Computing the changed tiles: ");
+    if (anim.SetFrames(0, 0, ANIMW, ANIMH, 0x10, frames, NFRAMES, tile))
+    {
+        printf("FAILED\n%s\n", anim.GetError());
+        delete [] data;
+        return -1;
+    }
+    printf("OK\n");
+
+    int total = 0;
+    for (f = 0; f < NFRAMES; ++f) total += anim.GetDeltaBytes(f);
+    double dbytes = (double)total / NFRAMES;
+    printf("* %d frames of %d x %d, %d-pixel tiles\n", NFRAMES, ANIMW, ANIMH, tile);
+    printf("* whole frame: %d bytes; changed tiles: %.0f bytes per frame (%.1f%%)\n",
+           anim.GetKeyBytes(), dbytes, dbytes * 100.0 / anim.GetKeyBytes());
+    printf("* max. frame rate at 115200 baud: %.1f fps whole, %.1f fps delta\n",
+           11520.0 / anim.GetKeyBytes(), 11520.0 / dbytes);
+    printf("* max. frame rate at 256000 baud: %.1f fps whole, %.1f fps delta\n",
+           25600.0 / anim.GetKeyBytes(), 25600.0 / dbytes);
+
+    if (!port)
+    {
+        delete [] data;
+        return 0;
+    }
+
+    PGD oled;
+    printf("* Attempting to connect to display: ");
+    if (oled.Connect(port))
+    {
+        printf("FAILED\n%s\n", oled.GetError());
+        delete [] data;
+        return -1;
+    }
+    printf("OK\n");
+
+    oled.Clear();
+    printf("* Playing %d frames at %d fps: ", count, fps);
+    fflush(stdout);
+    int res = anim.Play(&oled, fps, count);
+    const PGDANIMSTATS &st = anim.GetStats();
+    if (res)
+        printf("FAILED\n%s\n", anim.GetError());
+    else
+        printf("OK\n");
+    if (st.shown && (st.seconds > 0.0))
+    {
+        printf("* shown %d, dropped %d in %.2f s: %.1f fps, %lu bytes per frame\n",
+               st.shown, st.dropped, st.seconds, st.shown / st.seconds,
+               st.bytes / st.shown);
+    }
+
+    oled.Close();
+    delete [] data;
+    return res;
+}
@@ -0,0 +1,244 @@
+/**
+    file: testbtncache.cpp
+
+    This program lays out a row of buttons with cached faces and reports
+    the bytes needed to show a press compared with a Button command.
+    With a serial device it also measures the time from a (simulated)
+    touch to the end of the visual feedback with PGD::Button and with
+    the cached faces.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <string.h>
+
+#include "oled.h"
+#include "btncache.h"
+
+extern char *optarg;
+extern int optopt;
+
+using namespace disp;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: testbtncache {-p serial_device} {-s sector} {-n presses} {-h}\n");
+    fprintf(stderr, "\t-p: serial_device (default: none, host-side figures only)\n");
+    fprintf(stderr, "\t-s: keep the faces on the card from this sector (default: hidden strip)\n");
+    fprintf(stderr, "\t-n: number of presses to time (default: 100)\n");
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+// elapsed time in microseconds
+double elapsed(struct timeval ts, struct timeval te)
+{
+    return (te.tv_sec - ts.tv_sec) * 1e6 + (te.tv_usec - ts.tv_usec);
+}
+
+#define SCRW (320)
+#define SCRH (240)
+// the staging strip at the bottom of the screen
+#define STAGEY (200)
+#define NBTN (4)
+#define BGCOLOR (0x0000)
+
+static const char *label[NBTN] = { "START", "STOP", "RESET", "MENU" };
+
+int main(int argc, char **argv)
+{
+    const char *port = NULL;
+    int sector = -1;
+    int npress = 100;
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":p:s:n:h")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 'p')
+        {
+            port = optarg;
+            continue;
+        }
+        if (inchar == 's')
+        {
+            sector = atoi(optarg);
+            if (sector < 0)
+            {
+                fprintf(stderr, "invalid sector: '%s'\n", optarg);
+                return -1;
+            }
+            continue;
+        }
+        if (inchar == 'n')
+        {
+            npress = atoi(optarg);
+            if (npress < 1)
+            {
+                fprintf(stderr, "invalid number of presses: '%s'\n", optarg);
+                return -1;
+            }
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+
+    PGDBTNCACHE cache;
+    if (sector >= 0)
+    {
+        if (cache.SetCard(sector, 256))
+        {
+            printf("* using the card: FAILED\n%s\n", cache.GetError());
+            return -1;
+        }
+    }
+    else
+    {
+        cache.SetStage(PGDRECT(0, STAGEY, SCRW - 1, SCRH - 1));
+    }
+
+    int i;
+    int x = 8;
+    int btnbytes = 0;
+    for (i = 0; i < NBTN; ++i)
+    {
+        if (cache.Add(x, 80, 0x001f, 2, 0xffff, 1, 1, label[i], BGCOLOR) < 0)
+        {
+            printf("* adding button '%s': FAILED\n%s\n", label[i], cache.GetError());
+            return -1;
+        }
+        const PGDRECT &r = cache.GetRect(i);
+        printf("* button '%s': %d x %d at %d, %d\n", label[i],
+               r.x2 - r.x1 + 1, r.y2 - r.y1 + 1, r.x1, r.y1);
+        if (cache.Find(r.x1 + 2, r.y1 + 2) != i)
+        {
+            printf("  touch lookup: FAILED\n");
+            return -1;
+        }
+        btnbytes += 14 + strlen(label[i]);
+        x = r.x2 + 8;
+    }
+    // IDs which name no button
+    if ((!cache.GetRect(-1).IsEmpty()) || (!cache.GetRect(NBTN).IsEmpty())
+        || cache.IsPressed(-1) || cache.IsPressed(NBTN))
+    {
+        printf("* invalid button IDs: FAILED\n");
+        return -1;
+    }
+    printf("* bytes per press: Button %.1f, cached face %d\n",
+           (double)btnbytes / NBTN, (sector >= 0) ? 14 : 13);
+
+    if (!port) return 0;
+
+    PGD oled;
+    printf("* Attempting to connect to display: ");
+    if (oled.Connect(port))
+    {
+        printf("FAILED\n%s\n", oled.GetError());
+        return -1;
+    }
+    printf("OK\n");
+    oled.Clear();
+
+    struct timeval ts, te;
+    int res = 0;
+    double tmin, tmax, t;
+    const PGDRECT *rp;
+
+    // a touch is simulated by picking a button; the feedback is complete
+    // when the device acknowledges the command which draws it
+    printf("* feedback with PGD::Button: ");
+    fflush(stdout);
+    tmin = 1e9;
+    tmax = 0;
+    t = 0;
+    for (i = 0; (i < npress) && (!res); ++i)
+    {
+        int id = i % NBTN;
+        rp = &cache.GetRect(id);
+        gettimeofday(&ts, NULL);
+        res = oled.Button(true, rp->x1, rp->y1, 0x001f, 2, 0xffff, 1, 1, label[id]);
+        gettimeofday(&te, NULL);
+        if (!res) res = oled.Button(false, rp->x1, rp->y1, 0x001f, 2, 0xffff, 1, 1, label[id]);
+        double dt = elapsed(ts, te) / 1000.0;
+        t += dt;
+        if (dt < tmin) tmin = dt;
+        if (dt > tmax) tmax = dt;
+    }
+    if (res)
+        printf("FAILED\n%s\n", oled.GetError());
+    else
+        printf("%.2f msec (min %.2f, max %.2f)\n", t / npress, tmin, tmax);
+
+    printf("* loading the faces: ");
+    fflush(stdout);
+    gettimeofday(&ts, NULL);
+    res = cache.Load(&oled);
+    gettimeofday(&te, NULL);
+    if (res)
+    {
+        printf("FAILED\n%s\n", cache.GetError());
+        oled.Close();
+        return -1;
+    }
+    printf("%.1f msec\n", elapsed(ts, te) / 1000.0);
+
+    printf("* feedback with cached faces: ");
+    fflush(stdout);
+    tmin = 1e9;
+    tmax = 0;
+    t = 0;
+    for (i = 0; (i < npress) && (!res); ++i)
+    {
+        int id = i % NBTN;
+        gettimeofday(&ts, NULL);
+        res = cache.Press(&oled, id, true);
+        gettimeofday(&te, NULL);
+        if (!res) res = cache.Press(&oled, id, false);
+        double dt = elapsed(ts, te) / 1000.0;
+        t += dt;
+        if (dt < tmin) tmin = dt;
+        if (dt > tmax) tmax = dt;
+    }
+    if (res)
+        printf("FAILED\n%s\n", cache.GetError());
+    else
+        printf("%.2f msec (min %.2f, max %.2f)\n", t / npress, tmin, tmax);
+
+    oled.Close();
+    return 0;
+}
@@ -0,0 +1,267 @@
+/**
+    file: testcapcache.cpp
+
+    This program exercises the capability cache: entries are stored,
+    saved and loaded again, a cache file with bad lines is read, and
+    Connect() is run against the stand-in (see standin.h) with a cache
+    file while the stand-in refuses or accepts the change of the bit
+    rate.  A rate which the display has refused must not be recorded.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "oled.h"
+#include "capcache.h"
+#include "standin.h"
+
+extern char *optarg;
+extern int optopt;
+
+using namespace disp;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: testcapcache {-f file} {-h}\n");
+    fprintf(stderr, "\t-f: cache file to use (default: /tmp/testcapcache.txt)\n");
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+// NACKs the change of the bit rate; Notify() toggles this.  The
+// stand-in takes the signal well within the power-up wait of Connect().
+class RATESTANDIN : public STANDIN
+{
+private:
+    bool refuse;
+
+protected:
+    SIACTION Filter(const char *cmd, int /*len*/)
+    {
+        if ((refuse) && (cmd[0] == 'Q')) return SI_NACK;
+        return SI_EXEC;
+    }
+    void Notified(void)
+    {
+        refuse = !refuse;
+        return;
+    }
+
+public:
+    RATESTANDIN() : refuse(true) {}
+};
+
+static PGDCAPS makeCaps(int hres, DSGCREV rev, DBAUD baud)
+{
+    PGDCAPS caps;
+    caps.ver.display_type = DEV_OLED;
+    caps.ver.hardware_rev = 1;
+    caps.ver.firmware_rev = 2;
+    caps.ver.hres = hres;
+    caps.ver.vres = 128;
+    caps.rev = rev;
+    caps.baud = baud;
+    return caps;
+}
+
+static bool sameCaps(const PGDCAPS &a, const PGDCAPS &b)
+{
+    return (a.ver.display_type == b.ver.display_type)
+            && (a.ver.hardware_rev == b.ver.hardware_rev)
+            && (a.ver.firmware_rev == b.ver.firmware_rev)
+            && (a.ver.hres == b.ver.hres) && (a.ver.vres == b.ver.vres)
+            && (a.rev == b.rev) && (a.baud == b.baud);
+}
+
+// store, save and load two entries
+static int roundTrip(const char *filename)
+{
+    PGDCAPS a = makeCaps(128, SGC_R11, DB_115200);
+    PGDCAPS b = makeCaps(160, SGC_R4, DB_57600);
+    PGDCAPS c;
+    PGDCAPCACHE cache;
+
+    cache.Store("/dev/ttyA", makeCaps(96, SGC_R4, DB_9600));
+    cache.Store("/dev/ttyA", a);    // replaces the first entry
+    cache.Store("/dev/ttyB", b);
+    if (cache.Save(filename))
+    {
+        printf("%s\n", cache.GetError());
+        return -1;
+    }
+
+    PGDCAPCACHE loaded;
+    if (loaded.Load(filename))
+    {
+        printf("%s\n", loaded.GetError());
+        return -1;
+    }
+
+    if (loaded.Find("/dev/ttyA", a.ver, &c) || (!sameCaps(a, c))) return -1;
+    if (loaded.Find("/dev/ttyB", b.ver, &c) || (!sameCaps(b, c))) return -1;
+    // another display on a known port, and a known display on another port
+    if (!loaded.Find("/dev/ttyA", b.ver, &c)) return -1;
+    if (!loaded.Find("/dev/ttyC", a.ver, &c)) return -1;
+    return 0;
+}
+
+// lines with an unknown rev or baud are skipped; a malformed line fails
+static int badLines(const char *filename)
+{
+    FILE *fp = fopen(filename, "w");
+    if (!fp) return -1;
+    fprintf(fp, "# port type hwrev fwrev hres vres rev baud\n");
+    fprintf(fp, "/dev/ttyA 0 1 2 128 128 7 13\n");      // unknown rev
+    fprintf(fp, "/dev/ttyB 0 1 2 128 128 2 200\n");     // unknown baud
+    fprintf(fp, "/dev/ttyC 0 1 2 128 128 2 8\n");       // unknown baud
+    fprintf(fp, "/dev/ttyD 0 1 2 128 128 2 13\n");
+    fclose(fp);
+
+    PGDCAPCACHE cache;
+    PGDCAPS ref = makeCaps(128, SGC_R11, DB_115200);
+    PGDCAPS c;
+    if (cache.Load(filename))
+    {
+        printf("%s\n", cache.GetError());
+        return -1;
+    }
+    if ((!cache.Find("/dev/ttyA", ref.ver, &c)) || (!cache.Find("/dev/ttyB", ref.ver, &c))
+        || (!cache.Find("/dev/ttyC", ref.ver, &c))) return -1;
+    if (cache.Find("/dev/ttyD", ref.ver, &c) || (!sameCaps(ref, c))) return -1;
+
+    fp = fopen(filename, "a");
+    if (!fp) return -1;
+    fprintf(fp, "/dev/ttyE 0 1 2\n");
+    fclose(fp);
+    if (!cache.Load(filename)) return -1;
+    if (!cache.Find("/dev/ttyD", ref.ver, &c)) return -1;
+    return 0;
+}
+
+// connect with the cache; <found> is set if the display is in the file
+// afterwards and <caps> is its entry
+static int connect(RATESTANDIN &standin, const char *filename, bool &found, PGDCAPS &caps)
+{
+    PGD oled;
+    if (oled.SetCapCache(filename) || oled.Connect(standin.GetDevice()))
+    {
+        printf("%s\n", oled.GetError());
+        return -1;
+    }
+    PGDVER ver = oled.GetCaps().ver;
+    oled.Close();
+
+    PGDCAPCACHE cache;
+    if (cache.Load(filename))
+    {
+        printf("%s\n", cache.GetError());
+        return -1;
+    }
+    found = !cache.Find(standin.GetDevice(), ver, &caps);
+    return 0;
+}
+
+// the cache file is only written once the display has accepted the rate
+static int failedRate(const char *filename)
+{
+    RATESTANDIN standin;
+    if (standin.Start()) return -1;
+
+    bool found;
+    PGDCAPS caps;
+    int res = 0;
+
+    remove(filename);
+    if (connect(standin, filename, found, caps) || found)
+    {
+        printf("  refused rate: %s\n", found ? "recorded" : "FAILED");
+        res = -1;
+    }
+
+    standin.Notify();
+    if ((!res) && (connect(standin, filename, found, caps) || (!found)
+        || (caps.baud != DB_MAX)))
+    {
+        printf("  accepted rate: %s\n", found ? "wrong rate recorded" : "not recorded");
+        res = -1;
+    }
+
+    // a cached rate which is refused does not replace the entry
+    standin.Notify();
+    if ((!res) && (connect(standin, filename, found, caps) || (!found)
+        || (caps.baud != DB_MAX)))
+    {
+        printf("  refused cached rate: entry %s\n", found ? "changed" : "lost");
+        res = -1;
+    }
+
+    standin.Stop();
+    return res;
+}
+
+int main(int argc, char **argv)
+{
+    const char *filename = "/tmp/testcapcache.txt";
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":f:h")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 'f')
+        {
+            filename = optarg;
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+
+    int fails = 0;
+    int res = roundTrip(filename);
+    printf("* Store/Save/Load: %s\n", res ? "FAILED" : "OK");
+    if (res) ++fails;
+
+    res = badLines(filename);
+    printf("* bad lines: %s\n", res ? "FAILED" : "OK");
+    if (res) ++fails;
+
+    res = failedRate(filename);
+    printf("* Connect() with a refused rate: %s\n", res ? "FAILED" : "OK");
+    if (res) ++fails;
+
+    remove(filename);
+    return fails ? -1 : 0;
+}
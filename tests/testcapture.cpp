@@ -0,0 +1,447 @@
+/**
+    file: testcapture.cpp
+
+    This program captures the traffic of a port talking to a stand-in
+    device on a pseudo-terminal which answers each command after a
+    varying delay, reports the cost of the capture to the port's thread,
+    and replays the capture with COMREPLAY to compare the response times
+    with the original ones.  It also fills a small ring to show that the
+    port is never held up by the writer thread.  With a display it
+    captures and replays a short drawing session.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <math.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "oled.h"
+#include "comport.h"
+#include "comcapture.h"
+
+extern char *optarg;
+extern int optopt;
+
+using namespace disp;
+using namespace com;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: testcapture {-p serial_device} {-f file} {-n commands} {-h}\n");
+    fprintf(stderr, "\t-p: serial_device (default: none, stand-in device only)\n");
+    fprintf(stderr, "\t-f: capture file (default: /tmp/testcapture.cap)\n");
+    fprintf(stderr, "\t-n: number of commands (default: 500)\n");
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+// elapsed time in microseconds
+double elapsed(struct timeval ts, struct timeval te)
+{
+    return (te.tv_sec - ts.tv_sec) * 1e6 + (te.tv_usec - ts.tv_usec);
+}
+
+#define CMDLEN (11)
+#define ACK (0x06)
+
+// usec taken by the stand-in to answer command <i>
+static int delay(int i)
+{
+    return 500 + (i % 7) * 1000;
+}
+
+// answer every CMDLEN bytes with an ACK after delay() until killed
+static void respond(int fd)
+{
+    char buf[64];
+    int count = 0;
+    int ncmd = 0;
+    int nb;
+    while ((nb = read(fd, buf, sizeof(buf))) != 0)
+    {
+        if (nb < 0) continue;
+        count += nb;
+        while (count >= CMDLEN)
+        {
+            count -= CMDLEN;
+            usleep(delay(ncmd++));
+            buf[0] = ACK;
+            if (write(fd, buf, 1) != 1) _exit(1);
+        }
+    }
+    _exit(0);
+}
+
+// thread CPU time in usec
+static double cpuUsec(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_THREAD, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e6
+        + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+// send <ncmd> commands, each waiting for its ACK; the response time of
+// each command goes into <rtt> and the thread's CPU time into <cpu>
+static int run(COMMIF *port, int ncmd, double *rtt, double &cpu)
+{
+    const char cmd[CMDLEN] = { 'L', 0, 1, 0, 2, 0, 3, 0, 4, '\x7f', '\xff' };
+    struct timeval t0, t1;
+    char ack;
+    int i;
+    double c0 = cpuUsec();
+    for (i = 0; i < ncmd; ++i)
+    {
+        gettimeofday(&t0, NULL);
+        if ((port->Write(cmd, CMDLEN) != CMDLEN)
+            || (port->Read(&ack, 1, 1000) != 1) || (ack != ACK))
+        {
+            printf("FAILED at command %d\n%s\n", i, port->GetError());
+            return -1;
+        }
+        gettimeofday(&t1, NULL);
+        rtt[i] = elapsed(t0, t1);
+    }
+    cpu = cpuUsec() - c0;
+    return 0;
+}
+
+static double mean(const double *v, int n)
+{
+    double s = 0;
+    int i;
+    for (i = 0; i < n; ++i) s += v[i];
+    return s / n;
+}
+
+static int cmpDouble(const void *a, const void *b)
+{
+    double d = *(const double *)a - *(const double *)b;
+    return (d < 0) ? -1 : ((d > 0) ? 1 : 0);
+}
+
+// median absolute difference and correlation of two series
+static void compare(const double *a, const double *b, int n, double &mad, double &corr)
+{
+    double ma = mean(a, n);
+    double mb = mean(b, n);
+    double sab = 0, saa = 0, sbb = 0;
+    double *d = new double[n];
+    int i;
+    for (i = 0; i < n; ++i)
+    {
+        d[i] = fabs(a[i] - b[i]);
+        sab += (a[i] - ma) * (b[i] - mb);
+        saa += (a[i] - ma) * (a[i] - ma);
+        sbb += (b[i] - mb) * (b[i] - mb);
+    }
+    qsort(d, n, sizeof(double), cmpDouble);
+    mad = d[n / 2];
+    delete [] d;
+    corr = (saa > 0 && sbb > 0) ? sab / sqrt(saa * sbb) : 0;
+    return;
+}
+
+static long fileSize(const char *name)
+{
+    struct stat st;
+    if (stat(name, &st)) return -1;
+    return st.st_size;
+}
+
+// capture a short session on a display and replay it through PGD
+static int testDisplay(const char *devname, const char *fname)
+{
+    COMPORT serial;
+    CAPTURE cap;
+    PGD oled;
+    struct timeval ts, te;
+    double tcap, trep;
+    int i, res = 0;
+
+    if (cap.Start(fname))
+    {
+        printf("%s\n", cap.GetError());
+        return -1;
+    }
+    serial.SetCapture(&cap);
+    oled.SetTransport(&serial);
+    printf("* Attempting to connect to display: ");
+    if (oled.Connect(devname))
+    {
+        printf("FAILED\n%s\n", oled.GetError());
+        return -1;
+    }
+    printf("OK\n");
+    gettimeofday(&ts, NULL);
+    for (i = 0; (i < 100) && (!res); ++i)
+        res = oled.Line(0, i, 100, i, 0xffff);
+    gettimeofday(&te, NULL);
+    tcap = elapsed(ts, te);
+    oled.Close();
+    serial.SetCapture(NULL);
+    cap.Stop();
+    if (res)
+    {
+        printf("* Line: FAILED\n%s\n", oled.GetError());
+        return -1;
+    }
+
+    COMREPLAY replay;
+    PGD ghost;
+    ghost.SetTransport(&replay);
+    printf("* Replaying the session: ");
+    if (ghost.Connect(fname))
+    {
+        printf("FAILED\n%s\n", ghost.GetError());
+        return -1;
+    }
+    gettimeofday(&ts, NULL);
+    for (i = 0; (i < 100) && (!res); ++i)
+        res = ghost.Line(0, i, 100, i, 0xffff);
+    gettimeofday(&te, NULL);
+    trep = elapsed(ts, te);
+    if (res)
+    {
+        printf("FAILED\n%s\n", ghost.GetError());
+        return -1;
+    }
+    printf("OK\n  Line: %.2f msec per command on the display, %.2f msec replayed, "
+           "%lu bytes differ\n", tcap / 100000.0, trep / 100000.0,
+           replay.GetStats().mismatched);
+    ghost.Close();
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *devname = NULL;
+    const char *fname = "/tmp/testcapture.cap";
+    int ncmd = 500;
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":p:f:n:h")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 'p')
+        {
+            devname = optarg;
+            continue;
+        }
+        if (inchar == 'f')
+        {
+            fname = optarg;
+            continue;
+        }
+        if (inchar == 'n')
+        {
+            ncmd = atoi(optarg);
+            if (ncmd < 1)
+            {
+                fprintf(stderr, "invalid number of commands: '%s'\n", optarg);
+                return -1;
+            }
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((master < 0) || grantpt(master) || unlockpt(master))
+    {
+        perror("could not create a pseudo-terminal");
+        return -1;
+    }
+    char slave[64];
+    snprintf(slave, sizeof(slave), "%s", ptsname(master));
+
+    double *rtt = new double[ncmd];
+    double *rcap = new double[ncmd];
+    double *rrep = new double[ncmd];
+    double cpu0, cpu1, cpu2;
+    int res = 0;
+    COMPORT port;
+    CAPTURE cap;
+
+    // a fresh stand-in for each run so that the delays repeat
+    for (int pass = 0; (pass < 2) && (!res); ++pass)
+    {
+        pid_t pid = fork();
+        if (!pid) respond(master);
+        COMPARAMS params;
+        params.speed = B115200;
+        if (port.Open(slave, &params))
+        {
+            printf("* could not open %s\n%s\n", slave, port.GetError());
+            res = -1;
+        }
+        if ((!res) && pass)
+        {
+            if (cap.Start(fname))
+            {
+                printf("* capture: FAILED\n%s\n", cap.GetError());
+                res = -1;
+            }
+            port.SetCapture(&cap);
+        }
+        if (!res)
+        {
+            printf("* %d commands %s capture: ", ncmd, pass ? "with" : "without");
+            res = run(&port, ncmd, pass ? rcap : rtt, pass ? cpu1 : cpu0);
+            if (!res) printf("OK\n");
+        }
+        port.SetCapture(NULL);
+        port.Close();
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+    if (!res)
+    {
+        if (cap.Stop())
+        {
+            printf("* capture: FAILED\n%s\n", cap.GetError());
+            res = -1;
+        }
+        const CAPSTATS &cs = cap.GetStats();
+        printf("  response %.1f usec without capture, %.1f usec with it\n",
+               mean(rtt, ncmd), mean(rcap, ncmd));
+        printf("  port thread CPU %.2f usec per command without capture, %.2f usec with it\n",
+               cpu0 / ncmd, cpu1 / ncmd);
+        printf("  %lu records, %lu data bytes, %lu dropped, %ld bytes in %s\n",
+               cs.records, cs.bytes, cs.dropped, fileSize(fname), fname);
+    }
+
+    // the replay must reproduce the stand-in's response times
+    COMREPLAY replay;
+    if ((!res) && replay.Open(fname))
+    {
+        printf("* replay: FAILED\n%s\n", replay.GetError());
+        res = -1;
+    }
+    if (!res)
+    {
+        printf("* replay with the captured timing: ");
+        res = run(&replay, ncmd, rrep, cpu2);
+    }
+    if (!res)
+    {
+        double mad, corr;
+        compare(rcap, rrep, ncmd, mad, corr);
+        const REPLAYSTATS &rs = replay.GetStats();
+        printf("OK\n  response %.1f usec (captured %.1f), median difference %.1f usec, "
+               "correlation %.3f\n  %lu bytes written, %lu differ, end of capture: %s\n",
+               mean(rrep, ncmd), mean(rcap, ncmd), mad, corr, rs.txbytes, rs.mismatched,
+               replay.AtEnd() ? "yes" : "no");
+        // single responses may be late when the scheduler is busy
+        if (rs.mismatched || (!replay.AtEnd()) || (mad > 200.0))
+        {
+            printf("* replay: FAILED\n");
+            res = -1;
+        }
+    }
+    if (!res)
+    {
+        struct timeval ts, te;
+        replay.SetTimeScale(0.0);
+        replay.Reopen();
+        printf("* replay without delays: ");
+        gettimeofday(&ts, NULL);
+        res = run(&replay, ncmd, rrep, cpu2);
+        gettimeofday(&te, NULL);
+        if (!res)
+            printf("OK\n  %.2f usec per command\n", elapsed(ts, te) / ncmd);
+    }
+    replay.Close();
+
+    // a ring much smaller than the traffic; Put() must never wait
+    if (!res)
+    {
+        const int NPUT = 200000;
+        const char cmd[CMDLEN] = { 'L', 0, 1, 0, 2, 0, 3, 0, 4, '\x7f', '\xff' };
+        struct timeval ts, te;
+        double tmax = 0, t;
+        if (cap.Start(fname, 16384))
+        {
+            printf("* capture: FAILED\n%s\n", cap.GetError());
+            res = -1;
+        }
+        printf("* %d blocks into a 16 kB ring: ", NPUT);
+        struct timeval t0, t1;
+        gettimeofday(&ts, NULL);
+        for (int i = 0; (i < NPUT) && (!res); ++i)
+        {
+            gettimeofday(&t0, NULL);
+            cap.Put((i & 1) ? CAPRX : CAPTX, cmd, (i & 1) ? 1 : CMDLEN);
+            gettimeofday(&t1, NULL);
+            t = elapsed(t0, t1);
+            if (t > tmax) tmax = t;
+        }
+        gettimeofday(&te, NULL);
+        cap.Stop();
+        const CAPSTATS &cs = cap.GetStats();
+        printf("%.3f usec per block (max %.0f), %lu bytes written, %lu dropped\n",
+               elapsed(ts, te) / NPUT, tmax, cs.bytes, cs.dropped);
+        if (replay.Open(fname))
+        {
+            printf("* replay: FAILED\n%s\n", replay.GetError());
+            res = -1;
+        }
+        else
+        {
+            // read through every record to count the gaps
+            char buf[256];
+            replay.SetTimeScale(0.0);
+            while ((!replay.AtEnd()) && (replay.Write(cmd, CMDLEN) > 0))
+                while (replay.Read(buf, sizeof(buf), 0) > 0);
+            printf("  %lu gap records in the file\n", replay.GetStats().gaps);
+            replay.Close();
+        }
+    }
+
+    delete [] rtt;
+    delete [] rcap;
+    delete [] rrep;
+    close(master);
+
+    if (res || (!devname)) return res;
+    return testDisplay(devname, fname);
+}
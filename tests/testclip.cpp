@@ -0,0 +1,358 @@
+/**
+    file: testclip.cpp
+
+    This program checks the host-side clipping on a simulated display:
+    lines and rectangles are cut at a viewport, text outside it is
+    trimmed or dropped and the clip stack is pushed and popped.  With a
+    serial device it also scrolls a map made of lines, rectangles,
+    labels and icons through a viewport and reports how many commands
+    and bytes the clipping removes.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <string.h>
+
+#include "oled.h"
+#include "comsim.h"
+
+#define WHITE (0xffff)
+#define BLACK (0x0000)
+#define RED (0xf800)
+#define GREEN (0x07e0)
+#define BLUE (0x001f)
+#define GREY (0x7bef)
+#define YELLOW (0xffe0)
+
+extern char *optarg;
+extern int optopt;
+
+using namespace disp;
+using namespace com;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: testclip {-p serial_device} {-n frames} {-h}\n");
+    fprintf(stderr, "\t-p: serial_device (default: none, simulated display only)\n");
+    fprintf(stderr, "\t-n: number of frames (default 20)\n");
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+// elapsed time in milliseconds
+double elapsed(struct timeval ts, struct timeval te)
+{
+    return (te.tv_sec - ts.tv_sec) * 1e3 + (te.tv_usec - ts.tv_usec) / 1e3;
+}
+
+// map size in pixels; the map is 3 screens wide
+#define MAPW (720)
+#define MAPH (320)
+#define ICONW (16)
+
+// draw the map scrolled left by <dx> pixels; returns the nominal
+// number of bytes of the commands issued or -1 on failure
+long drawMap(PGD *pgd, int dx, const uchar *icon)
+{
+    long nb = 0;
+    int i, x;
+    char txt[16];
+
+    // grid
+    for (i = 0; i < MAPW; i += 40)
+    {
+        x = i - dx;
+        if ((x >= 0) && (x < 0x10000))
+        {
+            if (pgd->Line(x, 0, x, MAPH - 1, GREY)) return -1;
+            nb += 11;
+        }
+    }
+    // blocks and labels
+    for (i = 0; i < MAPW; i += 60)
+    {
+        x = i - dx;
+        if ((x < 0) || (x >= 0x10000)) continue;
+        if (pgd->Rectangle(x, 40 + (i % 120), x + 50, 70 + (i % 120), BLUE)) return -1;
+        snprintf(txt, 16, "BLK%d", i / 60);
+        if (pgd->ScaleString(x, 80 + (i % 120), 0, YELLOW, 1, 1, txt)) return -1;
+        if (pgd->DrawIcon(x + 20, 200, ICONW, ICONW, 0x10, icon, ICONW * ICONW * 2)) return -1;
+        nb += 11 + strlen(txt) + 11 + ICONW * ICONW * 2 + 10;
+    }
+    return nb;
+}
+
+// size of the simulated display and the viewport used for the checks
+#define SIMW (160)
+#define SIMH (128)
+#define VX1 (20)
+#define VY1 (20)
+#define VX2 (99)
+#define VY2 (79)
+
+// what reached the simulated display and what the clipping counted
+struct SENT {
+    unsigned long commands;
+    unsigned long bytes;
+    unsigned long dropped;
+    unsigned long trimmed;
+};
+
+static void mark(COMSIM &sim, PGD &oled, SENT *s)
+{
+    s->commands = sim.GetStats().commands;
+    s->bytes = sim.GetStats().bytes;
+    s->dropped = oled.GetClipStats().dropped;
+    s->trimmed = oled.GetClipStats().trimmed;
+    return;
+}
+
+// compare what was sent since <s> with the expected commands, bytes,
+// dropped and trimmed commands; <bytes> < 0 is not checked
+static bool sent(COMSIM &sim, PGD &oled, const SENT &s, unsigned long commands,
+                 long bytes, unsigned long dropped, unsigned long trimmed)
+{
+    SENT e;
+    mark(sim, oled, &e);
+    return (e.commands - s.commands == commands)
+        && ((bytes < 0) || (e.bytes - s.bytes == (unsigned long)bytes))
+        && (e.dropped - s.dropped == dropped) && (e.trimmed - s.trimmed == trimmed);
+}
+
+// count the pixels drawn inside and outside of the viewport
+static void count(COMSIM &sim, int *inside, int *outside)
+{
+    const ushort *fb = sim.GetFrame();
+    *inside = 0;
+    *outside = 0;
+    for (int i = 0; i < SIMW * SIMH; ++i)
+    {
+        if (!fb[i]) continue;
+        int x = i % SIMW;
+        int y = i / SIMW;
+        if ((x >= VX1) && (x <= VX2) && (y >= VY1) && (y <= VY2))
+            ++*inside;
+        else
+            ++*outside;
+    }
+    return;
+}
+
+static bool drawn(COMSIM &sim, int x, int y)
+{
+    return sim.GetFrame()[y * SIMW + x] != 0;
+}
+
+static int report(const char *what, bool ok)
+{
+    printf("  %s: %s\n", what, ok ? "OK" : "FAILED");
+    return ok ? 0 : -1;
+}
+
+// check the clipping on a simulated display; returns 0 for success
+static int checkClipping(void)
+{
+    COMSIM sim;
+    PGD oled;
+    PGDVER ver;
+    SENT s;
+    int in, out;
+    int res = 0;
+
+    printf("* Clipping on a simulated %dx%d display\n", SIMW, SIMH);
+    oled.SetTransport(&sim);
+    if (sim.SetSize(SIMW, SIMH) || oled.Connect("sim") || oled.Version(&ver, false))
+    {
+        printf("  FAILED\n%s\n%s\n", sim.GetError(), oled.GetError());
+        return -1;
+    }
+    const PGDRECT full = oled.GetClip();
+    res |= report("bounds from Version()", (full.x1 == 0) && (full.y1 == 0)
+                  && (full.x2 == SIMW - 1) && (full.y2 == SIMH - 1));
+    oled.PushClip(PGDRECT(VX1, VY1, VX2, VY2));
+
+    // a line with both ends outside which crosses the viewport is cut at
+    // its left and right edges
+    oled.Clear();
+    mark(sim, oled, &s);
+    oled.Line(0, 10, 150, 100, WHITE);
+    count(sim, &in, &out);
+    res |= report("line through the viewport", sent(sim, oled, s, 1, 11, 0, 1)
+                  && in && (!out) && drawn(sim, VX1, 22) && drawn(sim, VX2, 69));
+
+    // a line with the ends on different sides which passes the corner
+    oled.Clear();
+    mark(sim, oled, &s);
+    oled.Line(0, 30, 30, 0, WHITE);
+    count(sim, &in, &out);
+    res |= report("line past the corner", sent(sim, oled, s, 0, 0, 1, 0) && (!in) && (!out));
+
+    // a solid rectangle is cut to the viewport; one outside is dropped
+    oled.Clear();
+    mark(sim, oled, &s);
+    oled.Rectangle(0, 0, 50, 50, WHITE);
+    count(sim, &in, &out);
+    res |= report("rectangle across the edge", sent(sim, oled, s, 1, 11, 0, 1)
+                  && (in == (51 - VX1) * (51 - VY1)) && (!out));
+    oled.Clear();
+    mark(sim, oled, &s);
+    oled.Rectangle(100, 0, 150, 10, WHITE);
+    count(sim, &in, &out);
+    res |= report("rectangle outside", sent(sim, oled, s, 0, 0, 1, 0) && (!in) && (!out));
+
+    // the characters left of the viewport are removed from the string
+    PGDRECT ext = PGDTextExtent(0, 0, FNT_SMALL, 1, 1, "X");
+    int cw = ext.x2 - ext.x1 + 1;
+    int ch = ext.y2 - ext.y1 + 1;
+    mark(sim, oled, &s);
+    oled.ScaleString(VX1 - 2 * cw, 40, FNT_SMALL, WHITE, 1, 1, "ABCDEFGH");
+    res |= report("string across the edge", sent(sim, oled, s, 1, 11 + 6, 0, 1));
+    mark(sim, oled, &s);
+    oled.ScaleString(VX2 + 1, 40, FNT_SMALL, WHITE, 1, 1, "ABCDEFGH");
+    res |= report("string outside", sent(sim, oled, s, 0, 0, 1, 0));
+
+    // a row which starts below the viewport is dropped
+    mark(sim, oled, &s);
+    oled.ShowString(0, VY2 / ch + 1, FNT_SMALL, WHITE, "BELOW");
+    oled.ShowString(0, VY2 / ch, FNT_SMALL, WHITE, "LAST");
+    res |= report("rows of text", sent(sim, oled, s, 1, 7 + 4, 1, 0));
+
+    // the clip stack intersects the areas and restores them when popped
+    oled.PushClip(PGDRECT(50, 0, SIMW - 1, SIMH - 1));
+    PGDRECT inner = oled.GetClip();
+    oled.PopClip();
+    PGDRECT outer = oled.GetClip();
+    oled.PopClip();
+    bool ok = (inner.x1 == 50) && (inner.y1 == VY1) && (inner.x2 == VX2) && (inner.y2 == VY2)
+        && (outer.x1 == VX1) && (outer.x2 == VX2)
+        && (oled.GetClip().x2 == full.x2) && (oled.GetClip().y2 == full.y2)
+        && (oled.PopClip() < 0);
+    int i;
+    for (i = 0; i < PGDCLIPDEPTH; ++i) ok = ok && (!oled.PushClip(full));
+    ok = ok && (oled.PushClip(full) < 0);
+    for (i = 0; i < PGDCLIPDEPTH; ++i) oled.PopClip();
+    oled.Clear();
+    mark(sim, oled, &s);
+    oled.Rectangle(0, 0, SIMW - 1, SIMH - 1, WHITE);
+    count(sim, &in, &out);
+    res |= report("clip stack", ok && sent(sim, oled, s, 1, 11, 0, 0)
+                  && (in + out == SIMW * SIMH));
+
+    oled.Close();
+    return res;
+}
+
+int main(int argc, char **argv)
+{
+    const char *port = NULL;
+    int nframes = 20;
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":p:n:h")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 'p')
+        {
+            port = optarg;
+            continue;
+        }
+        if (inchar == 'n')
+        {
+            nframes = atoi(optarg);
+            if (nframes < 1) nframes = 1;
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+
+    if (checkClipping()) return -1;
+    if (!port) return 0;
+
+    PGD oled;
+    printf("* Attempting to connect to display: ");
+    if (oled.Connect(port))
+    {
+        printf("FAILED\n%s\n", oled.GetError());
+        return -1;
+    }
+    printf("OK\n");
+
+    PGDVER ver;
+    if ((oled.Version(&ver, false)) || (!ver.hres))
+    {
+        printf("* Unknown display size; assuming 320x240\n");
+        oled.SetBounds(320, 240);
+    }
+    printf("* Clipping area: %d,%d - %d,%d\n", oled.GetClip().x1, oled.GetClip().y1,
+           oled.GetClip().x2, oled.GetClip().y2);
+
+    ushort icon[ICONW * ICONW];
+    int i;
+    for (i = 0; i < ICONW * ICONW; ++i) icon[i] = ((i / ICONW + i) & 4) ? RED : GREEN;
+
+    // draw inside a viewport which leaves room for a status line
+    PGDRECT view = oled.GetClip();
+    view.y1 = 16;
+    oled.PushClip(view);
+
+    struct timeval ts, te;
+    long bytes = 0;
+    long nb;
+    gettimeofday(&ts, NULL);
+    for (i = 0; i < nframes; ++i)
+    {
+        oled.Clear();
+        nb = drawMap(&oled, (i * (MAPW - 240) / nframes), (const uchar *)icon);
+        if (nb < 0)
+        {
+            printf("* Frame %d FAILED\n%s\n", i, oled.GetError());
+            break;
+        }
+        bytes += nb;
+    }
+    gettimeofday(&te, NULL);
+    oled.PopClip();
+
+    const PGDCLIPSTATS &cs = oled.GetClipStats();
+    printf("* %d frames in %.1f msec\n", i, elapsed(ts, te));
+    printf("\tcommands dropped: %lu, trimmed: %lu\n", cs.dropped, cs.trimmed);
+    printf("\tbytes issued: %ld, not sent: %lu (%.1f%%)\n", bytes, cs.saved,
+           bytes ? cs.saved * 100.0 / bytes : 0.0);
+
+    oled.Close();
+    return 0;
+}
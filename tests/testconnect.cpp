@@ -0,0 +1,240 @@
+/**
+    file: testconnect.cpp
+
+    This program compares Connect() with ConnectAsync(): how long the
+    caller is blocked and how long it takes for the first pixel of the
+    first frame to reach the display.  Without a display it talks to the
+    stand-in (see standin.h), which notes when the first drawing command
+    of each connection arrives.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "oled.h"
+#include "standin.h"
+
+extern char *optarg;
+extern int optopt;
+
+using namespace disp;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: testconnect {-p serial_device} {-h}\n");
+    fprintf(stderr, "\t-p: serial_device (default: none, stand-in device)\n");
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+// lines drawn in the first frame
+#define NLINES (40)
+
+// notes the time at which the first drawing command of each connection
+// arrives and reports it for 'X'
+class CONNECTSTANDIN : public STANDIN
+{
+private:
+    bool drawn;
+    double tdraw;
+
+protected:
+    void Executed(const char *cmd, int /*len*/)
+    {
+        // autobaud starts each connection
+        if (cmd[0] == 'U')
+        {
+            drawn = false;
+            tdraw = -1.0;
+        }
+        if ((!drawn) && ((cmd[0] == 'L') || (cmd[0] == 'r')))
+        {
+            tdraw = now();
+            drawn = true;
+        }
+        return;
+    }
+    int Report(char *data, int /*maxlen*/)
+    {
+        memcpy(data, &tdraw, sizeof(tdraw));
+        return sizeof(tdraw);
+    }
+
+public:
+    CONNECTSTANDIN()
+    {
+        drawn = false;
+        tdraw = -1.0;
+    }
+};
+
+// the first frame: a cleared area and a fan of lines
+static int drawFrame(PGD &oled)
+{
+    int res = oled.Rectangle(0, 0, 127, 127, 0x0000);
+    for (int i = 0; (i < NLINES) && (!res); ++i)
+        res = oled.Line(0, 0, 127, i * 3, 0xffff);
+    return res;
+}
+
+static volatile bool linked = false;
+static volatile bool linkok = false;
+
+static void callback(PGD * /*pgd*/, PGDCMD cmd, bool ok, void * /*obj*/)
+{
+    if (cmd != PG_CONNECT) return;
+    linkok = ok;
+    linked = true;
+    return;
+}
+
+// read the stand-in's report of the first pixel; -1 if there is none
+static double firstPixel(STANDIN &standin)
+{
+    double t;
+    if ((!standin.IsRunning()) || standin.GetReport(&t, sizeof(t))) return -1.0;
+    return t;
+}
+
+int main(int argc, char **argv)
+{
+    const char *devname = NULL;
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":p:h")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 'p')
+        {
+            devname = optarg;
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+
+    CONNECTSTANDIN standin;
+    if (!devname)
+    {
+        if (standin.Start()) return -1;
+        devname = standin.GetDevice();
+        printf("* stand-in device at %s\n", devname);
+    }
+
+    PGD oled;
+    double t0, tret, tpix, tframe;
+    int res;
+
+    printf("* Connect(): ");
+    fflush(stdout);
+    t0 = now();
+    res = oled.Connect(devname);
+    tret = now();
+    if (!res) res = drawFrame(oled);
+    tframe = now();
+    if (res)
+    {
+        printf("FAILED\n%s\n", oled.GetError());
+        return -1;
+    }
+    tpix = firstPixel(standin);
+    printf("OK\n  caller blocked %.1f msec; ", tret - t0);
+    if (tpix >= 0) printf("first pixel at %.1f msec, ", tpix - t0);
+    printf("frame done at %.1f msec\n", tframe - t0);
+    oled.Close();
+
+    oled.SetCallback(callback, NULL);
+    printf("* ConnectAsync(): ");
+    fflush(stdout);
+    t0 = now();
+    res = oled.ConnectAsync(devname);
+    tret = now();
+    double tq = 0;
+    if (!res)
+    {
+        // the application goes on with its first frame at once
+        res = drawFrame(oled);
+        tq = now() - tret;
+    }
+    if (res)
+    {
+        printf("FAILED\n%s\n", oled.GetError());
+        return -1;
+    }
+    while (!linked) usleep(1000);
+    tpix = firstPixel(standin);
+    const PGDLINKSTATS &ls = oled.GetLinkStats();
+    if ((!linkok) || ls.flushres)
+    {
+        printf("FAILED\n%s\n", oled.GetError());
+        return -1;
+    }
+    printf("OK\n  caller blocked %.3f msec; frame queued in %.3f msec (%d commands)\n",
+           tret - t0, tq, ls.queued);
+    printf("  link up at %.1f msec, ", ls.linkup);
+    if (tpix >= 0) printf("first pixel at %.1f msec, ", tpix - t0);
+    printf("frame done at %.1f msec\n", ls.flushed);
+
+    // once connected the commands go straight to the display
+    res = oled.Line(0, 127, 127, 0, 0xf800);
+    if (res) printf("* Line after connecting: FAILED\n%s\n", oled.GetError());
+    oled.Close();
+
+    // Close() while connecting cancels the connection
+    if (!res)
+    {
+        linked = false;
+        printf("* Close() while connecting: ");
+        if (oled.ConnectAsync(devname))
+        {
+            printf("FAILED\n%s\n", oled.GetError());
+            res = -1;
+        }
+        else
+        {
+            usleep(100000);
+            t0 = now();
+            oled.Close();
+            printf("%s, Close() took %.1f msec\n",
+                   (linked && (!linkok) && (!oled.IsConnecting())) ? "OK" : "FAILED",
+                   now() - t0);
+            if ((!linked) || linkok) res = -1;
+        }
+    }
+
+    standin.Stop();
+    return res;
+}
@@ -0,0 +1,275 @@
+/**
+    file: testdigits.cpp
+
+    This program counts on a 6-digit numeric display with cached glyphs,
+    checks that the recorded commands leave the right glyph in every
+    cell and reports the bytes per update compared with clearing the
+    field and sending ScaleString.  With a serial device it also
+    measures the updates per second of both methods.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <string.h>
+
+#include "oled.h"
+#include "cmdbuf.h"
+#include "digits.h"
+
+extern char *optarg;
+extern int optopt;
+
+using namespace disp;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: testdigits {-p serial_device} {-n updates} {-h}\n");
+    fprintf(stderr, "\t-p: serial_device (default: none, host-side figures only)\n");
+    fprintf(stderr, "\t-n: number of updates (default: 1000)\n");
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+// elapsed time in microseconds
+double elapsed(struct timeval ts, struct timeval te)
+{
+    return (te.tv_sec - ts.tv_sec) * 1e6 + (te.tv_usec - ts.tv_usec);
+}
+
+#define SCRW (320)
+#define SCRH (240)
+// the staging strip at the bottom of the screen
+#define STAGEY (200)
+#define NDIG (6)
+#define FONT (2)
+#define XMUL (3)
+#define YMUL (3)
+
+// each pixel holds the character whose glyph covers it; ' ' is the background
+static char screen[SCRH][SCRW];
+// text settings left by the recorded commands
+static int font = -1;
+static int opacity = -1;
+
+#define GETW(p) ((((p)[0] & 0xff) << 8) | ((p)[1] & 0xff))
+
+// draw the recorded commands; only the forms produced by PGDDIGITS are handled
+static int replay(const PGDCMDBUF *buf)
+{
+    static char tmp[SCRH * SCRW];
+    int i, x, y, x1, y1, w, h;
+    const char *cp;
+    PGDRECT r;
+    for (i = 0; i < buf->GetCount(); ++i)
+    {
+        cp = buf->GetData() + buf->GetOffset(i);
+        switch (cp[0])
+        {
+            case 'p':
+                break;
+            case 'F':
+                font = cp[1];
+                break;
+            case 'O':
+                opacity = cp[1];
+                break;
+            case 'r':
+                for (y = GETW(&cp[3]); y <= GETW(&cp[7]); ++y)
+                    for (x = GETW(&cp[1]); x <= GETW(&cp[5]); ++x) screen[y][x] = ' ';
+                break;
+            case 't':
+                r = PGDTextExtent(GETW(&cp[2]), GETW(&cp[4]), FONT, cp[8], cp[9], "0");
+                for (y = r.y1; y <= r.y2; ++y)
+                    for (x = r.x1; x <= r.x2; ++x) screen[y][x] = cp[1];
+                break;
+            case 'c':
+                x1 = GETW(&cp[1]);
+                y1 = GETW(&cp[3]);
+                w = GETW(&cp[9]);
+                h = GETW(&cp[11]);
+                for (y = 0; y < h; ++y)
+                    for (x = 0; x < w; ++x) tmp[y * w + x] = screen[y1 + y][x1 + x];
+                x1 = GETW(&cp[5]);
+                y1 = GETW(&cp[7]);
+                for (y = 0; y < h; ++y)
+                    for (x = 0; x < w; ++x) screen[y1 + y][x1 + x] = tmp[y * w + x];
+                break;
+            default:
+                return -1;
+        }
+    }
+    return 0;
+}
+
+// true if every cell of the field shows the expected text
+static bool check(const PGDRECT &field, const char *text)
+{
+    int cw = (field.x2 - field.x1 + 1) / NDIG;
+    int i, x, y;
+    for (i = 0; i < NDIG; ++i)
+        for (y = field.y1; y <= field.y2; ++y)
+            for (x = 0; x < cw; ++x)
+                if (screen[y][field.x1 + i * cw + x] != text[i]) return false;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const char *port = NULL;
+    int nupd = 1000;
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":p:n:h")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 'p')
+        {
+            port = optarg;
+            continue;
+        }
+        if (inchar == 'n')
+        {
+            nupd = atoi(optarg);
+            if (nupd < 1)
+            {
+                fprintf(stderr, "invalid number of updates: '%s'\n", optarg);
+                return -1;
+            }
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+
+    PGDDIGITS num(40, 60, NDIG, FONT, 0xffe0, 0x0000, XMUL, YMUL);
+    if (num.SetStage(PGDRECT(0, STAGEY, SCRW - 1, SCRH - 1)))
+    {
+        printf("* staging the glyphs: FAILED\n%s\n", num.GetError());
+        return -1;
+    }
+    num.SetTextMode(FNT_MEDIUM, OPAQUE);
+
+    // the counter starts below zero to exercise the sign and right alignment
+    PGDCMDBUF buf;
+    char text[32];
+    long value;
+    long bytes = 0;
+    int i;
+    memset(screen, '?', sizeof(screen));
+    printf("* counting from -120, %d updates: ", nupd);
+    fflush(stdout);
+    for (i = 0; i < nupd; ++i)
+    {
+        value = i - 120;
+        num.SetValue(value);
+        buf.Clear();
+        if (num.Render(&buf))
+        {
+            printf("FAILED\n%s\n", num.GetError());
+            return -1;
+        }
+        snprintf(text, sizeof(text), "%*ld", NDIG, value);
+        if (replay(&buf) || (!check(num.GetRect(), text)))
+        {
+            printf("MISMATCH at %ld\n", value);
+            return -1;
+        }
+        if ((font != FNT_MEDIUM) || (opacity != OPAQUE))
+        {
+            printf("text settings not restored at %ld\n", value);
+            return -1;
+        }
+        // the first update draws the glyphs
+        if (i) bytes += buf.GetLength();
+    }
+    printf("OK\n");
+    if (nupd > 1)
+        printf("  %.1f bytes per update (%d bytes to clear the field and send ScaleString)\n",
+               (double)bytes / (nupd - 1), 11 + 11 + NDIG);
+
+    if (!port) return 0;
+
+    PGD oled;
+    printf("* Attempting to connect to display: ");
+    if (oled.Connect(port))
+    {
+        printf("FAILED\n%s\n", oled.GetError());
+        return -1;
+    }
+    printf("OK\n");
+    oled.Clear();
+
+    struct timeval ts, te;
+    int res = 0;
+    const PGDRECT &f = num.GetRect();
+
+    printf("* ScaleString: ");
+    fflush(stdout);
+    oled.PenSize(SOLID);
+    oled.SetOpacity(TRANSPARENT);
+    gettimeofday(&ts, NULL);
+    for (i = 0; (i < nupd) && (!res); ++i)
+    {
+        snprintf(text, sizeof(text), "%*d", NDIG, i);
+        res = oled.Rectangle(f.x1, f.y1, f.x2, f.y2, 0x0000);
+        if (!res) res = oled.ScaleString(f.x1, f.y1, FONT, 0xffe0, XMUL, YMUL, text);
+    }
+    gettimeofday(&te, NULL);
+    if (res)
+        printf("FAILED\n%s\n", oled.GetError());
+    else
+        printf("%.1f updates/s\n", nupd / (elapsed(ts, te) / 1e6));
+
+    printf("* cached glyphs: ");
+    fflush(stdout);
+    num.Invalidate();
+    num.SetValue(0);
+    res = num.Flush(&oled);
+    gettimeofday(&ts, NULL);
+    for (i = 1; (i <= nupd) && (!res); ++i)
+    {
+        num.SetValue(i);
+        res = num.Flush(&oled);
+    }
+    gettimeofday(&te, NULL);
+    if (res)
+        printf("FAILED\n%s\n", num.GetError());
+    else
+        printf("%.1f updates/s\n", nupd / (elapsed(ts, te) / 1e6));
+
+    oled.Close();
+    return 0;
+}
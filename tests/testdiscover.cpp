@@ -0,0 +1,272 @@
+/**
+    file: testdiscover.cpp
+
+    This program probes a set of serial ports for displays, first one
+    port at a time and then all at once, and reports the time taken and
+    the displays found.  Without a port pattern it creates 8 candidate
+    ports: 5 pseudo-terminals served by stand-in displays of different
+    types and response times, 2 silent pseudo-terminals and one port
+    which does not exist.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/wait.h>
+
+#include "discover.h"
+
+extern char *optarg;
+extern int optopt;
+
+using namespace disp;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: testdiscover {-p port_pattern} {-h}\n");
+    fprintf(stderr, "\t-p: ports to probe, eg. '/dev/ttyUSB*' (default: none, stand-in ports)\n");
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+#define ACK (0x06)
+#define NACK (0x15)
+#define NCAND (8)
+#define NSILENT (2)
+
+// the stand-in displays: Version reply and response delay in msec
+struct STANDIN {
+    char ver[5];
+    int delay;
+};
+
+static const STANDIN displays[] = {
+    { { 0x00, 0x11, 0x22, 0x28, 0x28 }, 2 },     // uOLED 128x128
+    { { 0x00, 0x12, 0x23, 0x60, 0x28 }, 5 },     // uOLED 160x128
+    { { 0x01, 0x13, 0x24, 0x24, 0x32 }, 8 },     // uLCD 240x320
+    { { 0x02, 0x14, 0x25, 0x32, 0x24 }, 12 },    // uVGA 320x240
+    { { 0x00, 0x15, 0x26, 0x64, 0x64 }, 20 },    // uOLED 64x64
+};
+
+#define NDISP ((int)(sizeof(displays) / sizeof(displays[0])))
+
+// serve the stand-in displays on masters[0 .. NDISP-1]; the remaining
+// masters swallow whatever is written to them
+static void standin(int *masters, int nmasters)
+{
+    struct pollfd pfd[NCAND];
+    char buf[64];
+    int i, j, nb;
+
+    for (i = 0; i < nmasters; ++i)
+    {
+        pfd[i].fd = masters[i];
+        pfd[i].events = POLLIN;
+    }
+
+    while (poll(pfd, nmasters, -1) > 0)
+    {
+        for (i = 0; i < nmasters; ++i)
+        {
+            if (!(pfd[i].revents & (POLLIN | POLLHUP))) continue;
+            nb = read(masters[i], buf, sizeof(buf));
+            if (nb <= 0)
+            {
+                // no slave is open
+                usleep(1000);
+                continue;
+            }
+            if (i >= NDISP) continue;
+            usleep(displays[i].delay * 1000);
+            for (j = 0; j < nb; ++j)
+            {
+                char c = NACK;
+                if (buf[j] == 'V')
+                {
+                    if (write(masters[i], displays[i].ver, 5) != 5) _exit(1);
+                    ++j;    // skip the version flag
+                    continue;
+                }
+                if (buf[j] == 'U') c = ACK;
+                if (write(masters[i], &c, 1) != 1) _exit(1);
+            }
+        }
+    }
+    _exit(0);
+}
+
+static void printResults(PGDDISCOVER &disc)
+{
+    static const char *types[] = { "OLED", "LCD", "VGA" };
+    int i;
+    for (i = 0; i < disc.GetCount(); ++i)
+    {
+        const PGDFOUND &f = disc.GetResult(i);
+        printf("    %-22s %6.1f msec  ", f.port, f.msec);
+        if (f.status)
+        {
+            printf("%s\n", f.status < 0 ? "cannot open" : "no display");
+            continue;
+        }
+        printf("%-4s %3ux%-3u hw 0x%.2X fw 0x%.2X\n",
+               (f.ver.display_type <= DEV_VGA) ? types[f.ver.display_type] : "?",
+               f.ver.hres, f.ver.vres, f.ver.hardware_rev, f.ver.firmware_rev);
+    }
+    return;
+}
+
+int main(int argc, char **argv)
+{
+    const char *pattern = NULL;
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":p:h")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 'p')
+        {
+            pattern = optarg;
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+
+    PGDDISCOVER disc;
+    double t0;
+    int res;
+
+    if (pattern)
+    {
+        t0 = now();
+        res = disc.Probe(pattern);
+        if (res < 0)
+        {
+            printf("* probe FAILED\n%s\n", disc.GetError());
+            return -1;
+        }
+        printf("* %d display(s) on %d port(s) in %.1f msec\n",
+               res, disc.GetCount(), now() - t0);
+        printResults(disc);
+        return 0;
+    }
+
+    char names[NCAND][64];
+    const char *ports[NCAND];
+    int masters[NCAND];
+    int keep[NCAND];
+    int nm = NDISP + NSILENT;
+    int i;
+
+    for (i = 0; i < nm; ++i)
+    {
+        masters[i] = posix_openpt(O_RDWR | O_NOCTTY);
+        if ((masters[i] < 0) || grantpt(masters[i]) || unlockpt(masters[i]))
+        {
+            perror("could not create the stand-in ports");
+            return -1;
+        }
+        snprintf(names[i], sizeof(names[i]), "%s", ptsname(masters[i]));
+        // keep the pty alive between probes
+        keep[i] = open(names[i], O_RDWR | O_NOCTTY);
+    }
+    snprintf(names[nm], sizeof(names[nm]), "/dev/nonexistent-tty");
+    for (i = 0; i < NCAND; ++i) ports[i] = names[i];
+
+    pid_t pid = fork();
+    if (!pid) standin(masters, nm);
+    for (i = 0; i < nm; ++i)
+    {
+        close(masters[i]);
+        close(keep[i]);
+    }
+
+    // one port at a time
+    double tseq = 0;
+    int nseq = 0;
+    printf("* probing %d ports one at a time\n", NCAND);
+    for (i = 0; i < NCAND; ++i)
+    {
+        t0 = now();
+        res = disc.Probe(&ports[i], 1);
+        tseq += now() - t0;
+        if (res > 0) nseq += res;
+        printResults(disc);
+    }
+    printf("  %d display(s) in %.1f msec\n", nseq, tseq);
+
+    // all at once
+    printf("* probing %d ports at once\n", NCAND);
+    t0 = now();
+    res = disc.Probe(ports, NCAND);
+    double tpar = now() - t0;
+    if (res < 0)
+    {
+        printf("  FAILED\n%s\n", disc.GetError());
+        kill(pid, SIGTERM);
+        return -1;
+    }
+    printResults(disc);
+    printf("  %d display(s) in %.1f msec (%.1fx faster)\n", res, tpar, tseq / tpar);
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+
+    if ((res != NDISP) || (nseq != NDISP))
+    {
+        printf("* FAILED: expected %d displays\n", NDISP);
+        return -1;
+    }
+    for (i = 0; i < NDISP; ++i)
+    {
+        if (strcmp(disc.GetDisplayPort(i), ports[i]))
+        {
+            printf("* FAILED: display %d reported on %s\n", i, disc.GetDisplayPort(i));
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,212 @@
+/**
+    file: testdither.cpp
+
+    This program converts test.img to the display's 8-bit colour format
+    with each dithering method, checks the SIMD conversion against the
+    scalar version and reports the PSNR, conversion time and upload
+    size.  With a serial device it also draws each version.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <string.h>
+
+#include "oled.h"
+#include "quantize.h"
+
+extern char *optarg;
+extern int optopt;
+
+using namespace disp;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: testdither {-p serial_device} {-n passes} {-h}\n");
+    fprintf(stderr, "\t-p: serial_device (default: none, host-side figures only)\n");
+    fprintf(stderr, "\t-n: number of passes per measurement (default 50)\n");
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+// elapsed time in microseconds
+double elapsed(struct timeval ts, struct timeval te)
+{
+    return (te.tv_sec - ts.tv_sec) * 1e6 + (te.tv_usec - ts.tv_usec);
+}
+
+#define IMGW (320)
+#define IMGH (240)
+
+int main(int argc, char **argv)
+{
+    const char *port = NULL;
+    int npass = 50;
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":p:n:h")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 'p')
+        {
+            port = optarg;
+            continue;
+        }
+        if (inchar == 'n')
+        {
+            npass = atoi(optarg);
+            if (npass < 1) npass = 1;
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+
+    unsigned char *src = new unsigned char[IMGW * IMGH * 2];
+    FILE *fp = fopen("test.img", "r");
+    if ((!fp) || (fread(src, 2, IMGW * IMGH, fp) != IMGW * IMGH))
+    {
+        if (fp) fclose(fp);
+        printf("* cannot load test.img\n");
+        delete [] src;
+        return -1;
+    }
+    fclose(fp);
+
+    unsigned char *ref = new unsigned char[IMGW * IMGH];
+    unsigned char *out[3];
+    int i, k, pass;
+    for (i = 0; i < 3; ++i) out[i] = new unsigned char[IMGW * IMGH];
+
+    // odd widths exercise the columns which are not whole SIMD blocks
+    const int SW[3] = { IMGW, 317, 5 };
+    const PGDDITHER DM[3] = { DI_NONE, DI_ORDERED, DI_DIFFUSION };
+    const char DN[3][12] = { "none", "ordered", "diffusion" };
+    printf("* Checking SIMD against scalar conversion: ");
+    for (i = 0; i < 3; ++i)
+    {
+        for (k = 0; k < 3; ++k)
+        {
+            PGDQuantize(src, PF_RGB565, SW[k], IMGH, DM[i], ref, false);
+            PGDQuantize(src, PF_RGB565, SW[k], IMGH, DM[i], out[i], true);
+            if (memcmp(ref, out[i], SW[k] * IMGH))
+            {
+                printf("FAILED (%d x %d, %s)\n", SW[k], IMGH, DN[i]);
+                return -1;
+            }
+        }
+    }
+    printf("OK\n");
+
+    struct timeval ts, te;
+    double psnr, tq, tsc;
+    printf("* %d x %d: %d bytes at 16 bits, %d bytes at 8 bits\n", IMGW, IMGH,
+           IMGW * IMGH * 2, IMGW * IMGH);
+    for (i = 0; i < 3; ++i)
+    {
+        gettimeofday(&ts, NULL);
+        for (pass = 0; pass < npass; ++pass)
+            PGDQuantize(src, PF_RGB565, IMGW, IMGH, DM[i], out[i]);
+        gettimeofday(&te, NULL);
+        tq = elapsed(ts, te) / npass;
+        gettimeofday(&ts, NULL);
+        for (pass = 0; pass < npass; ++pass)
+            PGDQuantize(src, PF_RGB565, IMGW, IMGH, DM[i], ref, false);
+        gettimeofday(&te, NULL);
+        tsc = elapsed(ts, te) / npass;
+        psnr = PGDPsnr(src, PF_RGB565, IMGW, IMGH, out[i]);
+        printf("* dither %-9s: PSNR %.2f dB, %.2f msec per image (scalar %.2f msec)\n",
+               DN[i], psnr, tq / 1000.0, tsc / 1000.0);
+    }
+
+    if (!port)
+    {
+        for (i = 0; i < 3; ++i) delete [] out[i];
+        delete [] ref;
+        delete [] src;
+        return 0;
+    }
+
+    PGD oled;
+    printf("* Attempting to connect to display: ");
+    if (oled.Connect(port))
+    {
+        printf("FAILED\n%s\n", oled.GetError());
+        for (i = 0; i < 3; ++i) delete [] out[i];
+        delete [] ref;
+        delete [] src;
+        return -1;
+    }
+    printf("OK\n");
+
+    oled.Clear();
+    printf("* Draw Icon, 16-bit: ");
+    fflush(stdout);
+    gettimeofday(&ts, NULL);
+    if (oled.DrawIcon(0, 0, IMGW, IMGH, 16, src, IMGW * IMGH * 2))
+    {
+        printf("FAILED\n%s\n", oled.GetError());
+    }
+    else
+    {
+        gettimeofday(&te, NULL);
+        printf("OK (%.1f msec)\n", elapsed(ts, te) / 1000.0);
+    }
+    usleep(3000000);
+
+    for (i = 0; i < 3; ++i)
+    {
+        oled.Clear();
+        printf("* Draw Icon, 8-bit, dither %s: ", DN[i]);
+        fflush(stdout);
+        gettimeofday(&ts, NULL);
+        if (oled.DrawIcon(0, 0, IMGW, IMGH, 8, out[i], IMGW * IMGH))
+        {
+            printf("FAILED\n%s\n", oled.GetError());
+        }
+        else
+        {
+            gettimeofday(&te, NULL);
+            printf("OK (%.1f msec)\n", elapsed(ts, te) / 1000.0);
+        }
+        usleep(3000000);
+    }
+
+    oled.Close();
+    for (i = 0; i < 3; ++i) delete [] out[i];
+    delete [] ref;
+    delete [] src;
+    return 0;
+}
@@ -0,0 +1,272 @@
+/**
+    file: testgauges.cpp
+
+    This program updates a dashboard of 25 bar gauges and 25 needle
+    dials, every one of them changing each frame, and reports the bytes
+    and link time per frame when the screen is repainted, when each
+    changed widget is redrawn and when the widgets change in place.  The
+    in-place result is checked against a full repaint, both drawn on the
+    simulated display (see comsim.h).  With a serial device it also times
+    each method.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <string.h>
+
+#include "oled.h"
+#include "cmdbuf.h"
+#include "widget.h"
+#include "comsim.h"
+
+extern char *optarg;
+extern int optopt;
+
+using namespace disp;
+using namespace com;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: testgauges {-p serial_device} {-n frames} {-h}\n");
+    fprintf(stderr, "\t-p: serial_device (default: none, host-side figures only)\n");
+    fprintf(stderr, "\t-n: number of frames (default: 100)\n");
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+// elapsed time in microseconds
+double elapsed(struct timeval ts, struct timeval te)
+{
+    return (te.tv_sec - ts.tv_sec) * 1e6 + (te.tv_usec - ts.tv_usec);
+}
+
+#define SCRW (320)
+#define SCRH (240)
+#define NBAR (25)
+#define NDIAL (25)
+#define BLACK (0x0000)
+#define WHITE (0xffff)
+#define GREEN (0x07e0)
+#define GREY (0x7bef)
+#define RED (0xf800)
+#define NAVY (0x0010)
+
+// a 5 x 5 grid of dials on the left and a column of bars on the right
+struct DASH {
+    PGDPANEL body;
+    PGDNEEDLE *dial[NDIAL];
+    PGDGAUGE *bar[NBAR];
+
+    DASH() : body(0, 0, SCRW - 1, SCRH - 1, NAVY)
+    {
+        int i;
+        for (i = 0; i < NDIAL; ++i)
+            dial[i] = new PGDNEEDLE(16 + 32 * (i % 5), 16 + 32 * (i / 5), 14, 0, 100,
+                                    135, 405, 6, BLACK, RED, WHITE);
+        for (i = 0; i < NBAR; ++i)
+            bar[i] = new PGDGAUGE(170, 2 + 9 * i, 315, 7 + 9 * i, 0, 100, GREEN, GREY);
+    }
+    ~DASH()
+    {
+        int i;
+        for (i = 0; i < NDIAL; ++i) delete dial[i];
+        for (i = 0; i < NBAR; ++i) delete bar[i];
+    }
+    void attach(PGDSCREEN *scr)
+    {
+        int i;
+        scr->Add(&body);
+        for (i = 0; i < NDIAL; ++i) scr->Add(dial[i], &body);
+        for (i = 0; i < NBAR; ++i) scr->Add(bar[i], &body);
+    }
+    // every widget takes a random step; with <redraw> each is damaged whole
+    void update(PGDSCREEN *scr, bool redraw)
+    {
+        int i, v;
+        for (i = 0; i < NDIAL; ++i)
+        {
+            v = dial[i]->GetValue() + rand() % 11 - 5;
+            dial[i]->SetValue((v < 0) ? 0 : ((v > 100) ? 100 : v));
+            if (redraw) scr->Damage(dial[i]->GetRect());
+        }
+        for (i = 0; i < NBAR; ++i)
+        {
+            v = bar[i]->GetValue() + rand() % 11 - 5;
+            bar[i]->SetValue((v < 0) ? 0 : ((v > 100) ? 100 : v));
+            if (redraw) scr->Damage(bar[i]->GetRect());
+        }
+    }
+};
+
+// the screen on which the recorded commands are drawn
+static COMSIM screen;
+
+// draw the recorded commands; fails if any is not drawn
+static int replay(const PGDCMDBUF *buf)
+{
+    SIMSTATS ss = screen.GetStats();
+    if (buf->GetLength() && (screen.Write(buf->GetData(), buf->GetLength()) < 0)) return -1;
+    screen.Flush();
+    if ((screen.GetStats().nacked != ss.nacked) || (screen.GetStats().undrawn != ss.undrawn))
+        return -1;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *port = NULL;
+    int nframes = 100;
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":p:n:h")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 'p')
+        {
+            port = optarg;
+            continue;
+        }
+        if (inchar == 'n')
+        {
+            nframes = atoi(optarg);
+            if (nframes < 1) nframes = 1;
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+
+    PGDSCREEN scr(SCRW, SCRH, BLACK);
+    DASH dash;
+    dash.attach(&scr);
+
+    if (screen.SetSize(SCRW, SCRH) || screen.Open("replay"))
+    {
+        printf("FAILED\n%s\n", screen.GetError());
+        return -1;
+    }
+
+    PGDCMDBUF buf;
+    buf.Reserve(65536, 2048);
+    static ushort result[SCRH * SCRW];
+    struct timeval ts, te;
+    int i, mode;
+    long bytes, cmds;
+    const char *MODE[3] = { "full repaint", "widget redraw", "in place" };
+
+    for (mode = 0; mode < 3; ++mode)
+    {
+        srand(1);
+        scr.Invalidate();
+        buf.Clear();
+        scr.Render(&buf);
+        replay(&buf);
+        bytes = 0;
+        cmds = 0;
+        gettimeofday(&ts, NULL);
+        for (i = 0; i < nframes; ++i)
+        {
+            dash.update(&scr, mode == 1);
+            if (mode == 0) scr.Invalidate();
+            buf.Clear();
+            if (scr.Render(&buf))
+            {
+                printf("FAILED\n%s\n", scr.GetError());
+                return -1;
+            }
+            bytes += buf.GetLength();
+            cmds += buf.GetCount();
+            if (replay(&buf))
+            {
+                printf("* %s: unexpected command\n", MODE[mode]);
+                return -1;
+            }
+        }
+        gettimeofday(&te, NULL);
+        printf("* %s: %.1f bytes/frame, %.1f commands/frame, render %.1f usec/frame\n",
+               MODE[mode], (double)bytes / nframes, (double)cmds / nframes,
+               elapsed(ts, te) / nframes);
+        printf("\testimated link time at 115200 bps: %.1f msec/frame (5 Hz allows 200)\n",
+               bytes * 10000.0 / 115200.0 / nframes);
+
+        // the last frame drawn from scratch must match
+        memcpy(result, screen.GetFrame(), sizeof(result));
+        scr.Invalidate();
+        buf.Clear();
+        scr.Render(&buf);
+        replay(&buf);
+        if (memcmp(result, screen.GetFrame(), sizeof(result)))
+        {
+            printf("\tMISMATCH with a full repaint\n");
+            return -1;
+        }
+    }
+
+    if (!port) return 0;
+
+    PGD oled;
+    printf("* Attempting to connect to display: ");
+    if (oled.Connect(port))
+    {
+        printf("FAILED\n%s\n", oled.GetError());
+        return -1;
+    }
+    printf("OK\n");
+
+    scr.Reserve(65536, 2048);
+    for (mode = 0; mode < 3; ++mode)
+    {
+        oled.Clear();
+        scr.Invalidate();
+        scr.Flush(&oled);
+        gettimeofday(&ts, NULL);
+        for (i = 0; i < nframes; ++i)
+        {
+            dash.update(&scr, mode == 1);
+            if (mode == 0) scr.Invalidate();
+            if (scr.Flush(&oled))
+            {
+                printf("* %s: FAILED\n%s\n", MODE[mode], scr.GetError());
+                break;
+            }
+        }
+        gettimeofday(&te, NULL);
+        printf("* %s on display: %.1f msec/frame\n", MODE[mode], elapsed(ts, te) / nframes / 1000.0);
+    }
+
+    oled.Close();
+    return 0;
+}
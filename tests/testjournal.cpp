@@ -0,0 +1,285 @@
+/**
+    file: testjournal.cpp
+
+    This program measures how long the screen stays blank after the
+    display resets.  It talks to the stand-in (see standin.h), which
+    takes the time a real serial line would need at the selected rate.
+    When the stand-in is reset its screen is cleared, it ignores
+    everything for a while and then waits for autobaud at 9600.  It
+    reports the time from the reset until its screen matches the one
+    before the reset.  A dashboard is drawn and the display reset, first
+    with the application reconnecting and redrawing and then with the
+    screen journal enabled; finally a reset is found with CheckReset()
+    while idle.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "oled.h"
+#include "standin.h"
+
+extern char *optarg;
+extern int optopt;
+
+using namespace disp;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: testjournal {-n nupdates} {-h}\n");
+    fprintf(stderr, "\t-n: tile updates before the reset (default: 200)\n");
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+#define SIZE (128)
+
+// what the stand-in reports for 'X'
+struct REPORT {
+    double blank;       // msec from the reset until the screen was restored
+    int restored;
+    int commands;       // commands received from the reset until then
+};
+
+// notes when the screen shown before a reset has been restored
+class JOURNALSTANDIN : public STANDIN
+{
+private:
+    ushort before[SIZE * SIZE];
+    double treset;
+    REPORT rep;
+
+protected:
+    void Resetting(void)
+    {
+        memcpy(before, GetFrame(), sizeof(before));
+        treset = now();
+        memset(&rep, 0, sizeof(rep));
+        return;
+    }
+    void Executed(const char * /*cmd*/, int /*len*/)
+    {
+        if (treset <= 0.0) return;
+        ++rep.commands;
+        if (!memcmp(GetFrame(), before, sizeof(before)))
+        {
+            rep.blank = now() - treset;
+            rep.restored = 1;
+            treset = 0.0;
+        }
+        return;
+    }
+    int Report(char *data, int /*maxlen*/)
+    {
+        memcpy(data, &rep, sizeof(rep));
+        return sizeof(rep);
+    }
+
+public:
+    JOURNALSTANDIN()
+    {
+        treset = 0.0;
+        memset(&rep, 0, sizeof(rep));
+    }
+};
+
+/* the dashboard: 16 tiles of 32x32, each with a background, a frame
+   and a needle showing its value */
+#define NTILES (16)
+static int value[NTILES];
+
+static int drawTile(PGD &oled, int t)
+{
+    int x = (t % 4) * 32;
+    int y = (t / 4) * 32;
+    int v = value[t];
+    ushort color = (v * 2111) & 0xffff;
+    int res = oled.PenSize(SOLID);
+    if (!res) res = oled.Rectangle(x, y, x + 31, y + 31, color);
+    if (!res) res = oled.PenSize(WIREFRAME);
+    if (!res) res = oled.Rectangle(x + 1, y + 1, x + 30, y + 30, 0xffff);
+    if (!res) res = oled.Line(x + 16, y + 16, x + 2 + (v % 28), y + 2 + (v / 28) % 28, 0xf800);
+    return res;
+}
+
+static int drawAll(PGD &oled)
+{
+    int res = oled.Clear();
+    for (int t = 0; (t < NTILES) && (!res); ++t) res = drawTile(oled, t);
+    return res;
+}
+
+static int update(PGD &oled, int i)
+{
+    int t = (i * 7) % NTILES;
+    value[t] = (value[t] + 37 + i) % 784;
+    return drawTile(oled, t);
+}
+
+static int report(STANDIN &standin, const char *title)
+{
+    REPORT rep;
+    if (standin.GetReport(&rep, sizeof(rep)))
+    {
+        printf("  %s: could not read the stand-in's report\n", title);
+        return -1;
+    }
+    if (!rep.restored)
+    {
+        printf("  %s: FAILED, the screen was not restored\n", title);
+        return -1;
+    }
+    printf("  %s: screen blank for %.0f msec (%d commands after the reset)\n",
+           title, rep.blank, rep.commands);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int nupdates = 200;
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":n:h")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 'n')
+        {
+            nupdates = atoi(optarg);
+            if (nupdates < 1)
+            {
+                fprintf(stderr, "invalid number of updates: '%s'\n", optarg);
+                return -1;
+            }
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+
+    JOURNALSTANDIN standin;
+    if (standin.Start(true)) return -1;
+    const char *slave = standin.GetDevice();
+    printf("* stand-in device at %s\n", slave);
+
+    PGD oled;
+    int i;
+    int res = 0;
+    double t0;
+
+    // without the journal the application notices a failed command,
+    // reconnects and redraws the whole screen
+    printf("* without the journal\n");
+    memset(value, 0, sizeof(value));
+    if (oled.Connect(slave) || drawAll(oled))
+        res = -1;
+    for (i = 0; (i < nupdates) && (!res); ++i) res = update(oled, i);
+    if (!res)
+    {
+        int shown[NTILES];
+        memcpy(shown, value, sizeof(value));
+        standin.Reset();
+        t0 = now();
+        res = update(oled, i);
+        printf("  the next update failed (%d) after %.0f msec\n", res, now() - t0);
+        // redraw what was shown, then make the update again
+        memcpy(value, shown, sizeof(value));
+        oled.Close();
+        res = oled.Connect(slave);
+        if (!res) res = drawAll(oled);
+        printf("  reconnected and redrawn after %.0f msec\n", now() - t0);
+        if (!res) res = update(oled, i);
+        if (!res) res = report(standin, "without the journal");
+    }
+    oled.Close();
+
+    // with the journal PGD finds the reset and replays the screen
+    if (!res)
+    {
+        printf("* with the journal\n");
+        memset(value, 0, sizeof(value));
+        res = oled.SetJournal(65536);
+        if (!res) res = oled.Connect(slave);
+        if (!res) res = drawAll(oled);
+        for (i = 0; (i < nupdates) && (!res); ++i) res = update(oled, i);
+    }
+    if (!res)
+    {
+        const PGDJOURNALSTATS &js = oled.GetJournalStats();
+        printf("  journal: %lu commands recorded, %lu kept (%lu bytes), %lu removed\n",
+               js.recorded, js.entries, js.bytes, js.collapsed);
+        standin.Reset();
+        t0 = now();
+        res = update(oled, i);
+        const PGDRESETSTATS &xs = oled.GetResetStats();
+        printf("  the next update returned %d after %.0f msec: reset found in %.0f msec,"
+               " %lu commands replayed in %.0f msec\n", res, now() - t0, xs.detect,
+               xs.replayed, xs.replay);
+        if ((!res) && (xs.restored != 1))
+        {
+            printf("  FAILED: the screen was not restored by PGD\n");
+            res = -1;
+        }
+        // the update itself changed the screen after it was restored
+        if (!res) res = report(standin, "with the journal");
+    }
+
+    // a reset while idle is found by CheckReset()
+    if (!res)
+    {
+        printf("* idle\n");
+        standin.Reset();
+        usleep(STANDINBOOT * 1000);
+        t0 = now();
+        res = oled.CheckReset();
+        const PGDRESETSTATS &xs = oled.GetResetStats();
+        printf("  CheckReset() returned %d after %.0f msec (%lu commands replayed)\n",
+               res, now() - t0, xs.replayed);
+        if (res == 1)
+            res = report(standin, "idle");
+        else
+            res = -1;
+        if ((!res) && (oled.CheckReset() != 0))
+        {
+            printf("  FAILED: a second check found another reset\n");
+            res = -1;
+        }
+    }
+    if (res) printf("* FAILED\n%s\n", oled.GetError());
+
+    oled.Close();
+    standin.Stop();
+    return res;
+}
@@ -0,0 +1,255 @@
+/**
+    file: testlayout.cpp
+
+    This program compares a screen built from a compiled layout
+    (test.lay) against the same screen drawn by hand-coded calls.
+    Without a serial device only the host-side build time and the
+    number of bytes on the wire are reported.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <errno.h>
+#include <string.h>
+
+#include "oled.h"
+#include "cmdbuf.h"
+#include "layout.h"
+
+
+#define WHITE (0xffff)
+#define BLACK (0x0000)
+#define RED (0xf800)
+#define GREEN (0x07e0)
+#define BLUE (0x001f)
+#define YELLOW (0xffe0)
+
+extern char *optarg;
+extern int optopt;
+
+using namespace disp;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: testlayout {-p serial_device} {-f layout} {-n iterations} {-h}\n");
+    fprintf(stderr, "\t-p: serial_device (default: none, host-side figures only)\n");
+    fprintf(stderr, "\t-f: layout file (default test.lay)\n");
+    fprintf(stderr, "\t-n: iterations for the build time test (default 1000)\n");
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+// elapsed time in microseconds
+double elapsed(struct timeval ts, struct timeval te)
+{
+    return (te.tv_sec - ts.tv_sec) * 1e6 + (te.tv_usec - ts.tv_usec);
+}
+
+const char *LABELS[8] = { "Flow (l/min)", "Pressure (kPa)", "Temperature (C)", "Status",
+                          "Inlet valve", "Outlet valve", "Run time (h)", "Alarms" };
+const char *VALUES[8] = { "  1250.5", "   310.2", "    41.7", "RUNNING ",
+                          "OPEN    ", "OPEN    ", "   18233", "       0" };
+
+// draw one of the two value panels of test.lay the way application code does it
+template <class T> int handPanel(T *dev, int panel, const char **values)
+{
+    int i;
+    int y = panel ? 132 : 36;
+    int res = dev->PenSize(SOLID);
+    if (!res) res = dev->Rectangle(4, y, 235, y + 89, BLACK);
+    if (!res) res = dev->PenSize(WIREFRAME);
+    if (!res) res = dev->Rectangle(4, y, 235, y + 89, WHITE);
+    for (i = 0; (i < 4) && (!res); ++i)
+    {
+        res = dev->ScaleString(10, y + 8 + 20 * i, 1, YELLOW, 1, 1, LABELS[panel * 4 + i]);
+        if (!res) res = dev->ScaleString(150, y + 8 + 20 * i, 1,
+                                         ((panel * 4 + i) == 7) ? RED : WHITE,
+                                         1, 1, values[panel * 4 + i]);
+    }
+    return res;
+}
+
+// the hand-coded equivalent of test.lay
+template <class T> int handScreen(T *dev, const char **values)
+{
+    int res = dev->PenSize(SOLID);
+    if (!res) res = dev->Rectangle(0, 0, 239, 29, BLUE);
+    if (!res) res = dev->SetOpacity(TRANSPARENT);
+    if (!res) res = dev->ScaleString(6, 8, 2, WHITE, 1, 1, "PUMP STATION 4");
+    if (!res) res = handPanel(dev, 0, values);
+    if (!res) res = handPanel(dev, 1, values);
+    if (!res) res = dev->Button(false, 10, 262, GREEN, 2, BLACK, 1, 1, "START");
+    if (!res) res = dev->Button(false, 130, 262, RED, 2, BLACK, 1, 1, "STOP");
+    return res;
+}
+
+int main(int argc, char **argv)
+{
+    const char *port = NULL;
+    const char *layfile = "test.lay";
+    int niter = 1000;
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":p:f:n:h")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 'p')
+        {
+            port = optarg;
+            continue;
+        }
+        if (inchar == 'f')
+        {
+            layfile = optarg;
+            continue;
+        }
+        if (inchar == 'n')
+        {
+            niter = atoi(optarg);
+            if (niter < 1) niter = 1;
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+
+    PGDLAYOUT lay;
+    struct timeval ts, te;
+    int i;
+
+    printf("* Load and compile layout '%s': ", layfile);
+    if (lay.Load(layfile) || lay.Compile())
+    {
+        printf("FAILED\n%s\n", lay.GetError());
+        return -1;
+    }
+    printf("OK (%d fields)\n", lay.GetFieldCount());
+
+    // host-side build time: layout compilation versus recording the hand-coded calls
+    gettimeofday(&ts, NULL);
+    for (i = 0; i < niter; ++i)
+    {
+        lay.Clear();
+        lay.Load(layfile);
+        lay.Compile();
+    }
+    gettimeofday(&te, NULL);
+    printf("* Layout build (parse + compile): %.1f usec\n", elapsed(ts, te) / niter);
+
+    PGDCMDBUF hand;
+    gettimeofday(&ts, NULL);
+    for (i = 0; i < niter; ++i)
+    {
+        hand.Clear();
+        handScreen(&hand, VALUES);
+    }
+    gettimeofday(&te, NULL);
+    printf("* Hand-coded encode: %.1f usec\n", elapsed(ts, te) / niter);
+
+    const PGDCMDBUF *sb = lay.GetStatic();
+    const PGDCMDBUF *fb = lay.GetSlots();
+    printf("* Full screen\n");
+    printf("\tlayout    : %d bytes, %d commands (static %d + fields %d bytes)\n",
+           sb->GetLength() + fb->GetLength(), sb->GetCount() + fb->GetCount(),
+           sb->GetLength(), fb->GetLength());
+    printf("\thand-coded: %d bytes, %d commands\n", hand.GetLength(), hand.GetCount());
+
+    PGDCMDBUF panel;
+    handPanel(&panel, 0, VALUES);
+    const PGDFIELD *fld = lay.GetField(0);
+    int flen = fb->GetOffset(fld->cmd + 2) - fb->GetOffset(fld->cmd);
+    printf("* Single field update\n");
+    printf("\tlayout    : %d bytes, 2 commands\n", flen);
+    printf("\thand-coded: %d bytes, %d commands (panel redraw)\n",
+           panel.GetLength(), panel.GetCount());
+
+    // an item added after Compile() leaves no stale fields behind
+    PGDLAYOUT more;
+    more.Load(layfile);
+    more.Compile();
+    more.AddBox(0, 0, 9, 9, 0xffff, true);
+    bool stale = more.IsCompiled() || more.GetFieldCount() || (!more.SetFieldText(0, "0"));
+    more.Compile();
+    stale = stale || (more.GetFieldCount() != lay.GetFieldCount());
+    printf("* Add after Compile: %s\n", stale ? "FAILED" : "OK");
+    if (stale) return -1;
+
+    if (!port) return 0;
+
+    PGD oled;
+    printf("* Attempting to connect to display: ");
+    if (oled.Connect(port))
+    {
+        printf("FAILED\n%s\n", oled.GetError());
+        return -1;
+    }
+    printf("OK\n");
+
+    oled.Clear();
+    gettimeofday(&ts, NULL);
+    int res = handScreen(&oled, VALUES);
+    gettimeofday(&te, NULL);
+    printf("* Hand-coded screen: %s, %.1f msec\n", res ? "FAIL" : "OK", elapsed(ts, te) / 1000.0);
+    if (res) printf("%s\n", oled.GetError());
+    usleep(1000000);
+
+    oled.Clear();
+    for (i = 0; i < lay.GetFieldCount(); ++i) lay.SetFieldText(i, VALUES[i]);
+    gettimeofday(&ts, NULL);
+    res = lay.Draw(&oled);
+    gettimeofday(&te, NULL);
+    printf("* Layout screen: %s, %.1f msec\n", res ? "FAIL" : "OK", elapsed(ts, te) / 1000.0);
+    if (res) printf("%s\n", lay.GetError());
+    usleep(1000000);
+
+    gettimeofday(&ts, NULL);
+    for (i = 0; i < 10; ++i) handPanel(&oled, 0, VALUES);
+    gettimeofday(&te, NULL);
+    printf("* Hand-coded panel update: %.1f msec\n", elapsed(ts, te) / 10000.0);
+
+    char val[16];
+    gettimeofday(&ts, NULL);
+    for (i = 0; i < 10; ++i)
+    {
+        snprintf(val, 16, "%8d", 1000 + i);
+        lay.SetField(&oled, 0, val);
+    }
+    gettimeofday(&te, NULL);
+    printf("* Layout field update: %.1f msec\n", elapsed(ts, te) / 10000.0);
+
+    oled.Close();
+    return 0;
+}
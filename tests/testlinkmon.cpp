@@ -0,0 +1,256 @@
+/**
+    file: testlinkmon.cpp
+
+    This program exercises the link quality monitor.  Without a display
+    it talks to the stand-in (see standin.h), which takes the time a
+    real serial line would need at the selected rate and which, while
+    the line is "noisy", loses or garbles commands at the higher rates
+    (115200: 10% NACK, 2% no response; 57600: 0.5% NACK).  The same
+    workload is run with the monitor only measuring and with automatic
+    rate changes; the line is then made clean to see the rate raised
+    again.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "oled.h"
+#include "standin.h"
+
+extern char *optarg;
+extern int optopt;
+
+using namespace disp;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: testlinkmon {-p serial_device} {-n ncmds} {-h}\n");
+    fprintf(stderr, "\t-p: serial_device (default: none, stand-in device)\n");
+    fprintf(stderr, "\t-n: commands in each run (default: 500)\n");
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+// the line of the stand-in is noisy until it is notified; then NACKs or
+// loses the given share (per 1000) of the rectangles at each rate
+class NOISYSTANDIN : public STANDIN
+{
+private:
+    bool noisy;
+
+protected:
+    SIACTION Filter(const char *cmd, int /*len*/)
+    {
+        int nack = 0;
+        int lost = 0;
+        if ((!noisy) || (cmd[0] != 'r')) return SI_EXEC;
+        if (GetRate() == DB_115200)
+        {
+            nack = 100;
+            lost = 20;
+        }
+        if (GetRate() == DB_57600) nack = 5;
+        int r = rand() % 1000;
+        if (r < lost) return SI_LOSE;
+        if (r < lost + nack) return SI_NACK;
+        return SI_EXEC;
+    }
+    void Notified(void)
+    {
+        noisy = false;
+        return;
+    }
+
+public:
+    NOISYSTANDIN()
+    {
+        noisy = true;
+        srand(1);
+    }
+};
+
+static const char *rateName(DBAUD rate)
+{
+    switch (rate)
+    {
+        case DB_9600:
+            return "9600";
+        case DB_57600:
+            return "57600";
+        case DB_115200:
+            return "115200";
+        case DB_128000:
+            return "128000";
+        case DB_256000:
+            return "256000";
+    }
+    return "?";
+}
+
+static const char *reasonName(PGDLQREASON reason)
+{
+    switch (reason)
+    {
+        case LQ_ERRORS:
+            return "errors";
+        case LQ_CLEAN:
+            return "clean";
+        case LQ_SLOWER:
+            return "slower";
+        default:
+            break;
+    }
+    return "none";
+}
+
+// draw <ncmds> rectangles; stop early once <until> returns true
+static int run(PGD &oled, const char *title, int ncmds, bool (*until)(PGD &) = NULL)
+{
+    oled.ResetLinkQuality();
+    int i, res;
+    int ok = 0;
+    int fault = 0;
+    double t0 = now();
+    for (i = 0; i < ncmds; ++i)
+    {
+        res = oled.Rectangle(i % 100, i % 100, i % 100 + 20, i % 100 + 20, i & 0xffff);
+        if (!res) ++ok;
+        if (res < 0) ++fault;
+        if (until && until(oled))
+        {
+            ++i;
+            break;
+        }
+    }
+    double dt = (now() - t0) / 1000.0;
+
+    const PGDLINKQUAL &lq = oled.GetLinkQuality();
+    printf("* %s\n", title);
+    printf("  %d commands in %.2f s: %d ok, %lu NACK, %lu timeout, %d fault\n",
+           i, dt, ok, lq.nacks, lq.timeouts, fault);
+    printf("  effective throughput %.0f bytes/s (%.0f bytes/s while busy)\n",
+           ok * 11 / dt, (lq.busy > 0.0) ? lq.okbytes / lq.busy : 0.0);
+    printf("  rate %s; %lu down, %lu up, %lu reverted, %lu failed",
+           rateName(lq.rate), lq.downshifts, lq.upshifts, lq.reverts, lq.shiftfails);
+    if (lq.reason != LQ_NONE)
+        printf("; last %s -> %s (%s) at %.2f s", rateName(lq.from), rateName(lq.to),
+               reasonName(lq.reason), lq.when);
+    printf("\n");
+    return (fault) ? -1 : 0;
+}
+
+static bool raised(PGD &oled)
+{
+    return oled.GetLinkQuality().upshifts > 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *devname = NULL;
+    int ncmds = 500;
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":p:n:h")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 'p')
+        {
+            devname = optarg;
+            continue;
+        }
+        if (inchar == 'n')
+        {
+            ncmds = atoi(optarg);
+            if (ncmds < 1)
+            {
+                fprintf(stderr, "invalid number of commands: '%s'\n", optarg);
+                return -1;
+            }
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+
+    NOISYSTANDIN standin;
+    if (!devname)
+    {
+        if (standin.Start(true)) return -1;
+        devname = standin.GetDevice();
+        printf("* stand-in device at %s\n", devname);
+    }
+
+    PGD oled;
+    if (oled.Connect(devname))
+    {
+        printf("* Connect: FAILED\n%s\n", oled.GetError());
+        return -1;
+    }
+
+    int res = run(oled, "monitor measuring only, noisy line", ncmds);
+
+    PGDLQPARAMS lp;
+    lp.autoshift = true;
+    lp.upclean = 100;
+    lp.holdoff = 1000;
+    if ((!res) && oled.SetLinkMonitor(lp))
+    {
+        printf("* SetLinkMonitor: FAILED\n%s\n", oled.GetError());
+        res = -1;
+    }
+    if (!res) res = run(oled, "automatic rate changes, noisy line", ncmds);
+    if ((!res) && (oled.GetBaud() == DB_115200))
+    {
+        printf("  FAILED: the rate was not lowered\n");
+        res = -1;
+    }
+
+    if ((!res) && standin.IsRunning())
+    {
+        standin.Notify();
+        res = run(oled, "automatic rate changes, clean line", ncmds * 10, raised);
+        // the higher rate must survive its trial
+        if (!res) res = run(oled, "automatic rate changes, clean line (continued)", ncmds);
+        if ((!res) && (oled.GetBaud() != DB_115200))
+        {
+            printf("  FAILED: the rate was not raised\n");
+            res = -1;
+        }
+    }
+
+    oled.Close();
+    standin.Stop();
+    return res;
+}
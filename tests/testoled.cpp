@@ -22,6 +22,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <sys/time.h>
 #include <errno.h>
@@ -47,9 +48,11 @@ const float pi = 3.1415927;
 
 void printUsage(void)
 {
-    fprintf(stderr, "Usage: testoled {-p serial_device} {-b} {-h}\n");
+    fprintf(stderr, "Usage: testoled {-p serial_device} {-b} {-a kbytes} {-c cache_file} {-h}\n");
     fprintf(stderr, "\t-p: serial_device (default /dev/ttyUSB0)\n");
     fprintf(stderr, "\t-b: include `replace background' test\n");
+    fprintf(stderr, "\t-a: size of the staging arena in kbytes (default 0, no arena)\n");
+    fprintf(stderr, "\t-c: device capability cache file (default: none)\n");
     fprintf(stderr, "\t-h: display usage and exit\n");
     return;
 }
@@ -115,9 +118,11 @@ int main(int argc, char **argv)
 {
     const char *port = "/dev/ttyUSB0";
     bool test_bkgd = false;
+    unsigned int arenasize = 0;
+    const char *capfile = NULL;
 
     int inchar;
-    while ((inchar = getopt(argc, argv, ":p:hb")) > 0)
+    while ((inchar = getopt(argc, argv, ":p:a:c:hb")) > 0)
     {
         if (inchar == 'h')
         {
@@ -134,6 +139,16 @@ int main(int argc, char **argv)
             port = optarg;
             continue;
         }
+        if (inchar == 'a')
+        {
+            arenasize = atoi(optarg) * 1024;
+            continue;
+        }
+        if (inchar == 'c')
+        {
+            capfile = optarg;
+            continue;
+        }
         if (inchar == '?')
         {
             fprintf(stderr, "unknown option: '%c'\n", optopt);
@@ -153,6 +168,11 @@ int main(int argc, char **argv)
     GLOBS globs;
     globs.wait = false;
     oled.SetCallback(usrcb, &globs);
+    if ((oled.SetArena(arenasize)) || (oled.SetCapCache(capfile)))
+    {
+        printf("%s\n", oled.GetError());
+        return -1;
+    }
 
     // horizontal center of display
     unsigned short midx;
@@ -178,7 +198,10 @@ int main(int argc, char **argv)
 
 
 
+    int i;
+    struct timeval ts, te;
     printf("\n\n* Attempting to connect to display: ");
+    gettimeofday(&ts, NULL);
     if (oled.Connect(port))
     {
         printf("FAILED\n");
@@ -186,14 +209,16 @@ int main(int argc, char **argv)
         fflush(stdout);
         return -1;
     }
+    gettimeofday(&te, NULL);
     printf("OK\n");
+    calctime(ts, te);
+    if (oled.GetCaps().rev != SGC_UNKNOWN)
+        printf("* Command set: %s\n", (oled.GetCaps().rev == SGC_R11) ? "R11" : "R4");
 
     printf("* Baud code: 0x%.2X\n", oled.GetBaud());
 
     // NOTE: The version response is significantly delayed
     // if we request the information to be displayed on the screen.
-    int i;
-    struct timeval ts, te;
     for (i = 0; i < 2; ++i)
     {
         if (i == 0)
@@ -822,19 +847,27 @@ goto LATEST;
 
     // TEST: int  DrawIcon(ushort x, ushort y, ushort width, ushort height,
     //              uchar colormode, const uchar *data, int datalen)
-    oled.Ctl(4, 1); // Landscape format; note as per documentation that it is the
-                    // default orientation setting and not the current orientation
-                    // setting which affects the rendering of Draw Image Icon
-    oled.Clear();
-    printf("* Draw Icon (render image): ");
-    fflush(stdout);
+    // the image is rotated on the host so that it appears upright; in
+    // PORTRAIT the part which is off the screen is trimmed
     do {
-        unsigned short data[76800];
+        static unsigned short data[76800];
         size_t fs;
         FILE *fp = fopen("test.img", "r");
-        if ((fp) && ((fs = fread(data, 2, 76800, fp)) == 76800))
+        if ((!fp) || ((fs = fread(data, 2, 76800, fp)) != 76800))
+        {
+            if (fp) fclose(fp);
+            printf("* Draw Icon (render image): FAIL (cannot load image): %s\n",
+                   (fs >= 0) ? "file is too short" : strerror(errno));
+            break;
+        }
+        fclose(fp);
+        static const uchar iconorient[2] = { LANDSCAPE_R, PORTRAIT };
+        for (i = 0; i < 2; ++i)
         {
-            fclose(fp);
+            oled.Ctl(4, iconorient[i]);
+            oled.Clear();
+            printf("* Draw Icon (render image, %s): ", OR[iconorient[i] - 1]);
+            fflush(stdout);
             gettimeofday(&ts, NULL);
             switch (oled.DrawIcon(0, 0, 320, 240, 16, (unsigned char *)data, 153600))
             {
@@ -853,12 +886,13 @@ goto LATEST;
                     printf("FAIL (see message below)\n%s\n", oled.GetError());
                     break;
             }
+            usleep(2000000);
         }
-        else
-        {
-            if (fp) fclose(fp);
-            printf("FAIL (cannot load image): %s\n", (fs >= 0) ? "file is too short" : strerror(errno));
-        }
+    } while (0);
+    do {
+        const PGDMEMSTATS &ms = oled.GetMemStats();
+        printf("* Arena: capacity %u, in use %u, peak %u, steady %u, allocations %u, misses %u\n",
+               ms.capacity, ms.inuse, ms.peak, ms.steady, ms.allocs, ms.failures);
     } while (0);
     usleep(2000);
     oled.Ctl(4, 3); // Portrait format
@@ -0,0 +1,375 @@
+/**
+    file: testpixbatch.cpp
+
+    This program draws a scatter plot and sparklines pixel by pixel
+    into a pixel batch, checks that the coalesced commands reproduce
+    the pixels and reports the commands and bytes compared with one
+    WritePixel per pixel.  On the simulated display it checks that a
+    batch honours a pen size set with Transmit().  With a serial device
+    it also times both methods.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <string.h>
+#include <math.h>
+
+#include "oled.h"
+#include "cmdbuf.h"
+#include "pixbatch.h"
+#include "comsim.h"
+
+extern char *optarg;
+extern int optopt;
+
+using namespace disp;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: testpixbatch {-p serial_device} {-h}\n");
+    fprintf(stderr, "\t-p: serial_device (default: none, host-side figures only)\n");
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+// elapsed time in microseconds
+double elapsed(struct timeval ts, struct timeval te)
+{
+    return (te.tv_sec - ts.tv_sec) * 1e6 + (te.tv_usec - ts.tv_usec);
+}
+
+#define SCRW (320)
+#define SCRH (240)
+// marks pixels not written
+#define NOPIX (0x10000)
+
+// the last write to each pixel
+static int expected[SCRH][SCRW];
+// the result of the recorded commands
+static int drawn[SCRH][SCRW];
+
+// anything which can write pixels: PGD, PGDPIXBATCH or the reference
+class REFPIX {
+    public:
+        int WritePixel(ushort x, ushort y, ushort color)
+        {
+            if ((x < SCRW) && (y < SCRH)) expected[y][x] = color;
+            return 0;
+        }
+};
+
+template <class T>
+static void plotPoint(T *dev, int x, int y, ushort color)
+{
+    dev->WritePixel(x, y, color);
+}
+
+// scatter plot: single dots, 3x3 square markers and 4x4 multicolor markers
+template <class T>
+static void scatter(T *dev)
+{
+    int i, dx, dy, x, y;
+    srand(1);
+    for (i = 0; i < 200; ++i)
+        plotPoint(dev, rand() % SCRW, rand() % SCRH, 0xffff);
+    for (i = 0; i < 60; ++i)
+    {
+        x = rand() % (SCRW - 3);
+        y = rand() % (SCRH - 3);
+        for (dy = 0; dy < 3; ++dy)
+            for (dx = 0; dx < 3; ++dx) plotPoint(dev, x + dx, y + dy, 0xf800);
+    }
+    for (i = 0; i < 30; ++i)
+    {
+        x = rand() % (SCRW - 4);
+        y = rand() % (SCRH - 4);
+        for (dy = 0; dy < 4; ++dy)
+            for (dx = 0; dx < 4; ++dx)
+                plotPoint(dev, x + dx, y + dy, (dx + dy) & 1 ? 0x07e0 : 0x001f);
+    }
+}
+
+// sparklines: 4 traces across the screen joined with Bresenham lines
+template <class T>
+static void sparklines(T *dev)
+{
+    int s, i, x0, y0, x1, y1, dx, dy, sx, sy, err, e2;
+    const ushort col[4] = { 0xffe0, 0x07ff, 0xf81f, 0xffff };
+    for (s = 0; s < 4; ++s)
+    {
+        x0 = 0;
+        y0 = s * 60 + 30;
+        for (i = 1; i < SCRW / 4; ++i)
+        {
+            x1 = i * 4;
+            y1 = s * 60 + 30 + (int)(20 * sin(i * (0.15 + 0.05 * s)) + 6 * sin(i * 0.9));
+            dx = abs(x1 - x0);
+            dy = -abs(y1 - y0);
+            sx = (x0 < x1) ? 1 : -1;
+            sy = (y0 < y1) ? 1 : -1;
+            err = dx + dy;
+            while (true)
+            {
+                plotPoint(dev, x0, y0, col[s]);
+                if ((x0 == x1) && (y0 == y1)) break;
+                e2 = 2 * err;
+                if (e2 >= dy)
+                {
+                    err += dy;
+                    x0 += sx;
+                }
+                if (e2 <= dx)
+                {
+                    err += dx;
+                    y0 += sy;
+                }
+            }
+        }
+    }
+}
+
+// diagonal lines as drawn by testoled
+template <class T>
+static void diagonals(T *dev)
+{
+    int i;
+    for (i = 0; i < SCRH; ++i)
+    {
+        plotPoint(dev, i, i, 0xffff);
+        plotPoint(dev, SCRW - 1 - i, i, 0xffff);
+    }
+}
+
+#define GETW(p) ((((p)[0] & 0xff) << 8) | ((p)[1] & 0xff))
+
+// draw the recorded commands; only the forms produced by PGDPIXBATCH are handled
+static int replay(const PGDCMDBUF *buf)
+{
+    int i, j, x, y, x1, y1, x2, y2, w, h;
+    const char *cp;
+    for (y = 0; y < SCRH; ++y)
+        for (x = 0; x < SCRW; ++x) drawn[y][x] = NOPIX;
+
+    for (i = 0; i < buf->GetCount(); ++i)
+    {
+        cp = buf->GetData() + buf->GetOffset(i);
+        x1 = GETW(&cp[1]);
+        y1 = GETW(&cp[3]);
+        switch (cp[0])
+        {
+            case 'P':
+                drawn[y1][x1] = GETW(&cp[5]);
+                break;
+            case 'L':
+            case 'r':
+                x2 = GETW(&cp[5]);
+                y2 = GETW(&cp[7]);
+                if ((cp[0] == 'L') && (x1 != x2) && (y1 != y2)) return -1;
+                for (y = y1; y <= y2; ++y)
+                    for (x = x1; x <= x2; ++x) drawn[y][x] = GETW(&cp[9]);
+                break;
+            case 'I':
+                w = GETW(&cp[5]);
+                h = GETW(&cp[7]);
+                for (j = 0; j < w * h; ++j)
+                    drawn[y1 + j / w][x1 + j % w] = GETW(&cp[10 + j * 2]);
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    return memcmp(expected, drawn, sizeof(expected)) ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *port = NULL;
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":p:h")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 'p')
+        {
+            port = optarg;
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+
+    const char NAME[3][12] = { "scatter", "sparklines", "diagonals" };
+    PGDPIXBATCH batch;
+    PGDCMDBUF buf;
+    REFPIX ref;
+    int i, x, y;
+    for (i = 0; i < 3; ++i)
+    {
+        for (y = 0; y < SCRH; ++y)
+            for (x = 0; x < SCRW; ++x) expected[y][x] = NOPIX;
+        batch.Clear();
+        buf.Clear();
+        switch (i)
+        {
+            case 0:
+                scatter(&ref);
+                scatter(&batch);
+                break;
+            case 1:
+                sparklines(&ref);
+                sparklines(&batch);
+                break;
+            default:
+                diagonals(&ref);
+                diagonals(&batch);
+                break;
+        }
+        if (batch.Render(&buf))
+        {
+            printf("* %s: FAILED\n%s\n", NAME[i], batch.GetError());
+            return -1;
+        }
+        const PGDPIXSTATS &st = batch.GetStats();
+        printf("* %s: %d writes, %d pixels -> %d points, %d lines, %d rects, %d icons: ",
+               NAME[i], st.writes, st.pixels, st.points, st.lines, st.rects, st.icons);
+        if (replay(&buf))
+        {
+            printf("MISMATCH\n");
+            return -1;
+        }
+        printf("OK\n");
+        printf("  %d commands, %d bytes (%d bytes and %d commands as WritePixel, %.1fx)\n",
+               buf.GetCount(), st.bytes, st.rawbytes, st.writes,
+               (double)st.rawbytes / st.bytes);
+    }
+
+    // a pen size sent with Transmit() must be seen by Flush(): with a
+    // wireframe pen a solid block must still be drawn in full
+    {
+        com::COMSIM sim;
+        PGD oled;
+        oled.SetTransport(&sim);
+        printf("* pen size after Transmit(): ");
+        buf.Clear();
+        buf.PenSize(WIREFRAME);
+        buf.Rectangle(0, 0, 9, 9, 0x001f);
+        if (oled.Connect("sim") || oled.Transmit(&buf))
+        {
+            printf("FAILED\n%s\n", oled.GetError());
+            return -1;
+        }
+        batch.Clear();
+        for (y = 20; y < 28; ++y)
+            for (x = 20; x < 28; ++x) batch.WritePixel(x, y, 0xf800);
+        int res = batch.Flush(&oled);
+        const unsigned short *fb = sim.GetFrame();
+        int missing = 0;
+        for (y = 20; y < 28; ++y)
+            for (x = 20; x < 28; ++x)
+                if (fb[y * sim.GetWidth() + x] != 0xf800) ++missing;
+        if (res || (oled.GetPenSize() != WIREFRAME) || missing)
+        {
+            printf("FAILED (pen %d, %d pixels missing)\n", oled.GetPenSize(), missing);
+            return -1;
+        }
+        printf("OK\n");
+        oled.Close();
+    }
+
+    if (!port) return 0;
+
+    PGD oled;
+    printf("* Attempting to connect to display: ");
+    if (oled.Connect(port))
+    {
+        printf("FAILED\n%s\n", oled.GetError());
+        return -1;
+    }
+    printf("OK\n");
+
+    struct timeval ts, te;
+    int res;
+    for (i = 0; i < 3; ++i)
+    {
+        oled.Clear();
+        printf("* %s with WritePixel: ", NAME[i]);
+        fflush(stdout);
+        gettimeofday(&ts, NULL);
+        switch (i)
+        {
+            case 0:
+                scatter(&oled);
+                break;
+            case 1:
+                sparklines(&oled);
+                break;
+            default:
+                diagonals(&oled);
+                break;
+        }
+        gettimeofday(&te, NULL);
+        printf("%.1f msec\n", elapsed(ts, te) / 1000.0);
+
+        oled.Clear();
+        printf("* %s with a pixel batch: ", NAME[i]);
+        fflush(stdout);
+        batch.Clear();
+        gettimeofday(&ts, NULL);
+        switch (i)
+        {
+            case 0:
+                scatter(&batch);
+                break;
+            case 1:
+                sparklines(&batch);
+                break;
+            default:
+                diagonals(&batch);
+                break;
+        }
+        res = batch.Flush(&oled);
+        gettimeofday(&te, NULL);
+        if (res)
+            printf("FAILED\n%s\n", batch.GetError());
+        else
+            printf("%.1f msec\n", elapsed(ts, te) / 1000.0);
+        usleep(2000000);
+    }
+
+    oled.Close();
+    return 0;
+}
@@ -0,0 +1,226 @@
+/**
+    file: testretry.cpp
+
+    This program exercises the automatic retry of commands whose response
+    timed out.  Without a display it talks to the stand-in (see
+    standin.h), which here loses 6% of the commands or their ACKs; the
+    stand-in counts how many times each command was executed so that
+    the program can check that only idempotent commands were repeated.
+    The same workload is run without retries and with the default
+    retries.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "oled.h"
+#include "standin.h"
+
+extern char *optarg;
+extern int optopt;
+
+using namespace disp;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: testretry {-n ncmds} {-h}\n");
+    fprintf(stderr, "\t-n: commands in each run (default: 400)\n");
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+// per 1000 commands: the command is lost / the ACK is lost
+#define LOSTCMD (30)
+#define LOSTACK (30)
+
+// commands in the workload; 'v' is a relative volume step
+static const char ops[] = "rFsv";
+#define NOPS (4)
+
+// executions of each command, kept by the stand-in and read with 'X'
+struct COUNTS {
+    unsigned int exec[NOPS];
+};
+
+// loses some of the commands of the workload or their ACKs
+class RETRYSTANDIN : public STANDIN
+{
+private:
+    COUNTS counts;
+
+protected:
+    SIACTION Filter(const char *cmd, int /*len*/)
+    {
+        const char *op = strchr(ops, cmd[0]);
+        if (!op) return SI_EXEC;
+        int r = rand() % 1000;
+        if (r < LOSTCMD) return SI_LOSE;
+        ++counts.exec[op - ops];
+        if (r < LOSTCMD + LOSTACK) return SI_MUTE;
+        return SI_EXEC;
+    }
+    int Report(char *data, int /*maxlen*/)
+    {
+        memcpy(data, &counts, sizeof(counts));
+        memset(&counts, 0, sizeof(counts));
+        return sizeof(counts);
+    }
+
+public:
+    RETRYSTANDIN()
+    {
+        memset(&counts, 0, sizeof(counts));
+        srand(7);
+    }
+};
+
+// run the workload; returns the number of commands which the
+// application saw fail, or -1 for a fault
+static int run(PGD &oled, STANDIN &standin, int ncmds, int nretries)
+{
+    unsigned int sent[NOPS] = { 0 };
+    unsigned int fails[NOPS] = { 0 };
+    int i, res, op;
+    const char *title = (nretries) ? "with retries" : "without retries";
+
+    if (oled.Connect(standin.GetDevice()) || oled.SetRetries(nretries))
+    {
+        printf("* %s: FAILED\n%s\n", title, oled.GetError());
+        return -1;
+    }
+    oled.ResetRetryStats();
+
+    double t0 = now();
+    for (i = 0; i < ncmds; ++i)
+    {
+        op = i % NOPS;
+        switch (op)
+        {
+            case 0:
+                res = oled.Rectangle(i % 100, 10, i % 100 + 20, 30, 0x07e0);
+                break;
+            case 1:
+                res = oled.SetFont(i & 1);
+                break;
+            case 2:
+                res = oled.ShowString(0, 1, FNT_SMALL, 0xffff, "Retried!");
+                break;
+            default:
+                res = oled.SetVolume((i & 1) ? VOL_UP : VOL_DOWN);
+                break;
+        }
+        ++sent[op];
+        if (res) ++fails[op];
+        if (res < 0)
+        {
+            printf("* %s: FAILED\n%s\n", title, oled.GetError());
+            oled.Close();
+            return -1;
+        }
+    }
+    double dt = (now() - t0) / 1000.0;
+
+    // the stand-in answers on the port used by PGD; the count request
+    // goes through a second descriptor on the same terminal
+    COUNTS counts;
+    res = standin.GetReport(&counts, sizeof(counts));
+    oled.Close();
+    if (res)
+    {
+        printf("* %s: could not read the stand-in's counts\n", title);
+        return -1;
+    }
+
+    const PGDRETRYSTATS &rs = oled.GetRetryStats();
+    static const char *names[NOPS] = { "Rectangle", "SetFont", "ShowString", "SetVolume(+/-)" };
+    int visible = 0;
+    printf("* %s: %d commands in %.2f s\n", title, ncmds, dt);
+    printf("  %-15s %6s %6s %9s\n", "command", "sent", "failed", "executed");
+    for (op = 0; op < NOPS; ++op)
+    {
+        printf("  %-15s %6u %6u %9u\n", names[op], sent[op], fails[op], counts.exec[op]);
+        visible += fails[op];
+    }
+    printf("  timeouts %lu: %lu not idempotent, %lu retried (%lu resends), "
+           "%lu recovered, %lu failed\n", rs.timeouts, rs.unsafe, rs.retried,
+           rs.resends, rs.recovered, rs.failed);
+
+    // a relative volume step must never be executed twice
+    if (counts.exec[3] > sent[3])
+    {
+        printf("  FAILED: SetVolume was repeated\n");
+        return -1;
+    }
+    return visible;
+}
+
+int main(int argc, char **argv)
+{
+    int ncmds = 400;
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":n:h")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 'n')
+        {
+            ncmds = atoi(optarg);
+            if (ncmds < NOPS)
+            {
+                fprintf(stderr, "invalid number of commands: '%s'\n", optarg);
+                return -1;
+            }
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+
+    RETRYSTANDIN standin;
+    if (standin.Start()) return -1;
+    printf("* stand-in device at %s\n", standin.GetDevice());
+
+    PGD oled;
+    int plain = run(oled, standin, ncmds, 0);
+    int retried = (plain < 0) ? -1 : run(oled, standin, ncmds, PGDRETRIES);
+
+    standin.Stop();
+
+    if ((plain < 0) || (retried < 0)) return -1;
+    printf("* failures seen by the application: %d without retries, %d with retries\n",
+           plain, retried);
+    return (retried < plain) ? 0 : -1;
+}
@@ -0,0 +1,454 @@
+/**
+    file: testrotate.cpp
+
+    This program checks the image rotation against fixed patterns and
+    the SIMD version against the scalar one, checks where DrawIcon puts
+    an image on a simulated display in each orientation and that a large
+    rotated image sent in bands matches one sent whole, and reports the
+    rotation throughput in megapixels per second.  With a serial
+    device it also draws test.img in each orientation.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <string.h>
+
+#include "oled.h"
+#include "rotate.h"
+#include "comsim.h"
+
+extern char *optarg;
+extern int optopt;
+
+using namespace disp;
+using namespace com;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: testrotate {-p serial_device} {-n passes} {-h}\n");
+    fprintf(stderr, "\t-p: serial_device (default: none, host-side figures only)\n");
+    fprintf(stderr, "\t-n: number of passes per measurement (default 200)\n");
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+// elapsed time in microseconds
+double elapsed(struct timeval ts, struct timeval te)
+{
+    return (te.tv_sec - ts.tv_sec) * 1e6 + (te.tv_usec - ts.tv_usec);
+}
+
+#define IMGW (320)
+#define IMGH (240)
+
+/* a 3 x 2 image and its clockwise rotations by 0..3 quarter turns:
+       1 2 3      4 1      6 5 4      3 6
+       4 5 6      5 2      3 2 1      2 5
+                  6 3                 1 4 */
+static const unsigned char pattern[6] = { 1, 2, 3, 4, 5, 6 };
+static const unsigned char rotated[4][6] = {
+    { 1, 2, 3, 4, 5, 6 },
+    { 4, 1, 5, 2, 6, 3 },
+    { 6, 5, 4, 3, 2, 1 },
+    { 3, 6, 2, 5, 1, 4 }
+};
+
+// rotate the pattern with <bpp> bytes per pixel; returns 0 if it matches
+static int checkPattern(int bpp, int turns, bool simd)
+{
+    unsigned char src[12];
+    unsigned char dst[12];
+    int i, j;
+    for (i = 0; i < 6; ++i)
+        for (j = 0; j < bpp; ++j) src[i * bpp + j] = pattern[i] + 0x10 * j;
+    if (PGDRotate(src, 3, 3, 2, bpp, turns, dst, simd)) return -1;
+    for (i = 0; i < 6; ++i)
+        for (j = 0; j < bpp; ++j)
+            if (dst[i * bpp + j] != rotated[turns][i] + 0x10 * j) return -1;
+    return 0;
+}
+
+/* the corners of an image in clockwise order from the top left; a
+   clockwise quarter turn moves each to the next */
+static int corner(int c, int w, int h)
+{
+    switch (c & 3)
+    {
+        case 1:
+            return w - 1;
+        case 2:
+            return w * h - 1;
+        case 3:
+            return (h - 1) * w;
+        default:
+            break;
+    }
+    return 0;
+}
+
+// rotate a <w> x <h> image whose corners are marked; returns 0 if each
+// corner lands where it should
+static int checkCorners(int w, int h, int bpp, int turns, bool simd, unsigned char *src,
+                        unsigned char *dst)
+{
+    int c, j;
+    memset(src, 0, w * h * bpp);
+    for (c = 0; c < 4; ++c)
+        for (j = 0; j < bpp; ++j) src[corner(c, w, h) * bpp + j] = 0x11 * (c + 1) + j;
+    if (PGDRotate(src, w, w, h, bpp, turns, dst, simd)) return -1;
+    int dw = (turns & 1) ? h : w;
+    int dh = (turns & 1) ? w : h;
+    for (c = 0; c < 4; ++c)
+        for (j = 0; j < bpp; ++j)
+            if (dst[corner(c + turns, dw, dh) * bpp + j] != 0x11 * (c + 1) + j) return -1;
+    return 0;
+}
+
+// the simulated display; not square so that the axes cannot be mixed up
+#define SIMW (160)
+#define SIMH (128)
+#define ICONX (10)
+#define ICONY (20)
+#define ICONW (4)
+#define ICONH (2)
+
+/* where the top left and bottom right pixels of the icon must appear on
+   the simulated display in its native (LANDSCAPE) orientation; PORTRAIT
+   is a clockwise quarter turn from LANDSCAPE */
+static const int iconpos[4][4] = {
+    {  10,  20,  13,  21 },     // LANDSCAPE
+    { 149, 107, 146, 106 },     // LANDSCAPE_R
+    { 139,  10, 138,  13 },     // PORTRAIT
+    {  20, 117,  21, 114 }      // PORTRAIT_R
+};
+
+// draw an icon in each orientation on a simulated display and check
+// where it lands; returns 0 for success
+static int checkIcon(void)
+{
+    const char OR[4][12] = {"LANDSCAPE", "LANDSCAPE_R", "PORTRAIT", "PORTRAIT_R"};
+    COMSIM sim;
+    PGD oled;
+    unsigned char icon[ICONW * ICONH * 2];
+    int i, o;
+
+    // the pixels are numbered; the color is big-endian
+    for (i = 0; i < ICONW * ICONH; ++i)
+    {
+        icon[2 * i] = 0xf8;
+        icon[2 * i + 1] = i + 1;
+    }
+    if (sim.SetSize(SIMW, SIMH))
+    {
+        printf("FAILED\n%s\n", sim.GetError());
+        return -1;
+    }
+    // the display size is needed to map the position of the icon
+    PGDVER ver;
+    oled.SetTransport(&sim);
+    if (oled.Connect("sim") || oled.Version(&ver, false))
+    {
+        printf("FAILED\n%s\n", oled.GetError());
+        return -1;
+    }
+
+    for (o = LANDSCAPE; o <= PORTRAIT_R; ++o)
+    {
+        if (oled.Ctl(DM_ORIENT, o) || oled.Clear()
+            || oled.DrawIcon(ICONX, ICONY, ICONW, ICONH, 16, icon, sizeof(icon)))
+        {
+            printf("FAILED\n%s\n", oled.GetError());
+            return -1;
+        }
+        const ushort *fb = sim.GetFrame();
+        const int *pos = iconpos[o - 1];
+        if ((fb[pos[1] * SIMW + pos[0]] != 0xf801)
+            || (fb[pos[3] * SIMW + pos[2]] != 0xf800 + ICONW * ICONH))
+        {
+            printf("FAILED (%s: the icon is misplaced or turned the wrong way)\n", OR[o - 1]);
+            return -1;
+        }
+
+        // the icon must match the same pixels written in this orientation
+        SIMIMAGE drawn, written;
+        sim.GetImage(&drawn);
+        oled.Clear();
+        for (i = 0; i < ICONW * ICONH; ++i)
+            oled.WritePixel(ICONX + i % ICONW, ICONY + i / ICONW, 0xf801 + i);
+        sim.GetImage(&written);
+        if (drawn.Compare(written))
+        {
+            printf("FAILED (%s: the icon differs from its pixels)\n", OR[o - 1]);
+            return -1;
+        }
+    }
+    oled.Close();
+    return 0;
+}
+
+// a rotated icon too large for PGDICONBUF, partly off the screen in
+// the portrait orientations
+#define BANDX (20)
+#define BANDY (10)
+#define BANDW (120)
+#define BANDH (100)
+
+// without an arena a large rotated icon is sent in bands of rows; it must
+// look the same as the icon staged whole in the arena; returns 0 for success
+static int checkBands(void)
+{
+    const char OR[4][12] = {"LANDSCAPE", "LANDSCAPE_R", "PORTRAIT", "PORTRAIT_R"};
+    static unsigned char icon[BANDW * BANDH * 2];
+    COMSIM sim;
+    PGD oled;
+    PGDVER ver;
+    SIMIMAGE banded, whole;
+    int i, o;
+
+    for (i = 0; i < BANDW * BANDH; ++i)
+    {
+        icon[2 * i] = (i * 7) >> 8;
+        icon[2 * i + 1] = i & 0xff;
+    }
+    oled.SetTransport(&sim);
+    if (sim.SetSize(SIMW, SIMH) || oled.Connect("sim") || oled.Version(&ver, false))
+    {
+        printf("FAILED\n%s\n", oled.GetError());
+        return -1;
+    }
+
+    for (o = LANDSCAPE_R; o <= PORTRAIT_R; ++o)
+    {
+        unsigned long ncmds = sim.GetStats().commands;
+        if (oled.SetArena(0) || oled.Ctl(DM_ORIENT, o) || oled.Clear()
+            || oled.DrawIcon(BANDX, BANDY, BANDW, BANDH, 16, icon, sizeof(icon)))
+        {
+            printf("FAILED\n%s\n", oled.GetError());
+            return -1;
+        }
+        ncmds = sim.GetStats().commands - ncmds;
+        sim.GetImage(&banded);
+        if (oled.SetArena(sizeof(icon) + 64) || oled.Clear()
+            || oled.DrawIcon(BANDX, BANDY, BANDW, BANDH, 16, icon, sizeof(icon)))
+        {
+            printf("FAILED\n%s\n", oled.GetError());
+            return -1;
+        }
+        sim.GetImage(&whole);
+        // Ctl, Clear and at least two bands
+        if ((ncmds < 4) || banded.Compare(whole))
+        {
+            printf("FAILED (%s: the bands differ from the whole icon)\n", OR[o - 1]);
+            return -1;
+        }
+    }
+    oled.Close();
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *port = NULL;
+    int npass = 200;
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":p:n:h")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 'p')
+        {
+            port = optarg;
+            continue;
+        }
+        if (inchar == 'n')
+        {
+            npass = atoi(optarg);
+            if (npass < 1) npass = 1;
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+
+    unsigned char *src = new unsigned char[IMGW * IMGH * 2];
+    unsigned char *ref = new unsigned char[IMGW * IMGH * 2];
+    unsigned char *out = new unsigned char[IMGW * IMGH * 2];
+    int i, bpp, turns, pass;
+    for (i = 0; i < IMGW * IMGH * 2; ++i) src[i] = (i * 7 + (i >> 9)) & 0xff;
+
+    // odd sizes exercise the edges which are not whole 8x8 blocks
+    const int SW[3] = { IMGW, 317, 61 };
+    const int SH[3] = { IMGH, 235, 9 };
+    int k;
+    printf("* Checking SIMD against scalar rotation: ");
+    for (bpp = 1; bpp <= 2; ++bpp)
+    {
+        for (k = 0; k < 3; ++k)
+        {
+            for (turns = 0; turns < 4; ++turns)
+            {
+                PGDRotate(src, IMGW, SW[k], SH[k], bpp, turns, ref, false);
+                PGDRotate(src, IMGW, SW[k], SH[k], bpp, turns, out, true);
+                if (memcmp(ref, out, SW[k] * SH[k] * bpp))
+                {
+                    printf("FAILED (%d x %d, %d bpp, %d turns)\n", SW[k], SH[k], bpp * 8, turns);
+                    return -1;
+                }
+            }
+        }
+    }
+    printf("OK\n");
+
+    printf("* Checking the direction of rotation: ");
+    for (bpp = 1; bpp <= 2; ++bpp)
+    {
+        for (turns = 0; turns < 4; ++turns)
+        {
+            if (checkPattern(bpp, turns, false) || checkPattern(bpp, turns, true))
+            {
+                printf("FAILED (3 x 2 pattern, %d bpp, %d turns)\n", bpp * 8, turns);
+                return -1;
+            }
+            for (k = 0; k < 3; ++k)
+            {
+                if (checkCorners(SW[k], SH[k], bpp, turns, false, ref, out)
+                    || checkCorners(SW[k], SH[k], bpp, turns, true, ref, out))
+                {
+                    printf("FAILED (corners of %d x %d, %d bpp, %d turns)\n", SW[k], SH[k],
+                           bpp * 8, turns);
+                    return -1;
+                }
+            }
+        }
+    }
+    printf("OK\n");
+
+    printf("* Checking DrawIcon in each orientation: ");
+    fflush(stdout);
+    if (checkIcon()) return -1;
+    printf("OK\n");
+
+    printf("* Checking large rotated icons sent in bands: ");
+    fflush(stdout);
+    if (checkBands()) return -1;
+    printf("OK\n");
+
+    struct timeval ts, te;
+    double mp = (double)IMGW * IMGH * npass / 1e6;
+    for (bpp = 2; bpp >= 1; --bpp)
+    {
+        for (turns = 1; turns < 4; ++turns)
+        {
+            gettimeofday(&ts, NULL);
+            for (pass = 0; pass < npass; ++pass)
+                PGDRotate(src, IMGW, IMGW, IMGH, bpp, turns, out, false);
+            gettimeofday(&te, NULL);
+            double tsc = elapsed(ts, te);
+            // half turns have no SIMD version
+            if (turns == 2)
+            {
+                printf("* %d-bit, %d x 90 deg: scalar %.1f MP/s\n", bpp * 8, turns,
+                       mp / tsc * 1e6);
+                continue;
+            }
+            gettimeofday(&ts, NULL);
+            for (pass = 0; pass < npass; ++pass)
+                PGDRotate(src, IMGW, IMGW, IMGH, bpp, turns, out, true);
+            gettimeofday(&te, NULL);
+            double tsi = elapsed(ts, te);
+            printf("* %d-bit, %d x 90 deg: scalar %.1f MP/s, SIMD %.1f MP/s\n", bpp * 8,
+                   turns, mp / tsc * 1e6, mp / tsi * 1e6);
+        }
+    }
+
+    delete [] ref;
+    delete [] out;
+    if (!port)
+    {
+        delete [] src;
+        return 0;
+    }
+
+    FILE *fp = fopen("test.img", "r");
+    if ((!fp) || (fread(src, 2, IMGW * IMGH, fp) != IMGW * IMGH))
+    {
+        if (fp) fclose(fp);
+        printf("* cannot load test.img\n");
+        delete [] src;
+        return -1;
+    }
+    fclose(fp);
+
+    PGD oled;
+    printf("* Attempting to connect to display: ");
+    if (oled.Connect(port))
+    {
+        printf("FAILED\n%s\n", oled.GetError());
+        delete [] src;
+        return -1;
+    }
+    printf("OK\n");
+
+    PGDVER ver;
+    if ((oled.Version(&ver, false)) || (!ver.hres)) oled.SetBounds(IMGW, IMGH);
+
+    // draw the image upright in each orientation; in the portrait
+    // orientations only the visible part is sent
+    const char OR[4][12] = {"LANDSCAPE", "LANDSCAPE_R", "PORTRAIT", "PORTRAIT_R"};
+    for (i = LANDSCAPE; i <= PORTRAIT_R; ++i)
+    {
+        oled.Ctl(DM_ORIENT, i);
+        oled.Clear();
+        printf("* Draw Icon in %s: ", OR[i - 1]);
+        fflush(stdout);
+        gettimeofday(&ts, NULL);
+        if (oled.DrawIcon(0, 0, IMGW, IMGH, 16, src, IMGW * IMGH * 2))
+        {
+            printf("FAILED\n%s\n", oled.GetError());
+        }
+        else
+        {
+            gettimeofday(&te, NULL);
+            printf("OK (%.1f msec)\n", elapsed(ts, te) / 1000.0);
+        }
+        usleep(3000000);
+    }
+
+    oled.Ctl(DM_ORIENT, LANDSCAPE);
+    oled.Close();
+    delete [] src;
+    return 0;
+}
@@ -0,0 +1,165 @@
+/**
+    file: testsdlist.cpp
+
+    This program lists a directory of the display's SD card with the
+    streaming and the std::list variants of SDListDirFAT and reports
+    the time to the first entry and to the end of each listing.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <string.h>
+
+#include "oled.h"
+
+extern char *optarg;
+extern int optopt;
+
+using namespace disp;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: testsdlist {-p serial_device} {-m pattern} {-f name} {-h}\n");
+    fprintf(stderr, "\t-p: serial_device (default /dev/ttyUSB0)\n");
+    fprintf(stderr, "\t-m: file pattern (default *.*)\n");
+    fprintf(stderr, "\t-f: stop the streaming listing when this file is found\n");
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+// elapsed time in milliseconds
+double elapsed(struct timeval ts, struct timeval te)
+{
+    return (te.tv_sec - ts.tv_sec) * 1e3 + (te.tv_usec - ts.tv_usec) / 1e3;
+}
+
+struct LISTING {
+    const char *target;     // stop when this name is seen (may be NULL)
+    struct timeval ts;      // start of the listing
+    double first;           // time to the first entry (msec)
+    int count;
+};
+
+bool printEntry(const char *name, int len, void *obj)
+{
+    LISTING *lp = (LISTING *)obj;
+    if (!lp->count)
+    {
+        struct timeval te;
+        gettimeofday(&te, NULL);
+        lp->first = elapsed(lp->ts, te);
+    }
+    ++lp->count;
+    printf("\t%s (%d)\n", name, len);
+    if ((lp->target) && (!strcasecmp(name, lp->target))) return false;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const char *port = "/dev/ttyUSB0";
+    const char *pattern = "*.*";
+    const char *target = NULL;
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":p:m:f:h")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 'p')
+        {
+            port = optarg;
+            continue;
+        }
+        if (inchar == 'm')
+        {
+            pattern = optarg;
+            continue;
+        }
+        if (inchar == 'f')
+        {
+            target = optarg;
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+
+    PGD oled;
+    printf("* Attempting to connect to display: ");
+    if (oled.Connect(port))
+    {
+        printf("FAILED\n%s\n", oled.GetError());
+        return -1;
+    }
+    printf("OK\n");
+
+    if (oled.SDInit())
+    {
+        printf("* SD card initialization FAILED\n%s\n", oled.GetError());
+        oled.Close();
+        return -1;
+    }
+
+    struct timeval te;
+    LISTING lst;
+    lst.target = target;
+    lst.first = 0.0;
+    lst.count = 0;
+    printf("* Streaming listing of '%s':\n", pattern);
+    gettimeofday(&lst.ts, NULL);
+    int res = oled.SDListDirFAT(pattern, printEntry, &lst);
+    gettimeofday(&te, NULL);
+    if (res < 0)
+        printf("FAILED\n%s\n", oled.GetError());
+    else
+        printf("* %d entries; first after %.1f msec, done after %.1f msec\n",
+               res, lst.first, elapsed(lst.ts, te));
+
+    std::list<std::string> dir;
+    struct timeval ts;
+    printf("* List of '%s': ", pattern);
+    fflush(stdout);
+    gettimeofday(&ts, NULL);
+    res = oled.SDListDirFAT(pattern, &dir);
+    gettimeofday(&te, NULL);
+    if (res < 0)
+        printf("FAILED\n%s\n", oled.GetError());
+    else
+        printf("%d entries after %.1f msec\n", res, elapsed(ts, te));
+
+    oled.Close();
+    return 0;
+}
@@ -0,0 +1,283 @@
+/**
+    file: testshadow.cpp
+
+    This program exercises the display shadow kept in a memory-mapped
+    file.  Without a display it talks to the stand-in (see standin.h),
+    which draws what it receives and counts the bytes.  A dashboard is
+    drawn through a shadow file, the shadow is then dropped as if the
+    process had been restarted, and the next frame is drawn by a new
+    shadow which resumes from the file; the bytes sent are compared with
+    those of a restart without the file, and the stand-in's framebuffer
+    is checked against the frame.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "oled.h"
+#include "shadow.h"
+#include "standin.h"
+
+extern char *optarg;
+extern int optopt;
+
+using namespace disp;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: testshadow {-n nframes} {-f file} {-h}\n");
+    fprintf(stderr, "\t-n: frames drawn before the restart (default: 20)\n");
+    fprintf(stderr, "\t-f: shadow file (default: testshadow.map)\n");
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+#define SIZE (128)
+
+// what the stand-in reports for 'X'
+struct REPORT {
+    unsigned long bytes;        // bytes received since the last report
+    unsigned long commands;     // commands received since the last report
+    unsigned long sum;          // checksum of the framebuffer
+};
+
+// checksum of a SIZE x SIZE image
+static unsigned long checksum(const ushort *img)
+{
+    unsigned long sum = 0;
+    for (int i = 0; i < SIZE * SIZE; ++i) sum = sum * 31 + img[i];
+    return sum;
+}
+
+// reports the bytes and commands received and the checksum of the screen
+class SHADOWSTANDIN : public STANDIN
+{
+protected:
+    int Report(char *data, int /*maxlen*/)
+    {
+        REPORT rep;
+        rep.bytes = GetBytes();
+        rep.commands = GetCommands();
+        rep.sum = checksum(GetFrame());
+        ResetCounts();
+        memcpy(data, &rep, sizeof(rep));
+        return sizeof(rep);
+    }
+};
+
+/* the dashboard: 16 gauges of 32x32, each with a background, a frame
+   and a bar showing its value; one gauge changes in each frame */
+#define NGAUGES (16)
+static int value[NGAUGES];
+static ushort frame[SIZE * SIZE];
+
+static void box(int x1, int y1, int x2, int y2, ushort color)
+{
+    for (int y = y1; y <= y2; ++y)
+        for (int x = x1; x <= x2; ++x)
+            frame[y * SIZE + x] = color;
+    return;
+}
+
+static void render(void)
+{
+    for (int g = 0; g < NGAUGES; ++g)
+    {
+        int x = (g % 4) * 32;
+        int y = (g / 4) * 32;
+        box(x, y, x + 31, y + 31, 0x2104);
+        box(x + 1, y + 1, x + 30, y + 30, 0x0010 + g * 0x0841);
+        box(x + 4, y + 24, x + 4 + value[g] % 24, y + 27, 0xf800);
+        // a gradient which cannot be sent as a rectangle
+        for (int i = 0; i < 24; ++i) frame[(y + 6) * SIZE + x + 4 + i] = i * 0x0802 + value[g];
+    }
+    return;
+}
+
+static void step(int i)
+{
+    int g = (i * 7) % NGAUGES;
+    value[g] = (value[g] + 5 + i) % 97;
+    return;
+}
+
+// draw the next frame through the shadow and check what the display shows
+static int drawFrame(PGD &oled, PGDSHADOW &shadow, STANDIN &standin,
+                     const char *title, int i, unsigned long *bytes)
+{
+    step(i);
+    render();
+    double t0 = now();
+    if (shadow.Update(&oled, 0, 0, SIZE, SIZE, frame))
+    {
+        printf("  %s: FAILED\n%s\n", title, shadow.GetError());
+        return -1;
+    }
+    double dt = now() - t0;
+    REPORT rep;
+    if (standin.GetReport(&rep, sizeof(rep)))
+    {
+        printf("  %s: could not read the stand-in's report\n", title);
+        return -1;
+    }
+    if (title)
+    {
+        printf("  %s: %lu bytes in %lu commands, %.0f msec\n", title, rep.bytes,
+               rep.commands, dt);
+    }
+    if (rep.sum != checksum(frame))
+    {
+        printf("  %s: FAILED, the display does not show the frame\n", title ? title : "frame");
+        return -1;
+    }
+    if (bytes) *bytes = rep.bytes;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int nframes = 20;
+    const char *fname = "testshadow.map";
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":n:f:h")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 'n')
+        {
+            nframes = atoi(optarg);
+            if (nframes < 1)
+            {
+                fprintf(stderr, "invalid number of frames: '%s'\n", optarg);
+                return -1;
+            }
+            continue;
+        }
+        if (inchar == 'f')
+        {
+            fname = optarg;
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+
+    SHADOWSTANDIN standin;
+    if (standin.Start(true)) return -1;
+    const char *slave = standin.GetDevice();
+    printf("* stand-in device at %s\n", slave);
+
+    unlink(fname);
+    memset(value, 0, sizeof(value));
+    int i, res = 0;
+    unsigned long full = 0, resumed = 0, fresh = 0;
+
+    // the first process draws the dashboard through the shadow file
+    {
+        PGD oled;
+        PGDSHADOW shadow;
+        printf("* first run\n");
+        if (oled.Connect(slave) || oled.SetBaud(DB_115200))
+        {
+            printf("  FAILED\n%s\n", oled.GetError());
+            res = -1;
+        }
+        if ((!res) && (shadow.Open(fname, SIZE, SIZE) != 1))
+        {
+            printf("  FAILED: a new shadow was not reported\n%s\n", shadow.GetError());
+            res = -1;
+        }
+        if (!res) res = drawFrame(oled, shadow, standin, "first frame", 0, &full);
+        for (i = 1; (i < nframes) && (!res); ++i)
+            res = drawFrame(oled, shadow, standin, NULL, i, NULL);
+        if (!res)
+        {
+            const PGDSHADOWSTATS &ss = shadow.GetStats();
+            printf("  %lu frames: %lu of %lu tiles sent in %lu rectangles and %lu icons,"
+                   " %lu bytes (%lu in full)\n", ss.updates, ss.changed, ss.tiles,
+                   ss.rects, ss.icons, ss.bytes, ss.rawbytes);
+        }
+        // the process stops here; the display keeps its contents
+        oled.Close();
+    }
+
+    // a restarted process resumes from the file
+    if (!res)
+    {
+        PGD oled;
+        PGDSHADOW shadow;
+        printf("* restarted with the shadow file\n");
+        int r = shadow.Open(fname, SIZE, SIZE);
+        if (r || shadow.GetUnknown())
+        {
+            printf("  FAILED: the shadow was not resumed (%d, %d unknown tiles)\n%s\n",
+                   r, shadow.GetUnknown(), shadow.GetError());
+            res = -1;
+        }
+        if ((!res) && (oled.Connect(slave) || oled.SetBaud(DB_115200)))
+        {
+            printf("  FAILED\n%s\n", oled.GetError());
+            res = -1;
+        }
+        if (!res) res = drawFrame(oled, shadow, standin, "next frame", i, &resumed);
+        oled.Close();
+    }
+
+    // without the file a restarted process must redraw everything
+    if (!res)
+    {
+        PGD oled;
+        PGDSHADOW shadow;
+        printf("* restarted without the shadow file\n");
+        ++i;
+        if ((shadow.Open(NULL, SIZE, SIZE) != 1) || oled.Connect(slave)
+            || oled.SetBaud(DB_115200))
+        {
+            printf("  FAILED\n%s\n%s\n", shadow.GetError(), oled.GetError());
+            res = -1;
+        }
+        if (!res) res = drawFrame(oled, shadow, standin, "next frame", i, &fresh);
+        oled.Close();
+    }
+
+    standin.Stop();
+    unlink(fname);
+
+    if (res) return -1;
+    printf("* after a restart: %lu bytes with the shadow file, %lu without "
+           "(first frame %lu)\n", resumed, fresh, full);
+    return (resumed < fresh) ? 0 : -1;
+}
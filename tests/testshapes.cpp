@@ -0,0 +1,347 @@
+/**
+    file: testshapes.cpp
+
+    This program records two gauge designs (an arc gauge and a bar
+    gauge on rounded panels) as composite shapes, checks the recorded
+    commands against the ideal shapes and compares the commands and
+    bytes with sending the gauges as images.  With a serial device it
+    also times both methods.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <string.h>
+#include <math.h>
+
+#include "oled.h"
+#include "cmdbuf.h"
+#include "shapes.h"
+
+extern char *optarg;
+extern int optopt;
+
+using namespace disp;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: testshapes {-p serial_device} {-h}\n");
+    fprintf(stderr, "\t-p: serial_device (default: none, host-side figures only)\n");
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+// elapsed time in microseconds
+double elapsed(struct timeval ts, struct timeval te)
+{
+    return (te.tv_sec - ts.tv_sec) * 1e6 + (te.tv_usec - ts.tv_usec);
+}
+
+#define CARDW (160)
+#define CARDH (120)
+
+#define C_BG     (0x0000)
+#define C_BORDER (0x8410)
+#define C_PANEL  (0x2104)
+#define C_TRACK  (0x4208)
+#define C_VALUE  (0x07e0)
+#define C_NEEDLE (0xf800)
+#define C_HUB    (0xffff)
+
+// arc gauge geometry
+#define GCX (80)
+#define GCY (66)
+#define GRIN (40)
+#define GROUT (50)
+#define GA0 (135.0)
+#define GA1 (405.0)
+
+// bar gauge geometry
+#define BX1 (10)
+#define BY1 (52)
+#define BX2 (149)
+#define BY2 (67)
+
+static ushort img[CARDH][CARDW];
+
+// record a gauge at <value> (0..1)
+static int arcGauge(PGDCMDBUF *buf, double value)
+{
+    double a = GA0 + (GA1 - GA0) * value;
+    int res = PGDRoundFrame(buf, 0, 0, CARDW - 1, CARDH - 1, 10, 2, C_BORDER, C_PANEL);
+    res |= PGDArc(buf, GCX, GCY, GRIN, GROUT, a, GA1, C_TRACK, false);
+    res |= PGDArc(buf, GCX, GCY, GRIN, GROUT, GA0, a, C_VALUE, false);
+    res |= PGDThickLine(buf, GCX, GCY, PGDShapeCoord(GCX + 36 * cos(a * M_PI / 180.0)),
+                        PGDShapeCoord(GCY + 36 * sin(a * M_PI / 180.0)), 4, C_NEEDLE,
+                        true, false);
+    res |= buf->Circle(GCX, GCY, 5, C_HUB);
+    return res;
+}
+
+static int barGauge(PGDCMDBUF *buf, double value)
+{
+    int xv = BX1 + (int)((BX2 - BX1) * value);
+    int res = PGDRoundFrame(buf, 0, 0, CARDW - 1, CARDH - 1, 10, 2, C_BORDER, C_PANEL);
+    res |= PGDRoundRect(buf, BX1, BY1, BX2, BY2, 8, C_TRACK, false);
+    res |= PGDRoundRect(buf, BX1, BY1, xv, BY2, 8, C_VALUE, false);
+    return res;
+}
+
+// ideal shapes, sampled at the pixel positions
+static bool inRound(int x, int y, int x1, int y1, int x2, int y2, int r)
+{
+    if ((x < x1) || (x > x2) || (y < y1) || (y > y2)) return false;
+    if (2 * r > x2 - x1) r = (x2 - x1) / 2;
+    if (2 * r > y2 - y1) r = (y2 - y1) / 2;
+    int cx = (x < x1 + r) ? x1 + r : ((x > x2 - r) ? x2 - r : x);
+    int cy = (y < y1 + r) ? y1 + r : ((y > y2 - r) ? y2 - r : y);
+    return (x - cx) * (x - cx) + (y - cy) * (y - cy) <= r * r;
+}
+
+static bool inArc(int x, int y, double a0, double a1)
+{
+    double d = sqrt((double)(x - GCX) * (x - GCX) + (double)(y - GCY) * (y - GCY));
+    if ((d < GRIN) || (d > GROUT)) return false;
+    double a = atan2((double)(y - GCY), (double)(x - GCX)) * 180.0 / M_PI;
+    while (a < a0) a += 360.0;
+    return a <= a1;
+}
+
+static bool inSegment(int x, int y, double x1, double y1, double x2, double y2, double w)
+{
+    double dx = x2 - x1;
+    double dy = y2 - y1;
+    double t = ((x - x1) * dx + (y - y1) * dy) / (dx * dx + dy * dy);
+    if (t < 0.0) t = 0.0;
+    if (t > 1.0) t = 1.0;
+    double ex = x1 + t * dx - x;
+    double ey = y1 + t * dy - y;
+    return ex * ex + ey * ey <= w * w / 4.0;
+}
+
+static ushort ideal(int design, double value, int x, int y)
+{
+    if (!inRound(x, y, 0, 0, CARDW - 1, CARDH - 1, 10)) return C_BG;
+    if (!inRound(x, y, 2, 2, CARDW - 3, CARDH - 3, 8)) return C_BORDER;
+    if (design == 1)
+    {
+        int xv = BX1 + (int)((BX2 - BX1) * value);
+        if (inRound(x, y, BX1, BY1, xv, BY2, 8)) return C_VALUE;
+        if (inRound(x, y, BX1, BY1, BX2, BY2, 8)) return C_TRACK;
+        return C_PANEL;
+    }
+
+    double a = GA0 + (GA1 - GA0) * value;
+    double ar = a * M_PI / 180.0;
+    if ((x - GCX) * (x - GCX) + (y - GCY) * (y - GCY) <= 25) return C_HUB;
+    if (inSegment(x, y, GCX, GCY, PGDShapeCoord(GCX + 36 * cos(ar)),
+                  PGDShapeCoord(GCY + 36 * sin(ar)), 4.0)) return C_NEEDLE;
+    if (inArc(x, y, GA0, a)) return C_VALUE;
+    if (inArc(x, y, a, GA1)) return C_TRACK;
+    return C_PANEL;
+}
+
+#define GETW(p) ((((p)[0] & 0xff) << 8) | ((p)[1] & 0xff))
+
+// draw the recorded commands with a solid pen; returns -1 for unexpected commands
+static int replay(const PGDCMDBUF *buf)
+{
+    int i, x, y, x1, y1, x2, y2, x3, y3, r;
+    long e1, e2, e3;
+    const char *cp;
+    for (y = 0; y < CARDH; ++y)
+        for (x = 0; x < CARDW; ++x) img[y][x] = C_BG;
+
+    for (i = 0; i < buf->GetCount(); ++i)
+    {
+        cp = buf->GetData() + buf->GetOffset(i);
+        switch (cp[0])
+        {
+            case 'p':
+                if (cp[1] != SOLID) return -1;
+                break;
+            case 'r':
+                x1 = GETW(&cp[1]);
+                y1 = GETW(&cp[3]);
+                x2 = GETW(&cp[5]);
+                y2 = GETW(&cp[7]);
+                for (y = y1; (y <= y2) && (y < CARDH); ++y)
+                    for (x = x1; (x <= x2) && (x < CARDW); ++x) img[y][x] = GETW(&cp[9]);
+                break;
+            case 'C':
+                x1 = GETW(&cp[1]);
+                y1 = GETW(&cp[3]);
+                r = GETW(&cp[5]);
+                for (y = 0; y < CARDH; ++y)
+                    for (x = 0; x < CARDW; ++x)
+                        if ((x - x1) * (x - x1) + (y - y1) * (y - y1) <= r * r)
+                            img[y][x] = GETW(&cp[7]);
+                break;
+            case 'G':
+                x1 = GETW(&cp[1]);
+                y1 = GETW(&cp[3]);
+                x2 = GETW(&cp[5]);
+                y2 = GETW(&cp[7]);
+                x3 = GETW(&cp[9]);
+                y3 = GETW(&cp[11]);
+                // anticlockwise on the screen
+                if ((long)(x2 - x1) * (y3 - y1) - (long)(y2 - y1) * (x3 - x1) >= 0) return -1;
+                for (y = 0; y < CARDH; ++y)
+                {
+                    for (x = 0; x < CARDW; ++x)
+                    {
+                        e1 = (long)(x2 - x1) * (y - y1) - (long)(y2 - y1) * (x - x1);
+                        e2 = (long)(x3 - x2) * (y - y2) - (long)(y3 - y2) * (x - x2);
+                        e3 = (long)(x1 - x3) * (y - y3) - (long)(y1 - y3) * (x - x3);
+                        if ((e1 <= 0) && (e2 <= 0) && (e3 <= 0)) img[y][x] = GETW(&cp[13]);
+                    }
+                }
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *port = NULL;
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":p:h")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 'p')
+        {
+            port = optarg;
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+
+    const char NAME[2][12] = { "arc gauge", "bar gauge" };
+    const double VALUE = 0.6;
+    PGDCMDBUF buf[2];
+    uchar *icon[2];
+    int d, x, y, n, nref;
+    int ibytes = CARDW * CARDH * 2 + 10;
+    for (d = 0; d < 2; ++d)
+    {
+        if ((d ? barGauge(&buf[d], VALUE) : arcGauge(&buf[d], VALUE)) || (replay(&buf[d])))
+        {
+            printf("* %s: FAILED\n%s\n", NAME[d], buf[d].GetError());
+            return -1;
+        }
+
+        // pixels which differ from the ideal shapes
+        n = 0;
+        nref = 0;
+        icon[d] = new uchar[CARDW * CARDH * 2];
+        for (y = 0; y < CARDH; ++y)
+        {
+            for (x = 0; x < CARDW; ++x)
+            {
+                ushort c = ideal(d, VALUE, x, y);
+                if (c != img[y][x]) ++n;
+                if (c != C_BG) ++nref;
+                icon[d][(y * CARDW + x) * 2] = c >> 8;
+                icon[d][(y * CARDW + x) * 2 + 1] = c & 0xff;
+            }
+        }
+        printf("* %s: %d commands, %d bytes; as an image 1 command, %d bytes (%.0fx)\n",
+               NAME[d], buf[d].GetCount(), buf[d].GetLength(), ibytes,
+               (double)ibytes / buf[d].GetLength());
+        printf("  %d of %d pixels (%.2f%%) differ from the ideal shape\n",
+               n, nref, n * 100.0 / nref);
+    }
+
+    if (!port)
+    {
+        delete [] icon[0];
+        delete [] icon[1];
+        return 0;
+    }
+
+    PGD oled;
+    printf("* Attempting to connect to display: ");
+    if (oled.Connect(port))
+    {
+        printf("FAILED\n%s\n", oled.GetError());
+        delete [] icon[0];
+        delete [] icon[1];
+        return -1;
+    }
+    printf("OK\n");
+
+    struct timeval ts, te;
+    for (d = 0; d < 2; ++d)
+    {
+        oled.Clear();
+        printf("* %s as shapes: ", NAME[d]);
+        fflush(stdout);
+        gettimeofday(&ts, NULL);
+        if (oled.Transmit(&buf[d]))
+            printf("FAILED\n%s\n", oled.GetError());
+        else
+        {
+            gettimeofday(&te, NULL);
+            printf("%.1f msec\n", elapsed(ts, te) / 1000.0);
+        }
+        usleep(2000000);
+
+        oled.Clear();
+        printf("* %s as an image: ", NAME[d]);
+        fflush(stdout);
+        gettimeofday(&ts, NULL);
+        if (oled.DrawIcon(0, 0, CARDW, CARDH, 16, icon[d], CARDW * CARDH * 2))
+            printf("FAILED\n%s\n", oled.GetError());
+        else
+        {
+            gettimeofday(&te, NULL);
+            printf("%.1f msec\n", elapsed(ts, te) / 1000.0);
+        }
+        usleep(2000000);
+    }
+
+    // Transmit() does not track the pen
+    oled.PenSize(SOLID);
+    oled.Close();
+    delete [] icon[0];
+    delete [] icon[1];
+    return 0;
+}
@@ -0,0 +1,312 @@
+/**
+    file: testsim.cpp
+
+    This program exercises the simulated display (see comsim.h).  The
+    same dashboard is drawn three ways through PGD on a COMSIM port: with
+    plain commands, with the pixels coalesced by PGDPIXBATCH and with
+    the frames diffed by PGDSHADOW.  The final screens are compared
+    pixel by pixel with SIMIMAGE and must be identical.  The first run
+    also writes periodic snapshots and the last keeps a shared image,
+    which are checked against the screen.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+#include "oled.h"
+#include "pixbatch.h"
+#include "shadow.h"
+#include "comsim.h"
+
+extern char *optarg;
+extern int optopt;
+
+using namespace disp;
+using namespace com;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: testsim {-n nframes} {-k} {-h}\n");
+    fprintf(stderr, "\t-n: frames drawn in each run (default: 20)\n");
+    fprintf(stderr, "\t-k: keep the images (testsim-*.ppm)\n");
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+#define SIZE (128)
+// commands between the snapshots of the first run
+#define SNAPCMDS (200)
+// a pixel on the frame of a gauge
+#define STRAYX (64)
+#define STRAYY (40)
+
+/* the dashboard: 16 gauges of 32x32, each with a frame, a background,
+   a bar showing its value and a row of pixels shaded by the value;
+   one gauge changes in each frame */
+#define NGAUGES (16)
+static int value[NGAUGES];
+
+enum MODE { DIRECT, BATCHED, SHADOWED };
+
+static ushort shade(int g, int i)
+{
+    return i * 0x0802 + value[g];
+}
+
+static void step(int i)
+{
+    int g = (i * 7) % NGAUGES;
+    value[g] = (value[g] + 5 + i) % 97;
+    return;
+}
+
+// draw gauge <g> with commands; the shaded pixels go to <batch> if it is given
+static int drawGauge(PGD &oled, PGDPIXBATCH *batch, int g)
+{
+    int x = (g % 4) * 32;
+    int y = (g / 4) * 32;
+    int res = oled.Rectangle(x, y, x + 31, y + 31, 0x2104);
+    if (!res) res = oled.Rectangle(x + 1, y + 1, x + 30, y + 30, 0x0010 + g * 0x0841);
+    if (!res) res = oled.Rectangle(x + 4, y + 24, x + 4 + value[g] % 24, y + 27, 0xf800);
+    for (int i = 0; (i < 24) && (!res); ++i)
+    {
+        if (batch)
+            res = batch->WritePixel(x + 4 + i, y + 6, shade(g, i));
+        else
+            res = oled.WritePixel(x + 4 + i, y + 6, shade(g, i));
+    }
+    return res;
+}
+
+// render the dashboard on the host for the shadow
+static void render(ushort *frame)
+{
+    int g, x, y, i, j;
+    for (g = 0; g < NGAUGES; ++g)
+    {
+        x = (g % 4) * 32;
+        y = (g / 4) * 32;
+        for (j = 0; j < 32; ++j)
+        {
+            for (i = 0; i < 32; ++i)
+            {
+                ushort c = 0x0010 + g * 0x0841;
+                if ((i == 0) || (j == 0) || (i == 31) || (j == 31))
+                    c = 0x2104;
+                else if ((j >= 24) && (j <= 27) && (i >= 4) && (i <= 4 + value[g] % 24))
+                    c = 0xf800;
+                else if ((j == 6) && (i >= 4) && (i < 28))
+                    c = shade(g, i - 4);
+                frame[(y + j) * SIZE + x + i] = c;
+            }
+        }
+    }
+    return;
+}
+
+// draw the dashboard <nframes> times, then a pixel which is not part of
+// it if <stray> is true; returns 0 for success
+static int run(COMSIM &sim, MODE mode, int nframes, const char *title, bool stray = false)
+{
+    PGD oled;
+    PGDPIXBATCH batch;
+    PGDSHADOW shadow;
+    ushort frame[SIZE * SIZE];
+    int f, g, res;
+
+    memset(value, 0, sizeof(value));
+    oled.SetTransport(&sim);
+    res = oled.Connect("sim");
+    if ((!res) && (mode == SHADOWED) && (shadow.Open(NULL, SIZE, SIZE) < 0))
+    {
+        printf("  %s: FAILED\n%s\n", title, shadow.GetError());
+        return -1;
+    }
+    sim.ResetStats();
+
+    double t0 = now();
+    for (f = 0; (f < nframes) && (!res); ++f)
+    {
+        step(f);
+        if (mode == SHADOWED)
+        {
+            render(frame);
+            res = shadow.Update(&oled, 0, 0, SIZE, SIZE, frame);
+            if (res) printf("  %s: FAILED\n%s\n", title, shadow.GetError());
+            continue;
+        }
+        // the first frame draws every gauge, later frames the one which changed
+        for (g = 0; (g < NGAUGES) && (!res); ++g)
+        {
+            if ((f) && (g != (f * 7) % NGAUGES)) continue;
+            res = drawGauge(oled, (mode == BATCHED) ? &batch : NULL, g);
+        }
+        if ((!res) && (mode == BATCHED)) res = batch.Flush(&oled);
+    }
+    double dt = now() - t0;
+    if ((!res) && (stray)) res = oled.WritePixel(STRAYX, STRAYY, 0x1234);
+
+    if ((res) && (mode != SHADOWED)) printf("  %s: FAILED\n%s\n", title, oled.GetError());
+    oled.Close();
+    if (res) return -1;
+
+    const SIMSTATS &ss = sim.GetStats();
+    printf("  %-10s %6lu commands %7lu bytes %8lu pixels %7.1f msec\n", title,
+           ss.commands, ss.bytes, ss.pixels, dt);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int nframes = 20;
+    bool keep = false;
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":n:kh")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 'n')
+        {
+            nframes = atoi(optarg);
+            if (nframes < 1)
+            {
+                fprintf(stderr, "invalid number of frames: '%s'\n", optarg);
+                return -1;
+            }
+            continue;
+        }
+        if (inchar == 'k')
+        {
+            keep = true;
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+
+    static const char *snaps = "testsim-snap%03u.ppm";
+    static const char *shared = "testsim-shared.ppm";
+    static const char *names[3] = { "direct", "batched", "shadowed" };
+    COMSIM sim[3];
+    SIMIMAGE img[3];
+    SIMDIFF diff;
+    char fname[64];
+    int res = 0;
+    unsigned int nsnaps = 0;
+
+    printf("* %d frames on a simulated %dx%d display\n", nframes, SIZE, SIZE);
+    sim[DIRECT].SetSnapshots(snaps, SNAPCMDS);
+    sim[SHADOWED].SetSharedImage(shared);
+    for (int m = DIRECT; (m <= SHADOWED) && (!res); ++m)
+    {
+        res = run(sim[m], (MODE)m, nframes, names[m]);
+        if (!res) res = sim[m].GetImage(&img[m]);
+        if (keep)
+        {
+            snprintf(fname, sizeof(fname), "testsim-%s.ppm", names[m]);
+            sim[m].Snapshot(fname);
+        }
+    }
+    nsnaps = sim[DIRECT].GetStats().snapshots;
+    sim[DIRECT].SetSnapshots(NULL, 0);
+
+    // the optimised runs must leave exactly the same screen
+    for (int m = BATCHED; (m <= SHADOWED) && (!res); ++m)
+    {
+        long n = img[DIRECT].Compare(img[m], &diff);
+        printf("* %s vs %s: %ld of %ld pixels differ\n", names[DIRECT], names[m],
+               n, diff.pixels);
+        if (n) res = -1;
+    }
+
+    // the last periodic snapshot shows a state of the first run
+    if (!res)
+    {
+        SIMIMAGE last;
+        snprintf(fname, sizeof(fname), snaps, nsnaps - 1);
+        if ((!nsnaps) || (last.Load(fname)) || (last.Compare(img[DIRECT]) < 0))
+        {
+            printf("* FAILED: no usable snapshot (%u written)\n%s\n", nsnaps, last.GetError());
+            res = -1;
+        }
+        else
+        {
+            printf("* %u snapshots written every %d commands\n", nsnaps, SNAPCMDS);
+        }
+    }
+
+    // the shared image follows the screen
+    if (!res)
+    {
+        SIMIMAGE shm;
+        long n = -1;
+        if (!shm.Load(shared)) n = shm.Compare(img[SHADOWED]);
+        printf("* shared image vs screen: %ld pixels differ\n", n);
+        if (n) res = -1;
+    }
+
+    // a single stray pixel must be found
+    if (!res)
+    {
+        SIMIMAGE stray;
+        res = run(sim[BATCHED], BATCHED, nframes, "stray", true);
+        if (!res) res = sim[BATCHED].GetImage(&stray);
+        long n = (res) ? -1 : img[DIRECT].Compare(stray, &diff);
+        printf("* %s vs one stray pixel: %ld differ within (%d, %d)-(%d, %d)\n",
+               names[DIRECT], n, diff.x1, diff.y1, diff.x2, diff.y2);
+        if ((n != 1) || (diff.x1 != STRAYX) || (diff.y1 != STRAYY)) res = -1;
+    }
+
+    if (!keep)
+    {
+        for (unsigned int i = 0; i < nsnaps; ++i)
+        {
+            snprintf(fname, sizeof(fname), snaps, i);
+            unlink(fname);
+        }
+        unlink(shared);
+    }
+    if (res) printf("* FAILED\n");
+    return res;
+}
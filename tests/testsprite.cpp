@@ -0,0 +1,362 @@
+/**
+    file: testsprite.cpp
+
+    This program moves overlapping sprites over a patterned background,
+    checks that the recorded commands produce the expected picture and
+    reports the bytes per move compared with redrawing the background
+    and the sprite from the host.  With a serial device it also times
+    both methods.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <string.h>
+#include <math.h>
+
+#include "oled.h"
+#include "cmdbuf.h"
+#include "sprite.h"
+
+extern char *optarg;
+extern int optopt;
+
+using namespace disp;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: testsprite {-p serial_device} {-n moves} {-h}\n");
+    fprintf(stderr, "\t-p: serial_device (default: none, host-side figures only)\n");
+    fprintf(stderr, "\t-n: number of moves (default: 200)\n");
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+// elapsed time in microseconds
+double elapsed(struct timeval ts, struct timeval te)
+{
+    return (te.tv_sec - ts.tv_sec) * 1e6 + (te.tv_usec - ts.tv_usec);
+}
+
+#define SCRW (320)
+#define SCRH (240)
+// the staging strip at the bottom of the screen
+#define STAGEY (200)
+#define NSPR (3)
+#define SPRW (24)
+#define SPRH (24)
+
+static ushort screen[SCRH][SCRW];
+static ushort expected[SCRH][SCRW];
+static uchar sprdata[NSPR][SPRW * SPRH * 2];
+static int posx[NSPR];
+static int posy[NSPR];
+static bool visible[NSPR];
+
+static ushort background(int x, int y)
+{
+    return (((x / 8) ^ (y / 8)) & 1) ? 0x4208 : 0x8410;
+}
+
+// a filled disk with a border on a black square; every sprite has its own colors
+static void makeSprites(void)
+{
+    const ushort fill[NSPR] = { 0xf800, 0x07e0, 0x001f };
+    int i, x, y, d;
+    ushort c;
+    for (i = 0; i < NSPR; ++i)
+    {
+        for (y = 0; y < SPRH; ++y)
+        {
+            for (x = 0; x < SPRW; ++x)
+            {
+                d = (2 * x - SPRW + 1) * (2 * x - SPRW + 1) + (2 * y - SPRH + 1) * (2 * y - SPRH + 1);
+                if (d > SPRW * SPRW)
+                    c = 0;
+                else if (d > (SPRW - 6) * (SPRW - 6))
+                    c = 0xffff;
+                else
+                    c = fill[i] | (ushort)(x + y);
+                sprdata[i][(y * SPRW + x) * 2] = c >> 8;
+                sprdata[i][(y * SPRW + x) * 2 + 1] = c & 0xff;
+            }
+        }
+    }
+}
+
+// positions at step <n>: the sprites circle at different radii and speeds and
+// cross each other; sprite 1 is hidden for a while every 50 steps
+static void place(int n)
+{
+    int i;
+    for (i = 0; i < NSPR; ++i)
+    {
+        double a = n * (0.05 + 0.02 * i) + i * 2.1;
+        posx[i] = 148 + (int)((40 + 40 * i) * cos(a));
+        posy[i] = 76 + (int)((20 + 25 * i) * sin(a));
+        visible[i] = (i != 1) || ((n % 50) < 40);
+    }
+}
+
+// the picture the user should see
+static void compose(void)
+{
+    int i, x, y;
+    for (y = 0; y < SCRH; ++y)
+        for (x = 0; x < SCRW; ++x) expected[y][x] = background(x, y);
+    for (i = 0; i < NSPR; ++i)
+    {
+        if (!visible[i]) continue;
+        for (y = 0; y < SPRH; ++y)
+            for (x = 0; x < SPRW; ++x)
+                expected[posy[i] + y][posx[i] + x] =
+                    (sprdata[i][(y * SPRW + x) * 2] << 8) | sprdata[i][(y * SPRW + x) * 2 + 1];
+    }
+}
+
+#define GETW(p) ((((p)[0] & 0xff) << 8) | ((p)[1] & 0xff))
+
+// draw the recorded commands; only the forms produced by PGDSPRITES are handled
+static int replay(const PGDCMDBUF *buf)
+{
+    static ushort tmp[SCRH * SCRW];
+    int i, j, x, y, x1, y1, w, h;
+    const char *cp;
+    for (i = 0; i < buf->GetCount(); ++i)
+    {
+        cp = buf->GetData() + buf->GetOffset(i);
+        x1 = GETW(&cp[1]);
+        y1 = GETW(&cp[3]);
+        switch (cp[0])
+        {
+            case 'I':
+                w = GETW(&cp[5]);
+                h = GETW(&cp[7]);
+                if ((cp[9] != 0x10) || (x1 + w > SCRW) || (y1 + h > SCRH)) return -1;
+                for (j = 0; j < w * h; ++j)
+                    screen[y1 + j / w][x1 + j % w] = GETW(&cp[10 + j * 2]);
+                break;
+            case 'c':
+                w = GETW(&cp[9]);
+                h = GETW(&cp[11]);
+                if ((x1 + w > SCRW) || (y1 + h > SCRH)
+                    || (GETW(&cp[5]) + w > SCRW) || (GETW(&cp[7]) + h > SCRH)) return -1;
+                for (y = 0; y < h; ++y)
+                    for (x = 0; x < w; ++x) tmp[y * w + x] = screen[y1 + y][x1 + x];
+                x1 = GETW(&cp[5]);
+                y1 = GETW(&cp[7]);
+                for (y = 0; y < h; ++y)
+                    for (x = 0; x < w; ++x) screen[y1 + y][x1 + x] = tmp[y * w + x];
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    // the staging strip is not compared
+    return memcmp(expected, screen, sizeof(screen[0]) * STAGEY) ? -1 : 0;
+}
+
+// move all sprites to their positions at step <n>
+static void step(PGDSPRITES *sp, int n)
+{
+    int i;
+    place(n);
+    for (i = 0; i < NSPR; ++i)
+    {
+        sp->Move(i, posx[i], posy[i]);
+        sp->Show(i, visible[i]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *port = NULL;
+    int nmoves = 200;
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":p:n:h")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 'p')
+        {
+            port = optarg;
+            continue;
+        }
+        if (inchar == 'n')
+        {
+            nmoves = atoi(optarg);
+            if (nmoves < 1)
+            {
+                fprintf(stderr, "invalid number of moves: '%s'\n", optarg);
+                return -1;
+            }
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+
+    makeSprites();
+
+    PGDSPRITES spr;
+    PGDCMDBUF buf;
+    int i, n, x, y;
+    spr.SetStage(PGDRECT(0, STAGEY, SCRW - 1, SCRH - 1));
+    for (i = 0; i < NSPR; ++i)
+    {
+        if (spr.Add(SPRW, SPRH, 0x10, sprdata[i], sizeof(sprdata[i])) < 0)
+        {
+            printf("* adding sprite %d: FAILED\n%s\n", i, spr.GetError());
+            return -1;
+        }
+    }
+
+    for (y = 0; y < SCRH; ++y)
+        for (x = 0; x < SCRW; ++x) screen[y][x] = background(x, y);
+
+    printf("* %d sprites, %d moves: ", NSPR, nmoves);
+    fflush(stdout);
+    long bytes = 0;
+    int moved = 0;
+    for (n = 0; n < nmoves; ++n)
+    {
+        step(&spr, n);
+        compose();
+        buf.Clear();
+        if (spr.Render(&buf))
+        {
+            printf("FAILED\n%s\n", spr.GetError());
+            return -1;
+        }
+        if (replay(&buf))
+        {
+            printf("MISMATCH at step %d\n", n);
+            return -1;
+        }
+        // the first step uploads the images
+        if (n == 0) continue;
+        bytes += buf.GetLength();
+        for (i = 0; i < NSPR; ++i) if (visible[i]) ++moved;
+    }
+    printf("OK\n");
+    if (moved)
+        printf("  %.1f bytes per sprite move (%d bytes to redraw background and sprite)\n",
+               (double)bytes / moved, 2 * (10 + SPRW * SPRH * 2));
+
+    if (!port) return 0;
+
+    PGD oled;
+    printf("* Attempting to connect to display: ");
+    if (oled.Connect(port))
+    {
+        printf("FAILED\n%s\n", oled.GetError());
+        return -1;
+    }
+    printf("OK\n");
+
+    // background tiles as sent by the host when redrawing
+    static uchar bgtile[SPRW * SPRH * 2];
+    struct timeval ts, te;
+    int res = 0;
+
+    oled.Clear();
+    for (y = 0; y < STAGEY; y += 8)
+        for (x = 0; x < SCRW; x += 8)
+            oled.Rectangle(x, y, x + 7, y + 7, background(x, y));
+
+    printf("* host redraw: ");
+    fflush(stdout);
+    place(0);
+    gettimeofday(&ts, NULL);
+    for (n = 1; (n < nmoves) && (!res); ++n)
+    {
+        for (i = 0; (i < NSPR) && (!res); ++i)
+        {
+            if (!visible[i]) continue;
+            for (y = 0; y < SPRH; ++y)
+            {
+                for (x = 0; x < SPRW; ++x)
+                {
+                    ushort c = background(posx[i] + x, posy[i] + y);
+                    bgtile[(y * SPRW + x) * 2] = c >> 8;
+                    bgtile[(y * SPRW + x) * 2 + 1] = c & 0xff;
+                }
+            }
+            res = oled.DrawIcon(posx[i], posy[i], SPRW, SPRH, 0x10, bgtile, sizeof(bgtile));
+        }
+        place(n);
+        for (i = 0; (i < NSPR) && (!res); ++i)
+        {
+            if (visible[i])
+                res = oled.DrawIcon(posx[i], posy[i], SPRW, SPRH, 0x10,
+                                    sprdata[i], sizeof(sprdata[i]));
+        }
+    }
+    gettimeofday(&te, NULL);
+    if (res)
+        printf("FAILED\n%s\n", oled.GetError());
+    else
+        printf("%.1f steps/s\n", (nmoves - 1) / (elapsed(ts, te) / 1e6));
+
+    oled.Clear();
+    for (y = 0; y < STAGEY; y += 8)
+        for (x = 0; x < SCRW; x += 8)
+            oled.Rectangle(x, y, x + 7, y + 7, background(x, y));
+    spr.Invalidate();
+    step(&spr, 0);
+    if (spr.Flush(&oled))
+    {
+        printf("* uploading sprites: FAILED\n%s\n", spr.GetError());
+        return -1;
+    }
+
+    printf("* sprites: ");
+    fflush(stdout);
+    gettimeofday(&ts, NULL);
+    for (n = 1; (n < nmoves) && (!res); ++n)
+    {
+        step(&spr, n);
+        res = spr.Flush(&oled);
+    }
+    gettimeofday(&te, NULL);
+    if (res)
+        printf("FAILED\n%s\n", spr.GetError());
+    else
+        printf("%.1f steps/s\n", (nmoves - 1) / (elapsed(ts, te) / 1e6));
+
+    oled.Close();
+    return 0;
+}
@@ -0,0 +1,403 @@
+/**
+    file: testtcp.cpp
+
+    This program starts a local stand-in for a serial device server
+    which answers every 11-byte command with an ACK and measures the
+    round-trip time per command of a plain socket (with and without
+    Nagle's algorithm) and of COMTCP in raw and RFC 2217 mode, for
+    commands written in two parts and for windows of 8 commands.  With
+    a device server address it also times a display through COMTCP.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "oled.h"
+#include "comtcp.h"
+
+extern char *optarg;
+extern int optopt;
+
+using namespace disp;
+using namespace com;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: testtcp {-a host:port} {-r} {-n commands} {-h}\n");
+    fprintf(stderr, "\t-a: serial device server with a display (default: none)\n");
+    fprintf(stderr, "\t-r: the device server uses RFC 2217 (default: raw TCP)\n");
+    fprintf(stderr, "\t-n: number of commands per test (default: 2000)\n");
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+// elapsed time in microseconds
+double elapsed(struct timeval ts, struct timeval te)
+{
+    return (te.tv_sec - ts.tv_sec) * 1e6 + (te.tv_usec - ts.tv_usec);
+}
+
+#define CMDLEN (11)
+#define HDRLEN (5)
+#define WINDOW (8)
+#define ACK (0x06)
+#define NACK (0x15)
+
+// a Line command in white; the colour bytes must be escaped for RFC 2217
+static const char CMD[CMDLEN] = { 'L', 0, 1, 0, 2, 0, 3, 0, 4, '\xff', '\xff' };
+
+// serve one connection; a client speaking RFC 2217 starts with IAC
+static void serve(int fd)
+{
+    unsigned char buf[512];
+    unsigned char cmd[CMDLEN];
+    unsigned char sb[16];
+    int n = 0;
+    int sblen = 0;
+    int state = 0;      // 0 data, 1 IAC, 2 option, 3 SB, 4 SB IAC
+    bool telnet = false;
+    bool first = true;
+    int nb, i;
+    while ((nb = read(fd, buf, sizeof(buf))) > 0)
+    {
+        if (first) telnet = (buf[0] == 0xff);
+        first = false;
+        for (i = 0; i < nb; ++i)
+        {
+            unsigned char c = buf[i];
+            if (telnet)
+            {
+                switch (state)
+                {
+                    case 1:
+                        if (c == 0xff) break;   // escaped data byte
+                        state = (c == 250) ? 3 : ((c >= 251) ? 2 : 0);
+                        sblen = 0;
+                        continue;
+                    case 2:
+                        state = 0;
+                        continue;
+                    case 3:
+                        if (c == 0xff)
+                            state = 4;
+                        else if (sblen < 16)
+                            sb[sblen++] = c;
+                        continue;
+                    case 4:
+                        if (c == 0xff)
+                        {
+                            if (sblen < 16) sb[sblen++] = c;
+                            state = 3;
+                            continue;
+                        }
+                        // confirm a rate change with the same rate
+                        if ((c == 240) && (sblen == 6) && (sb[0] == 44) && (sb[1] == 1))
+                        {
+                            unsigned char rep[10] = { 0xff, 250, 44, 101, sb[2], sb[3],
+                                                      sb[4], sb[5], 0xff, 240 };
+                            if (write(fd, rep, 10) != 10) return;
+                        }
+                        state = 0;
+                        continue;
+                    default:
+                        if (c == 0xff)
+                        {
+                            state = 1;
+                            continue;
+                        }
+                        break;
+                }
+                state = 0;
+            }
+            cmd[n++] = c;
+            if (n == CMDLEN)
+            {
+                n = 0;
+                buf[0] = memcmp(cmd, CMD, CMDLEN) ? NACK : ACK;
+                if (write(fd, buf, 1) != 1) return;
+            }
+        }
+    }
+    return;
+}
+
+static void standin(int lsock)
+{
+    int fd;
+    int one = 1;
+    while ((fd = accept(lsock, NULL, NULL)) >= 0)
+    {
+        // the ACKs must not be held back by the stand-in
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        serve(fd);
+        close(fd);
+    }
+    _exit(0);
+}
+
+// a client is either a plain socket or a COMTCP port
+struct LINK {
+    int fd;
+    COMTCP *tcp;
+    unsigned long sends;
+};
+
+static int linkWrite(LINK *lp, const char *data, int len)
+{
+    if (lp->tcp) return lp->tcp->Write(data, len);
+    ++lp->sends;
+    return send(lp->fd, data, len, MSG_NOSIGNAL);
+}
+
+static int linkAck(LINK *lp)
+{
+    char c = 0;
+    if (lp->tcp)
+    {
+        if (lp->tcp->Read(&c, 1, 1000) != 1) return -1;
+    }
+    else
+    {
+        struct pollfd pfd;
+        pfd.fd = lp->fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if ((poll(&pfd, 1, 1000) != 1) || (read(lp->fd, &c, 1) != 1)) return -1;
+    }
+    return (c == ACK) ? 0 : -1;
+}
+
+// commands written in two parts, each waiting for its ACK; and windows
+// of commands sent before their ACKs are collected
+static int measure(const char *name, LINK *lp, int ncmd)
+{
+    struct timeval ts, te, t0, t1;
+    double tmin = 1e9, tmax = 0, t;
+    int i, j;
+
+    lp->sends = 0;
+    unsigned long seg0 = lp->tcp ? lp->tcp->GetStats().segments : 0;
+    gettimeofday(&ts, NULL);
+    for (i = 0; i < ncmd; ++i)
+    {
+        gettimeofday(&t0, NULL);
+        if ((linkWrite(lp, CMD, HDRLEN) != HDRLEN)
+            || (linkWrite(lp, &CMD[HDRLEN], CMDLEN - HDRLEN) != CMDLEN - HDRLEN)
+            || linkAck(lp))
+        {
+            printf("* %s: FAILED at command %d\n", name, i);
+            if (lp->tcp) printf("%s\n", lp->tcp->GetError());
+            return -1;
+        }
+        gettimeofday(&t1, NULL);
+        t = elapsed(t0, t1);
+        if (t < tmin) tmin = t;
+        if (t > tmax) tmax = t;
+    }
+    gettimeofday(&te, NULL);
+    unsigned long sends = lp->tcp ? lp->tcp->GetStats().segments - seg0 : lp->sends;
+    printf("* %s\n\tcommand in 2 parts: %.1f usec (min %.1f, max %.1f), %.2f sends/command\n",
+           name, elapsed(ts, te) / ncmd, tmin, tmax, (double)sends / ncmd);
+
+    lp->sends = 0;
+    seg0 = lp->tcp ? lp->tcp->GetStats().segments : 0;
+    int nwin = (ncmd + WINDOW - 1) / WINDOW;
+    gettimeofday(&ts, NULL);
+    for (i = 0; i < nwin; ++i)
+    {
+        for (j = 0; j < WINDOW; ++j)
+        {
+            if (linkWrite(lp, CMD, CMDLEN) != CMDLEN)
+            {
+                printf("\twindow: FAILED\n");
+                return -1;
+            }
+        }
+        for (j = 0; j < WINDOW; ++j)
+        {
+            if (linkAck(lp))
+            {
+                printf("\twindow: FAILED (no ACK)\n");
+                return -1;
+            }
+        }
+    }
+    gettimeofday(&te, NULL);
+    sends = lp->tcp ? lp->tcp->GetStats().segments - seg0 : lp->sends;
+    printf("\twindow of %d: %.1f usec/command, %.2f sends/command\n", WINDOW,
+           elapsed(ts, te) / (nwin * WINDOW), (double)sends / (nwin * WINDOW));
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *server = NULL;
+    bool rfc2217 = false;
+    int ncmd = 2000;
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":a:rn:h")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 'a')
+        {
+            server = optarg;
+            continue;
+        }
+        if (inchar == 'r')
+        {
+            rfc2217 = true;
+            continue;
+        }
+        if (inchar == 'n')
+        {
+            ncmd = atoi(optarg);
+            if (ncmd < 1)
+            {
+                fprintf(stderr, "invalid number of commands: '%s'\n", optarg);
+                return -1;
+            }
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+
+    // the stand-in listens on an ephemeral port of the loopback interface
+    int lsock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in sa;
+    socklen_t salen = sizeof(sa);
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((lsock < 0) || bind(lsock, (struct sockaddr *)&sa, sizeof(sa))
+        || listen(lsock, 4) || getsockname(lsock, (struct sockaddr *)&sa, &salen))
+    {
+        perror("could not start the stand-in server");
+        return -1;
+    }
+    pid_t pid = fork();
+    if (!pid) standin(lsock);
+    close(lsock);
+
+    char addr[64];
+    snprintf(addr, sizeof(addr), "127.0.0.1:%d", ntohs(sa.sin_port));
+    printf("* stand-in server at %s, %d commands per test\n", addr, ncmd);
+
+    int res = 0;
+    LINK link;
+    int mode;
+    const char *NAME[2] = { "plain socket, Nagle on", "plain socket, TCP_NODELAY" };
+    for (mode = 0; (mode < 2) && (!res); ++mode)
+    {
+        link.tcp = NULL;
+        link.fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(link.fd, (struct sockaddr *)&sa, sizeof(sa)))
+        {
+            perror("could not connect to the stand-in server");
+            res = -1;
+            break;
+        }
+        int one = mode;
+        setsockopt(link.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        // with Nagle on each command costs a delayed ACK; keep the run short
+        res = measure(NAME[mode], &link, mode ? ncmd : (ncmd < 100 ? ncmd : 100));
+        close(link.fd);
+    }
+
+    for (mode = 0; (mode < 2) && (!res); ++mode)
+    {
+        COMTCP tcp(mode == 1);
+        if (tcp.Open(addr))
+        {
+            printf("* COMTCP: FAILED\n%s\n", tcp.GetError());
+            res = -1;
+            break;
+        }
+        if (mode == 1)
+        {
+            // the stand-in confirms the rate it is asked for
+            if (tcp.SetBaud(B115200, 500) || (tcp.GetServerBaud() != 115200))
+            {
+                printf("* RFC 2217 rate change: FAILED\n%s\n", tcp.GetError());
+                res = -1;
+                break;
+            }
+        }
+        link.tcp = &tcp;
+        res = measure(mode ? "COMTCP, RFC 2217" : "COMTCP, raw", &link, ncmd);
+        if (!res) printf("\tkernel RTT estimate: %d usec\n", tcp.GetRtt());
+        tcp.Close();
+    }
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    if (res || (!server)) return res;
+
+    COMTCP tcp(rfc2217);
+    PGD oled;
+    oled.SetTransport(&tcp);
+    printf("* Attempting to connect to display at %s: ", server);
+    if (oled.Connect(server))
+    {
+        printf("FAILED\n%s\n", oled.GetError());
+        return -1;
+    }
+    printf("OK\n");
+
+    struct timeval ts, te;
+    int i;
+    gettimeofday(&ts, NULL);
+    for (i = 0; (i < 100) && (!res); ++i)
+        res = oled.Line(0, i, 100, i, 0xffff);
+    gettimeofday(&te, NULL);
+    if (res)
+        printf("* Line: FAILED\n%s\n", oled.GetError());
+    else
+        printf("* Line: %.2f msec per command, kernel RTT estimate %d usec\n",
+               elapsed(ts, te) / 100000.0, tcp.GetRtt());
+
+    oled.Close();
+    return res;
+}
@@ -0,0 +1,367 @@
+/**
+    file: testuring.cpp
+
+    This program drives many pseudo-terminals, each answering every
+    11-byte command with an ACK, through COMPORT and through COMURING
+    on one shared ring.  It reports the commands per second, the CPU
+    time and context switches per command and, by tracing a shorter
+    run, the system calls per command of each.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/epoll.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "comport.h"
+#include "comuring.h"
+
+extern char *optarg;
+extern int optopt;
+
+using namespace com;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: testuring {-n ports} {-c commands} {-h}\n");
+    fprintf(stderr, "\t-n: number of ports (default: 256)\n");
+    fprintf(stderr, "\t-c: commands per port (default: 200)\n");
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+// elapsed time in microseconds
+double elapsed(struct timeval ts, struct timeval te)
+{
+    return (te.tv_sec - ts.tv_sec) * 1e6 + (te.tv_usec - ts.tv_usec);
+}
+
+#define CMDLEN (11)
+#define ACK (0x06)
+// commands per port in the traced run
+#define NTRACED (20)
+#define MAXSYS (1024)
+
+static int nports = 256;
+static int master[4096];
+static char slave[4096][64];
+
+// answer every CMDLEN bytes with an ACK until killed
+static void respond(void)
+{
+    int ep = epoll_create(nports);
+    int *count = new int[nports];
+    int i, n, nb;
+    char buf[256];
+    struct epoll_event ev;
+    struct epoll_event evs[64];
+    for (i = 0; i < nports; ++i)
+    {
+        count[i] = 0;
+        ev.events = EPOLLIN;
+        ev.data.u32 = i;
+        epoll_ctl(ep, EPOLL_CTL_ADD, master[i], &ev);
+    }
+    while (true)
+    {
+        n = epoll_wait(ep, evs, 64, -1);
+        for (i = 0; i < n; ++i)
+        {
+            int p = evs[i].data.u32;
+            nb = read(master[p], buf, sizeof(buf));
+            if (nb <= 0) continue;
+            count[p] += nb;
+            while (count[p] >= CMDLEN)
+            {
+                count[p] -= CMDLEN;
+                buf[0] = ACK;
+                if (write(master[p], buf, 1) != 1) _exit(1);
+            }
+        }
+    }
+}
+
+// <ncmd> rounds of a command to every port followed by reading every ACK
+static int run(COMMIF **port, int ncmd)
+{
+    // a Line command
+    const char cmd[CMDLEN] = { 'L', 0, 1, 0, 2, 0, 3, 0, 4, '\x7f', '\xff' };
+    char ack;
+    int i, j;
+    for (j = 0; j < ncmd; ++j)
+    {
+        for (i = 0; i < nports; ++i)
+        {
+            port[i]->Flush();
+            if (port[i]->Write(cmd, CMDLEN) != CMDLEN)
+            {
+                printf("FAILED\n%s\n", port[i]->GetError());
+                return -1;
+            }
+        }
+        for (i = 0; i < nports; ++i)
+        {
+            if ((port[i]->Read(&ack, 1, 1000) != 1) || (ack != ACK))
+            {
+                printf("FAILED\nno ACK from %s\n%s\n", slave[i], port[i]->GetError());
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int openAll(COMMIF **port)
+{
+    int i;
+    for (i = 0; i < nports; ++i)
+    {
+        if (port[i]->Open(slave[i]))
+        {
+            printf("FAILED\n%s\n", port[i]->GetError());
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void closeAll(COMMIF **port)
+{
+    int i;
+    for (i = 0; i < nports; ++i) port[i]->Close();
+    return;
+}
+
+// count the system calls of a child making <ncmd> commands per port;
+// the counted part is marked by two calls to getppid()
+static int countCalls(COMMIF **port, long *calls)
+{
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (!pid)
+    {
+        if (openAll(port)) _exit(1);
+        ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+        raise(SIGSTOP);
+        syscall(SYS_getppid);
+        int res = run(port, NTRACED);
+        syscall(SYS_getppid);
+        closeAll(port);
+        _exit(res ? 1 : 0);
+    }
+
+    int st;
+    int marks = 0;
+    struct __ptrace_syscall_info info;
+    memset(calls, 0, MAXSYS * sizeof(long));
+    if ((waitpid(pid, &st, 0) != pid) || (!WIFSTOPPED(st))) return -1;
+    if (ptrace(PTRACE_SETOPTIONS, pid, NULL, (void *)PTRACE_O_TRACESYSGOOD) == -1)
+    {
+        kill(pid, SIGKILL);
+        waitpid(pid, &st, 0);
+        return -1;
+    }
+    ptrace(PTRACE_SYSCALL, pid, NULL, NULL);
+    while (waitpid(pid, &st, 0) == pid)
+    {
+        if (WIFEXITED(st) || WIFSIGNALED(st)) break;
+        int sig = 0;
+        if (WSTOPSIG(st) == (SIGTRAP | 0x80))
+        {
+            if ((ptrace(PTRACE_GET_SYSCALL_INFO, pid, (void *)sizeof(info), &info) > 0)
+                && (info.op == PTRACE_SYSCALL_INFO_ENTRY))
+            {
+                if (info.entry.nr == SYS_getppid)
+                    ++marks;
+                else if ((marks == 1) && (info.entry.nr < MAXSYS))
+                    ++calls[info.entry.nr];
+            }
+        }
+        else
+        {
+            sig = WSTOPSIG(st);
+        }
+        ptrace(PTRACE_SYSCALL, pid, NULL, (void *)(long)sig);
+    }
+    if ((marks != 2) || (!WIFEXITED(st)) || WEXITSTATUS(st)) return -1;
+    return 0;
+}
+
+static void report(const char *name, COMMIF **port, int ncmd)
+{
+    struct rusage rs, re;
+    struct timeval ts, te;
+    long total = (long)nports * ncmd;
+
+    printf("* %s: ", name);
+    fflush(stdout);
+    if (openAll(port)) return;
+    if (run(port, 1))
+    {
+        closeAll(port);
+        return;
+    }
+    getrusage(RUSAGE_SELF, &rs);
+    gettimeofday(&ts, NULL);
+    int res = run(port, ncmd);
+    gettimeofday(&te, NULL);
+    getrusage(RUSAGE_SELF, &re);
+    closeAll(port);
+    if (res) return;
+
+    double cpu = elapsed(rs.ru_utime, re.ru_utime) + elapsed(rs.ru_stime, re.ru_stime);
+    printf("%.0f commands/s\n", total / (elapsed(ts, te) / 1e6));
+    printf("\tCPU %.2f usec/command (user %.2f, system %.2f), %.2f context switches/command\n",
+           cpu / total, elapsed(rs.ru_utime, re.ru_utime) / total,
+           elapsed(rs.ru_stime, re.ru_stime) / total,
+           (double)(re.ru_nvcsw - rs.ru_nvcsw + re.ru_nivcsw - rs.ru_nivcsw) / total);
+
+    static const struct { long nr; const char *name; } SYSNAME[] = {
+        { SYS_read, "read" }, { SYS_write, "write" }, { SYS_ioctl, "ioctl" },
+#ifdef SYS_poll
+        { SYS_poll, "poll" },
+#endif
+        { SYS_ppoll, "ppoll" }, { SYS_io_uring_enter, "io_uring_enter" },
+        { SYS_fcntl, "fcntl" }
+    };
+    long calls[MAXSYS];
+    if (countCalls(port, calls))
+    {
+        printf("\tsystem calls: could not trace the run\n");
+        return;
+    }
+    long ncalls = 0;
+    long named = 0;
+    int i;
+    total = (long)nports * NTRACED;
+    for (i = 0; i < MAXSYS; ++i) ncalls += calls[i];
+    printf("\t%.2f system calls/command (", (double)ncalls / total);
+    for (i = 0; i < (int)(sizeof(SYSNAME) / sizeof(SYSNAME[0])); ++i)
+    {
+        if (!calls[SYSNAME[i].nr]) continue;
+        printf("%s %.2f, ", SYSNAME[i].name, (double)calls[SYSNAME[i].nr] / total);
+        named += calls[SYSNAME[i].nr];
+    }
+    printf("other %.2f)\n", (double)(ncalls - named) / total);
+    return;
+}
+
+int main(int argc, char **argv)
+{
+    int ncmd = 200;
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":n:c:h")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 'n')
+        {
+            nports = atoi(optarg);
+            if ((nports < 1) || (nports > 4096))
+            {
+                fprintf(stderr, "invalid number of ports (1 .. 4096): '%s'\n", optarg);
+                return -1;
+            }
+            continue;
+        }
+        if (inchar == 'c')
+        {
+            ncmd = atoi(optarg);
+            if (ncmd < 1)
+            {
+                fprintf(stderr, "invalid number of commands: '%s'\n", optarg);
+                return -1;
+            }
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+
+    // each port needs its master, a slave kept open and the slave in use
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+
+    int i;
+    for (i = 0; i < nports; ++i)
+    {
+        master[i] = posix_openpt(O_RDWR | O_NOCTTY);
+        if ((master[i] < 0) || grantpt(master[i]) || unlockpt(master[i])
+            || (open(ptsname(master[i]), O_RDWR | O_NOCTTY) < 0))
+        {
+            fprintf(stderr, "could not create pseudo-terminal %d: %s\n", i, strerror(errno));
+            return -1;
+        }
+        snprintf(slave[i], sizeof(slave[i]), "%s", ptsname(master[i]));
+    }
+
+    pid_t responder = fork();
+    if (!responder) respond();
+
+    printf("* %d ports, %d commands per port\n", nports, ncmd);
+
+    COMMIF **port = new COMMIF*[nports];
+    for (i = 0; i < nports; ++i) port[i] = new COMPORT;
+    report("COMPORT", port, ncmd);
+    for (i = 0; i < nports; ++i) delete port[i];
+
+    URING ring;
+    if (ring.Init(nports))
+    {
+        printf("* COMURING: io_uring is not available\n%s\n", ring.GetError());
+    }
+    else
+    {
+        for (i = 0; i < nports; ++i) port[i] = new COMURING(&ring);
+        report("COMURING", port, ncmd);
+        printf("\t%lu io_uring_enter() calls in all\n", ring.GetEnterCount());
+        for (i = 0; i < nports; ++i) delete port[i];
+    }
+
+    delete [] port;
+    kill(responder, SIGTERM);
+    waitpid(responder, NULL, 0);
+    return 0;
+}
@@ -0,0 +1,250 @@
+/**
+    file: testwidget.cpp
+
+    This program compares damage-driven repainting of a widget tree
+    with a full repaint of the same screen.  Without a serial device
+    only the host-side render time and the number of bytes and commands
+    per frame are reported.
+
+    Copyright (C) 2012 Dr. Cirilo Bernardo (cjh.bernardo@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For licensing under different terms or for support, email cjh.bernardo@gmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <errno.h>
+#include <string.h>
+
+#include "oled.h"
+#include "cmdbuf.h"
+#include "widget.h"
+
+
+#define WHITE (0xffff)
+#define BLACK (0x0000)
+#define RED (0xf800)
+#define GREEN (0x07e0)
+#define BLUE (0x001f)
+#define GREY (0x7bef)
+#define YELLOW (0xffe0)
+
+extern char *optarg;
+extern int optopt;
+
+using namespace disp;
+
+void printUsage(void)
+{
+    fprintf(stderr, "Usage: testwidget {-p serial_device} {-n frames} {-h}\n");
+    fprintf(stderr, "\t-p: serial_device (default: none, host-side figures only)\n");
+    fprintf(stderr, "\t-n: number of frames (default 200)\n");
+    fprintf(stderr, "\t-h: display usage and exit\n");
+    return;
+}
+
+// elapsed time in microseconds
+double elapsed(struct timeval ts, struct timeval te)
+{
+    return (te.tv_sec - ts.tv_sec) * 1e6 + (te.tv_usec - ts.tv_usec);
+}
+
+#define NGAUGE (8)
+
+// a dashboard of 8 labelled bar gauges with numeric readouts and 2 buttons
+struct DASH {
+    PGDPANEL title;
+    PGDLABEL tlabel;
+    PGDPANEL body;
+    PGDLABEL *name[NGAUGE];
+    PGDGAUGE *gauge[NGAUGE];
+    PGDLABEL *value[NGAUGE];
+    PGDBUTTON start;
+    PGDBUTTON stop;
+
+    DASH() : title(0, 0, 239, 29, BLUE),
+             tlabel(6, 8, 2, WHITE, "PUMP STATION 4"),
+             body(4, 36, 235, 255, BLACK),
+             start(10, 270, GREEN, 2, BLACK, 1, 1, "START"),
+             stop(130, 270, RED, 2, BLACK, 1, 1, "STOP")
+    {
+        char txt[16];
+        int i;
+        body.SetBorder(true, WHITE);
+        for (i = 0; i < NGAUGE; ++i)
+        {
+            snprintf(txt, 16, "CH%d", i + 1);
+            name[i] = new PGDLABEL(10, 44 + 26 * i, 1, YELLOW, txt);
+            gauge[i] = new PGDGAUGE(50, 42 + 26 * i, 169, 53 + 26 * i, 0, 1000, GREEN, GREY);
+            value[i] = new PGDLABEL(178, 44 + 26 * i, 1, WHITE, "0");
+        }
+    }
+    ~DASH()
+    {
+        int i;
+        for (i = 0; i < NGAUGE; ++i)
+        {
+            delete name[i];
+            delete gauge[i];
+            delete value[i];
+        }
+    }
+    void attach(PGDSCREEN *scr)
+    {
+        int i;
+        scr->Add(&title);
+        scr->Add(&tlabel, &title);
+        scr->Add(&body);
+        for (i = 0; i < NGAUGE; ++i)
+        {
+            scr->Add(name[i], &body);
+            scr->Add(gauge[i], &body);
+            scr->Add(value[i], &body);
+        }
+        scr->Add(&start);
+        scr->Add(&stop);
+    }
+    // change two gauges per frame by a small amount, as a slowly varying process would
+    void update(int frame)
+    {
+        char txt[16];
+        int i, k, v;
+        for (k = 0; k < 2; ++k)
+        {
+            i = (frame * 3 + k * 5) % NGAUGE;
+            v = gauge[i]->GetValue() + ((frame & 4) ? -37 : 41);
+            if (v < 0) v = 0;
+            if (v > 1000) v = 1000;
+            gauge[i]->SetValue(v);
+            snprintf(txt, 16, "%d", v);
+            value[i]->SetText(txt);
+        }
+        if ((frame % 50) == 0) start.SetPressed(!start.IsPressed());
+    }
+};
+
+int main(int argc, char **argv)
+{
+    const char *port = NULL;
+    int nframes = 200;
+
+    int inchar;
+    while ((inchar = getopt(argc, argv, ":p:n:h")) > 0)
+    {
+        if (inchar == 'h')
+        {
+            printUsage();
+            return 0;
+        }
+        if (inchar == 'p')
+        {
+            port = optarg;
+            continue;
+        }
+        if (inchar == 'n')
+        {
+            nframes = atoi(optarg);
+            if (nframes < 1) nframes = 1;
+            continue;
+        }
+        if (inchar == '?')
+        {
+            fprintf(stderr, "unknown option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+        if (inchar == ':')
+        {
+            fprintf(stderr, "missing value for option: '%c'\n", optopt);
+            printUsage();
+            return -1;
+        }
+    }
+
+    PGDSCREEN scr(240, 320, BLACK);
+    DASH dash;
+    dash.attach(&scr);
+
+    PGDCMDBUF buf;
+    buf.Reserve(16384, 512);
+    struct timeval ts, te;
+    int i, mode;
+    long bytes, cmds;
+    const char *MODE[2] = { "full repaint", "damage-driven" };
+
+    for (mode = 0; mode < 2; ++mode)
+    {
+        bytes = 0;
+        cmds = 0;
+        gettimeofday(&ts, NULL);
+        for (i = 0; i < nframes; ++i)
+        {
+            dash.update(i);
+            if (mode == 0) scr.Invalidate();
+            buf.Clear();
+            if (scr.Render(&buf))
+            {
+                printf("FAILED\n%s\n", scr.GetError());
+                return -1;
+            }
+            bytes += buf.GetLength();
+            cmds += buf.GetCount();
+        }
+        gettimeofday(&te, NULL);
+        printf("* %s: %.1f bytes/frame, %.1f commands/frame, render %.1f usec/frame\n",
+               MODE[mode], (double)bytes / nframes, (double)cmds / nframes,
+               elapsed(ts, te) / nframes);
+        printf("\testimated link time at 115200 bps: %.1f msec/frame\n",
+               bytes * 10000.0 / 115200.0 / nframes);
+    }
+
+    if (!port) return 0;
+
+    PGD oled;
+    printf("* Attempting to connect to display: ");
+    if (oled.Connect(port))
+    {
+        printf("FAILED\n%s\n", oled.GetError());
+        return -1;
+    }
+    printf("OK\n");
+
+    scr.Reserve(16384, 512);
+    for (mode = 0; mode < 2; ++mode)
+    {
+        oled.Clear();
+        scr.Invalidate();
+        scr.Flush(&oled);
+        gettimeofday(&ts, NULL);
+        for (i = 0; i < nframes; ++i)
+        {
+            dash.update(i);
+            if (mode == 0) scr.Invalidate();
+            if (scr.Flush(&oled))
+            {
+                printf("* %s: FAILED\n%s\n", MODE[mode], scr.GetError());
+                break;
+            }
+        }
+        gettimeofday(&te, NULL);
+        printf("* %s on display: %.1f msec/frame\n", MODE[mode], elapsed(ts, te) / nframes / 1000.0);
+    }
+
+    oled.Close();
+    return 0;
+}